@@ -512,3 +512,92 @@ double get_load_average (void)
 {
         return (-1.0);
 }
+
+/* Shared memory and interprocess lock used to coordinate several prime95 processes */
+/* on one host (see HostSharedMemory in commonb.c).  Windows uses a named mutex */
+/* rather than a lock stored in the shared memory.  Windows deletes the segment */
+/* when the last process closes its handles, so there is no name to remove. */
+
+HANDLE  HOST_MAPPING = NULL;
+HANDLE  HOST_MUTEX = NULL;
+
+void *host_shm_attach (
+        const char *name,
+        unsigned long size,
+        int     *created)
+{
+        char    mutex_name[100];
+        HANDLE  mapping;
+        void    *p;
+
+        mapping = CreateFileMappingA (INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, name);
+        if (mapping == NULL) return (NULL);
+        *created = (GetLastError () != ERROR_ALREADY_EXISTS);
+        p = MapViewOfFile (mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (p == NULL) {
+                CloseHandle (mapping);
+                return (NULL);
+        }
+        sprintf (mutex_name, "%s_lock", name);
+        HOST_MUTEX = CreateMutexA (NULL, FALSE, mutex_name);
+        if (HOST_MUTEX == NULL) {
+                UnmapViewOfFile (p);
+                CloseHandle (mapping);
+                return (NULL);
+        }
+        HOST_MAPPING = mapping;
+        return (p);
+}
+
+void host_shm_detach (
+        void    *p,
+        unsigned long size)
+{
+        UnmapViewOfFile (p);
+        CloseHandle (HOST_MAPPING);
+        CloseHandle (HOST_MUTEX);
+        HOST_MAPPING = NULL;
+        HOST_MUTEX = NULL;
+}
+
+void host_shm_remove (
+        const char *name)
+{
+}
+
+void host_shm_lock_init (
+        void    *lock)
+{
+}
+
+/* A mutex abandoned by a process that died is still acquired */
+
+void host_shm_lock (
+        void    *lock)
+{
+        WaitForSingleObject (HOST_MUTEX, INFINITE);
+}
+
+void host_shm_unlock (
+        void    *lock)
+{
+        ReleaseMutex (HOST_MUTEX);
+}
+
+unsigned long host_getpid (void)
+{
+        return (GetCurrentProcessId ());
+}
+
+int host_process_alive (
+        unsigned long pid)
+{
+        HANDLE  process;
+        DWORD   exit_code;
+
+        process = OpenProcess (PROCESS_QUERY_INFORMATION, FALSE, pid);
+        if (process == NULL) return (GetLastError () == ERROR_ACCESS_DENIED);
+        if (!GetExitCodeProcess (process, &exit_code)) exit_code = STILL_ACTIVE;
+        CloseHandle (process);
+        return (exit_code == STILL_ACTIVE);
+}
@@ -82,6 +82,12 @@ int     STOP_FOR_AUTOBENCH = FALSE;/* Flag indicating we chould temporarily */
 char    STOP_FOR_PRIORITY_WORK[MAX_NUM_WORKER_THREADS] = {0};
                                 /* Flags indicating it is time to switch */
                                 /* a worker to high priority work. */
+char    STOP_FOR_STAGE2_HELP[MAX_NUM_WORKER_THREADS] = {0};
+                                /* Flags indicating it is time to stop a */
+                                /* worker to help with a P-1 stage 2. */
+unsigned long WORKER_CONFIG_GENERATION[MAX_NUM_WORKER_THREADS] = {0};
+                                /* CONFIG_GENERATION each worker last */
+                                /* applied live INI settings from. */
 struct pause_info *STOP_FOR_PAUSE[MAX_NUM_WORKER_THREADS] = {NULL};
                                 /* Flags saying worker thread should */
                                 /* pause while another program runs */
@@ -96,6 +102,19 @@ char    STOP_FOR_ABORT[MAX_NUM_WORKER_THREADS] = {0};
                                 /* Abort work unit due to unreserve, factor */
                                 /* found in a different thread, server */
                                 /* request, or any other reason. */
+char    STOP_FOR_PERF_ANOMALY[MAX_NUM_WORKER_THREADS] = {0};
+                                /* Restart work unit because the performance */
+                                /* anomaly detector re-pinned or reduced threads. */
+char    STOP_FOR_FFT_TRIAL[MAX_NUM_WORKER_THREADS] = {0};
+                                /* Restart work unit to time a different */
+                                /* implementation of its FFT length. */
+int     PERF_CORES_REDUCED[MAX_NUM_WORKER_THREADS] = {0};
+                                /* Cores taken away from each worker by */
+                                /* the performance anomaly detector. */
+int     PERF_STATE[MAX_NUM_WORKER_THREADS] = {0};
+                                /* Each worker's performance monitoring state */
+int     HOST_CORE_BASE = -1;    /* First core of the block claimed in the */
+                                /* host-wide core map, -1 if none claimed */
 char    ACTIVE_WORKERS[MAX_NUM_WORKER_THREADS] = {0};
                                 /* Flags indicating which worker threads */
                                 /* are active. */
@@ -336,34 +355,26 @@ void print_timer (
 /*    Routines dealing with thread priority and affinity      */
 /**************************************************************/
 
-/* Set thread priority and affinity correctly.  Most screen savers run at priority 4. */
-/* Most application's run at priority 9 when in foreground, 7 when in */
-/* background.  In selecting the proper thread priority I've assumed the */
-/* program usually runs in the background. */
+/* Decide which CPU core or set of logical CPUs a thread should run on.  Returns FALSE */
+/* if the thread should be allowed to run on any CPU.  Bind type 0 sets *core, bind type 2 */
+/* copies the thread's part of the Affinity INI setting to logical_CPU_substring. */
 
-void SetPriority (
-        struct PriorityInfo *info)
+int choose_affinity (
+        struct PriorityInfo *info,
+        int     *bind_type,
+        int     *core,
+        char    *logical_CPU_substring)         /* 255 characters */
 {
-        int     bind_type, core;
-#ifdef BIND_TYPE_1_USED
-        int     logical_CPU;
-#endif
         char    logical_CPU_string[255];
-        char    logical_CPU_substring[255];
         char    buf[255];
 
-/* Call OS-specific routine to set the priority */
-
-        if (IniGetInt (INI_FILE, "EnableSetPriority", 1))
-                setOsThreadPriority (PRIORITY);
-
 /* Skip setting affinity if requested by user.  There is no known reason to do this at present. */
 
-        if (! IniGetInt (INI_FILE, "EnableSetAffinity", 1)) return;
+        if (! IniGetInt (INI_FILE, "EnableSetAffinity", 1)) return (FALSE);
 
 /* Skip setting affinity if OS does not support it.  At present time, that is Apple. */
 
-        if (!OS_CAN_SET_AFFINITY) return;
+        if (!OS_CAN_SET_AFFINITY) return (FALSE);
 
 /* Pick from one of several methodologies to determine affinity setting */
 
@@ -372,20 +383,20 @@ void SetPriority (
 /* QA affinity.  Let threads run on any CPU. */
 
         case SET_PRIORITY_QA:
-                return;
+                return (FALSE);
 
 /* Advanced/Time affinity.  Set affinity to appropriate core. */
 
         case SET_PRIORITY_TIME:
-                bind_type = 0;                          // Set affinity to one specific core
-                core = info->aux_thread_num / info->time_hyperthreads;
+                *bind_type = 0;                         // Set affinity to one specific core
+                *core = info->aux_thread_num / info->time_hyperthreads;
                 break;
 
 /* Busy loop on specified CPU core. */
 
         case SET_PRIORITY_BUSY_LOOP:
-                bind_type = 0;                          // Set affinity to one specific core
-                core = info->busy_loop_cpu;
+                *bind_type = 0;                         // Set affinity to one specific core
+                *core = info->busy_loop_cpu;
                 break;
 
 /* Torture test affinity.  If we're running the same number of torture */
@@ -394,20 +405,20 @@ void SetPriority (
 
         case SET_PRIORITY_TORTURE:
                 if (info->torture_num_workers * info->torture_threads_per_test == NUM_CPUS * CPU_HYPERTHREADS) {
-                        bind_type = 0;                          // Set affinity to one specific core
-                        core = (info->worker_num * info->torture_threads_per_test + info->aux_thread_num) / CPU_HYPERTHREADS;
+                        *bind_type = 0;                         // Set affinity to one specific core
+                        *core = (info->worker_num * info->torture_threads_per_test + info->aux_thread_num) / CPU_HYPERTHREADS;
                 } else if (info->torture_num_workers * info->torture_threads_per_test == NUM_CPUS) {
-                        bind_type = 0;                          // Set affinity to one specific core
-                        core = (info->worker_num * info->torture_threads_per_test + info->aux_thread_num);
+                        *bind_type = 0;                         // Set affinity to one specific core
+                        *core = (info->worker_num * info->torture_threads_per_test + info->aux_thread_num);
                 } else
-                        return;                                 // Run on any core
+                        return (FALSE);                         // Run on any core
                 break;
 
 /* Benchmarking.  Set affinity to appropriate core. */
 
         case SET_PRIORITY_BENCHMARKING:
-                bind_type = 0;                          // Set affinity to one specific core
-                core = info->bench_base_cpu_num + info->aux_thread_num / info->bench_hyperthreads;
+                *bind_type = 0;                         // Set affinity to one specific core
+                *core = info->bench_base_cpu_num + info->aux_thread_num / info->bench_hyperthreads;
                 break;
 
 /* If user has given an explicit list of logical CPUs to set affinity to, then use that list. */
@@ -420,12 +431,24 @@ void SetPriority (
                         sprintf (section_name, "Worker #%d", info->worker_num+1);
                         p = IniSectionGetStringRaw (LOCALINI_FILE, section_name, "Affinity");
                         if (p != NULL) {
-                                bind_type = 2;                          // Set affinity to a set of logical CPUs
+                                *bind_type = 2;                         // Set affinity to a set of logical CPUs
                                 truncated_strcpy (logical_CPU_string, sizeof (logical_CPU_string), p);
                                 break;
                         }
                 }
 
+/* If other processes on this host share the CPU cores (see host_claim_cores), then */
+/* run our workers on the block of cores this process claimed. */
+
+                if (HOST_CORE_BASE >= 0) {
+                        int     i, cores_used_by_lower_workers;
+                        cores_used_by_lower_workers = 0;
+                        for (i = 0; i < info->worker_num; i++) cores_used_by_lower_workers += CORES_PER_TEST[i];
+                        *bind_type = 0;                         // Set affinity to a specific physical CPU core
+                        *core = HOST_CORE_BASE + cores_used_by_lower_workers + info->aux_thread_num / info->normal_work_hyperthreads;
+                        break;
+                }
+
 /* If number of workers equals number of physical cpus then run each */
 /* worker on its own physical CPU.  Run auxiliary threads on the same */
 /* physical CPU.  This might be advantageous on hyperthreaded CPUs.  User */
@@ -433,8 +456,8 @@ void SetPriority (
 /* logical CPUs created by hyperthreading. */
 
                 if (NUM_WORKER_THREADS == NUM_CPUS) {
-                        bind_type = 0;                          // Set affinity to a specific physical CPU core
-                        core = info->worker_num;
+                        *bind_type = 0;                         // Set affinity to a specific physical CPU core
+                        *core = info->worker_num;
                         break;
                 }
 
@@ -444,8 +467,8 @@ void SetPriority (
 /* performance hit will occur running on the same logical CPU. */
 
                 if (NUM_WORKER_THREADS == NUM_CPUS * CPU_HYPERTHREADS) {
-                        bind_type = 0;                          // Set affinity to a specific physical CPU core
-                        core = info->worker_num / CPU_HYPERTHREADS;
+                        *bind_type = 0;                         // Set affinity to a specific physical CPU core
+                        *core = info->worker_num / CPU_HYPERTHREADS;
                         break;
                 }
 
@@ -461,8 +484,8 @@ void SetPriority (
                         }
 
                         if (worker_core_count == NUM_CPUS) {
-                                bind_type = 0;                  // Set affinity to a specific physical CPU core
-                                core = cores_used_by_lower_workers + info->aux_thread_num / info->normal_work_hyperthreads;
+                                *bind_type = 0;                 // Set affinity to a specific physical CPU core
+                                *core = cores_used_by_lower_workers + info->aux_thread_num / info->normal_work_hyperthreads;
                                 break;
                         }
 
@@ -471,20 +494,20 @@ void SetPriority (
 /* (hoping hwloc assigns CPU numbers the same way the OS does). */
 
                         if (worker_core_count < (int) NUM_CPUS) {
-                                bind_type = 0;                  // Set affinity to a specific physical CPU core
-                                core = cores_used_by_lower_workers + info->aux_thread_num / info->normal_work_hyperthreads + 1;
+                                *bind_type = 0;                 // Set affinity to a specific physical CPU core
+                                *core = cores_used_by_lower_workers + info->aux_thread_num / info->normal_work_hyperthreads + 1;
                                 break;
                         }
 
 /* If total num cores is between num_cpus is greater than num_cpus, then what to do? */
 /* Our default policy is to throw our hands up in despair and simply run on any CPU. */
 
-                        return;
+                        return (FALSE);
                 }
 
 /* No good rule found for setting affinity.  Simply run on any CPU. */
 
-                return;
+                return (FALSE);
         }
 
 /* Parse affinity settings specified in the INI file. */
@@ -495,7 +518,7 @@ void SetPriority (
 /*      (3,5,7),(4,6)   Run main worker thread on logical CPUs #3, #5, & #7, run aux thread on logical CPUs #4 & #6 */
 /*      [3,5-7],(4,6)   Run main worker thread on logical CPUs #3, #5, #6, & #7, run aux thread on logical CPUs #4 & #6 */
 
-        if (bind_type == 2) {           // Find the subset of the logical CPU string for this auxillary thread
+        if (*bind_type == 2) {          // Find the subset of the logical CPU string for this auxillary thread
                 int     i;
                 char    *p, *start, end_char;
                 for (i = 0, p = logical_CPU_string; i <= info->aux_thread_num && *p; i++) {
@@ -510,26 +533,53 @@ void SetPriority (
                                 if (p == NULL) {
                                         sprintf (buf, "Error parsing affinity string: %s\n", logical_CPU_string);
                                         OutputStr (info->worker_num, buf);
-                                        return;
+                                        return (FALSE);
                                 }
-                                truncated_strcpy_with_len (logical_CPU_substring, sizeof (logical_CPU_substring),
+                                truncated_strcpy_with_len (logical_CPU_substring, 255,
                                                            start + 1, (int) (p - start - 1));
                                 if (strchr (p, ',') != NULL) p = strchr (p, ',') + 1;
                                 else p = p + strlen(p);
                         } else {
                                 p = strchr (start, ',');
                                 if (p != NULL) {
-                                        truncated_strcpy_with_len (logical_CPU_substring, sizeof (logical_CPU_substring),
+                                        truncated_strcpy_with_len (logical_CPU_substring, 255,
                                                                    start, (int) (p - start));
                                         p++;
                                 } else {
-                                        truncated_strcpy (logical_CPU_substring, sizeof (logical_CPU_substring), start);
+                                        truncated_strcpy (logical_CPU_substring, 255, start);
                                         p = start + strlen (start);
                                 }
                         }
                 }
         }
 
+        return (TRUE);
+}
+
+/* Set thread priority and affinity correctly.  Most screen savers run at priority 4. */
+/* Most application's run at priority 9 when in foreground, 7 when in */
+/* background.  In selecting the proper thread priority I've assumed the */
+/* program usually runs in the background. */
+
+void SetPriority (
+        struct PriorityInfo *info)
+{
+        int     bind_type, core;
+#ifdef BIND_TYPE_1_USED
+        int     logical_CPU;
+#endif
+        char    logical_CPU_substring[255];
+        char    buf[255];
+
+/* Call OS-specific routine to set the priority */
+
+        if (IniGetInt (INI_FILE, "EnableSetPriority", 1))
+                setOsThreadPriority (PRIORITY);
+
+/* Pick from one of several methodologies to determine affinity setting */
+
+        if (! choose_affinity (info, &bind_type, &core, logical_CPU_substring)) return;
+
 /* Output an informative message */
 
         if (NUM_CPUS > 1 && info->verbose_flag) {
@@ -651,6 +701,66 @@ void SetPriority (
         }
 }
 
+/* Return the NUMA node (as numbered by hwloc) that contains a set of logical CPUs, -1 if none */
+
+int numa_node_of_cpuset (
+        hwloc_const_cpuset_t cpuset)
+{
+        int     i, num_nodes;
+        hwloc_obj_t obj;
+
+        num_nodes = hwloc_get_nbobjs_by_type (hwloc_topology, HWLOC_OBJ_NUMANODE);
+        for (i = 0; i < num_nodes; i++) {
+                obj = hwloc_get_obj_by_type (hwloc_topology, HWLOC_OBJ_NUMANODE, i);
+                if (obj != NULL && obj->cpuset != NULL && hwloc_bitmap_intersects (obj->cpuset, cpuset)) return (i);
+        }
+        return (-1);
+}
+
+/* Fill in the NUMA node of each compute thread of a multithreaded FFT using the affinity */
+/* SetPriority will give the thread.  The nodes are renumbered 0, 1, 2... in order of first */
+/* use.  Returns the number of NUMA nodes the threads span.  Returns 1 if the FFT blocks */
+/* should not be partitioned by node, which is the case unless the user asks for it with */
+/* NumaPartitionedFFT=1 or if any thread can run on any CPU. */
+
+int fft_numa_map (
+        struct PriorityInfo *sp_info,   /* Thread priority and affinity info of the worker's main thread */
+        int     num_threads,            /* Number of compute threads */
+        int     *map)                   /* Returned node of each thread, MAX_NUMA_MAP_THREADS entries */
+{
+        struct PriorityInfo info;
+        int     i, bind_type, core, node, num_cores, numa_nodes;
+        int     renumber[256];
+        char    logical_CPU_substring[255];
+        hwloc_obj_t obj;
+
+        if (NUM_NUMA_NODES <= 1 || ! IniGetInt (INI_FILE, "NumaPartitionedFFT", 0)) return (1);
+        if (num_threads <= 1 || num_threads > MAX_NUMA_MAP_THREADS) return (1);
+
+        num_cores = hwloc_get_nbobjs_by_type (hwloc_topology, HWLOC_OBJ_CORE);
+        if (num_cores < 1) num_cores = hwloc_get_nbobjs_by_type (hwloc_topology, HWLOC_OBJ_PU);
+        if (num_cores < 1) num_cores = 1;
+        for (i = 0; i < 256; i++) renumber[i] = -1;
+        numa_nodes = 0;
+        memcpy (&info, sp_info, sizeof (struct PriorityInfo));
+        info.aux_hyperthread = FALSE;
+        for (i = 0; i < num_threads; i++) {
+                info.aux_thread_num = i;
+                if (! choose_affinity (&info, &bind_type, &core, logical_CPU_substring)) return (1);
+                if (bind_type == 0) {
+                        obj = hwloc_get_obj_by_type (hwloc_topology, HWLOC_OBJ_CORE, core % num_cores);
+                        if (obj == NULL) obj = hwloc_get_obj_by_type (hwloc_topology, HWLOC_OBJ_PU, core % num_cores);
+                } else
+                        obj = hwloc_get_obj_by_type (hwloc_topology, HWLOC_OBJ_PU, atoi (logical_CPU_substring));
+                if (obj == NULL || obj->cpuset == NULL) return (1);
+                node = numa_node_of_cpuset (obj->cpuset);
+                if (node < 0 || node >= 256) return (1);
+                if (renumber[node] < 0) renumber[node] = numa_nodes++;
+                map[i] = renumber[node];
+        }
+        return (numa_nodes);
+}
+
 /* Gwnum thread callback routine */
 
 void SetAuxThreadPriority (int aux_thread_num, int action, void *data)
@@ -705,6 +815,16 @@ EXTERNC int stopCheck (
 
         if (thread_num < 0) return (0);
 
+/* If live INI settings were reloaded, apply the ones that must be set by */
+/* the worker thread itself.  New gwnum helper threads pick up the new */
+/* priority when they are next created. */
+
+        if (WORKER_CONFIG_GENERATION[thread_num] != CONFIG_GENERATION) {
+                WORKER_CONFIG_GENERATION[thread_num] = CONFIG_GENERATION;
+                if (IniGetInt (INI_FILE, "EnableSetPriority", 1))
+                        setOsThreadPriority (PRIORITY);
+        }
+
 /* If an important option changed in the GUI, restart all threads. */
 /* For example, the user changes the priority of all worker threads. */
 
@@ -740,6 +860,28 @@ EXTERNC int stopCheck (
                 return (STOP_PRIORITY_WORK);
         }
 
+/* If another worker wants help with its P-1 stage 2, stop this work unit */
+
+        if (STOP_FOR_STAGE2_HELP[thread_num]) {
+                STOP_FOR_STAGE2_HELP[thread_num] = 0;
+                return (STOP_STAGE2_HELP);
+        }
+
+/* If the performance anomaly detector wants to restart this worker's */
+/* work unit, then return that stop code. */
+
+        if (STOP_FOR_PERF_ANOMALY[thread_num]) {
+                STOP_FOR_PERF_ANOMALY[thread_num] = 0;
+                return (STOP_PERF_ANOMALY);
+        }
+
+/* If the worker is switching FFT implementations, then return that stop code. */
+
+        if (STOP_FOR_FFT_TRIAL[thread_num]) {
+                STOP_FOR_FFT_TRIAL[thread_num] = 0;
+                return (STOP_FFT_TRIAL);
+        }
+
 /* If the thread needs to abort the current work unit, then return */
 /* that stop code. */
 
@@ -793,6 +935,8 @@ int stop_events_initialized = FALSE;
 
 void init_stop_code (void)
 {
+        int     i;
+
         STOP_FOR_RESTART = FALSE;
         STOP_FOR_REREAD_INI = FALSE;
         STOP_FOR_BATTERY = FALSE;
@@ -800,9 +944,15 @@ void init_stop_code (void)
         STOP_FOR_LOADAVG = 0;
         memset (STOP_FOR_MEM_CHANGED, 0, sizeof (STOP_FOR_MEM_CHANGED));
         memset (STOP_FOR_PRIORITY_WORK, 0, sizeof (STOP_FOR_PRIORITY_WORK));
+        memset (STOP_FOR_STAGE2_HELP, 0, sizeof (STOP_FOR_STAGE2_HELP));
         memset (STOP_FOR_PAUSE, 0, sizeof (STOP_FOR_PAUSE));
         memset (STOP_FOR_THROTTLE, 0, sizeof (STOP_FOR_THROTTLE));
         memset (STOP_FOR_ABORT, 0, sizeof (STOP_FOR_ABORT));
+        memset (STOP_FOR_PERF_ANOMALY, 0, sizeof (STOP_FOR_PERF_ANOMALY));
+        memset (STOP_FOR_FFT_TRIAL, 0, sizeof (STOP_FOR_FFT_TRIAL));
+        memset (PERF_CORES_REDUCED, 0, sizeof (PERF_CORES_REDUCED));
+        memset (PERF_STATE, 0, sizeof (PERF_STATE));
+        for (i = 0; i < MAX_NUM_WORKER_THREADS; i++) WORKER_CONFIG_GENERATION[i] = CONFIG_GENERATION;
         memset (WRITE_SAVE_FILES, 0, sizeof (WRITE_SAVE_FILES));
         memset (JACOBI_ERROR_CHECK, 0, sizeof (JACOBI_ERROR_CHECK));
 }
@@ -883,6 +1033,10 @@ void stop_workers_for_restart (void)
 void stop_workers_for_add_files (void)
 {
         if (WORKER_THREADS_ACTIVE && ! STOP_FOR_RESTART) {
+                if (reloadLiveIniSettings ()) {
+                        OutputStr (MAIN_THREAD_NUM, "Applied settings from .add file without restarting worker threads.\n");
+                        return;
+                }
                 OutputStr (MAIN_THREAD_NUM, "Restarting all worker threads to process .add file.\n");
                 STOP_FOR_RESTART = TRUE;
                 restart_waiting_workers (RESTART_ALL);
@@ -896,6 +1050,10 @@ void stop_workers_for_add_files (void)
 void stop_workers_for_reread_ini (void)
 {
         if (WORKER_THREADS_ACTIVE && ! STOP_FOR_REREAD_INI) {
+                if (reloadLiveIniSettings ()) {
+                        OutputStr (MAIN_THREAD_NUM, "Applied new timed INI settings without restarting worker threads.\n");
+                        return;
+                }
                 OutputStr (MAIN_THREAD_NUM, "Restarting all worker threads with new timed INI settings.\n");
                 STOP_FOR_REREAD_INI = TRUE;
                 restart_waiting_workers (RESTART_ALL);
@@ -938,6 +1096,18 @@ void stop_worker_for_priority_work (
         }
 }
 
+/* Set flag so that worker thread will stop to help another worker's */
+/* P-1 stage 2.  Wake the worker if it is waiting for work. */
+
+void stop_worker_for_stage2_help (
+        int     thread_num)
+{
+        if (WORKER_THREADS_ACTIVE && ! STOP_FOR_STAGE2_HELP[thread_num]) {
+                STOP_FOR_STAGE2_HELP[thread_num] = 1;
+                restart_one_waiting_worker (thread_num, RESTART_WORK_AVAILABLE);
+        }
+}
+
 /* Set flags so that worker threads will stop for throttling. */
 
 void stop_workers_for_throttle (void)
@@ -1244,7 +1414,7 @@ int set_memory_usage (
         unsigned long memory)   /* Memory in use (in MB) */
 {
         int     i, best_thread, worst_thread, all_threads_set;
-        unsigned long mem_usage;
+        unsigned long mem_usage, variable_usage;
 
 /* Obtain lock before accessing memory global variables */
 
@@ -1268,9 +1438,9 @@ int set_memory_usage (
                 MEM_FLAGS[thread_num] &= ~MEM_USAGE_NOT_SET;
         MEM_FLAGS[thread_num] &= ~MEM_RESTARTING;
 
-/* Record the amount of memory being used */
+/* Record the amount of memory being used, including the GMP arena */
 
-        MEM_IN_USE[thread_num] = memory;
+        MEM_IN_USE[thread_num] = memory + gmp_arena_mem (thread_num);
 
 /* Sum up the amount of memory used by all threads.  In case we've allocated */
 /* too much memory, select a variable thread to restart.  We do this to make */
@@ -1278,9 +1448,11 @@ int set_memory_usage (
 /* We'll restart the variable thread using the most memory. */
 
         mem_usage = 0;
+        variable_usage = 0;
         worst_thread = -1;
         for (i = 0; i < (int) NUM_WORKER_THREADS; i++) {
                 mem_usage += MEM_IN_USE[i];
+                if (MEM_FLAGS[i] & MEM_VARIABLE_USAGE) variable_usage += MEM_IN_USE[i];
                 if ((MEM_FLAGS[i] & MEM_VARIABLE_USAGE ||
                      MEM_FLAGS[i] & MEM_WILL_BE_VARIABLE_USAGE) &&
                     (worst_thread == -1 ||
@@ -1288,6 +1460,13 @@ int set_memory_usage (
                         worst_thread = i;
         }
 
+/* Publish our stage 2 memory to other processes on this host.  Memory used by */
+/* their stage 2s counts against our Memory= setting, which should be the */
+/* host-wide amount when processes coordinate. */
+
+        host_set_memory (variable_usage);
+        mem_usage += host_others_memory ();
+
 /* If we have allocated more than the maximum allowable, then stop a */
 /* thread to free up some memory.  We also make sure we are using significantly */
 /* more memory than we should be so that minor fluctuations in memory */
@@ -1548,6 +1727,10 @@ int avail_mem (
                 }
         }
 
+/* Stage 2s running in other processes on this host use fixed amounts of memory */
+
+        fixed_usage += host_others_memory ();
+
 /* We can now calculate how much memory is available for the threads */
 /* that are using a variable amount of memory.  */
 
@@ -2405,147 +2588,1171 @@ void read_load_average_info (void)
         LOAD_CHECK_TIME = IniGetInt (INI_FILE, "PauseTime", 20);
 }
 
-void start_load_average_timer (void)
-{
-        if (HI_LOAD <= 0.0 || LOAD_CHECK_TIME <= 0) return;
-        if (get_load_average () < 0.0) return;
-        add_timed_event (TE_LOAD_AVERAGE, LOAD_CHECK_TIME);
-}
+void start_load_average_timer (void)
+{
+        if (HI_LOAD <= 0.0 || LOAD_CHECK_TIME <= 0) return;
+        if (get_load_average () < 0.0) return;
+        add_timed_event (TE_LOAD_AVERAGE, LOAD_CHECK_TIME);
+}
+
+void stop_load_average_timer (void)
+{
+        delete_timed_event (TE_LOAD_AVERAGE);
+}
+
+/* Every time the pause-while-running timer fires, this routine is called */
+
+void checkLoadAverage (void)
+{
+        double  load;
+        long    recheck_interval;
+        int     i;
+
+/* Get the load average */
+
+        load = get_load_average ();
+        recheck_interval = LOAD_CHECK_TIME;
+
+/* Check if we need to stop one or more workers. */
+/* Wait at least a minute before rechecking the load */
+/* This gives the system time to adjust the average to */
+/* reflect our stopped worker. */
+
+        if (load >= HI_LOAD) {
+                double  threads_per_worker;
+                int     workers_to_stop;
+
+                threads_per_worker = (double) NUM_CPUS / (double) NUM_WORKER_THREADS;
+                if (threads_per_worker < 1.0) threads_per_worker = 1.0;
+                workers_to_stop = (int) ((load - HI_LOAD) / threads_per_worker);
+                if (workers_to_stop < 1) workers_to_stop = 1;
+                STOP_FOR_LOADAVG = workers_to_stop;
+                if (recheck_interval < 65) recheck_interval = 65;
+        }
+
+/* Check if we need to restart a worker.  We restart workers */
+/* one at a time so that we slowly build the load back up. */
+/* Wait at least a minute before rechecking the load to give the */
+/* system time to adjust the average to reflect our restarted worker. */
+
+        if (load >= 0.0 && load <= LO_LOAD) {
+                for (i = 0; i < (int) NUM_WORKER_THREADS; i++) {
+                        if (END_LOADAVG_OR_STOP_INITIALIZED[i]) {
+                                restart_one_waiting_worker (i, RESTART_LOADAVG);
+                                if (recheck_interval < 65) recheck_interval = 65;
+                                break;
+                        }
+                }
+        }
+
+/* Set the timer to check the load average again in the near future */
+
+        add_timed_event (TE_LOAD_AVERAGE, recheck_interval);
+}
+
+/* This routine implements a load average pause for one worker thread */
+
+void implement_loadavg (
+        int     thread_num)
+{
+        char    buf[140];
+
+/* Output an informative message. */
+
+        sprintf (buf, "Pausing due to high load.\n");
+        OutputStr (thread_num, buf);
+        title (thread_num, "Paused");
+
+/* Wait for the end of the high load */
+
+        gwevent_init (&END_LOADAVG_OR_STOP[thread_num]);
+        gwevent_reset (&END_LOADAVG_OR_STOP[thread_num]);
+        END_LOADAVG_OR_STOP_INITIALIZED[thread_num] = 1;
+        gwevent_wait (&END_LOADAVG_OR_STOP[thread_num], 0);
+        END_LOADAVG_OR_STOP_INITIALIZED[thread_num] = 0;
+        gwevent_destroy (&END_LOADAVG_OR_STOP[thread_num]);
+
+/* Output another informative message */
+
+        OutputStr (thread_num, "Resuming processing.\n");
+        title (thread_num, "Resuming");
+}
+
+/**************************************************************/
+/*             Routines dealing with throttling               */
+/**************************************************************/
+
+int     THROTTLE_SLEEP_TIME_IN_SEC = 0;
+int     THROTTLE_SLEEP_TIME_IN_MS = 0;
+
+void start_throttle_timer (void)
+{
+        if (THROTTLE_PCT <= 0 || THROTTLE_PCT >= 100) return;
+        THROTTLE_SLEEP_TIME_IN_SEC = (int)
+                ((double) TE_THROTTLE_FREQ * (100.0 / (double) THROTTLE_PCT - 1.0));
+        THROTTLE_SLEEP_TIME_IN_MS = (int)
+                ((double) (TE_THROTTLE_FREQ + THROTTLE_SLEEP_TIME_IN_SEC) *
+                          (100.0 - (double) THROTTLE_PCT) * 10.0);
+        add_timed_event (TE_THROTTLE, TE_THROTTLE_FREQ);
+}
+
+void stop_throttle_timer (void)
+{
+        delete_timed_event (TE_THROTTLE);
+}
+
+/* Every time the throttle timer fires, this routine is called */
+
+int handleThrottleTimerEvent (void)
+{
+        stop_workers_for_throttle ();
+
+/* Assume most threads will pause very soon.  Set timer to fire again */
+/* after the idle time plus TE_THROTTLE_FREQ time.  That way each thread */
+/* will run approximately TE_THROTTLE_FREQ seconds and idle */
+/* THROTTLE_SLEEP_TIME_IN_SEC seconds for a CPU usage of THROTTLE_PCT. */
+
+        return (TE_THROTTLE_FREQ + THROTTLE_SLEEP_TIME_IN_SEC);
+}
+
+/* This routine implements a throttle for one worker thread */
+
+void implementThrottle (
+        int     thread_num)
+{
+        int     totaltime;
+
+/* Every 0.1 seconds see if we should resume processing.  We check */
+/* frequently so that we can be responsive to an ESC or terminate command. */
+
+        for (totaltime = 0; totaltime < THROTTLE_SLEEP_TIME_IN_MS; totaltime += 100) {
+                if (WORKER_THREADS_STOPPING) return;
+                Sleep (100);
+        }
+}
+
+/**************************************************************/
+/*        Routines dealing with performance anomalies         */
+/**************************************************************/
+
+/* Each LL/PRP worker collects its iteration times in windows of PERF_WINDOW_SIZE */
+/* iterations.  The median of each window is compared to the best window median */
+/* the worker has seen for the same FFT length and core count.  This baseline */
+/* survives restarts of the work unit.  A worker that is PerfSlowThreshold times slower */
+/* for PerfSlowSeconds of work is flagged slow.  It is flagged normal again once it */
+/* stays below PerfRecoverThreshold for PerfRecoverSeconds.  When a worker becomes */
+/* slow we guess at the cause and take the action configured for that cause.  Every */
+/* action defaults to just logging the event. */
+
+#define PERF_WINDOW_SIZE        64
+
+#define PERF_STATE_UNMONITORED  0
+#define PERF_STATE_NORMAL       1
+#define PERF_STATE_SLOW         2
+
+#define PERF_CAUSE_SYSTEM       0       /* All monitored workers are slow (thermal or power throttling) */
+#define PERF_CAUSE_LOAD         1       /* Load average exceeds our thread count (a noisy neighbour) */
+#define PERF_CAUSE_AFFINITY     2       /* Worker no longer runs on the CPUs it was bound to */
+#define PERF_CAUSE_WORKER       3       /* Only this worker is slow, cause unknown */
+
+#define PERF_ACTION_LOG         0       /* Just log the event */
+#define PERF_ACTION_REPIN       1       /* Restart the work unit to redo thread affinities */
+#define PERF_ACTION_REDUCE      2       /* Restart the work unit using one fewer core */
+#define PERF_ACTION_PAUSE       3       /* Pause the worker for PerfPauseTime seconds */
+
+struct perf_monitor {
+        int     enabled;
+        int     windows;                /* Number of windows completed */
+        int     count;                  /* Number of iteration times in this window */
+        double  window[PERF_WINDOW_SIZE]; /* Iteration times in seconds */
+        double  *best_median;           /* Fastest window median for this FFT length and core count */
+        double  slow_seconds;           /* Time spent in consecutive slow windows */
+        double  fast_seconds;           /* Time spent in consecutive normal windows while slow */
+        double  slow_threshold;
+        double  recover_threshold;
+        double  slow_time;
+        double  recover_time;
+        hwloc_bitmap_t cpuset;          /* Worker thread's affinity at start of work unit */
+};
+
+static const char * const PERF_CAUSE_NAMES[4] = {"system", "load", "affinity", "worker"};
+static const char * const PERF_ACTION_NAMES[4] = {"log", "repin", "reduce-threads", "pause"};
+static const char * const PERF_ACTION_INI[4] = {"PerfActionSystem", "PerfActionLoad", "PerfActionAffinity", "PerfActionWorker"};
+static const int PERF_ACTION_DEFAULTS[4] = {PERF_ACTION_LOG, PERF_ACTION_LOG, PERF_ACTION_LOG, PERF_ACTION_LOG};
+
+hwloc_bitmap_t PERF_CPUSET[MAX_NUM_WORKER_THREADS] = {NULL};   /* Reused for each work unit */
+time_t  PERF_NEXT_ACTION[MAX_NUM_WORKER_THREADS] = {0};         /* Earliest time for another action, survives restarts */
+
+/* Each worker remembers the baselines of the last few FFT length and core count combinations */
+/* it ran, so that restarting a work unit (including for a repin or reduce-threads action) */
+/* does not lose the baseline. */
+
+#define PERF_BASELINES          4
+
+struct perf_baseline {
+        unsigned long fftlen;           /* FFT length, zero if slot is unused */
+        unsigned int cores;             /* Cores the worker used */
+        double  best_median;            /* Fastest window median seen */
+} PERF_BASELINE[MAX_NUM_WORKER_THREADS][PERF_BASELINES] = {0};
+int     PERF_BASELINE_NEXT[MAX_NUM_WORKER_THREADS] = {0};      /* Next slot to replace */
+
+/* Return the number of cores a worker should use for its multithreaded FFTs */
+
+unsigned int worker_num_cores (
+        int     thread_num)
+{
+        int     cores;
+
+        cores = (int) CORES_PER_TEST[thread_num] - PERF_CORES_REDUCED[thread_num];
+        return (cores < 1 ? 1 : cores);
+}
+
+/* Start monitoring a worker's iteration times */
+
+void perf_monitor_init (
+        int     thread_num,
+        struct perf_monitor *pm,
+        gwhandle *gwdata)
+{
+        struct perf_baseline *base;
+        int     i;
+
+        memset (pm, 0, sizeof (struct perf_monitor));
+        pm->enabled = IniGetInt (INI_FILE, "PerfMonitor", 1);
+        if (!pm->enabled) return;
+
+/* Find the baseline for this FFT length and core count, or start a new one */
+
+        for (i = 0; i < PERF_BASELINES; i++) {
+                base = &PERF_BASELINE[thread_num][i];
+                if (base->fftlen == gwfftlen (gwdata) && base->cores == worker_num_cores (thread_num)) break;
+        }
+        if (i == PERF_BASELINES) {
+                base = &PERF_BASELINE[thread_num][PERF_BASELINE_NEXT[thread_num]];
+                PERF_BASELINE_NEXT[thread_num] = (PERF_BASELINE_NEXT[thread_num] + 1) % PERF_BASELINES;
+                base->fftlen = gwfftlen (gwdata);
+                base->cores = worker_num_cores (thread_num);
+                base->best_median = 1.0e50;
+        }
+        pm->best_median = &base->best_median;
+        pm->slow_threshold = IniGetFloat (INI_FILE, "PerfSlowThreshold", (float) 1.25);
+        pm->recover_threshold = IniGetFloat (INI_FILE, "PerfRecoverThreshold", (float) 1.10);
+        pm->slow_time = IniGetInt (INI_FILE, "PerfSlowSeconds", 120);
+        pm->recover_time = IniGetInt (INI_FILE, "PerfRecoverSeconds", 120);
+        if (OS_CAN_SET_AFFINITY) {
+                if (PERF_CPUSET[thread_num] == NULL) PERF_CPUSET[thread_num] = hwloc_bitmap_alloc ();
+                if (PERF_CPUSET[thread_num] != NULL &&
+                    !hwloc_get_cpubind (hwloc_topology, PERF_CPUSET[thread_num], HWLOC_CPUBIND_THREAD))
+                        pm->cpuset = PERF_CPUSET[thread_num];
+        }
+        PERF_STATE[thread_num] = PERF_STATE_NORMAL;
+}
+
+/* Stop monitoring a worker's iteration times.  Called when a work unit returns. */
+
+void perf_monitor_done (
+        int     thread_num)
+{
+        PERF_STATE[thread_num] = PERF_STATE_UNMONITORED;
+}
+
+/* Return TRUE if the load average says some other program is competing for the CPUs */
+
+int perf_load_too_high (
+        double  load)
+{
+        int     i;
+        unsigned int our_threads;
+
+        our_threads = 0;
+        for (i = 0; i < (int) NUM_WORKER_THREADS; i++) our_threads += CORES_PER_TEST[i];
+        return (load >= 0.0 && load > (double) our_threads + IniGetFloat (INI_FILE, "PerfLoadMargin", (float) 1.0));
+}
+
+/* Guess why a worker has slowed down */
+
+int perf_classify (
+        int     thread_num,
+        struct perf_monitor *pm,
+        double  *load)
+{
+        int     i, monitored, slow;
+
+/* Get the load average for the log and for the load test below */
+
+        *load = get_load_average ();
+
+/* See if the worker thread has been moved off the CPUs it started on */
+
+        if (pm->cpuset != NULL) {
+                hwloc_bitmap_t current;
+                int     drifted = FALSE;
+                current = hwloc_bitmap_alloc ();
+                if (current != NULL) {
+                        if (!hwloc_get_cpubind (hwloc_topology, current, HWLOC_CPUBIND_THREAD))
+                                drifted = !hwloc_bitmap_isequal (current, pm->cpuset);
+                        hwloc_bitmap_free (current);
+                }
+                if (drifted) return (PERF_CAUSE_AFFINITY);
+        }
+
+/* See if every monitored worker is slow.  This points to the whole machine running */
+/* slower, as happens with thermal or power throttling. */
+
+        monitored = slow = 0;
+        for (i = 0; i < (int) NUM_WORKER_THREADS; i++) {
+                if (i == thread_num || PERF_STATE[i] == PERF_STATE_UNMONITORED) continue;
+                monitored++;
+                if (PERF_STATE[i] == PERF_STATE_SLOW) slow++;
+        }
+        if (monitored && slow == monitored) return (PERF_CAUSE_SYSTEM);
+
+/* See if the load average says some other program is competing for the CPUs */
+
+        if (perf_load_too_high (*load)) return (PERF_CAUSE_LOAD);
+
+/* Nothing obvious, only this worker is slow */
+
+        return (PERF_CAUSE_WORKER);
+}
+
+/* Median of the window of iteration times */
+
+double perf_window_median (
+        struct perf_monitor *pm)
+{
+        double  sorted[PERF_WINDOW_SIZE], t;
+        int     i, j;
+
+        for (i = 0; i < pm->count; i++) {
+                t = pm->window[i];
+                for (j = i; j > 0 && sorted[j-1] > t; j--) sorted[j] = sorted[j-1];
+                sorted[j] = t;
+        }
+        return (sorted[pm->count / 2]);
+}
+
+/* Record one iteration time */
+
+void perf_monitor_iteration (
+        int     thread_num,
+        struct perf_monitor *pm,
+        double  iteration_time)         /* In seconds */
+{
+        double  median, window_time, ratio, load;
+        int     i, cause, action;
+        char    buf[400];
+
+        if (!pm->enabled || iteration_time <= 0.0) return;
+        pm->window[pm->count++] = iteration_time;
+        if (pm->count < PERF_WINDOW_SIZE) return;
+
+/* The window is full.  Compare its median to the best median. */
+/* Skip the first window, it includes warm up and setup costs. */
+
+        median = perf_window_median (pm);
+        window_time = 0.0;
+        for (i = 0; i < pm->count; i++) window_time += pm->window[i];
+        pm->count = 0;
+        if (pm->windows++ == 0) return;
+        if (median < *pm->best_median) *pm->best_median = median;
+        ratio = median / *pm->best_median;
+
+/* Give back a core taken away by the reduce-threads action once the cooldown has */
+/* passed and the load average no longer says other programs are using the CPUs. */
+/* If the worker is slow again with the extra core, the action will take it away again. */
+
+        if (PERF_CORES_REDUCED[thread_num] && PERF_STATE[thread_num] == PERF_STATE_NORMAL &&
+            time (NULL) >= PERF_NEXT_ACTION[thread_num] && ! perf_load_too_high (get_load_average ())) {
+                PERF_CORES_REDUCED[thread_num]--;
+                PERF_NEXT_ACTION[thread_num] = time (NULL) + IniGetInt (INI_FILE, "PerfActionCooldown", 1800);
+                sprintf (buf, "Restarting worker using %u cores.\n", worker_num_cores (thread_num));
+                OutputStr (thread_num, buf);
+                sprintf (buf, "{\"event\":\"perf-restore-threads\", \"worker\":%d, \"cores\":%u}\n", thread_num+1, worker_num_cores (thread_num));
+                LogMsg (buf);
+                STOP_FOR_PERF_ANOMALY[thread_num] = 1;
+                return;
+        }
+
+/* Apply hysteresis.  A normal worker must be slow for slow_time seconds to be flagged. */
+/* A slow worker must be fast again for recover_time seconds to be unflagged. */
+
+        if (PERF_STATE[thread_num] == PERF_STATE_NORMAL) {
+                if (ratio < pm->slow_threshold) {
+                        pm->slow_seconds = 0.0;
+                        return;
+                }
+                pm->slow_seconds += window_time;
+                if (pm->slow_seconds < pm->slow_time) return;
+        } else {
+                if (ratio < pm->recover_threshold) {
+                        pm->fast_seconds += window_time;
+                        if (pm->fast_seconds >= pm->recover_time) {
+                                PERF_STATE[thread_num] = PERF_STATE_NORMAL;
+                                pm->slow_seconds = 0.0;
+                                sprintf (buf, "Iteration times are back to normal (%.3f ms).\n", median * 1000.0);
+                                OutputStr (thread_num, buf);
+                                sprintf (buf, "{\"event\":\"perf-recovered\", \"worker\":%d, \"median-ms\":%.3f, \"baseline-ms\":%.3f}\n",
+                                         thread_num+1, median * 1000.0, *pm->best_median * 1000.0);
+                                LogMsg (buf);
+                        }
+                } else
+                        pm->fast_seconds = 0.0;
+                return;
+        }
+
+/* The worker has just become slow.  Classify the cause and pick the action. */
+
+        PERF_STATE[thread_num] = PERF_STATE_SLOW;
+        pm->fast_seconds = 0.0;
+        cause = perf_classify (thread_num, pm, &load);
+        action = IniGetInt (INI_FILE, PERF_ACTION_INI[cause], PERF_ACTION_DEFAULTS[cause]);
+        if (action < PERF_ACTION_LOG || action > PERF_ACTION_PAUSE) action = PERF_ACTION_LOG;
+        if (action == PERF_ACTION_REDUCE && worker_num_cores (thread_num) <= 1) action = PERF_ACTION_LOG;
+        if (action != PERF_ACTION_LOG && time (NULL) < PERF_NEXT_ACTION[thread_num]) action = PERF_ACTION_LOG;
+
+        sprintf (buf, "Iterations are %.2f times slower than this worker's best at this FFT length (%.3f ms vs. %.3f ms), likely cause: %s.\n",
+                 ratio, median * 1000.0, *pm->best_median * 1000.0,
+                 cause == PERF_CAUSE_SYSTEM ? "all workers slowed down" :
+                 cause == PERF_CAUSE_LOAD ? "other programs are using the CPUs" :
+                 cause == PERF_CAUSE_AFFINITY ? "worker was moved to different CPUs" : "unknown");
+        OutputStr (thread_num, buf);
+        sprintf (buf, "{\"event\":\"perf-slow\", \"worker\":%d, \"cause\":\"%s\", \"action\":\"%s\", \"ratio\":%.2f, \"median-ms\":%.3f, \"baseline-ms\":%.3f, \"loadavg\":%.2f}\n",
+                 thread_num+1, PERF_CAUSE_NAMES[cause], PERF_ACTION_NAMES[action], ratio, median * 1000.0, *pm->best_median * 1000.0, load);
+        LogMsg (buf);
+
+/* Take the action.  Restarting the work unit recreates the helper threads, */
+/* which resets their affinity.  Reducing cores takes effect on that restart. */
+
+        if (action != PERF_ACTION_LOG) PERF_NEXT_ACTION[thread_num] = time (NULL) + IniGetInt (INI_FILE, "PerfActionCooldown", 1800);
+        if (action == PERF_ACTION_REPIN || action == PERF_ACTION_REDUCE) {
+                if (action == PERF_ACTION_REDUCE) {
+                        PERF_CORES_REDUCED[thread_num]++;
+                        sprintf (buf, "Restarting worker using %u cores.\n", worker_num_cores (thread_num));
+                } else
+                        strcpy (buf, "Restarting worker to reset thread affinities.\n");
+                OutputStr (thread_num, buf);
+                STOP_FOR_PERF_ANOMALY[thread_num] = 1;
+        }
+        if (action == PERF_ACTION_PAUSE) {
+                int     pause_time = IniGetInt (INI_FILE, "PerfPauseTime", 60);
+                sprintf (buf, "Pausing %d seconds.\n", pause_time);
+                OutputStr (thread_num, buf);
+                for (i = 0; i < pause_time * 10 && !WORKER_THREADS_STOPPING; i++) Sleep (100);
+        }
+}
+
+/**************************************************************/
+/*      Routines that time FFT implementations in production  */
+/**************************************************************/
+
+/* autoBench must stop the workers to benchmark FFT implementations, and its */
+/* timings may not match what the workers see with their real co-load.  Instead, */
+/* with FFTTrialInterval set (it is 0, disabled, by default) an LL or PRP worker */
+/* times its current FFT implementation every FFTTrialInterval hours for */
+/* FFTTrialMinutes.  It then restarts from its save file */
+/* once for each other implementation of the same FFT length, timing each for */
+/* FFTTrialMinutes.  Every timing is added to gwnum.txt as a benchmark row, and */
+/* once the last implementation is timed gwsetup picks the one with the best */
+/* throughput just as it does with autoBench data. */
+
+#define FFT_TRIAL_WARMUP        100     /* Iterations to skip after a restart */
+
+struct fft_trial {
+        int     nth;                    /* bench_pick_nth_fft of the implementation being timed, zero if none */
+        unsigned long fftlen;           /* FFT length being timed */
+        void    (*prod_proc)(void*);    /* Implementation used before the trials began */
+        double  k;                      /* Number the trials are run on */
+        unsigned long b, n;
+        signed long c;
+        time_t  next_trial;             /* When to next time the current implementation */
+};
+
+struct fft_trial FFT_TRIAL[MAX_NUM_WORKER_THREADS] = {{0}};     /* Survives work unit restarts */
+
+struct fft_trial_timer {
+        int     enabled;                /* FALSE if FFTTrialInterval is zero */
+        int     timing;                 /* TRUE if timing this implementation */
+        int     checks;                 /* Iterations since we last checked the clock */
+        int     warmup;                 /* Iterations skipped so far */
+        unsigned long iterations;       /* Iterations timed */
+        double  total_time;             /* Seconds spent in timed iterations */
+        double  trial_seconds;          /* Seconds of iterations to time */
+};
+
+/* Choose the FFT implementation to set up.  Called just before gwsetup. */
+/* Returns the minimum FFT length to pass to gwsetup. */
+
+unsigned long fft_trial_prepare (
+        int     thread_num,
+        struct work_unit *w,
+        gwhandle *gwdata,               /* Handle with all options set */
+        unsigned long minimum_fftlen)   /* Minimum FFT length if no trial is running */
+{
+        struct fft_trial *t = &FFT_TRIAL[thread_num];
+        gwhandle probe;
+        char    buf[200];
+
+        if (t->nth == 0) return (minimum_fftlen);
+
+/* A new work unit ends the trials */
+
+        if (w->k != t->k || w->b != t->b || w->n != t->n || w->c != t->c) {
+                t->nth = 0;
+                return (minimum_fftlen);
+        }
+
+/* Find the next implementation of this FFT length, skipping the one we were using */
+/* and (as gwinfo does) r4dwpn FFTs if the caller wants SUM(INPUTS) error checking. */
+
+        for ( ; ; t->nth++) {
+                gwinit (&probe);
+                probe.cpu_flags = gwdata->cpu_flags;
+                probe.maxmulbyconst = gwdata->maxmulbyconst;
+                probe.safety_margin = gwdata->safety_margin;
+                probe.minimum_fftlen = t->fftlen;
+                probe.bench_pick_nth_fft = t->nth;
+                if (gwinfo (&probe, w->k, w->b, w->n, w->c) || probe.FFTLEN != t->fftlen) break;
+                if (probe.GWPROCPTRS[0] == t->prod_proc) continue;
+                if (gwdata->sum_inputs_checking && ! probe.ALL_COMPLEX_FFT && ! (gwdata->cpu_flags & (CPU_AVX512F | CPU_AVX)) &&
+                    probe.FFT_TYPE == FFT_TYPE_RADIX_4_DWPN) continue;
+                gwdata->bench_pick_nth_fft = t->nth;
+                return (t->fftlen);
+        }
+
+/* All implementations have been timed */
+
+        t->nth = 0;
+        t->next_trial = time (NULL) + (time_t) (IniGetFloat (INI_FILE, "FFTTrialInterval", 0.0) * 3600.0);
+        sprintf (buf, "Finished timing all FFT implementations of length %luK.\n", t->fftlen / 1024);
+        OutputStr (thread_num, buf);
+        return (minimum_fftlen);
+}
+
+/* Init timing of the implementation that was just set up.  Called once gwsetup succeeds. */
+
+void fft_trial_init (
+        int     thread_num,
+        struct fft_trial_timer *tt,
+        gwhandle *gwdata)
+{
+        struct fft_trial *t = &FFT_TRIAL[thread_num];
+        double  interval;
+
+        memset (tt, 0, sizeof (struct fft_trial_timer));
+        interval = IniGetFloat (INI_FILE, "FFTTrialInterval", 0.0);
+        tt->enabled = (interval > 0.0 && ! gw_using_gmp (gwdata));   /* GMP has no FFT to time */
+        if (!tt->enabled) {
+                t->nth = 0;
+                return;
+        }
+        tt->trial_seconds = IniGetFloat (INI_FILE, "FFTTrialMinutes", 10.0) * 60.0;
+        if (t->next_trial == 0) t->next_trial = time (NULL) + (time_t) (interval * 3600.0);
+
+/* If a trial is running, time the implementation gwsetup chose.  Should gwsetup */
+/* not have used the FFT length we are trying, give up on this round of trials. */
+
+        if (t->nth) {
+                if (gwdata->FFTLEN == t->fftlen && gwdata->GWPROCPTRS[0] != t->prod_proc) tt->timing = TRUE;
+                else {
+                        t->nth = 0;
+                        t->next_trial = time (NULL) + (time_t) (interval * 3600.0);
+                }
+        }
+}
+
+/* Record one iteration time.  Once enough iterations are timed, add a */
+/* benchmark row and restart the work unit with the next implementation. */
+
+void fft_trial_iteration (
+        int     thread_num,
+        struct fft_trial_timer *tt,
+        gwhandle *gwdata,
+        struct work_unit *w,
+        double  iteration_time)         /* In seconds */
+{
+        struct fft_trial *t = &FFT_TRIAL[thread_num];
+        struct gwbench_add_struct bench_data;
+        char    buf[200], fft_desc[200];
+
+        if (iteration_time <= 0.0) return;
+
+/* Every so often, see if it is time to start timing the current implementation */
+
+        if (!tt->timing) {
+                if (!tt->enabled || t->nth || (++tt->checks & 127) || time (NULL) < t->next_trial) return;
+                tt->timing = TRUE;
+        }
+        if (tt->warmup < FFT_TRIAL_WARMUP) {
+                tt->warmup++;
+                return;
+        }
+        tt->iterations++;
+        tt->total_time += iteration_time;
+        if (tt->total_time < tt->trial_seconds) return;
+        tt->timing = FALSE;
+
+/* Add a benchmark row.  Use the same cores, workers, and hyperthreads that */
+/* gwinfo will look up.  Like the throughput benchmark, assume every worker */
+/* gets the same iteration time we did. */
+
+        bench_data.version = GWBENCH_ADD_VERSION;
+        bench_data.num_cores = gwdata->bench_num_cores ? gwdata->bench_num_cores : CPU_CORES;
+        bench_data.num_hyperthreads = gwdata->will_hyperthread > 1 ? gwdata->will_hyperthread : gwdata->will_hyperthread ? 2 : 1;
+        bench_data.num_workers = gwdata->bench_num_workers ? gwdata->bench_num_workers :
+                                        bench_data.num_cores * bench_data.num_hyperthreads / gwdata->num_threads;
+        if (bench_data.num_workers < 1) bench_data.num_workers = 1;
+        bench_data.throughput = (double) bench_data.num_workers * (double) tt->iterations / tt->total_time;
+        bench_data.bench_length = tt->total_time;
+        bench_data.error_checking = (gwdata->will_error_check == 1);
+        gwbench_add_data (gwdata, &bench_data);
+        host_write_bench_data ();
+
+        gwfft_description (gwdata, fft_desc);
+        sprintf (buf, "Timed %s: %.3f ms per iteration, throughput %.2f iter/sec.\n",
+                 fft_desc, tt->total_time / tt->iterations * 1000.0, bench_data.throughput);
+        OutputStr (thread_num, buf);
+
+/* Restart with the next implementation.  The first restart begins the trials. */
+
+        if (t->nth == 0) {
+                t->nth = 1;
+                t->fftlen = gwdata->FFTLEN;
+                t->prod_proc = gwdata->GWPROCPTRS[0];
+                t->k = w->k;
+                t->b = w->b;
+                t->n = w->n;
+                t->c = w->c;
+        } else
+                t->nth++;
+        STOP_FOR_FFT_TRIAL[thread_num] = 1;
+}
+
+/**************************************************************/
+/*     Routines dealing with other processes on this host     */
+/**************************************************************/
+
+/* Sites that run several mprime processes on one host can set HostSharedMemory=name */
+/* in prime.txt.  The first process creates a shared memory segment with that name */
+/* and every process registers itself there.  The segment holds a map of which */
+/* process owns each CPU core, a ledger of the memory each process uses for */
+/* P-1/ECM stage 2, and the location of one gwnum.txt that all the processes share */
+/* for benchmark data.  Processes that crash are removed when another process */
+/* notices their process ID is gone.  The last process to exit removes the segment. */
+
+#define HOST_SHARED_MAGIC       0x54534F48      /* "HOST" */
+#define HOST_SHARED_VERSION     2
+#define HOST_MAX_PROCESSES      64
+#define HOST_MAX_CORES          1024
+
+struct host_process {
+        unsigned long pid;              /* Zero if this slot is free */
+        unsigned long stage2_mem;       /* MB used by this process' variable memory workers */
+        int     num_cores;              /* Number of cores claimed in core map */
+};
+
+struct host_shared {
+        char    lock[HOST_LOCK_SIZE];   /* OS-specific interprocess lock */
+        unsigned long magic;            /* Set once the segment is initialized */
+        unsigned long version;
+        unsigned long removed;          /* Set when the last process removed the segment's name */
+        unsigned long bench_generation; /* Incremented each time the shared gwnum.txt is written */
+        char    bench_file[260];        /* Full path of the shared gwnum.txt */
+        short   core_owner[HOST_MAX_CORES]; /* Process slot + 1 owning each core, zero if free */
+        struct host_process procs[HOST_MAX_PROCESSES];
+};
+
+struct host_shared *HOST_SHARED = NULL; /* Shared segment, NULL if not coordinating */
+char    HOST_SHARED_NAME[80];           /* Name of the shared segment */
+int     HOST_SLOT = -1;                 /* Our slot in the procs array */
+unsigned long HOST_BENCH_GENERATION = 0; /* Last bench generation we merged */
+unsigned long HOST_OTHERS_MEM = 0;      /* Other processes' stage 2 memory at last check */
+
+/* Free the resources of processes that no longer exist.  Caller must hold the lock. */
+
+void host_reap_dead_processes (void)
+{
+        int     i, j;
+
+        for (i = 0; i < HOST_MAX_PROCESSES; i++) {
+                if (i == HOST_SLOT || HOST_SHARED->procs[i].pid == 0) continue;
+                if (host_process_alive (HOST_SHARED->procs[i].pid)) continue;
+                for (j = 0; j < HOST_MAX_CORES; j++)
+                        if (HOST_SHARED->core_owner[j] == i + 1) HOST_SHARED->core_owner[j] = 0;
+                memset (&HOST_SHARED->procs[i], 0, sizeof (struct host_process));
+        }
+}
+
+/* Attach to the shared memory segment and register this process */
+
+void host_attach (void)
+{
+        char    name[80], buf[400];
+        int     i, created, retry;
+        struct host_shared *shared;
+
+/* Return if not coordinating or already attached */
+
+        if (HOST_SHARED != NULL) return;
+        IniGetString (INI_FILE, "HostSharedMemory", name, sizeof (name), NULL);
+        if (name[0] == 0) return;
+
+/* Create or open the segment.  The process that creates it initializes the lock */
+/* and the bench file location.  Others wait for the creator to finish.  A creator */
+/* that died before finishing leaves a segment no one can use, remove its name and */
+/* start over.  So does a segment whose last process removed the name while we */
+/* were opening it. */
+
+        for (retry = 0; ; retry++) {
+                shared = (struct host_shared *) host_shm_attach (name, sizeof (struct host_shared), &created);
+                if (shared == NULL) {
+                        sprintf (buf, "Unable to attach shared memory segment %s.  Not coordinating with other processes.\n", name);
+                        OutputBoth (MAIN_THREAD_NUM, buf);
+                        return;
+                }
+                if (created) {
+                        host_shm_lock_init (shared->lock);
+                        IniGetString (INI_FILE, "HostBenchFile", shared->bench_file, sizeof (shared->bench_file), NULL);
+                        if (shared->bench_file[0] == 0 && _getcwd (shared->bench_file, sizeof (shared->bench_file) - 12) != NULL)
+                                strcat (shared->bench_file, "/" "gwnum.txt");
+                        shared->version = HOST_SHARED_VERSION;
+                        shared->magic = HOST_SHARED_MAGIC;
+                } else {
+                        for (i = 0; i < 50 && shared->magic != HOST_SHARED_MAGIC; i++) Sleep (100);
+                        if (shared->magic != HOST_SHARED_MAGIC && retry < 2) {
+                                host_shm_detach (shared, sizeof (struct host_shared));
+                                host_shm_remove (name);
+                                continue;
+                        }
+                        if (shared->magic != HOST_SHARED_MAGIC || shared->version != HOST_SHARED_VERSION) {
+                                host_shm_detach (shared, sizeof (struct host_shared));
+                                sprintf (buf, "Shared memory segment %s is not usable.  Not coordinating with other processes.\n", name);
+                                OutputBoth (MAIN_THREAD_NUM, buf);
+                                return;
+                        }
+                }
+
+/* Find a free slot */
+
+                host_shm_lock (shared->lock);
+                if (shared->removed && retry < 2) {
+                        host_shm_unlock (shared->lock);
+                        host_shm_detach (shared, sizeof (struct host_shared));
+                        continue;
+                }
+                HOST_SHARED = shared;
+                host_reap_dead_processes ();
+                for (i = 0; i < HOST_MAX_PROCESSES; i++) {
+                        if (shared->procs[i].pid != 0) continue;
+                        memset (&shared->procs[i], 0, sizeof (struct host_process));
+                        shared->procs[i].pid = host_getpid ();
+                        HOST_SLOT = i;
+                        break;
+                }
+                HOST_BENCH_GENERATION = shared->bench_generation;
+                host_shm_unlock (shared->lock);
+                break;
+        }
+        if (HOST_SLOT < 0) {
+                HOST_SHARED = NULL;
+                host_shm_detach (shared, sizeof (struct host_shared));
+                OutputBoth (MAIN_THREAD_NUM, "Too many processes using the shared memory segment.  Not coordinating with other processes.\n");
+                return;
+        }
+        strcpy (HOST_SHARED_NAME, name);
+
+/* Use the shared gwnum.txt for benchmark data */
+
+        if (shared->bench_file[0]) gwbench_set_file (shared->bench_file);
+        sprintf (buf, "Coordinating with other processes using shared memory segment %s.\n", name);
+        OutputStr (MAIN_THREAD_NUM, buf);
+}
+
+/* Unregister this process when it exits.  The last process to leave removes */
+/* the segment, a process attaching at the same time sees the removed flag and */
+/* creates a new segment. */
+
+void host_detach (void)
+{
+        int     i, others;
+
+        if (HOST_SHARED == NULL) return;
+        host_release ();
+        host_shm_lock (HOST_SHARED->lock);
+        memset (&HOST_SHARED->procs[HOST_SLOT], 0, sizeof (struct host_process));
+        host_reap_dead_processes ();
+        for (i = others = 0; i < HOST_MAX_PROCESSES; i++)
+                if (HOST_SHARED->procs[i].pid) others++;
+        if (others == 0) {
+                HOST_SHARED->removed = TRUE;
+                host_shm_remove (HOST_SHARED_NAME);
+        }
+        host_shm_unlock (HOST_SHARED->lock);
+        host_shm_detach (HOST_SHARED, sizeof (struct host_shared));
+        HOST_SHARED = NULL;
+        HOST_SLOT = -1;
+}
+
+/* Claim a block of cores for this process' workers.  SetPriority binds our */
+/* workers to these cores rather than assuming we own the whole machine. */
+
+void host_claim_cores (void)
+{
+        int     i, j, num_cores, total_cores;
+        char    buf[200];
+
+        HOST_CORE_BASE = -1;
+        if (HOST_SHARED == NULL) return;
+
+/* Count the cores our workers need */
+
+        num_cores = 0;
+        for (i = 0; i < (int) NUM_WORKER_THREADS; i++) num_cores += CORES_PER_TEST[i];
+        total_cores = (NUM_CPUS < HOST_MAX_CORES ? NUM_CPUS : HOST_MAX_CORES);
+
+/* Release any earlier claim, then find the first run of free cores that is big enough */
+
+        host_shm_lock (HOST_SHARED->lock);
+        host_reap_dead_processes ();
+        for (j = 0; j < HOST_MAX_CORES; j++)
+                if (HOST_SHARED->core_owner[j] == HOST_SLOT + 1) HOST_SHARED->core_owner[j] = 0;
+        for (i = 0; i + num_cores <= total_cores; i++) {
+                for (j = 0; j < num_cores; j++)
+                        if (HOST_SHARED->core_owner[i+j]) break;
+                if (j == num_cores) break;
+                i += j;
+        }
+        if (num_cores && i + num_cores <= total_cores) {
+                for (j = 0; j < num_cores; j++) HOST_SHARED->core_owner[i+j] = (short) (HOST_SLOT + 1);
+                HOST_SHARED->procs[HOST_SLOT].num_cores = num_cores;
+                HOST_CORE_BASE = i;
+        } else
+                HOST_SHARED->procs[HOST_SLOT].num_cores = 0;
+        host_shm_unlock (HOST_SHARED->lock);
+
+        if (HOST_CORE_BASE >= 0)
+                sprintf (buf, "Workers will use CPU cores #%d through #%d.\n", HOST_CORE_BASE + 1, HOST_CORE_BASE + num_cores);
+        else
+                sprintf (buf, "Other processes are using the CPU cores.  Unable to reserve %d free cores.\n", num_cores);
+        OutputStr (MAIN_THREAD_NUM, buf);
+}
+
+/* Release this process' cores and stage 2 memory when the workers stop */
+
+void host_release (void)
+{
+        int     j;
+
+        HOST_CORE_BASE = -1;
+        if (HOST_SHARED == NULL) return;
+        host_shm_lock (HOST_SHARED->lock);
+        for (j = 0; j < HOST_MAX_CORES; j++)
+                if (HOST_SHARED->core_owner[j] == HOST_SLOT + 1) HOST_SHARED->core_owner[j] = 0;
+        HOST_SHARED->procs[HOST_SLOT].num_cores = 0;
+        HOST_SHARED->procs[HOST_SLOT].stage2_mem = 0;
+        host_shm_unlock (HOST_SHARED->lock);
+}
+
+/* Return the stage 2 memory (in MB) in use by other processes on this host */
+
+unsigned long host_others_memory (void)
+{
+        unsigned long mem;
+        int     i;
+
+        if (HOST_SHARED == NULL) return (0);
+        mem = 0;
+        host_shm_lock (HOST_SHARED->lock);
+        for (i = 0; i < HOST_MAX_PROCESSES; i++)
+                if (i != HOST_SLOT && HOST_SHARED->procs[i].pid) mem += HOST_SHARED->procs[i].stage2_mem;
+        host_shm_unlock (HOST_SHARED->lock);
+        HOST_OTHERS_MEM = mem;
+        return (mem);
+}
+
+/* Publish the stage 2 memory (in MB) this process is using */
+
+void host_set_memory (
+        unsigned long memory)
+{
+        if (HOST_SHARED == NULL) return;
+        host_shm_lock (HOST_SHARED->lock);
+        HOST_SHARED->procs[HOST_SLOT].stage2_mem = memory;
+        host_shm_unlock (HOST_SHARED->lock);
+}
+
+/* Write benchmark data to gwnum.txt.  When it is shared with other processes, */
+/* hold the lock so that two processes do not write it at the same time and */
+/* tell the other processes to merge in the new data. */
+
+void host_write_bench_data (void)
+{
+        if (HOST_SHARED == NULL) {
+                gwbench_write_data ();
+                return;
+        }
+        host_shm_lock (HOST_SHARED->lock);
+        gwbench_write_data ();
+        HOST_BENCH_GENERATION = ++HOST_SHARED->bench_generation;
+        host_shm_unlock (HOST_SHARED->lock);
+}
+
+void start_host_timer (void)
+{
+        if (HOST_SHARED == NULL) return;
+        add_timed_event (TE_HOST_CHECK, HOST_CHECK_FREQ);
+}
+
+void stop_host_timer (void)
+{
+        delete_timed_event (TE_HOST_CHECK);
+}
+
+/* Every HOST_CHECK_FREQ seconds check in with the other processes.  If another */
+/* process released stage 2 memory, a worker waiting for memory may now be able */
+/* to run.  If another process wrote benchmark data, merge it into ours. */
+
+void host_check (void)
+{
+        unsigned long old_others_mem, generation;
+        int     i;
+
+        if (HOST_SHARED == NULL) return;
+        old_others_mem = HOST_OTHERS_MEM;
+
+        host_shm_lock (HOST_SHARED->lock);
+        host_reap_dead_processes ();
+        generation = HOST_SHARED->bench_generation;
+        host_shm_unlock (HOST_SHARED->lock);
+
+        if (generation != HOST_BENCH_GENERATION) {
+                HOST_BENCH_GENERATION = generation;
+                gwbench_merge_data ();
+        }
+
+        if (host_others_memory () + 32 < old_others_mem) {
+                gwmutex_lock (&MEM_MUTEX);
+                for (i = 0; i < (int) NUM_WORKER_THREADS; i++) {
+                        if (! (MEM_RESTART_FLAGS[i] & (MEM_RESTART_MORE_AVAIL | MEM_RESTART_IF_MORE))) continue;
+                        stop_worker_for_mem_changed (i);
+                        break;
+                }
+                gwmutex_unlock (&MEM_MUTEX);
+        }
+}
+
+/**************************************************************/
+/*         Routines dealing with GMP's memory allocation      */
+/**************************************************************/
+
+/* GMP's default allocator mallocs and frees its temporaries on every call. */
+/* A GCD or modular inverse of a multi-million digit number churns through */
+/* many megabytes of freshly faulted (and zeroed) pages each time.  Instead, */
+/* each worker keeps an arena sized from the number being worked on.  GMP */
+/* allocations made between gmp_arena_begin and gmp_arena_end come from the */
+/* worker's arena in a stack-like manner, larger requests fall back to malloc. */
+/* The arena uses large pages when the worker's gwnum handle does.  It is */
+/* allocated and touched by the worker thread, so with affinity set the OS */
+/* places it on the worker's NUMA node.  GmpArenaSize=n sets the arena size */
+/* to n times the size of the number in binary, zero turns off the arena.  The */
+/* default of 14 covers the extended GCD of a modular inverse, which peaked at */
+/* about 13.5 times the number's size in testing.  The arena is counted in the */
+/* worker's memory usage and freed when the work unit ends. */
+
+#ifdef _WIN32
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+#define GMP_ARENA_ALIGN(s)      (((s) + 63) & ~((size_t) 63))
+
+struct gmp_arena {
+        char    *base;                  /* Start of the arena, NULL if not allocated */
+        size_t  size;                   /* Size of the arena */
+        size_t  offset;                 /* Offset of the first free byte */
+        long    live;                   /* Number of allocations not yet freed */
+        int     large_pages;            /* TRUE if allocated with large_pages_malloc */
+} GMP_ARENAS[MAX_NUM_WORKER_THREADS] = {0};
 
-void stop_load_average_timer (void)
-{
-        delete_timed_event (TE_LOAD_AVERAGE);
-}
+/* Only the worker thread allocates from or frees into its arena, so the */
+/* allocator routines look at no arena but this thread's own. */
 
-/* Every time the pause-while-running timer fires, this routine is called */
+static THREAD_LOCAL struct gmp_arena *GMP_ARENA = NULL; /* This thread's active arena */
+static THREAD_LOCAL struct gmp_arena *GMP_THREAD_ARENA = NULL; /* This thread's arena, active or not */
 
-void checkLoadAverage (void)
-{
-        double  load;
-        long    recheck_interval;
-        int     i;
+void *(*GMP_DEFAULT_ALLOC)(size_t) = NULL;
+void *(*GMP_DEFAULT_REALLOC)(void *, size_t, size_t) = NULL;
+void (*GMP_DEFAULT_FREE)(void *, size_t) = NULL;
 
-/* Get the load average */
+/* Return this thread's arena if ptr was allocated from it */
 
-        load = get_load_average ();
-        recheck_interval = LOAD_CHECK_TIME;
+struct gmp_arena *gmp_arena_owner (
+        void    *ptr)
+{
+        struct gmp_arena *arena = GMP_THREAD_ARENA;
 
-/* Check if we need to stop one or more workers. */
-/* Wait at least a minute before rechecking the load */
-/* This gives the system time to adjust the average to */
-/* reflect our stopped worker. */
+        if (arena != NULL && arena->base != NULL && (char *) ptr >= arena->base && (char *) ptr < arena->base + arena->size)
+                return (arena);
+        return (NULL);
+}
 
-        if (load >= HI_LOAD) {
-                double  threads_per_worker;
-                int     workers_to_stop;
+void *gmp_arena_alloc (
+        size_t  size)
+{
+        struct gmp_arena *arena = GMP_ARENA;
+        void    *p;
 
-                threads_per_worker = (double) NUM_CPUS / (double) NUM_WORKER_THREADS;
-                if (threads_per_worker < 1.0) threads_per_worker = 1.0;
-                workers_to_stop = (int) ((load - HI_LOAD) / threads_per_worker);
-                if (workers_to_stop < 1) workers_to_stop = 1;
-                STOP_FOR_LOADAVG = workers_to_stop;
-                if (recheck_interval < 65) recheck_interval = 65;
+        if (arena != NULL && GMP_ARENA_ALIGN (size) <= arena->size - arena->offset) {
+                p = arena->base + arena->offset;
+                arena->offset += GMP_ARENA_ALIGN (size);
+                arena->live++;
+                return (p);
         }
+        return ((*GMP_DEFAULT_ALLOC) (size));
+}
 
-/* Check if we need to restart a worker.  We restart workers */
-/* one at a time so that we slowly build the load back up. */
-/* Wait at least a minute before rechecking the load to give the */
-/* system time to adjust the average to reflect our restarted worker. */
+void gmp_arena_free (
+        void    *ptr,
+        size_t  size)
+{
+        struct gmp_arena *arena;
 
-        if (load >= 0.0 && load <= LO_LOAD) {
-                for (i = 0; i < (int) NUM_WORKER_THREADS; i++) {
-                        if (END_LOADAVG_OR_STOP_INITIALIZED[i]) {
-                                restart_one_waiting_worker (i, RESTART_LOADAVG);
-                                if (recheck_interval < 65) recheck_interval = 65;
-                                break;
-                        }
-                }
+        arena = gmp_arena_owner (ptr);
+        if (arena == NULL) {
+                (*GMP_DEFAULT_FREE) (ptr, size);
+                return;
         }
 
-/* Set the timer to check the load average again in the near future */
+/* Give back the space if this was the last allocation.  Once everything */
+/* has been freed, start over at the bottom of the arena. */
 
-        add_timed_event (TE_LOAD_AVERAGE, recheck_interval);
+        if ((char *) ptr + GMP_ARENA_ALIGN (size) == arena->base + arena->offset) arena->offset -= GMP_ARENA_ALIGN (size);
+        if (--arena->live == 0) arena->offset = 0;
 }
 
-/* This routine implements a load average pause for one worker thread */
-
-void implement_loadavg (
-        int     thread_num)
+void *gmp_arena_realloc (
+        void    *ptr,
+        size_t  old_size,
+        size_t  new_size)
 {
-        char    buf[140];
-
-/* Output an informative message. */
+        struct gmp_arena *arena;
+        void    *p;
 
-        sprintf (buf, "Pausing due to high load.\n");
-        OutputStr (thread_num, buf);
-        title (thread_num, "Paused");
+        arena = gmp_arena_owner (ptr);
+        if (arena == NULL) return ((*GMP_DEFAULT_REALLOC) (ptr, old_size, new_size));
 
-/* Wait for the end of the high load */
+/* Grow or shrink the last allocation in place */
 
-        gwevent_init (&END_LOADAVG_OR_STOP[thread_num]);
-        gwevent_reset (&END_LOADAVG_OR_STOP[thread_num]);
-        END_LOADAVG_OR_STOP_INITIALIZED[thread_num] = 1;
-        gwevent_wait (&END_LOADAVG_OR_STOP[thread_num], 0);
-        END_LOADAVG_OR_STOP_INITIALIZED[thread_num] = 0;
-        gwevent_destroy (&END_LOADAVG_OR_STOP[thread_num]);
+        if (arena == GMP_ARENA &&
+            (char *) ptr + GMP_ARENA_ALIGN (old_size) == arena->base + arena->offset &&
+            GMP_ARENA_ALIGN (new_size) <= arena->size - ((char *) ptr - arena->base)) {
+                arena->offset = ((char *) ptr - arena->base) + GMP_ARENA_ALIGN (new_size);
+                return (ptr);
+        }
 
-/* Output another informative message */
+/* Otherwise, move the data */
 
-        OutputStr (thread_num, "Resuming processing.\n");
-        title (thread_num, "Resuming");
+        p = gmp_arena_alloc (new_size);
+        memcpy (p, ptr, old_size < new_size ? old_size : new_size);
+        gmp_arena_free (ptr, old_size);
+        return (p);
 }
 
-/**************************************************************/
-/*             Routines dealing with throttling               */
-/**************************************************************/
-
-int     THROTTLE_SLEEP_TIME_IN_SEC = 0;
-int     THROTTLE_SLEEP_TIME_IN_MS = 0;
+/* Route GMP's allocations through the arena routines.  Called once at startup */
+/* before any worker runs. */
 
-void start_throttle_timer (void)
+void gmp_arena_init (void)
 {
-        if (THROTTLE_PCT <= 0 || THROTTLE_PCT >= 100) return;
-        THROTTLE_SLEEP_TIME_IN_SEC = (int)
-                ((double) TE_THROTTLE_FREQ * (100.0 / (double) THROTTLE_PCT - 1.0));
-        THROTTLE_SLEEP_TIME_IN_MS = (int)
-                ((double) (TE_THROTTLE_FREQ + THROTTLE_SLEEP_TIME_IN_SEC) *
-                          (100.0 - (double) THROTTLE_PCT) * 10.0);
-        add_timed_event (TE_THROTTLE, TE_THROTTLE_FREQ);
+        mp_get_memory_functions (&GMP_DEFAULT_ALLOC, &GMP_DEFAULT_REALLOC, &GMP_DEFAULT_FREE);
+        mp_set_memory_functions (&gmp_arena_alloc, &gmp_arena_realloc, &gmp_arena_free);
 }
 
-void stop_throttle_timer (void)
+/* Return the memory (in MB) held by a worker's arena */
+
+unsigned long gmp_arena_mem (
+        int     thread_num)
 {
-        delete_timed_event (TE_THROTTLE);
+        return ((unsigned long) (GMP_ARENAS[thread_num].size >> 20));
 }
 
-/* Every time the throttle timer fires, this routine is called */
+/* Add or remove a worker's arena from the memory it is using */
 
-int handleThrottleTimerEvent (void)
+void gmp_arena_count_mem (
+        int     thread_num,
+        long    delta)          /* Change in MB */
 {
-        stop_workers_for_throttle ();
+        gwmutex_lock (&MEM_MUTEX);
+        MEM_IN_USE[thread_num] += delta;
+        gwmutex_unlock (&MEM_MUTEX);
+}
 
-/* Assume most threads will pause very soon.  Set timer to fire again */
-/* after the idle time plus TE_THROTTLE_FREQ time.  That way each thread */
-/* will run approximately TE_THROTTLE_FREQ seconds and idle */
-/* THROTTLE_SLEEP_TIME_IN_SEC seconds for a CPU usage of THROTTLE_PCT. */
+/* Free a worker's arena.  Called by the worker when its work unit ends. */
+/* An arena with GMP values still allocated from it is left alone. */
 
-        return (TE_THROTTLE_FREQ + THROTTLE_SLEEP_TIME_IN_SEC);
+void gmp_arena_term (
+        int     thread_num)
+{
+        struct gmp_arena *arena = &GMP_ARENAS[thread_num];
+
+        if (arena->base == NULL || arena->live) return;
+        gmp_arena_count_mem (thread_num, - (long) gmp_arena_mem (thread_num));
+        if (arena->large_pages) large_pages_free (arena->base);
+        else aligned_free (arena->base);
+        arena->base = NULL;
+        arena->size = 0;
+        arena->offset = 0;
 }
 
-/* This routine implements a throttle for one worker thread */
+/* Make this worker's arena the source of GMP memory until gmp_arena_end.  The */
+/* arena is created or grown to fit the number's size.  Values allocated between */
+/* begin and end must be freed before end, and must be freed by this worker. */
 
-void implementThrottle (
-        int     thread_num)
+void gmp_arena_begin (
+        int     thread_num,
+        gwhandle *gwdata)
 {
-        int     totaltime;
+        struct gmp_arena *arena = &GMP_ARENAS[thread_num];
+        size_t  size;
 
-/* Every 0.1 seconds see if we should resume processing.  We check */
-/* frequently so that we can be responsive to an ESC or terminate command. */
+/* GMP puts temporaries smaller than 64KB on the stack, an arena does not */
+/* help numbers that small */
 
-        for (totaltime = 0; totaltime < THROTTLE_SLEEP_TIME_IN_MS; totaltime += 100) {
-                if (WORKER_THREADS_STOPPING) return;
-                Sleep (100);
+        if (GMP_DEFAULT_ALLOC == NULL) return;
+        size = (size_t) (gwdata->bit_length / 8.0) * IniGetInt (INI_FILE, "GmpArenaSize", 14);
+        if (gwdata->bit_length < 524288.0 || size == 0) return;
+        size = (size + 2097151) & ~((size_t) 2097151);
+
+/* Replace an arena that is too small */
+
+        if (arena->base != NULL && arena->size < size) gmp_arena_term (thread_num);
+        if (arena->base == NULL) {
+                arena->large_pages = FALSE;
+                if (gw_using_large_pages (gwdata)) {
+                        arena->base = (char *) large_pages_malloc (size);
+                        arena->large_pages = (arena->base != NULL);
+                }
+                if (arena->base == NULL) arena->base = (char *) aligned_malloc (size, 4096);
+                if (arena->base == NULL) return;
+
+/* Touch every page now, from this thread, so that the GCDs do not pay */
+/* for page faults and the pages land on this worker's NUMA node */
+
+                memset (arena->base, 0, size);
+                arena->size = size;
+                arena->offset = 0;
+                arena->live = 0;
+                gmp_arena_count_mem (thread_num, (long) gmp_arena_mem (thread_num));
         }
+        GMP_ARENA = arena;
+        GMP_THREAD_ARENA = arena;
+}
+
+/* Go back to GMP's default allocator for this thread */
+
+void gmp_arena_end (void)
+{
+        GMP_ARENA = NULL;
 }
 
 /**************************************************************/
@@ -2566,24 +3773,25 @@ int isKnownMersennePrime (
                 p == 82589933);
 }
 
-/* Make a string out of a 96-bit value (a found factor) */
+/* Make a string out of a 128-bit value (a found factor) */
 
 void makestr (
+        unsigned long tsw,
         unsigned long hsw,
         unsigned long msw,
         unsigned long lsw,
         char    *buf)                   /* An 80 character output buffer */
 {
         int     i, j, k, carry;
-        unsigned long x[3];
+        unsigned long x[4];
         char    pow[80];
 
-        x[0] = hsw; x[1] = msw; x[2] = lsw;
+        x[0] = tsw; x[1] = hsw; x[2] = msw; x[3] = lsw;
         for (i = 0; i < 79; i++) pow[i] = '0', buf[i] = '0';
         pow[78] = '1';
         pow[79] = buf[79] = 0;
 
-        for (i = 3; i--; ) {
+        for (i = 4; i--; ) {
                 for (j = 0; j < 32; j++) {
                         if (x[i] & 1) {
                                 carry = 0;
@@ -2834,6 +4042,8 @@ int LaunchAdvancedTime (
         if (ld == NULL) return (OutOfMemory (MAIN_THREAD_NUM));
         if (p >= 9900 && p <= 9919) ld->num_threads = p - 9900 + 1;
         else if (p >= 9920 && p <= 9939) ld->num_threads = p - 9920 + 1;
+        else if (p == 9940) ld->num_threads = NUM_CPUS;
+        else if (p >= 9941 && p <= 9959) ld->num_threads = p - 9940;
         else ld->num_threads = 1;
         ld->p = p;
         ld->iters = iters;
@@ -2918,6 +4128,13 @@ again:  clearThreadHandleArray ();
 
         init_mem_state ();
 
+/* Register with other processes on this host and claim our CPU cores */
+
+        if (LAUNCH_TYPE == LD_CONTINUE) {
+                host_attach ();
+                host_claim_cores ();
+        }
+
 /* Run OS-specific code prior to launching the worker threads */
 
         PreLaunchCallback (LAUNCH_TYPE);
@@ -2957,6 +4174,10 @@ again:  clearThreadHandleArray ();
 /* Start the throttle timer */
 
                 start_throttle_timer ();
+
+/* Start the timer that checks on other processes on this host */
+
+                start_host_timer ();
         }
 
 /* Launch more worker threads if needed */
@@ -3011,6 +4232,11 @@ again:  clearThreadHandleArray ();
                 stop_pause_while_running_timer ();
                 stop_load_average_timer ();
                 stop_throttle_timer ();
+                stop_host_timer ();
+
+/* Give our CPU cores and stage 2 memory back to other processes on this host */
+
+                host_release ();
         }
 
 /* Change the icon */
@@ -3107,6 +4333,8 @@ void LauncherDispatch (void *arg)
 
 /* Change the title bar and output a line to the window */
 
+        gmp_arena_term (ld->thread_num);
+        preemptCheckpointDiscard (ld->thread_num);
         title (ld->thread_num, "Not running");
         OutputStr (ld->thread_num, "Worker stopped.\n");
         ChangeIcon (ld->thread_num, IDLE_ICON);
@@ -3215,6 +4443,7 @@ int primeContinue (
                     w->work_type == WORK_TEST ||
                     w->work_type == WORK_DBLCHK) {
                         stop_reason = prime (thread_num, &sp_info, w, pass);
+                        perf_monitor_done (thread_num);
                 }
 
 /* See if this is an ECM factoring line */
@@ -3233,10 +4462,12 @@ int primeContinue (
 
                 if (w->work_type == WORK_PRP) {
                         stop_reason = prp (thread_num, &sp_info, w, pass);
+                        perf_monitor_done (thread_num);
                 }
 
-/* Set us back to default memory usage */
+/* Free the GMP arena of a P-1 or ECM work unit and set us back to default memory usage */
 
+                gmp_arena_term (thread_num);
                 set_default_memory_usage (thread_num);
 
 /* If the work unit completed, remove it from the worktodo.txt file and move on to the next entry. */
@@ -3294,10 +4525,26 @@ check_stop_code:
 
         if (stop_reason == STOP_PRIORITY_WORK) continue;
 
+/* If another worker wants help with its P-1 stage 2, help and then go */
+/* back to this worker's own work. */
+
+        if (stop_reason == STOP_STAGE2_HELP) {
+                pm1_stage2_help (thread_num, &sp_info);
+                continue;
+        }
+
 /* If we need to restart with the new memory settings, do so. */
 
         if (stop_reason == STOP_MEM_CHANGED) continue;
 
+/* If the performance anomaly detector restarted the work unit, do so. */
+
+        if (stop_reason == STOP_PERF_ANOMALY) continue;
+
+/* If the worker is switching FFT implementations, restart the work unit. */
+
+        if (stop_reason == STOP_FFT_TRIAL) continue;
+
 /* If the user is specifically stopping this worker, then stop until */
 /* the user restarts the worker. */
 
@@ -3772,7 +5019,7 @@ void unlinkSaveFiles (
         writeSaveFileState *state)
 {
         int     i, maxbad;
-        char    unlink_filename[80];
+        char    unlink_filename[256];
 
         maxbad = IniGetInt (INI_FILE, "MaxBadSaveFiles", 10);
         for (i = 1; i <= maxbad; i++) {
@@ -3794,9 +5041,163 @@ void unlinkSaveFiles (
         }
         sprintf (unlink_filename, "%s.write", state->base_filename);
         _unlink (unlink_filename);
+        sprintf (unlink_filename, "%s.s2t", state->base_filename);
+        _unlink (unlink_filename);
+        sprintf (unlink_filename, "%s.s2p", state->base_filename);
+        _unlink (unlink_filename);
         _unlink (state->base_filename);
 }
 
+/* When a worker is preempted to do priority work, the LL or PRP test being */
+/* interrupted is checkpointed in memory.  The binary value the save file writer */
+/* would convert is taken from the test's residue snapshot, so the checkpoint costs */
+/* no extra gwtogiant.  The save file is then written from the checkpoint by a */
+/* background thread while the worker moves on to the priority work.  When the */
+/* worker returns to the test, it resumes from memory rather than rereading the */
+/* save file.  The checkpoint is only used by the worker that created it. */
+
+#define MAX_CHECKPOINT_VALUES   4
+
+struct preempt_checkpoint {
+        int     valid;                  /* TRUE if a checkpoint was taken */
+        int     thread_num;             /* Worker that took the checkpoint */
+        struct work_unit w;             /* Copy of the work unit checkpointed */
+        char    state[256];             /* Copy of the test's scalar state */
+        int     num_values;             /* Number of gwnums checkpointed */
+        giant   values[MAX_CHECKPOINT_VALUES]; /* Binary values of the gwnums */
+        writeSaveFileState write_save_file_state; /* Save files written from the checkpoint */
+        int     (*write_save_file)(struct preempt_checkpoint *); /* Writes a save file from the checkpoint */
+        int     writer_active;          /* TRUE if the background writer was started */
+        gwthread writer;                /* Background save file writer */
+} PREEMPT_CHECKPOINT[MAX_NUM_WORKER_THREADS] = {0};
+
+/* Background thread that writes the save file from a checkpoint */
+
+void preemptCheckpointWriter (
+        void    *arg)
+{
+        struct preempt_checkpoint *cp = (struct preempt_checkpoint *) arg;
+        char    buf[200];
+
+        if (! (*cp->write_save_file) (cp)) {
+                sprintf (buf, WRITEFILEERR, cp->write_save_file_state.base_filename);
+                OutputBoth (cp->thread_num, buf);
+        }
+}
+
+/* Free a worker's checkpoint.  Waits for the background save file write to finish. */
+
+void preemptCheckpointDiscard (
+        int     thread_num)
+{
+        struct preempt_checkpoint *cp = &PREEMPT_CHECKPOINT[thread_num];
+        int     i;
+
+        if (cp->writer_active) {
+                gwthread_wait_for_exit (&cp->writer);
+                cp->writer_active = FALSE;
+        }
+        for (i = 0; i < MAX_CHECKPOINT_VALUES; i++) {
+                free (cp->values[i]);
+                cp->values[i] = NULL;
+        }
+        cp->valid = FALSE;
+}
+
+/* Take an in-memory checkpoint of a test that is being preempted and start */
+/* writing its save file in the background.  Returns FALSE if no checkpoint */
+/* was taken, in which case the caller must write the save file itself. */
+
+int preemptCheckpointSave (
+        int     thread_num,
+        struct work_unit *w,
+        void    *state,                 /* Scalar state to copy */
+        size_t  state_size,
+        gwhandle *gwdata,
+        residue_snapshot *snap,         /* Shared binary value of one of the gwnums or NULL */
+        int     num_values,
+        gwnum   *values,                /* Gwnums to copy, NULL entries are skipped */
+        writeSaveFileState *write_save_file_state,
+        int     (*write_save_file)(struct preempt_checkpoint *))
+{
+        struct preempt_checkpoint *cp = &PREEMPT_CHECKPOINT[thread_num];
+        int     i;
+
+        preemptCheckpointDiscard (thread_num);
+        if (state_size > sizeof (cp->state) || num_values > MAX_CHECKPOINT_VALUES) return (FALSE);
+        if (!IniGetInt (INI_FILE, "PreemptCheckpoint", 1)) return (FALSE);
+
+/* Take ownership of the snapshot's binary value, convert any other gwnums */
+
+        for (i = 0; i < num_values; i++) {
+                if (values[i] == NULL) continue;
+                cp->values[i] = residue_snapshot_release (snap, values[i]);
+                if (cp->values[i] != NULL) continue;
+                cp->values[i] = allocgiant (((int) gwdata->bit_length >> 5) + 10);
+                if (cp->values[i] == NULL || gwtogiant (gwdata, values[i], cp->values[i])) {
+                        preemptCheckpointDiscard (thread_num);
+                        return (FALSE);
+                }
+        }
+
+/* Copy the work unit.  Its linked list and string pointers must not be used. */
+
+        cp->thread_num = thread_num;
+        cp->w = *w;
+        cp->w.known_factors = NULL;
+        cp->w.comment = NULL;
+        cp->w.next = cp->w.prev = NULL;
+        memcpy (cp->state, state, state_size);
+        cp->num_values = num_values;
+        cp->write_save_file_state = *write_save_file_state;
+        cp->write_save_file = write_save_file;
+        cp->valid = TRUE;
+
+/* Write the save file in the background */
+
+        gwthread_create_waitable (&cp->writer, &preemptCheckpointWriter, cp);
+        cp->writer_active = TRUE;
+        return (TRUE);
+}
+
+/* Resume a test from a worker's in-memory checkpoint.  Returns TRUE if the */
+/* checkpoint was for this work unit, FALSE if the save file must be read. */
+/* Either way the checkpoint is consumed. */
+
+int preemptCheckpointRestore (
+        int     thread_num,
+        struct work_unit *w,
+        void    *state,                 /* Scalar state to fill in */
+        size_t  state_size,
+        gwhandle *gwdata,
+        int     num_values,
+        gwnum   *values)                /* Gwnums to fill in, NULL entries are skipped */
+{
+        struct preempt_checkpoint *cp = &PREEMPT_CHECKPOINT[thread_num];
+        int     i, match;
+
+/* Let the background writer finish before the test writes save files of its own */
+
+        if (cp->writer_active) {
+                gwthread_wait_for_exit (&cp->writer);
+                cp->writer_active = FALSE;
+        }
+
+        match = (cp->valid &&
+                 cp->w.work_type == w->work_type &&
+                 cp->w.k == w->k && cp->w.b == w->b && cp->w.n == w->n && cp->w.c == w->c &&
+                 cp->num_values == num_values);
+        for (i = 0; match && i < num_values; i++)
+                if ((values[i] == NULL) != (cp->values[i] == NULL)) match = FALSE;
+        if (match) {
+                memcpy (state, cp->state, state_size);
+                for (i = 0; i < num_values; i++)
+                        if (values[i] != NULL) gianttogw (gwdata, cp->values[i], values[i]);
+        }
+        preemptCheckpointDiscard (thread_num);
+        return (match);
+}
+
 /************************/
 /* Trial Factoring code */
 /************************/
@@ -3818,6 +5219,7 @@ struct facasm_data {
         uint32_t firstcall;             /* Flag set on first facpasssetup */
         uint32_t pad[5];
         uint32_t xmm_data[188];         /* XMM data initialized in C code */
+        uint32_t FACTSW;                /* Top word of found factor (always zero, 32-bit code is limited to 2^96) */
 };
 
 /* This defines the factoring data handled in C code.  The handle */
@@ -4040,6 +5442,8 @@ struct facasm_data {
         uint32_t xmm_data[80];          /* XMM/YMM/ZMM data initialized in C code */
 
         uint32_t other_asm_temps_and_consts[600];
+
+        uint32_t FACTSW;                /* Top word of found factor.  Only the C code (factor128_tf) uses this. */
 };
 
 /* This defines the factoring data handled in C code.  The handle */
@@ -4097,6 +5501,7 @@ typedef struct {
         struct  facasm_data *asm_data;          /* Main thread's memory for assembly factoring code */
         int     factoring_pass;                 /* Which of the 16 factoring passes we are on */
         int     pass_complete;                  /* Set when a factoring pass completes */
+        int     tf128;                          /* Set when this pass's factors are above 2^96 and factor128_tf must do the TF */
         uint32_t initsieve_primes;              /* Which primes are sieved when initializing from initsieve */
         uint32_t one_eighth_initsieve_primes;   /* (1 / (8 * facdist1)) mod initsieve_primes.  Used to calculate first byte to copy from initsieve */
         uint32_t *modinvarray;                  /* Modular inverse of facdist for each sieving prime.  Used to set offsetarray. */
@@ -4106,6 +5511,7 @@ typedef struct {
         uint32_t found_lsw[MAX_TF_FOUND_COUNT]; /* LSW of a found factor */
         uint32_t found_msw[MAX_TF_FOUND_COUNT]; /* MSW of a found factor */
         uint32_t found_hsw[MAX_TF_FOUND_COUNT]; /* HSW of a found factor */
+        uint32_t found_tsw[MAX_TF_FOUND_COUNT]; /* TSW of a found factor */
         uint32_t found_count;                   /* Count of found factors */
         unsigned int num_active_threads;        /* Count of the number of active auxiliary threads */
         int     threads_must_exit;              /* Flag set to force all auxiliary threads to terminate */
@@ -4138,6 +5544,10 @@ EXTERNC int factor64_small (struct facasm_data *);      /* Assembly code, brute
 EXTERNC int factor64_sieve (struct facasm_data *);      /* Assembly code, sieve a block */
 EXTERNC int factor64_tf (struct facasm_data *);         /* Assembly code, TF a sieved block */
 
+/* C entry points */
+
+int factor128_tf (struct facasm_data *);                /* C code, TF a sieved block of factors above 2^96 */
+
 /* Forward declarations */
 
 int factorChunkMultithreaded (fachandle *facdata, struct facasm_data *asm_data, int aux_thread_num);
@@ -4582,27 +5992,34 @@ int factorPassSetup (
         fachandle *facdata)             /* Handle returned by factorSetup */
 {
         struct facasm_data *asm_data = facdata->asm_data;
-        uint32_t fachsw, facmsw;
+        uint32_t factsw, fachsw, facmsw;
         unsigned int i, j, bits_in_factor;
 
 /* Save the factoring pass */
 
         facdata->factoring_pass = pass;
 
-/* FACHSW/FACMSW specifies a floor for the first factor */
+/* FACTSW/FACHSW/FACMSW specifies a floor for the first factor */
 /* Start sieving at or above 2^44 (we brute force below 2^44) */
 
+        factsw = asm_data->FACTSW;
         fachsw = asm_data->FACHSW;
         facmsw = asm_data->FACMSW;
-        if (fachsw == 0 && facmsw < 0x1000) facmsw = 0x1000;
+        if (factsw == 0 && fachsw == 0 && facmsw < 0x1000) facmsw = 0x1000;
 
 /* Compute the number of bits in the factors we will be testing */
 
-        if (fachsw) i = fachsw, bits_in_factor = 64;
+        if (factsw) i = factsw, bits_in_factor = 96;
+        else if (fachsw) i = fachsw, bits_in_factor = 64;
         else i = facmsw, bits_in_factor = 32;
         while (i) bits_in_factor++, i >>= 1;
         if (bits_in_factor < 50) bits_in_factor = 50;           // PrimeFactor does 2^44 to 2^50 in one pass
 
+/* The assembly code handles factors up to 2^96.  Above that factor128_tf does the TF */
+/* and none of the assembly code constants below are needed. */
+
+        facdata->tf128 = (bits_in_factor > 96);
+
 /* Initialization for AVX512 FMA code using 2 doubles to factor numbers 45 bits and above. */
 /* We need to initialize the following data: */
 /*      FMA_SHIFTER             DD      32 DUP (0)      ; Up to 32 dword shifter values
@@ -4617,7 +6034,7 @@ int factorPassSetup (
         ZMM_FMA_TWO_TO_LO       DQ      0               ; 2^BITS_IN_LO_WORD
 */
 
-        if (bits_in_factor >= 45 && (asm_data->cpu_flags & CPU_AVX512F)) {
+        if (!facdata->tf128 && bits_in_factor >= 45 && (asm_data->cpu_flags & CPU_AVX512F)) {
                 uint32_t *dword_data;
                 double  *zmm_data;
                 uint64_t *zmm64_data;
@@ -4677,7 +6094,7 @@ int factorPassSetup (
         YMM_FMA_TWO_TO_LO       DQ      4 DUP           ; 2^BITS_IN_LO_WORD
 */
 
-        else if (bits_in_factor >= 45 && (asm_data->cpu_flags & CPU_FMA3)) {
+        else if (!facdata->tf128 && bits_in_factor >= 45 && (asm_data->cpu_flags & CPU_FMA3)) {
                 uint32_t *dword_data;
                 double  *ymm_data;
                 uint64_t *ymm64_data;
@@ -4731,7 +6148,7 @@ int factorPassSetup (
         XMM_BS                  DD      0,0
         XMM_SHIFTER             DD      64 DUP (0) */
 
-        else if (bits_in_factor >= 64 && (asm_data->cpu_flags & (CPU_SSE2 | CPU_AVX2))) {
+        else if (!facdata->tf128 && bits_in_factor >= 64 && (asm_data->cpu_flags & (CPU_SSE2 | CPU_AVX2))) {
                 uint32_t *xmm_data;
                 unsigned long p;
 
@@ -4766,9 +6183,9 @@ int factorPassSetup (
                         uint64_t rem;
                         uint32_t rems[16] = {1,7,17,23,31,41,47,49,71,73,79,89,97,103,113,119};
 
-                        // fachsw/facmsw specifies a floor for the first factor
+                        // factsw/fachsw/facmsw specifies a floor for the first factor
 
-                        savefac0 = fachsw;
+                        savefac0 = ((uint64_t) factsw << 32) + fachsw;
                         savefac1 = ((uint64_t) facmsw) << 32;
 
                         // Find next integer of the form 2kp+1
@@ -4808,12 +6225,15 @@ int factorPassSetup (
                 facdata->sievers[i].state = SIEVER_UNINITIALIZED;
 
 /* Calculate number of calls we will need to make to factor64_sieve.  Be careful when reading a save file, the first */
-/* factor could be just over the next power of two meaning there are no areas to sieve. */
+/* factor could be just over the next power of two meaning there are no areas to sieve.  Above 2^96 the count */
+/* can overflow 64 bits -- cap it at a value we will never reach. */
 
                 first_factor = (double) savefac0 * pow (2.0, 64.0) + (double) savefac1;
-                if (facdata->endpt > first_factor)
-                        facdata->sievers[i].num_areas_to_sieve = (uint64_t) ((facdata->endpt - first_factor) / (double) asm_data->facdist12K) + 1;
-                else
+                if (facdata->endpt > first_factor) {
+                        double  num_areas = (facdata->endpt - first_factor) / (double) asm_data->facdist12K + 1.0;
+                        if (num_areas > 1.0e15) num_areas = 1.0e15;
+                        facdata->sievers[i].num_areas_to_sieve = (uint64_t) num_areas;
+                } else
                         facdata->sievers[i].num_areas_to_sieve = 0;
                 facdata->total_num_areas_to_sieve += facdata->sievers[i].num_areas_to_sieve;
         }
@@ -4822,7 +6242,7 @@ int factorPassSetup (
 
         asm_data->savefac0 = facdata->sievers[0].next_sieve_first_factor[0];
         asm_data->savefac1 = facdata->sievers[0].next_sieve_first_factor[1];
-        factor64_pass_setup (asm_data);
+        if (!facdata->tf128) factor64_pass_setup (asm_data);
 
 /* Start each sieving-capable thread with a different siever */
 
@@ -4889,6 +6309,175 @@ void factorPassSetupPart2 (
         }
 }
 
+/* Trial factor a sieved block of factors above 2^96.  The assembly code's floating point tricks run */
+/* out of bits here, so we use Montgomery multiplication on two 64-bit words.  This limits us to */
+/* factors below 2^127.  To give the CPU's multipliers independent work, candidate factors are */
+/* collected in batches and exponentiated in lockstep. */
+
+#define TF128_BATCH     8
+
+static __inline uint64_t mul_64x64 (            /* Return low 64 bits of a 128-bit product */
+        uint64_t a,
+        uint64_t b,
+        uint64_t *hi)                           /* Returned high 64 bits of the product */
+{
+#ifdef _MSC_VER
+        return (_umul128 (a, b, hi));
+#else
+        unsigned __int128 t = (unsigned __int128) a * b;
+        *hi = (uint64_t) (t >> 64);
+        return ((uint64_t) t);
+#endif
+}
+
+/* Montgomery square of x mod q, R = 2^128.  Requires x < q < 2^127 and qinv = -1/q mod 2^64. */
+
+static __inline void mont_sqr128 (
+        uint64_t *xhi,
+        uint64_t *xlo,
+        uint64_t qhi,
+        uint64_t qlo,
+        uint64_t qinv)
+{
+        uint64_t t0, t1, t2, t3, dhi, dlo, phi, plo, m, c;
+
+/* Compute the 4-word square.  The cross product 2*xlo*xhi fits in 128 bits because xhi < 2^63. */
+
+        t0 = mul_64x64 (*xlo, *xlo, &t1);
+        t2 = mul_64x64 (*xhi, *xhi, &t3);
+        dlo = mul_64x64 (*xlo, *xhi, &dhi);
+        dhi = (dhi << 1) | (dlo >> 63);
+        dlo <<= 1;
+        t1 += dlo; c = (t1 < dlo);
+        t2 += c; c = (t2 < c);
+        t2 += dhi; c += (t2 < dhi);
+        t3 += c;
+
+/* Two word-by-word reduction steps, each zeroing the bottom word */
+
+        m = t0 * qinv;
+        plo = mul_64x64 (m, qlo, &phi);
+        t0 += plo; phi += (t0 < plo);
+        t1 += phi; c = (t1 < phi);
+        plo = mul_64x64 (m, qhi, &phi);
+        t1 += plo; c += (t1 < plo);
+        phi += c;
+        t2 += phi; t3 += (t2 < phi);
+
+        m = t1 * qinv;
+        plo = mul_64x64 (m, qlo, &phi);
+        t1 += plo; phi += (t1 < plo);
+        t2 += phi; c = (t2 < phi);
+        plo = mul_64x64 (m, qhi, &phi);
+        t2 += plo; c += (t2 < plo);
+        t3 += phi + c;
+
+/* The result is less than 2q.  Subtract q if necessary. */
+
+        if (t3 > qhi || (t3 == qhi && t2 >= qlo)) {
+                t3 -= qhi + (t2 < qlo);
+                t2 -= qlo;
+        }
+        *xhi = t3;
+        *xlo = t2;
+}
+
+/* Double x mod q.  Requires x < q < 2^127. */
+
+#define dbl_mod128(xhi,xlo,qhi,qlo) { \
+        xhi = (xhi << 1) | (xlo >> 63); xlo <<= 1; \
+        if (xhi > qhi || (xhi == qhi && xlo >= qlo)) { xhi -= qhi + (xlo < qlo); xlo -= qlo; } }
+
+/* Compute 2^p mod q for a batch of candidate factors.  Return the index of the first factor found or -1. */
+
+static int tf128_batch (
+        uint64_t p,
+        uint64_t *qhi,
+        uint64_t *qlo,
+        int     count)
+{
+        uint64_t qinv[TF128_BATCH], onehi[TF128_BATCH], onelo[TF128_BATCH], xhi[TF128_BATCH], xlo[TF128_BATCH];
+        int     i, j, bit;
+
+/* Compute -1/q mod 2^64 using Newton iterations (q is its own inverse mod 8) and R mod q by doubling */
+/* the largest power of two below q until we reach 2^128.  Start each x at 2 in Montgomery form. */
+
+        for (j = 0; j < count; j++) {
+                uint64_t inv = qlo[j];
+                for (i = 0; i < 5; i++) inv *= 2 - qlo[j] * inv;
+                qinv[j] = 0 - inv;
+                for (bit = 63; !(qhi[j] >> bit); bit--);
+                onehi[j] = 1ULL << bit;
+                onelo[j] = 0;
+                for (i = bit + 64; i < 128; i++) dbl_mod128 (onehi[j], onelo[j], qhi[j], qlo[j]);
+                xhi[j] = onehi[j];
+                xlo[j] = onelo[j];
+                dbl_mod128 (xhi[j], xlo[j], qhi[j], qlo[j]);
+        }
+
+/* Left-to-right binary exponentiation of the remaining bits of p */
+
+        for (bit = 63; !(p >> bit); bit--);
+        while (bit--) {
+                for (j = 0; j < count; j++) {
+                        mont_sqr128 (&xhi[j], &xlo[j], qhi[j], qlo[j], qinv[j]);
+                        if ((p >> bit) & 1) dbl_mod128 (xhi[j], xlo[j], qhi[j], qlo[j]);
+                }
+        }
+
+/* Q is a factor if 2^p mod q is one */
+
+        for (j = 0; j < count; j++)
+                if (xhi[j] == onehi[j] && xlo[j] == onelo[j]) return (j);
+        return (-1);
+}
+
+int factor128_tf (                      /* Return 1 if factor found, 2 if factor not found */
+        struct facasm_data *asm_data)
+{
+        uint64_t qhi[TF128_BATCH], qlo[TF128_BATCH];
+        unsigned char *sieve;
+        uint32_t i;
+        int     bit, count, found;
+
+/* Collect the candidates that survived sieving.  Bit i represents the factor savefac + i * facdist. */
+
+        sieve = (unsigned char *) asm_data->sieve;
+        count = 0;
+        for (i = 0; i < SIEVE_SIZE_IN_BYTES; i++) {
+                if (sieve[i] == 0) continue;
+                for (bit = 0; bit < 8; bit++) {
+                        uint64_t hi, lo;
+                        if (!(sieve[i] & (1 << bit))) continue;
+                        lo = mul_64x64 (i * 8 + bit, asm_data->facdists[1], &hi);
+                        lo += asm_data->savefac1;
+                        hi += asm_data->savefac0 + (lo < asm_data->savefac1);
+                        if (hi >> 63) continue;                 // Beyond what we can handle (and the end of the bit level)
+                        qhi[count] = hi;
+                        qlo[count] = lo;
+                        if (++count < TF128_BATCH) continue;
+
+/* Test a full batch, return the factor if one is found */
+
+                        found = tf128_batch (asm_data->p, qhi, qlo, count);
+                        if (found >= 0) goto found_factor;
+                        count = 0;
+                }
+        }
+        if (count) {
+                found = tf128_batch (asm_data->p, qhi, qlo, count);
+                if (found >= 0) goto found_factor;
+        }
+        return (2);
+
+found_factor:
+        asm_data->FACTSW = (uint32_t) (qhi[found] >> 32);
+        asm_data->FACHSW = (uint32_t) qhi[found];
+        asm_data->FACMSW = (uint32_t) (qlo[found] >> 32);
+        asm_data->FACLSW = (uint32_t) qlo[found];
+        return (1);
+}
+
 /* Factor one "chunk" single-threaded.  The assembly code decides how big a chunk is. */
 
 #define FACTOR_CHUNK_SIZE       (SIEVE_SIZE_IN_BYTES >> 10)             // 64-bit sieve processes one 12KB sieve
@@ -4901,13 +6490,14 @@ int factorChunk (                       /* Return 1 if factor found, 2 if factor
 
 /* If we're looking for factors below 2^44, use special brute force code */
 
-        if (facdata->factoring_pass == 0 && asm_data->FACHSW == 0 && asm_data->FACMSW < 0x1000) {
+        if (facdata->factoring_pass == 0 && asm_data->FACTSW == 0 && asm_data->FACHSW == 0 && asm_data->FACMSW < 0x1000) {
                 asm_data->savefac1 = 2 * (uint64_t) asm_data->p + 1;            // First factor to test is 2*p+1
                 while (factor64_small (asm_data) == 1) {                        // Remember the found factor
                         if (facdata->found_count < MAX_TF_FOUND_COUNT) {        // I doubt we'll find more than 10 factors
                                 facdata->found_lsw[facdata->found_count] = (uint32_t) asm_data->savefac1;
                                 facdata->found_msw[facdata->found_count] = (uint32_t) (asm_data->savefac1 >> 32);
                                 facdata->found_hsw[facdata->found_count] = 0;
+                                facdata->found_tsw[facdata->found_count] = 0;
                                 facdata->found_count++;
                         }
                         asm_data->savefac1 += 2 * (uint64_t) asm_data->p;       // Calculate next factor to test
@@ -4937,6 +6527,7 @@ int factorChunk (                       /* Return 1 if factor found, 2 if factor
                 asm_data->FACLSW = facdata->found_lsw[facdata->found_count];
                 asm_data->FACMSW = facdata->found_msw[facdata->found_count];
                 asm_data->FACHSW = facdata->found_hsw[facdata->found_count];
+                asm_data->FACTSW = facdata->found_tsw[facdata->found_count];
                 return (1);                                     // Return factor found
         }
         return (2);                                             // Return factor not found
@@ -5130,13 +6721,15 @@ tf:     if (!facdata->pooling)
         asm_data->savefac1 = sieve_area->first_factor[1];
         asm_data->sieve = sieve_area->sieve;
         gwmutex_unlock (&facdata->thread_lock);
-        res = factor64_tf (asm_data);
+        res = facdata->tf128 ? factor128_tf (asm_data) : factor64_tf (asm_data);
         gwmutex_lock (&facdata->thread_lock);
         if (res == 1) {                                                 /* Remember a found factor */
                 // On first found factor, only sieve areas below the found factor
                 if (facdata->found_count == 0 && !IniGetInt (INI_FILE, "TFFullBitLevel", 0)) {
-                        double factor = ((double) asm_data->FACHSW * 4294967296.0 + (double) asm_data->FACMSW) * 4294967296.0;
-                        uint64_t reduction = (uint64_t) ((facdata->endpt - factor) / (double) asm_data->facdist12K);
+                        double factor = (((double) asm_data->FACTSW * 4294967296.0 + (double) asm_data->FACHSW) * 4294967296.0 +
+                                         (double) asm_data->FACMSW) * 4294967296.0;
+                        double  areas_above = (facdata->endpt - factor) / (double) asm_data->facdist12K;
+                        uint64_t reduction = (uint64_t) (areas_above < 1.0e15 ? areas_above : 1.0e15);
                         for (i = 0; i < facdata->num_sievers; i++) {
                                 if (facdata->sievers[i].num_areas_to_sieve >= reduction) {
                                         facdata->total_num_chunks_to_TF -= reduction;
@@ -5155,6 +6748,7 @@ tf:     if (!facdata->pooling)
                         facdata->found_lsw[facdata->found_count] = asm_data->FACLSW;
                         facdata->found_msw[facdata->found_count] = asm_data->FACMSW;
                         facdata->found_hsw[facdata->found_count] = asm_data->FACHSW;
+                        facdata->found_tsw[facdata->found_count] = asm_data->FACTSW;
                         facdata->found_count++;
                 }
         }
@@ -5183,31 +6777,31 @@ void factorFindSmallestNotTFed (
         fachandle *facdata)             /* Handle returned by factorSetup */
 {
         int     i, j;
-        uint64_t smallest, temp;
+        uint64_t *smallest, *temp;
         struct facasm_data *asm_data = facdata->asm_data;
 
 /* Search for the smallest sieved area.  If there are no sieved areas, we'll end up */
-/* returning the next factor to sieve. */
+/* returning the next factor to sieve.  Factors are 128-bit values, most significant word first. */
 
         gwmutex_lock (&facdata->thread_lock);
-        for (i = 0; i < facdata->num_sievers; i++) {
-                temp = (facdata->sievers[i].next_sieve_first_factor[0] << 32) +
-                       (facdata->sievers[i].next_sieve_first_factor[1] >> 32);
-                if (i == 0 || temp < smallest) smallest = temp;
+        smallest = facdata->sievers[0].next_sieve_first_factor;
+        for (i = 1; i < facdata->num_sievers; i++) {
+                temp = facdata->sievers[i].next_sieve_first_factor;
+                if (temp[0] < smallest[0] || (temp[0] == smallest[0] && temp[1] < smallest[1])) smallest = temp;
         }
         for (i = 0; i < facdata->num_pools; i++) {
                 for (j = 0; j < facdata->num_sieve_areas_per_pool; j++) {
                         if (facdata->pools[i].sieve_areas[j].state != SIEVE_AREA_SIEVED) continue;
-                        temp = (facdata->pools[i].sieve_areas[j].first_factor[0] << 32) +
-                               (facdata->pools[i].sieve_areas[j].first_factor[1] >> 32);
-                        if (temp < smallest) smallest = temp;
+                        temp = facdata->pools[i].sieve_areas[j].first_factor;
+                        if (temp[0] < smallest[0] || (temp[0] == smallest[0] && temp[1] < smallest[1])) smallest = temp;
                 }
         }
 
-/* Return the information in FACHSW, FACMSW. */
+/* Return the information in FACTSW, FACHSW, FACMSW. */
 
-        asm_data->FACHSW = (uint32_t) (smallest >> 32);
-        asm_data->FACMSW = (uint32_t) smallest;
+        asm_data->FACTSW = (uint32_t) (smallest[0] >> 32);
+        asm_data->FACHSW = (uint32_t) smallest[0];
+        asm_data->FACMSW = (uint32_t) (smallest[1] >> 32);
         gwmutex_unlock (&facdata->thread_lock);
 }
 
@@ -5221,6 +6815,7 @@ int getAnotherFactorIfAny (
         facdata->asm_data->FACLSW = facdata->found_lsw[facdata->found_count];
         facdata->asm_data->FACMSW = facdata->found_msw[facdata->found_count];
         facdata->asm_data->FACHSW = facdata->found_hsw[facdata->found_count];
+        facdata->asm_data->FACTSW = facdata->found_tsw[facdata->found_count];
         return (TRUE);
 }
 
@@ -5234,7 +6829,12 @@ static const char FACMSG[] = "Trial factoring M%ld to 2^%d is %.*f%% complete.";
 static const char SHORT_FACMSG[] = "Trial factoring M%ld to 2^%d.";
 
 #define FACTOR_MAGICNUM         0x1567234D
-#define FACTOR_VERSION          1
+#define FACTOR_VERSION          2                       /* Version 2 added the top words needed for factors above 2^96 */
+
+/* Test if the factoring position (bits 32 and up of the next factor to test) has reached an end point */
+
+#define FACPOS_GE(a,tsw,hsw,msw)        ((a)->FACTSW > (tsw) || ((a)->FACTSW == (tsw) && \
+                                         ((a)->FACHSW > (hsw) || ((a)->FACHSW == (hsw) && (a)->FACMSW >= (msw)))))
 
 int primeFactor (
         int     thread_num,
@@ -5249,7 +6849,7 @@ int primeFactor (
         long    factor_found;           /* Returns true if factor found */
         int     fd;                     /* Continuation file handle or zero */
         int     first_iter_msg, continuation, stop_reason, find_smaller_factor;
-        unsigned long endpthi, endptlo;
+        unsigned long endpttsw, endpthi, endptlo;
         double  endpt, startpt;         /* For computing percent complete */
         unsigned long pass;             /* Factoring pass 0 through 15 */
         unsigned long report_bits;      /* When to report results one bit */
@@ -5313,6 +6913,20 @@ begin:  factor_found = 0;
                 test_bits = 78;
         }
 
+/* Note: Factors above 2^96 are only supported by the 64-bit C code, which stops at 2^127. */
+
+#ifdef X86_64
+        if (test_bits > 127) {
+                OutputBoth (thread_num, "Trial factoring code cannot go above 2^127.\n");
+                test_bits = 127;
+        }
+#else
+        if (test_bits > 96) {
+                OutputBoth (thread_num, "32-bit trial factoring code cannot go above 2^96.\n");
+                test_bits = 96;
+        }
+#endif
+
 /* Check for a v24 continuation file.  These were named pXXXXXXX.  The */
 /* first 16 bits contained a 2 to distinguish it from a LL save file. */
 /* In v25, we name the file fXXXXXXX and use the common header format */
@@ -5341,6 +6955,8 @@ begin:  factor_found = 0;
                     read_long (fd, &endpthi, NULL) &&
                     read_long (fd, &endptlo, NULL)) {
                         OutputBoth (thread_num, "Using old-style factoring save file.\n");
+                        endpttsw = 0;
+                        facdata.asm_data->FACTSW = 0;
                         facdata.asm_data->FACHSW = fachsw;
                         facdata.asm_data->FACMSW = facmsw;
                         factor_found = file_factor_found;
@@ -5377,10 +6993,11 @@ begin:  factor_found = 0;
 
                 fd = _open (read_save_file_state.current_filename, _O_BINARY | _O_RDONLY);
                 if (fd > 0) {
-                        unsigned long version, sum, fachsw, facmsw;
+                        unsigned long version, sum, factsw, fachsw, facmsw;
+                        factsw = endpttsw = 0;
                         if (read_magicnum (fd, FACTOR_MAGICNUM) &&
                             read_header (fd, &version, w, &sum) &&
-                            version == FACTOR_VERSION &&
+                            version >= 1 && version <= FACTOR_VERSION &&
                             read_long (fd, (unsigned long *) &factor_found, NULL) &&
                             read_long (fd, &bits, NULL) &&
                             read_long (fd, &pass, NULL) &&
@@ -5388,7 +7005,10 @@ begin:  factor_found = 0;
                             read_long (fd, &facmsw, NULL) &&
                             read_long (fd, &endpthi, NULL) &&
                             read_long (fd, &endptlo, NULL) &&
-                            (fachsw < endpthi || (fachsw == endpthi && facmsw < endptlo))) {
+                            (version < 2 || (read_long (fd, &factsw, NULL) && read_long (fd, &endpttsw, NULL))) &&
+                            (factsw < endpttsw || (factsw == endpttsw &&
+                             (fachsw < endpthi || (fachsw == endpthi && facmsw < endptlo))))) {
+                                facdata.asm_data->FACTSW = factsw;
                                 facdata.asm_data->FACHSW = fachsw;
                                 facdata.asm_data->FACMSW = facmsw;
                                 continuation = TRUE;
@@ -5447,11 +7067,17 @@ begin:  factor_found = 0;
 
             if (!continuation) {
                 if (end_bits < 64) {
+                        endpttsw = 0;
                         endpthi = 0;
                         endptlo = 1L << (end_bits-32);
-                } else {
+                } else if (end_bits < 96) {
+                        endpttsw = 0;
                         endpthi = 1L << (end_bits-64);
                         endptlo = 0;
+                } else {
+                        endpttsw = 1L << (end_bits-96);
+                        endpthi = 0;
+                        endptlo = 0;
                 }
             }
 
@@ -5459,7 +7085,7 @@ begin:  factor_found = 0;
 
             if (bits < 32) startpt = 0.0;
             else startpt = pow ((double) 2.0, (int) (bits-32));
-            endpt = endpthi * 4294967296.0 + endptlo;
+            endpt = (endpttsw * 4294967296.0 + endpthi) * 4294967296.0 + endptlo;
 
 /* Sixteen passes.  Two for the 1 or 7 mod 8 factors times two for the */
 /* 1 or 2 mod 3 factors times four for the 1, 2, 3, or 4 mod 5 factors. */
@@ -5477,21 +7103,26 @@ begin:  factor_found = 0;
                 if (continuation)
                         continuation = FALSE;
                 else {
+                        facdata.asm_data->FACTSW = 0;
                         if (bits < 50) {
                                 facdata.asm_data->FACHSW = 0;
                                 facdata.asm_data->FACMSW = 0;
                         } else if (bits < 64) {
                                 facdata.asm_data->FACHSW = 0;
                                 facdata.asm_data->FACMSW = 1L << (bits-32);
-                        } else {
+                        } else if (bits < 96) {
                                 facdata.asm_data->FACHSW = 1L << (bits-64);
                                 facdata.asm_data->FACMSW = 0;
+                        } else {
+                                facdata.asm_data->FACTSW = 1L << (bits-96);
+                                facdata.asm_data->FACHSW = 0;
+                                facdata.asm_data->FACMSW = 0;
                         }
                 }
 
 /* Only test for factors less than 2^32 on the first pass */
 
-                if (facdata.asm_data->FACHSW == 0 &&
+                if (facdata.asm_data->FACTSW == 0 && facdata.asm_data->FACHSW == 0 &&
                     facdata.asm_data->FACMSW == 0 && pass != 0)
                         facdata.asm_data->FACMSW = 1;
 
@@ -5524,7 +7155,8 @@ begin:  factor_found = 0;
                         if (res == 1) {
                                 stackgiant (f, 10);
                                 stackgiant (x, 10);
-                                itog ((int) facdata.asm_data->FACHSW, f); gshiftleft (32, f);
+                                itog ((int) facdata.asm_data->FACTSW, f); gshiftleft (32, f);
+                                uladdg (facdata.asm_data->FACHSW, f); gshiftleft (32, f);
                                 uladdg (facdata.asm_data->FACMSW, f); gshiftleft (32, f);
                                 uladdg (facdata.asm_data->FACLSW, f);
                                 itog (2, x);
@@ -5608,10 +7240,9 @@ begin:  factor_found = 0;
 
                         if (stop_reason || testSaveFilesFlag (thread_num)) {
                                 factorFindSmallestNotTFed (&facdata);
-                                if (facdata.asm_data->FACHSW > endpthi ||
-                                    (facdata.asm_data->FACHSW == endpthi && facdata.asm_data->FACMSW >= endptlo)) {
-                                        if (endptlo == 0) facdata.asm_data->FACHSW = endpthi - 1;
-                                        else facdata.asm_data->FACHSW = endpthi;
+                                if (FACPOS_GE (facdata.asm_data, endpttsw, endpthi, endptlo)) {
+                                        facdata.asm_data->FACTSW = (endptlo == 0 && endpthi == 0) ? endpttsw - 1 : endpttsw;
+                                        facdata.asm_data->FACHSW = (endptlo == 0) ? endpthi - 1 : endpthi;
                                         facdata.asm_data->FACMSW = endptlo - 1;
                                 }
                                 fd = openWriteSaveFile (&write_save_file_state);
@@ -5623,7 +7254,9 @@ begin:  factor_found = 0;
                                     write_long (fd, facdata.asm_data->FACHSW, NULL) &&
                                     write_long (fd, facdata.asm_data->FACMSW, NULL) &&
                                     write_long (fd, endpthi, NULL) &&
-                                    write_long (fd, endptlo, NULL))
+                                    write_long (fd, endptlo, NULL) &&
+                                    write_long (fd, facdata.asm_data->FACTSW, NULL) &&
+                                    write_long (fd, endpttsw, NULL))
                                         closeWriteSaveFile (&write_save_file_state, fd);
                                 else {
                                         sprintf (buf, WRITEFILEERR, filename);
@@ -5660,7 +7293,7 @@ begin:  factor_found = 0;
 /* Format and output a message for each found factor */
 
                 do {
-                        makestr (facdata.asm_data->FACHSW, facdata.asm_data->FACMSW, facdata.asm_data->FACLSW, str);
+                        makestr (facdata.asm_data->FACTSW, facdata.asm_data->FACHSW, facdata.asm_data->FACMSW, facdata.asm_data->FACLSW, str);
                         sprintf (buf, "M%ld has a factor: %s (TF:%d-%d)\n", p, str, (int) w->sieve_depth, (int) test_bits);
                         OutputStr (thread_num, buf);
                         formatMsgForResultsFile (buf, w);
@@ -5704,14 +7337,19 @@ begin:  factor_found = 0;
 
                 if (!find_smaller_factor) break;
 
+                endpttsw = facdata.asm_data->FACTSW;
                 if (facdata.asm_data->FACMSW != 0xFFFFFFFF) {
                         endpthi = facdata.asm_data->FACHSW;
                         endptlo = facdata.asm_data->FACMSW+1;
-                } else {
+                } else if (facdata.asm_data->FACHSW != 0xFFFFFFFF) {
                         endpthi = facdata.asm_data->FACHSW+1;
                         endptlo = 0;
+                } else {
+                        endpttsw = facdata.asm_data->FACTSW+1;
+                        endpthi = 0;
+                        endptlo = 0;
                 }
-                endpt = endpthi * 4294967296.0 + endptlo;
+                endpt = (endpttsw * 4294967296.0 + endpthi) * 4294967296.0 + endptlo;
 
 /* Do next of the 16 passes */
 
@@ -5831,6 +7469,8 @@ typedef struct {                /* Some of the data kept during LL test */
                                 /* gwsetup will return a handle */
         gwnum   lldata;         /* Number in the lucas sequence */
         unsigned long units_bit; /* Shift count */
+        residue_snapshot snap;  /* Binary value of lldata shared by the Jacobi check, */
+                                /* save file writer, and residue printers */
 } llhandle;
 
 /* Prepare for running a Lucas-Lehmer test.  Caller must have already called gwinit. */
@@ -5848,6 +7488,7 @@ int lucasSetup (
 
         lldata->lldata = NULL;
         lldata->units_bit = 0;
+        residue_snapshot_init (&lldata->snap, &lldata->gwdata);
 
 /* As a kludge for the benchmarking and timing code, an odd FFTlen sets up gwnum for all-complex FFTs. */
 
@@ -5904,6 +7545,7 @@ void lucasDone (
 
 /* Free memory for the Lucas-Lehmer data */
 
+        residue_snapshot_term (&lldata->snap);
         gwfree (&lldata->gwdata, lldata->lldata);
 
 /* Cleanup the FFT code */
@@ -5911,6 +7553,46 @@ void lucasDone (
         gwdone (&lldata->gwdata);
 }
 
+/* Return 64 bits of a giant starting at the given bit position */
+
+uint64_t giant_bits64 (
+        giant   g,
+        unsigned long bit)
+{
+        unsigned long word, shift;
+        uint64_t val;
+
+        word = bit >> 5;
+        shift = bit & 31;
+        if ((long) word >= g->sign) return (0);
+        val = g->n[word] >> shift;
+        if ((long) word + 1 < g->sign) val += ((uint64_t) g->n[word+1]) << (32 - shift);
+        if (shift && (long) word + 2 < g->sign) val += ((uint64_t) g->n[word+2]) << (64 - shift);
+        return (val);
+}
+
+/* Compute the 64-bit residue of a p-bit giant that is rotated left shift_count bits. */
+/* Unlike rotateg, the giant is not modified. */
+
+uint64_t rotated_res64 (
+        giant   g,
+        unsigned long p,        /* Mersenne exponent (bit size of the giant) */
+        unsigned long shift_count)
+{
+        uint64_t res64;
+
+        /* If the shift count is large, we will need some of the bottom bits too */
+        res64 = 0;
+        if (shift_count + 64 > p) {
+                res64 = giant_bits64 (g, 0);
+                res64 <<= p - shift_count;
+                if (p < 64) res64 &= (((uint64_t) 1) << p) - 1;
+        }
+
+        /* Apply the shift count and get the low 64 bits */
+        return (res64 + giant_bits64 (g, shift_count));
+}
+
 /* Generate the 64-bit residue of a Lucas-Lehmer test.  Returns -1 for an */
 /* illegal result, 0 for a zero result, 1 for a non-zero result. */
 
@@ -5925,32 +7607,28 @@ int generateResidue64 (
         int     err_code;
 
         *reshi = *reslo = 0;
-        tmp = popg (&lldata->gwdata.gdata, (p >> 5) + 5);
-        err_code = gwtogiant (&lldata->gwdata, lldata->lldata, tmp);
-        if (err_code < 0) {
-                pushg (&lldata->gwdata.gdata, 1);
-                return (err_code);
-        }
-        if (tmp->sign == 0) {
-                pushg (&lldata->gwdata.gdata, 1);
-                return (0);
-        }
 
-        /* If the shift count is large, we will need some of the bottom bits too */
-        res64 = 0;
-        if (lldata->units_bit + 64 > p) {
-                if (tmp->sign > 0) res64 = tmp->n[0];
-                if (tmp->sign > 1) res64 += ((uint64_t) tmp->n[1]) << 32;
-                res64 <<= p - lldata->units_bit;
-                if (p < 64) res64 &= (((uint64_t) 1) << p) - 1;
+        /* Use the binary value from this iteration's snapshot if there is one */
+        tmp = residue_snapshot_giant (&lldata->snap, lldata->lldata, &err_code);
+        if (err_code < 0) return (err_code);
+        if (tmp == NULL) {
+                tmp = popg (&lldata->gwdata.gdata, (p >> 5) + 5);
+                err_code = gwtogiant (&lldata->gwdata, lldata->lldata, tmp);
+                if (err_code < 0) {
+                        pushg (&lldata->gwdata.gdata, 1);
+                        return (err_code);
+                }
+                if (tmp->sign == 0) {
+                        pushg (&lldata->gwdata.gdata, 1);
+                        return (0);
+                }
+                res64 = rotated_res64 (tmp, p, lldata->units_bit);
+                pushg (&lldata->gwdata.gdata, 1);
+        } else {
+                if (tmp->sign == 0) return (0);
+                res64 = rotated_res64 (tmp, p, lldata->units_bit);
         }
 
-        /* Apply the shift count and get the low 64 bits */
-        gshiftright (lldata->units_bit, tmp);
-        if (tmp->sign > 0) res64 += tmp->n[0];
-        if (tmp->sign > 1) res64 += ((uint64_t) tmp->n[1]) << 32;
-        pushg (&lldata->gwdata.gdata, 1);
-
         /* Return the calculated 64-bit residue */
         *reslo = (uint32_t) res64;
         *reshi = (uint32_t) (res64 >> 32);
@@ -5970,11 +7648,13 @@ int generateResidue64 (
 #define LL_ERROR_COUNT_OFFSET   52
 
 int writeLLSaveFile (
-        llhandle *lldata,
+        llhandle *lldata,               /* LL data, NULL if writing from a checkpoint */
         writeSaveFileState *write_save_file_state,
         struct work_unit *w,
         unsigned long counter,
-        unsigned long error_count)
+        unsigned long error_count,
+        unsigned long units_bit,
+        giant   value)                  /* Binary LL value or NULL to use lldata's */
 {
         int     fd;
         unsigned long sum = 0;
@@ -5988,8 +7668,12 @@ int writeLLSaveFile (
 
         if (!write_long (fd, error_count, &sum)) goto err;
         if (!write_long (fd, counter, &sum)) goto err;
-        if (!write_long (fd, lldata->units_bit, &sum)) goto err;
-        if (!write_gwnum (fd, &lldata->gwdata, lldata->lldata, &sum)) goto err;
+        if (!write_long (fd, units_bit, &sum)) goto err;
+        if (value != NULL) {
+                if (!write_giant (fd, value, &sum)) goto err;
+        } else {
+                if (!write_gwnum_snapshot (fd, &lldata->snap, &lldata->gwdata, lldata->lldata, &sum)) goto err;
+        }
 
         if (!write_checksum (fd, sum)) goto err;
 
@@ -6002,6 +7686,18 @@ err:    deleteWriteSaveFile (write_save_file_state, fd);
         return (FALSE);
 }
 
+/* Write an LL save file from a preemption checkpoint.  The checkpoint state */
+/* is the iteration counter, error count, and shift count. */
+
+int writeLLCheckpointSaveFile (
+        struct preempt_checkpoint *cp)
+{
+        unsigned long ll_state[3];
+
+        memcpy (ll_state, cp->state, sizeof (ll_state));
+        return (writeLLSaveFile (NULL, &cp->write_save_file_state, &cp->w, ll_state[0], ll_state[1], ll_state[2], cp->values[0]));
+}
+
 /* Update the error count in an intermediate file */
 
 void writeNewErrorCount (
@@ -6388,6 +8084,71 @@ int exponent_near_fft_limit (
         return (gwnear_fft_limit (gwdata, IniGetFloat (INI_FILE, "NearFFTLimitPct", 0.5)));
 }
 
+/* Near an FFT's limit LL tests and PRP tests without Gerbicz error checking */
+/* round off check every iteration, as nothing else would catch a silent */
+/* error above 0.5.  A Gerbicz PRP test only checks the iterations before a */
+/* save file, the first and last 50, and the Gerbicz multiplies, relying on */
+/* the Gerbicz check to catch everything else.  Setting RoundoffSampleInterval=n */
+/* also checks every n-th iteration of a Gerbicz PRP test near the FFT limit. */
+/* This does not change reliability, which the Gerbicz check provides.  It */
+/* gathers round off statistics and, when a sampled error comes within */
+/* RoundoffEscalateMargin (default 3/64) of the allowable maximum, checks every */
+/* iteration for the next RoundoffEscalateIters (default 10000).  Near the */
+/* limit a typical maximum is around 0.3 against an allowable 27/64, so a */
+/* sample this close to the allowable maximum means the unsampled iterations */
+/* have a real chance of exceeding it.  Checking them catches such an error */
+/* in the iteration it happens rather than at the next Gerbicz check, which */
+/* would roll back a whole block.  The default of 0 does no sampling. */
+/* Sampling only adds round off checks, it never skips one, so it makes no */
+/* test faster.  Running most LL or PRP iterations unchecked near the FFT */
+/* limit is deliberately not supported. */
+
+typedef struct {
+        unsigned long interval;         /* Check every interval-th iteration, 0 = no sampling */
+        unsigned long escalate_iters;   /* Iterations to check after a large sampled error */
+        unsigned long check_all_until;  /* Check every iteration until this counter */
+        double  escalate_maxerr;        /* Sampled error that triggers checking every iteration */
+} roundoff_sampler;
+
+void roundoff_sampler_init (
+        roundoff_sampler *rs,
+        double  allowable_maxerr)       /* Largest round off error the test allows */
+{
+        rs->interval = IniGetInt (INI_FILE, "RoundoffSampleInterval", 0);
+        rs->escalate_iters = IniGetInt (INI_FILE, "RoundoffEscalateIters", 10000);
+        rs->escalate_maxerr = allowable_maxerr - IniGetFloat (INI_FILE, "RoundoffEscalateMargin", (float) 0.046875);
+        rs->check_all_until = 0;
+}
+
+/* Return TRUE if an iteration of a Gerbicz PRP test near the FFT limit should be error checked */
+
+int roundoff_sample_due (
+        roundoff_sampler *rs,
+        unsigned long counter)
+{
+        return (rs->interval && (counter < rs->check_all_until || counter % rs->interval == 0));
+}
+
+/* Look at the round off from an error checked iteration.  Escalate to */
+/* checking every iteration if it is getting large. */
+
+void roundoff_sample_result (
+        int     thread_num,
+        roundoff_sampler *rs,
+        unsigned long counter,
+        double  maxerr)
+{
+        char    buf[100];
+
+        if (rs->interval == 0 || maxerr <= rs->escalate_maxerr) return;
+        if (counter >= rs->check_all_until) {
+                sprintf (buf, "Round off error %.10g, checking every iteration for the next %lu iterations.\n",
+                         maxerr, rs->escalate_iters);
+                OutputStr (thread_num, buf);
+        }
+        rs->check_all_until = counter + rs->escalate_iters;
+}
+
 /* Output the good news of a new prime to the screen in an infinite loop */
 
 void good_news (void *arg)
@@ -6432,6 +8193,32 @@ int rotateg (                           /* Return false if failed due to memory
         return (1);
 }
 
+/* Set an mpz to a p-bit giant rotated right shift_count bits.  GMP reads the giant's memory directly */
+/* so the only copying is done by the rotate itself.  The giant's value is unchanged, but gtompz_view may */
+/* zero the word above an odd length value.  Residue snapshots zero that word when they are converted, */
+/* so viewing one never writes to memory another thread may be reading. */
+
+void rotated_gtompz (
+        giant   v,                      /* Giant to rotate right */
+        unsigned long p,                /* Mersenne exponent (bit size of the giant to rotate) */
+        unsigned long shift_count,      /* Number of bits to rotate right */
+        mpz_t   a)                      /* Returned rotated value */
+{
+        mpz_t   v_view, hi;
+
+        gtompz_view (v, v_view);
+        if (shift_count == 0) {
+                mpz_set (a, v_view);
+                return;
+        }
+        mpz_init (hi);
+        mpz_tdiv_q_2exp (hi, v_view, shift_count);
+        mpz_tdiv_r_2exp (a, v_view, shift_count);
+        mpz_mul_2exp (a, a, p - shift_count);
+        mpz_add (a, a, hi);
+        mpz_clear (hi);
+}
+
 /* Perform a Jacobi test on the current LL iteration.  This check has a 50% chance of catching */
 /* a calculation error.  See http://www.mersenneforum.org/showthread.php?t=22471 especially */
 /* starting at post #30. */
@@ -6452,26 +8239,28 @@ int jacobi_test (
         clear_timers (timers, sizeof (timers) / sizeof (timers[0]));
         start_timer (timers, 0);
 
-/* Convert current iteration to binary.  Apply the shift count. */
+/* Use the binary value from this iteration's snapshot if there is one.  Otherwise, */
+/* convert current iteration to binary. */
 
-        v = popg (&lldata->gwdata.gdata, (p >> 5) + 5);
-        if (v == NULL) goto oom;
-        err_code = gwtogiant (&lldata->gwdata, lldata->lldata, v);
+        v = residue_snapshot_giant (&lldata->snap, lldata->lldata, &err_code);
+        if (v == NULL && err_code == 0) {
+                giant   tmp;
+                tmp = popg (&lldata->gwdata.gdata, (p >> 5) + 5);
+                if (tmp == NULL) goto oom;
+                err_code = gwtogiant (&lldata->gwdata, lldata->lldata, tmp);
+                if (err_code >= 0) {
+                        mpz_init (a);
+                        rotated_gtompz (tmp, p, lldata->units_bit, a);
+                }
+                pushg (&lldata->gwdata.gdata, 1);
+        } else if (v != NULL) {
+                mpz_init (a);
+                rotated_gtompz (v, p, lldata->units_bit, a);
+        }
         if (err_code < 0) {             /* LL value could not be calculated.  Should not happen, return failed-Jacobi-test */
                 OutputBoth (thread_num, "LL value corrupt.  Could not run Jacobi error check.\n");
-                pushg (&lldata->gwdata.gdata, 1);
                 return (0);
         }
-        if (! rotateg (v, p, lldata->units_bit, &lldata->gwdata.gdata)) {
-                pushg (&lldata->gwdata.gdata, 1);
-                goto oom;
-        }
-
-/* Copy the LL value to "a" */
-
-        mpz_init (a);
-        gtompz (v, a);
-        pushg (&lldata->gwdata.gdata, 1);
 
 /* Generate the Mersenne number */
 
@@ -6532,9 +8321,12 @@ int prime (
         int     first_iter_msg, near_fft_limit, sleep5;
         unsigned long high32, low32;
         int     rc, isPrime, stop_reason;
+        int     numa_map[MAX_NUMA_MAP_THREADS];
         char    buf[400], JSONbuf[4000], fft_desc[200];
         int     slow_iteration_count;
         double  best_iteration_time;
+        struct perf_monitor perf;
+        struct fft_trial_timer fft_timer;
         unsigned long last_counter = 0xFFFFFFFF;        /* Iteration of last error */
         int     maxerr_recovery_mode = 0;               /* Big roundoff err rerun */
         double  last_suminp = 0.0;
@@ -6640,16 +8432,33 @@ begin:  gwinit (&lldata.gwdata);
         gwset_bench_workers (&lldata.gwdata, NUM_WORKER_THREADS);
         if (ERRCHK) gwset_will_error_check (&lldata.gwdata);
         else gwset_will_error_check_near_limit (&lldata.gwdata);
-        gwset_num_threads (&lldata.gwdata, CORES_PER_TEST[thread_num] * sp_info->normal_work_hyperthreads);
+        gwset_num_threads (&lldata.gwdata, worker_num_cores (thread_num) * sp_info->normal_work_hyperthreads);
+        gwset_numa_nodes (&lldata.gwdata, fft_numa_map (sp_info, gwget_num_threads (&lldata.gwdata), numa_map), numa_map);
         gwset_thread_callback (&lldata.gwdata, SetAuxThreadPriority);
         gwset_thread_callback_data (&lldata.gwdata, sp_info);
-        stop_reason = lucasSetup (thread_num, p, w->minimum_fftlen, &lldata);
+        stop_reason = lucasSetup (thread_num, p, fft_trial_prepare (thread_num, w, &lldata.gwdata, w->minimum_fftlen), &lldata);
         if (stop_reason) return (stop_reason);
 
 /* Record the amount of memory being used by this thread. */
 
         set_memory_usage (thread_num, 0, cvt_gwnums_to_mem (&lldata.gwdata, 1));
 
+/* If we were preempted for priority work in the middle of this test, resume from memory. */
+/* As with a save file, the restored value must pass the Jacobi check. */
+
+        {
+                unsigned long ll_state[3];
+                if (preemptCheckpointRestore (thread_num, w, ll_state, sizeof (ll_state), &lldata.gwdata, 1, &lldata.lldata)) {
+                        lldata.units_bit = ll_state[2];
+                        if (!Jacobi_testing_enabled || jacobi_test (thread_num, p, &lldata)) {
+                                counter = ll_state[0];
+                                error_count = ll_state[1];
+                                first_iter_msg = TRUE;
+                                goto resumed;
+                        }
+                }
+        }
+
 /* Loop reading from save files (and backup save files).  Limit number of backup */
 /* files we try to read in case there is an error deleting bad save files. */
 
@@ -6693,6 +8502,7 @@ begin:  gwinit (&lldata.gwdata);
 /* If this is a restart from an error, use the incremented error_count in restart_error_count */
 /* rather than the error_count from a save file. */
 
+resumed:
         if (restart_error_count) error_count = restart_error_count;
 
 /* Hyperthreading backoff is an option to pause the program when iterations */
@@ -6702,6 +8512,8 @@ begin:  gwinit (&lldata.gwdata);
 
         best_iteration_time = 1.0e50;
         slow_iteration_count = 0;
+        perf_monitor_init (thread_num, &perf, &lldata.gwdata);
+        fft_trial_init (thread_num, &fft_timer, &lldata.gwdata);
 
 /* Clear all timers */
 
@@ -6822,8 +8634,9 @@ begin:  gwinit (&lldata.gwdata);
                 interim_residue = (INTERIM_RESIDUES && (counter+1) % INTERIM_RESIDUES <= 2);
                 interim_file = (INTERIM_FILES && (counter+1) % INTERIM_FILES == 0);
 
-/* Do a Lucas-Lehmer iteration */
+/* Do a Lucas-Lehmer iteration.  Any snapshot of the previous iteration is now stale. */
 
+                residue_snapshot_invalidate (&lldata.snap);
                 timers[1] = 0.0;
                 start_timer (timers, 1);
 
@@ -6953,6 +8766,12 @@ begin:  gwinit (&lldata.gwdata);
                         goto restart;
                 }
 
+/* If the Jacobi check, save file writers, or residue printers need the binary value */
+/* of this iteration, take one snapshot they all share so gwtogiant is called only once. */
+
+                if (Jacobi_testing || saving || sending_residue || interim_residue || interim_file)
+                        residue_snapshot_take (&lldata.snap, lldata.lldata);
+
 /* Check the Jacobi symbol */
 
                 if (Jacobi_testing && !jacobi_test (thread_num, p, &lldata)) {
@@ -7069,8 +8888,20 @@ begin:  gwinit (&lldata.gwdata);
 /* Write results to a file every DISK_WRITE_TIME minutes */
 /* On error, retry in 10 minutes (it could be a temporary disk-full situation) */
 
+/* When preempted for priority work, checkpoint in memory and let a background thread write the save file */
+
+                if (saving && stop_reason == STOP_PRIORITY_WORK) {
+                        unsigned long ll_state[3];
+                        ll_state[0] = counter;
+                        ll_state[1] = error_count;
+                        ll_state[2] = lldata.units_bit;
+                        if (preemptCheckpointSave (thread_num, w, ll_state, sizeof (ll_state), &lldata.gwdata, &lldata.snap,
+                                                   1, &lldata.lldata, &write_save_file_state, &writeLLCheckpointSaveFile))
+                                saving = FALSE;
+                }
+
                 if (saving) {
-                        if (! writeLLSaveFile (&lldata, &write_save_file_state, w, counter, error_count)) {
+                        if (! writeLLSaveFile (&lldata, &write_save_file_state, w, counter, error_count, lldata.units_bit, NULL)) {
                                 sprintf (buf, WRITEFILEERR, filename);
                                 OutputBoth (thread_num, buf);
                         }
@@ -7137,7 +8968,7 @@ begin:  gwinit (&lldata.gwdata);
                         sprintf (interimfile, "%s.%03ld", filename, counter / INTERIM_FILES);
                         writeSaveFileStateInit (&state, interimfile, 0);
                         state.num_ordinary_save_files = 99;
-                        writeLLSaveFile (&lldata, &state, w, counter, error_count);
+                        writeLLSaveFile (&lldata, &state, w, counter, error_count, lldata.units_bit, NULL);
                 }
 
 /* If ten iterations take 40% longer than a typical iteration, then */
@@ -7159,6 +8990,11 @@ begin:  gwinit (&lldata.gwdata);
                         } else
                                 slow_iteration_count = 0;
                 }
+
+/* Feed the iteration time to the performance anomaly detector and the FFT implementation trials */
+
+                perf_monitor_iteration (thread_num, &perf, timer_value (timers, 1));
+                fft_trial_iteration (thread_num, &fft_timer, &lldata.gwdata, w, timer_value (timers, 1));
         }
 
 /* Check for a successful completion */
@@ -8457,7 +10293,6 @@ int primeSieveTest (
         FILE    *fd;
         unsigned long p;
         int     stop_reason;
-        uint32_t res, carryl, carryh;
 
 /* Open factors file */
 
@@ -8470,38 +10305,47 @@ int primeSieveTest (
 /* Loop until all the entire range is factored */
 
         while (fscanf (fd, "%ld", &p) && p) {
-                unsigned long fachi, facmid, faclo;
+                unsigned long factop, fachi, facmid, faclo;
                 unsigned long i, pass;
+                uint32_t facwords[4];
                 char fac[480];
                 char *f;
 
-/* What is the factor? */
+/* What is the factor?  Factors above 2^96 are only supported by the 64-bit C code. */
 
                 (void) fscanf (fd, "%s", fac);
-                fachi = facmid = faclo = 0;
+                memset (facwords, 0, sizeof (facwords));
+                factop = 0;
                 for (f = fac; *f; f++) {
+                        uint64_t carry;
                         if (*f < '0' || *f > '9') continue;
-                        res = *f - '0';
-                        carryl = 0;
-                        muladdhlp (&res, &carryl, &carryh, faclo, 10);
-                        faclo = res;
-                        res = carryl;
-                        carryl = 0;
-                        muladdhlp (&res, &carryl, &carryh, facmid, 10);
-                        facmid = res;
-                        fachi = fachi * 10 + carryl;
-                        if (fachi >= 268435456 ||
-                            (fachi >= 4194304 && !(CPU_FLAGS & CPU_FMA3)) ||
-                            (fachi >= 16384 && !(CPU_FLAGS & CPU_SSE2))) {
-                                sprintf (buf, "%ld %s factor too big.\n", p, fac);
-                                OutputBoth (thread_num, buf);
-                                goto nextp;
+                        carry = *f - '0';
+                        for (i = 0; i < 4; i++) {
+                                carry += (uint64_t) facwords[i] * 10;
+                                facwords[i] = (uint32_t) carry;
+                                carry >>= 32;
                         }
+                        if (carry) factop = 0xFFFFFFFF;
+                }
+                if (factop == 0) factop = facwords[3];
+                fachi = facwords[2]; facmid = facwords[1]; faclo = facwords[0];
+#ifdef X86_64
+                if (factop >= 0x80000000 ||
+#else
+                if (factop ||
+#endif
+                    (factop == 0 &&
+                     (fachi >= 268435456 ||
+                      (fachi >= 4194304 && !(CPU_FLAGS & CPU_FMA3)) ||
+                      (fachi >= 16384 && !(CPU_FLAGS & CPU_SSE2))))) {
+                        sprintf (buf, "%ld %s factor too big.\n", p, fac);
+                        OutputBoth (thread_num, buf);
+                        goto nextp;
                 }
 
 /* See if p is too small (less than 2^44) */
 
-                if (fachi == 0 && facmid < 0x1000) {
+                if (factop == 0 && fachi == 0 && facmid < 0x1000) {
                         sprintf (buf, "%ld %s factor too small.\n", p, fac);
                         OutputBoth (thread_num, buf);
                         goto nextp;
@@ -8517,7 +10361,7 @@ int primeSieveTest (
 
 /* Setup the factoring program */
 
-                i = (fachi % 120 * 16 + facmid % 120 * 16 + faclo % 120) % 120;
+                i = (factop % 120 * 16 + fachi % 120 * 16 + facmid % 120 * 16 + faclo % 120) % 120;
                 if (i == 1) pass = 0;
                 else if (i == 7) pass = 1;
                 else if (i == 17) pass = 2;
@@ -8554,10 +10398,11 @@ int primeSieveTest (
                 /* set endpoint to 10% higher than the factor to find. */
                 {
                         double  fltfac;
-                        fltfac = ((double) fachi * 4294967296.0 + (double) facmid) * 4294967296.0 + (double) faclo;
+                        fltfac = (((double) factop * 4294967296.0 + (double) fachi) * 4294967296.0 + (double) facmid) * 4294967296.0 + (double) faclo;
                         facdata.endpt = pow (2.0, ceil (_log2 (fltfac)));
                         if (facdata.endpt > fltfac * 1.1) facdata.endpt = fltfac * 1.1;
                 }
+                facdata.asm_data->FACTSW = factop;
                 facdata.asm_data->FACHSW = fachi;
                 facdata.asm_data->FACMSW = facmid & ~0xFFF;
                 stop_reason = factorPassSetup (thread_num, pass, &facdata);
@@ -8571,7 +10416,8 @@ int primeSieveTest (
 
                 do {
                         if (factorChunk (&facdata) != 2) {
-                                if (facdata.asm_data->FACHSW == fachi &&
+                                if (facdata.asm_data->FACTSW == factop &&
+                                    facdata.asm_data->FACHSW == fachi &&
                                     facdata.asm_data->FACMSW == facmid &&
                                     facdata.asm_data->FACLSW == faclo) {
                                         sprintf (buf, "%ld %s factored OK.\n", p, fac);
@@ -8718,6 +10564,12 @@ static  int     time_all_complex = 0;   /* TRUE if we should time all-complex FF
                 }
                 if (p >= 9900 && p <= 9919)
                         return (test_randomly (thread_num, &sp_info));
+                if (p >= 9940 && p <= 9959)
+                        return (test_all_impl_sweep (thread_num, &sp_info));
+                if (p == 9960)
+                        return (test_sincos_tables (thread_num));
+                if (p == 9961)
+                        return (test_gmp_mul (thread_num));
                 return (test_all_impl (thread_num, &sp_info));
         }
 
@@ -8962,7 +10814,11 @@ int factorBench (
         unsigned long num_lengths, i, j;
         double  best_time;
         char    buf[512];
+#ifdef X86_64
+        int     bit_lengths[] = {61, 62, 63, 64, 65, 66, 67, 75, 76, 77, 97, 110, 126};
+#else
         int     bit_lengths[] = {61, 62, 63, 64, 65, 66, 67, 75, 76, 77};
+#endif
         int     res, stop_reason;
         double  timers[2];
 
@@ -8992,14 +10848,20 @@ int factorBench (
                         last_bench_cpu_num = NUM_CPUS;
                         return (stop_reason);
                 }
+                facdata.asm_data->FACTSW = 0;
                 if (bit_lengths[i] <= 64) {
                         facdata.asm_data->FACHSW = 0;
                         facdata.asm_data->FACMSW = 1L << (bit_lengths[i]-33);
-                } else {
+                } else if (bit_lengths[i] <= 96) {
                         facdata.asm_data->FACHSW = 1L << (bit_lengths[i]-65);
                         facdata.asm_data->FACMSW = 0;
+                } else {
+                        facdata.asm_data->FACTSW = 1L << (bit_lengths[i]-97);
+                        facdata.asm_data->FACHSW = 0;
+                        facdata.asm_data->FACMSW = 0;
                 }
-                facdata.endpt = (facdata.asm_data->FACHSW * 4294967296.0 + facdata.asm_data->FACMSW) * 4294967296.0 * 2.0;
+                facdata.endpt = ((facdata.asm_data->FACTSW * 4294967296.0 + facdata.asm_data->FACHSW) * 4294967296.0 +
+                                 facdata.asm_data->FACMSW) * 4294967296.0 * 2.0;
                 stop_reason = factorPassSetup (thread_num, 0, &facdata);
                 if (stop_reason) {
                         last_bench_cpu_num = NUM_CPUS;
@@ -9056,6 +10918,99 @@ int factorBench (
         return (0);
 }
 
+/* Routine to benchmark the tiny FFT lengths used by ECM and PRP on small numbers.  For each FFT length */
+/* we report squarings per second using gwnum's one-pass fast path and using the general call path. */
+
+int tinyFFTBench (
+        int     thread_num)
+{
+        gwhandle gwdata;
+        gwnum   x;
+        unsigned long len, min_FFT_length, max_FFT_length, fftlen, last_fftlen, iterations, j;
+        int     fast_path, pass, stop_reason;
+        double  ops_per_sec[2];
+        char    buf[512];
+        double  timers[2];
+
+        min_FFT_length = IniGetInt (INI_FILE, "MinTinyBenchFFT", 32);
+        max_FFT_length = IniGetInt (INI_FILE, "MaxTinyBenchFFT", 16384);
+        if (min_FFT_length < 32) min_FFT_length = 32;
+
+/* Loop over the power-of-two FFT lengths */
+
+        last_fftlen = 0;
+        for (len = min_FFT_length; len <= max_FFT_length; len *= 2) {
+
+/* Initialize for this FFT length.  gwinfo decides whether the fast path applies. */
+/* Skip lengths that gwinfo rounds up to an FFT length we already timed. */
+
+                gwinit (&gwdata);
+                gwset_sum_inputs_checking (&gwdata, SUM_INPUTS_ERRCHK);
+                gwset_minimum_fftlen (&gwdata, len);
+                if (gwsetup (&gwdata, 1.0, 2, len * 17, -1)) {
+                        gwdone (&gwdata);
+                        continue;
+                }
+                fftlen = gwfftlen (&gwdata);
+                if (fftlen == last_fftlen) {
+                        gwdone (&gwdata);
+                        continue;
+                }
+                last_fftlen = fftlen;
+                fast_path = gwdata.ZERO_UPPER;
+                x = gwalloc (&gwdata);
+                if (x == NULL) {
+                        gwdone (&gwdata);
+                        OutputStr (thread_num, "Error allocating memory for FFT data.\n");
+                        return (STOP_OUT_OF_MEM);
+                }
+                dbltogw (&gwdata, 3.0, x);
+                gwsetnormroutine (&gwdata, 0, 0, 0);
+                gwstartnextfft (&gwdata, TRUE);
+
+/* Time enough squarings to run for roughly a quarter second */
+
+                iterations = 40000000 / fftlen + 1000;
+                sprintf (buf, "Timing %lu squarings of FFT length %lu.  ", iterations, fftlen);
+                OutputStr (thread_num, buf);
+
+/* Time the fast path first, then the general call path.  Skip the second timing if */
+/* gwinfo did not choose the fast path for this FFT length. */
+
+                for (pass = 0; pass < 2; pass++) {
+                        if (pass == 1 && !fast_path) break;
+                        stop_reason = stopCheck (thread_num);
+                        if (stop_reason) {
+                                OutputStrNoTimeStamp (thread_num, "\n");
+                                OutputStr (thread_num, "Execution halted.\n");
+                                gwdone (&gwdata);
+                                return (stop_reason);
+                        }
+                        gwdata.ZERO_UPPER = (pass == 0) ? fast_path : FALSE;
+                        gwsquare (&gwdata, x);
+                        clear_timers (timers, sizeof (timers) / sizeof (timers[0]));
+                        start_timer (timers, 0);
+                        for (j = 0; j < iterations; j++) gwsquare (&gwdata, x);
+                        end_timer (timers, 0);
+                        ops_per_sec[pass] = (double) iterations / timer_value (timers, 0);
+                }
+                gwdone (&gwdata);
+
+/* Output the squarings per second */
+
+                if (fast_path)
+                        sprintf (buf, "FFT length %lu: %.0f squarings/sec, %.0f without fast path (%.2fx)\n",
+                                 fftlen, ops_per_sec[0], ops_per_sec[1], ops_per_sec[0] / ops_per_sec[1]);
+                else
+                        sprintf (buf, "FFT length %lu: %.0f squarings/sec, no fast path\n", fftlen, ops_per_sec[0]);
+                OutputStrNoTimeStamp (thread_num, buf);
+                writeResultsBench (buf);
+        }
+
+        writeResultsBench ("\n");
+        return (0);
+}
+
 /* Globals and structures used in primeBenchMultipleWorkers */
 
 int     num_bench_workers = 0;
@@ -9218,7 +11173,7 @@ int primeBenchMultipleWorkersInternal (
             if (all_bench) lldata.gwdata.bench_pick_nth_fft = 1;
             stop_reason = lucasSetup (thread_num, fftlen * 17 + 1, fftlen + plus1, &lldata);
             if (stop_reason) {
-                    if (all_bench) gwbench_write_data ();       /* Write accumulated benchmark data to gwnum.txt */
+                    if (all_bench) host_write_bench_data ();  /* Write accumulated benchmark data to gwnum.txt */
                     gwmutex_destroy (&bench_workers_mutex);
                     gwevent_destroy (&bench_workers_sync);
                     return (stop_reason);
@@ -9341,7 +11296,7 @@ int primeBenchMultipleWorkersInternal (
                                     gwthread_wait_for_exit (&thread_id[i]);
                             stop_reason = stopCheck (thread_num);
                             if (stop_reason) {
-                                if (all_bench) gwbench_write_data ();   /* Write accumulated benchmark data to gwnum.txt */
+                                if (all_bench) host_write_bench_data ();   /* Write accumulated benchmark data to gwnum.txt */
                                 lucasDone (&lldata);
                                 gwmutex_destroy (&bench_workers_mutex);
                                 gwevent_destroy (&bench_workers_sync);
@@ -9439,7 +11394,7 @@ int primeBenchMultipleWorkersInternal (
 
 /* Write the benchmark data to gwnum.txt so that gwnum can select the FFT implementations with the best throughput */
 
-        if (all_bench) gwbench_write_data ();
+        if (all_bench) host_write_bench_data ();
 
 /* Output completion message, cleanup and return */
 
@@ -9529,7 +11484,7 @@ int primeBenchMultipleWorkers (
 
 /* Write the benchmark data to gwnum.txt so that gwnum can select the FFT implementations with the best throughput */
 
-        if (all_bench) gwbench_write_data ();
+        if (all_bench) host_write_bench_data ();
 
 /* If benchmark did not complete, return */
 
@@ -9742,7 +11697,7 @@ void autoBench (void)
 
 /* Write the benchmark data to gwnum.txt so that gwnum can select the FFT implementations with the best throughput */
 
-        gwbench_write_data ();
+        host_write_bench_data ();
 
 /* Send the benchmark data to the server??? */
 //bug - do we want to send autobench bench data to server???
@@ -9776,6 +11731,7 @@ int primeBench (
         int     min_cores, max_cores, incr_cores, cpu, hypercpu;
         int     all_bench, only_time_5678, time_all_complex, plus1, stop_reason;
         int     is_a_5678, bench_hyperthreading, bench_arch;
+        int     numa_nodes, numa_map[MAX_NUMA_MAP_THREADS];
         unsigned long fftlen, min_FFT_length, max_FFT_length;
         double  timers[2];
         struct primenetBenchmarkData pkt;
@@ -9828,6 +11784,13 @@ int primeBench (
                 return (factorBench (thread_num));
         }
 
+/* Optionally time the tiny FFT lengths before the classic FFT timings benchmark. */
+
+        if (IniGetInt (INI_FILE, "BenchTinyFFTs", 0)) {
+                stop_reason = tinyFFTBench (thread_num);
+                if (stop_reason) return (stop_reason);
+        }
+
 /* Fall through to the classic FFT timings benchmark. */
 
 /* Init */
@@ -9892,6 +11855,13 @@ int primeBench (
                 sprintf (buf, "Timing FFTs using %d threads on %d core%s.\n", cpu * hypercpu, cpu, cpu > 1 ? "s" : "");
               OutputBothBench (thread_num, buf);
             }
+            sp_info.bench_base_cpu_num = 0;
+            sp_info.bench_hyperthreads = hypercpu;
+            numa_nodes = fft_numa_map (&sp_info, cpu * hypercpu, numa_map);
+            if (numa_nodes > 1) {
+              sprintf (buf, "Partitioning FFT blocks over %d NUMA nodes.\n", numa_nodes);
+              OutputBothBench (thread_num, buf);
+            }
 
 /* Set global that makes sure we are running the correct number of busy loops */
 
@@ -9915,6 +11885,7 @@ int primeBench (
                   if (IniGetInt (LOCALINI_FILE, "UseLargePages", 0)) gwset_use_large_pages (&lldata.gwdata);
                   if (IniGetInt (INI_FILE, "HyperthreadPrefetch", 0)) gwset_hyperthread_prefetch (&lldata.gwdata);
                   gwset_num_threads (&lldata.gwdata, cpu * hypercpu);
+                  gwset_numa_nodes (&lldata.gwdata, numa_nodes, numa_map);
                   sp_info.bench_base_cpu_num = 0;
                   sp_info.bench_hyperthreads = hypercpu;
                   gwset_thread_callback (&lldata.gwdata, SetAuxThreadPriority);
@@ -10160,7 +12131,9 @@ int writePRPSaveFile (
         gwhandle *gwdata,
         writeSaveFileState *write_save_file_state,
         struct work_unit *w,
-        struct prp_state *ps)
+        struct prp_state *ps,
+        residue_snapshot *snap,         /* Shared binary value of ps->x or NULL */
+        giant   *values)                /* Binary x, alt_x, u0, d from a checkpoint or NULL to use ps's gwnums */
 {
         int     fd;
         unsigned long sum = 0;
@@ -10185,20 +12158,24 @@ int writePRPSaveFile (
         if (!write_long (fd, ps->start_counter, &sum)) goto err;
         if (!write_long (fd, ps->next_mul_counter, &sum)) goto err;
         if (!write_long (fd, ps->end_counter, &sum)) goto err;
-        if (!write_gwnum (fd, gwdata, ps->x, &sum)) goto err;
+        if (values != NULL) {
+                if (!write_giant (fd, values[0], &sum)) goto err;
+        } else {
+                if (!write_gwnum_snapshot (fd, snap, gwdata, ps->x, &sum)) goto err;
+        }
 
         if (ps->state != PRP_STATE_NORMAL && ps->state != PRP_STATE_GERB_MID_BLOCK && ps->state != PRP_STATE_GERB_MID_BLOCK_MULT) {
-                if (!write_gwnum (fd, gwdata, ps->alt_x, &sum)) goto err;
+                if (values != NULL ? !write_giant (fd, values[1], &sum) : !write_gwnum (fd, gwdata, ps->alt_x, &sum)) goto err;
         }
 
         if (ps->state != PRP_STATE_NORMAL && ps->state != PRP_STATE_DCHK_PASS1 && ps->state != PRP_STATE_DCHK_PASS2 &&
             ps->state != PRP_STATE_GERB_START_BLOCK && ps->state != PRP_STATE_GERB_FINAL_MULT) {
-                if (!write_gwnum (fd, gwdata, ps->u0, &sum)) goto err;
+                if (values != NULL ? !write_giant (fd, values[2], &sum) : !write_gwnum (fd, gwdata, ps->u0, &sum)) goto err;
         }
 
         if (ps->state != PRP_STATE_NORMAL && ps->state != PRP_STATE_DCHK_PASS1 && ps->state != PRP_STATE_DCHK_PASS2 &&
             ps->state != PRP_STATE_GERB_START_BLOCK) {
-                if (!write_gwnum (fd, gwdata, ps->d, &sum)) goto err;
+                if (values != NULL ? !write_giant (fd, values[3], &sum) : !write_gwnum (fd, gwdata, ps->d, &sum)) goto err;
         }
 
         if (!write_checksum (fd, sum)) goto err;
@@ -10307,6 +12284,80 @@ err:    _close (fd);
         return (FALSE);
 }
 
+/* Checkpoint a PRP test in memory when the worker is preempted for priority */
+/* work.  The same gwnums are saved as in the save file, which is then written */
+/* from the checkpoint in the background. */
+
+void prpCheckpointValues (
+        struct prp_state *ps,
+        gwnum   *values)
+{
+        values[0] = ps->x;
+        values[1] = (ps->state != PRP_STATE_NORMAL && ps->state != PRP_STATE_GERB_MID_BLOCK && ps->state != PRP_STATE_GERB_MID_BLOCK_MULT) ? ps->alt_x : NULL;
+        values[2] = (ps->state != PRP_STATE_NORMAL && ps->state != PRP_STATE_DCHK_PASS1 && ps->state != PRP_STATE_DCHK_PASS2 &&
+                     ps->state != PRP_STATE_GERB_START_BLOCK && ps->state != PRP_STATE_GERB_FINAL_MULT) ? ps->u0 : NULL;
+        values[3] = (ps->state != PRP_STATE_NORMAL && ps->state != PRP_STATE_DCHK_PASS1 && ps->state != PRP_STATE_DCHK_PASS2 &&
+                     ps->state != PRP_STATE_GERB_START_BLOCK) ? ps->d : NULL;
+}
+
+int writePRPCheckpointSaveFile (
+        struct preempt_checkpoint *cp)
+{
+        struct prp_state ps;
+
+        memcpy (&ps, cp->state, sizeof (struct prp_state));
+        return (writePRPSaveFile (NULL, &cp->write_save_file_state, &cp->w, &ps, NULL, cp->values));
+}
+
+int prpCheckpointSave (
+        int     thread_num,
+        struct work_unit *w,
+        gwhandle *gwdata,
+        struct prp_state *ps,
+        residue_snapshot *snap,         /* Shared binary value of ps->x */
+        writeSaveFileState *write_save_file_state)
+{
+        gwnum   values[4];
+
+        prpCheckpointValues (ps, values);
+        return (preemptCheckpointSave (thread_num, w, ps, sizeof (struct prp_state), gwdata, snap, 4, values,
+                                       write_save_file_state, &writePRPCheckpointSaveFile));
+}
+
+int prpCheckpointRestore (
+        int     thread_num,
+        struct work_unit *w,
+        gwhandle *gwdata,
+        struct prp_state *ps)
+{
+        struct prp_state saved_ps;
+        gwnum   values[4];
+
+/* The state determines which gwnums were checkpointed, peek at it first */
+
+        if (!PREEMPT_CHECKPOINT[thread_num].valid) return (FALSE);
+        memcpy (&saved_ps, PREEMPT_CHECKPOINT[thread_num].state, sizeof (struct prp_state));
+        if (saved_ps.error_check_type != ps->error_check_type) {
+                preemptCheckpointDiscard (thread_num);
+                return (FALSE);
+        }
+        saved_ps.x = ps->x;
+        saved_ps.alt_x = ps->alt_x;
+        saved_ps.u0 = ps->u0;
+        saved_ps.d = ps->d;
+        prpCheckpointValues (&saved_ps, values);
+        if (!preemptCheckpointRestore (thread_num, w, &saved_ps, sizeof (struct prp_state), gwdata, 4, values)) return (FALSE);
+
+/* Copy the scalar state, keeping this run's gwnums */
+
+        saved_ps.x = ps->x;
+        saved_ps.alt_x = ps->alt_x;
+        saved_ps.u0 = ps->u0;
+        saved_ps.d = ps->d;
+        *ps = saved_ps;
+        return (TRUE);
+}
+
 /* Output the good news of a new probable prime to the screen in an infinite loop */
 
 void good_news_prp (void *arg)
@@ -10336,6 +12387,14 @@ int areTwoPRPValsEqual (
 {
         giant   tmp1, tmp2;
         int     diff, err_code1, err_code2;
+        uint64_t fp1, fp2;
+
+/* Compare fingerprints first.  Matching fingerprints are convincing proof the values are equal. */
+/* A mismatch may be a genuine error, so only then do we pay for two full binary conversions. */
+/* Fingerprinting declines zero values, letting the code below flag them as errors. */
+
+        if (gwfingerprint2 (gwdata, val1, units_bit1, val2, units_bit2, &fp1, &fp2) == TRUE &&
+            fp1 == fp2) return (TRUE);
 
         tmp1 = popg (&gwdata->gdata, ((unsigned long) gwdata->bit_length >> 5) + 5);
         err_code1 = gwtogiant (gwdata, val1, tmp1) || isZero (tmp1);
@@ -10356,7 +12415,7 @@ void basemulg (
         unsigned int prp_base,          /* PRP base */
         int     power)                  /* Desired power of the PRP base */
 {
-        mpz_t   modulus, prp_base_power, tmp;
+        mpz_t   modulus, prp_base_power, tmp, v_view;
 
 /* If power is zero, then multiply by base^0 is a no-op */
 
@@ -10374,10 +12433,10 @@ void basemulg (
         mpz_init_set_ui (prp_base_power, prp_base);
         mpz_powm (prp_base_power, prp_base_power, tmp, modulus);
 
-/* Copy the giant value to tmp.  Multiply by prp_base_power to get the final result */
+/* Multiply the giant value by prp_base_power to get the final result */
 
-        gtompz (v, tmp);
-        mpz_mul (tmp, tmp, prp_base_power);
+        gtompz_view (v, v_view);
+        mpz_mul (tmp, v_view, prp_base_power);
         mpz_mod (tmp, tmp, modulus);
         mpztog (tmp, v);
 
@@ -10412,12 +12471,10 @@ int isPRPg (
                 return (result);
         }
 
-/* Convert giants to mpz_t type */
+/* View giants as mpz_t type */
 
-        mpz_init (mpz_v);
-        gtompz (v, mpz_v);
-        mpz_init (mpz_N);
-        gtompz (N, mpz_N);
+        gtompz_view (v, mpz_v);
+        gtompz_view (N, mpz_N);
         mpz_init (compare_val);
 
 /* Handle the cofactor case.  We calculated v = a^(N*KF-1) mod (N*KF).  We have a PRP if (v mod N) = (a^(KF-1)) mod N */
@@ -10470,8 +12527,6 @@ int isPRPg (
 
 /* Cleanup and return */
 
-        mpz_clear (mpz_v);
-        mpz_clear (mpz_N);
         mpz_clear (compare_val);
         return (result);
 }
@@ -10488,8 +12543,11 @@ int prp (
         struct prp_state ps;
         gwhandle gwdata;
         giant   N, exp, tmp;
+        residue_snapshot snap;
         int     first_iter_msg, res, stop_reason;
         int     echk, near_fft_limit, sleep5, isProbablePrime;
+        int     numa_map[MAX_NUMA_MAP_THREADS];
+        roundoff_sampler rs;
         int     interim_counter_off_one, interim_mul, mul_final;
         unsigned long explen, final_counter, iters;
         int     slow_iteration_count;
@@ -10498,6 +12556,8 @@ int prp (
         double  reallyminerr = 1.0;
         double  reallymaxerr = 0.0;
         double  best_iteration_time;
+        struct perf_monitor perf;
+        struct fft_trial_timer fft_timer;
         readSaveFileState read_save_file_state; /* Manage savefile names during reading */
         writeSaveFileState write_save_file_state; /* Manage savefile names during writing */
         char    filename[32];
@@ -10639,6 +12699,7 @@ int prp (
 /* Null gwnums and giants in case they get freed */
 
 begin:  N = exp = NULL;
+        residue_snapshot_init (&snap, &gwdata);
 
 /* Init the FFT code for squaring modulo k*b^n+c */
 
@@ -10654,11 +12715,17 @@ begin:  N = exp = NULL;
         gwset_bench_workers (&gwdata, NUM_WORKER_THREADS);
         if (ERRCHK) gwset_will_error_check (&gwdata);
         else gwset_will_error_check_near_limit (&gwdata);
-        gwset_num_threads (&gwdata, CORES_PER_TEST[thread_num] * sp_info->normal_work_hyperthreads);
+        gwset_num_threads (&gwdata, worker_num_cores (thread_num) * sp_info->normal_work_hyperthreads);
+        gwset_numa_nodes (&gwdata, fft_numa_map (sp_info, gwget_num_threads (&gwdata), numa_map), numa_map);
         gwset_thread_callback (&gwdata, SetAuxThreadPriority);
         gwset_thread_callback_data (&gwdata, sp_info);
-        gwset_minimum_fftlen (&gwdata, w->minimum_fftlen);
         gwset_safety_margin (&gwdata, IniGetFloat (INI_FILE, "ExtraSafetyMargin", 0.0));
+        gwset_minimum_fftlen (&gwdata, fft_trial_prepare (thread_num, w, &gwdata, w->minimum_fftlen));
+/* Numbers too large for our FFTs can be tested using GMP, but at 20 to 30 times the cost of */
+/* an FFT a test near the FFT limit would take many years.  Thus, this is off by default and */
+/* such work units are rejected by gwsetup.  PRPUseGMP=1 allows GMP for numbers too large */
+/* for our FFTs, PRPUseGMP=2 uses GMP even when an FFT would work (for testing). */
+        gwset_gmp_fallback (&gwdata, IniGetInt (INI_FILE, "PRPUseGMP", 0));
         res = gwsetup (&gwdata, w->k, w->b, w->n, w->c);
 
 /* If we were unable to init the FFT code, then print an error message */
@@ -10697,10 +12764,8 @@ begin:  N = exp = NULL;
                 mpz_t   tmp;
                 int     is_divisible;
 
-                mpz_init (tmp);
-                gtompz (N, tmp);
+                gtompz_view (N, tmp);
                 is_divisible = mpz_divisible_ui_p (tmp, ps.prp_base);
-                mpz_clear (tmp);
                 if (is_divisible) {
                         sprintf (buf, "PRP test of %s aborted -- number is divisible by %u\n", gwmodulo_as_string (&gwdata), ps.prp_base);
                         OutputBoth (thread_num, buf);
@@ -10775,6 +12840,13 @@ begin:  N = exp = NULL;
         sprintf (buf, "PRP %s", string_rep);
         title (thread_num, buf);
 
+/* If we were preempted for priority work in the middle of this test, resume from memory. */
+
+        if (prpCheckpointRestore (thread_num, w, &gwdata, &ps)) {
+                first_iter_msg = TRUE;
+                goto resumed;
+        }
+
 /* Loop reading from save files (and backup save files).  Limit number of backup */
 /* files we try to read in case there is an error deleting bad save files. */
 
@@ -10822,6 +12894,7 @@ begin:  N = exp = NULL;
 /* If this is a restart from an error, use the incremented error_count in restart_error_count */
 /* rather than the error_count from a save file. */
 
+resumed:
         if (restart_error_count) ps.error_count = restart_error_count;
 
 /* Output a message saying we are starting/resuming the PRP test. */
@@ -10889,6 +12962,8 @@ begin:  N = exp = NULL;
 
         best_iteration_time = 1.0e50;
         slow_iteration_count = 0;
+        perf_monitor_init (thread_num, &perf, &gwdata);
+        fft_trial_init (thread_num, &fft_timer, &gwdata);
 
 /* Clear all timers */
 
@@ -10912,12 +12987,13 @@ begin:  N = exp = NULL;
 /* running the first-test and double-check simultaneously. */
 
         allowable_maxerr = IniGetFloat (INI_FILE, "MaxRoundoffError", (float) (near_fft_limit ? 0.421875 : 0.40625));
+        roundoff_sampler_init (&rs, allowable_maxerr);
 
 /* Set the proper starting value and state if no save file was present */
 
         if (ps.counter == 0) {
-                /* For Mersenne numbers we support FFT data shifting */
-                if (w->k == 1.0 && w->b == 2 && w->n > 1000 && w->c == -1) {
+                /* For Mersenne numbers we support FFT data shifting (there is no FFT data to shift when using GMP) */
+                if (w->k == 1.0 && w->b == 2 && w->n > 1000 && w->c == -1 && ! gw_using_gmp (&gwdata)) {
                         unsigned long word, bit_in_word;
                         // Generate a random initial shift count
                         srand ((unsigned) time (NULL));
@@ -11013,6 +13089,7 @@ rotateg (t1, w->n, ps.units_bit, &gwdata.gdata);
                 unsigned long *units_bit;       /* Pointer to units_bit to update */
                 int     saving, saving_highly_reliable, sending_residue, interim_residue, interim_file;
                 int     actual_frequency;
+                unsigned long interim_reshi, interim_reslo;
 
 /* If this is the first iteration of a Gerbicz error-checking block, then */
 /* determine "L" -- the number of squarings between each Gerbicz multiplication */
@@ -11062,10 +13139,12 @@ rotateg (t1, w->n, ps.units_bit, &gwdata.gdata);
                 saving_highly_reliable = FALSE;
 
 /* Round off error check the first and last 50 iterations, before writing a save file, near an FFT size's limit, */
-/* or check every iteration option is set, and every 128th iteration. */
+/* or check every iteration option is set, and every 128th iteration.  Gerbicz PRP tests near the limit can */
+/* also sample round off (see roundoff_sampler). */
 
                 echk = ERRCHK || ps.counter < 50 || ps.counter >= final_counter-50 || saving ||
-                       (ps.error_check_type == PRP_ERRCHK_NONE && (near_fft_limit || ((ps.counter & 127) == 0)));
+                       (ps.error_check_type == PRP_ERRCHK_NONE && (near_fft_limit || ((ps.counter & 127) == 0))) ||
+                       (ps.error_check_type != PRP_ERRCHK_NONE && near_fft_limit && roundoff_sample_due (&rs, ps.counter));
                 gw_clear_maxerr (&gwdata);
 
 /* Check if we should send residue to server, output residue to screen, or create an interediate save file */
@@ -11188,6 +13267,8 @@ OutputStr (thread_num, "Iteration failed.\n");
                 if (echk) {
                         if (ps.counter > 30 && gw_get_maxerr (&gwdata) < reallyminerr) reallyminerr = gw_get_maxerr (&gwdata);
                         if (gw_get_maxerr (&gwdata) > reallymaxerr) reallymaxerr = gw_get_maxerr (&gwdata);
+                        if (near_fft_limit && ps.error_check_type != PRP_ERRCHK_NONE)
+                                roundoff_sample_result (thread_num, &rs, ps.counter, gw_get_maxerr (&gwdata));
                 }
 
 /* If the sum of the output values is an error (such as infinity) then raise an error. */
@@ -11519,10 +13600,23 @@ OutputStr (thread_num, "Iteration failed.\n");
                         }
                 }
 
+/* If the save file writers or residue printers need the binary value of this */
+/* iteration, take one snapshot they all share so gwtogiant is called only once. */
+
+                residue_snapshot_invalidate (&snap);
+                if (saving || sending_residue || interim_residue || interim_file)
+                        residue_snapshot_take (&snap, x);
+
 /* Write results to a file every DISK_WRITE_TIME minutes */
 
+/* When preempted for priority work, checkpoint in memory and let a background thread write the save file */
+
+                if (saving && stop_reason == STOP_PRIORITY_WORK &&
+                    prpCheckpointSave (thread_num, w, &gwdata, &ps, &snap, &write_save_file_state))
+                        saving = FALSE;
+
                 if (saving) {
-                        if (! writePRPSaveFile (&gwdata, &write_save_file_state, w, &ps)) {
+                        if (! writePRPSaveFile (&gwdata, &write_save_file_state, w, &ps, &snap, NULL)) {
                                 sprintf (buf, WRITEFILEERR, filename);
                                 OutputBoth (thread_num, buf);
                         }
@@ -11541,6 +13635,31 @@ OutputStr (thread_num, "Iteration failed.\n");
                         goto exit;
                 }
 
+/* Compute the interim 64-bit residue once for both the server and the screen */
+
+                if ((sending_residue && w->assignment_uid[0]) || interim_residue) {
+                        giant   g;
+                        int     err_code;
+                        g = residue_snapshot_giant (&snap, x, &err_code);
+                        tmp = popg (&gwdata.gdata, ((unsigned long) gwdata.bit_length >> 5) + 5);
+                        if (g != NULL) gtog (g, tmp);
+                        else if (err_code || gwtogiant (&gwdata, x, tmp)) {
+                                pushg (&gwdata.gdata, 1);
+                                OutputBoth (thread_num, ERRMSG8);
+                                inc_error_count (2, &ps.error_count);
+                                last_counter = ps.counter;              /* create save files before and after this iteration */
+                                restart_counter = -1;                   /* rollback to any save file */
+                                sleep5 = TRUE;
+                                goto restart;
+                        }
+                        rotateg (tmp, w->n, *units_bit, &gwdata.gdata);
+                        if (interim_mul) basemulg (tmp, w, ps.prp_base, -1);
+                        if (w->known_factors && ps.residue_type != PRIMENET_PRP_TYPE_COFACTOR) modg (N, tmp);
+                        interim_reshi = (unsigned long) tmp->n[1];
+                        interim_reslo = (unsigned long) tmp->n[0];
+                        pushg (&gwdata.gdata, 1);
+                }
+
 /* Send the 64-bit residue to the server at specified interims.  The server will record */
 /* the residues for possible verification at a later date.  We could catch suspect computers */
 /* or malicious cheaters without doing a full double-check. */
@@ -11557,46 +13676,18 @@ OutputStr (thread_num, "Iteration failed.\n");
                         pkt.next_update = (uint32_t) (DAYS_BETWEEN_CHECKINS * 86400.0);
                         pkt.fftlen = w->fftlen;
                         pkt.iteration = ps.counter - interim_counter_off_one;
-                        tmp = popg (&gwdata.gdata, ((unsigned long) gwdata.bit_length >> 5) + 5);
-                        if (gwtogiant (&gwdata, x, tmp)) {
-                                pushg (&gwdata.gdata, 1);
-                                OutputBoth (thread_num, ERRMSG8);
-                                inc_error_count (2, &ps.error_count);
-                                last_counter = ps.counter;              /* create save files before and after this iteration */
-                                restart_counter = -1;                   /* rollback to any save file */
-                                sleep5 = TRUE;
-                                goto restart;
-                        }
-                        rotateg (tmp, w->n, *units_bit, &gwdata.gdata);
-                        if (interim_mul) basemulg (tmp, w, ps.prp_base, -1);
-                        if (w->known_factors && ps.residue_type != PRIMENET_PRP_TYPE_COFACTOR) modg (N, tmp);
-                        sprintf (pkt.residue, "%08lX%08lX", (unsigned long) tmp->n[1], (unsigned long) tmp->n[0]);
+                        sprintf (pkt.residue, "%08lX%08lX", interim_reshi, interim_reslo);
                         sprintf (pkt.error_count, "%08lX", ps.error_count);
                         spoolMessage (-PRIMENET_ASSIGNMENT_PROGRESS, &pkt);
-                        pushg (&gwdata.gdata, 1);
                 }
 
 /* Output the 64-bit residue at specified interims. */
 
                 if (interim_residue) {
-                        tmp = popg (&gwdata.gdata, ((unsigned long) gwdata.bit_length >> 5) + 5);
-                        if (gwtogiant (&gwdata, x, tmp)) {
-                                pushg (&gwdata.gdata, 1);
-                                OutputBoth (thread_num, ERRMSG8);
-                                inc_error_count (2, &ps.error_count);
-                                last_counter = ps.counter;              /* create save files before and after this iteration */
-                                restart_counter = -1;                   /* rollback to any save file */
-                                sleep5 = TRUE;
-                                goto restart;
-                        }
-                        rotateg (tmp, w->n, *units_bit, &gwdata.gdata);
-                        if (interim_mul) basemulg (tmp, w, ps.prp_base, -1);
-                        if (w->known_factors && ps.residue_type != PRIMENET_PRP_TYPE_COFACTOR) modg (N, tmp);
                         sprintf (buf, "%s interim PRP residue %08lX%08lX at iteration %ld\n",
-                                 string_rep, (unsigned long) tmp->n[1], (unsigned long) tmp->n[0],
+                                 string_rep, interim_reshi, interim_reslo,
                                  ps.counter - interim_counter_off_one);
                         OutputBoth (thread_num, buf);
-                        pushg (&gwdata.gdata, 1);
                 }
 
 /* Write a save file every INTERIM_FILES iterations. */
@@ -11607,7 +13698,7 @@ OutputStr (thread_num, "Iteration failed.\n");
                         sprintf (interimfile, "%s.%03ld", filename, ps.counter / INTERIM_FILES);
                         writeSaveFileStateInit (&state, interimfile, 0);
                         state.num_ordinary_save_files = 99;
-                        writePRPSaveFile (&gwdata, &state, w, &ps);
+                        writePRPSaveFile (&gwdata, &state, w, &ps, &snap, NULL);
                 }
 
 /* If ten iterations take 40% longer than a typical iteration, then */
@@ -11629,6 +13720,11 @@ OutputStr (thread_num, "Iteration failed.\n");
                         } else
                                 slow_iteration_count = 0;
                 }
+
+/* Feed the iteration time to the performance anomaly detector and the FFT implementation trials */
+
+                perf_monitor_iteration (thread_num, &perf, timer_value (timers, 1));
+                fft_trial_iteration (thread_num, &fft_timer, &gwdata, w, timer_value (timers, 1));
         }
 #ifdef CHECK_ITER
 pushg(&gwdata.gdata, 2);}
@@ -11842,7 +13938,8 @@ pushg(&gwdata.gdata, 2);}
 
 /* Cleanup and exit */
 
-exit:   gwdone (&gwdata);
+exit:   residue_snapshot_term (&snap);
+        gwdone (&gwdata);
         free (N);
         free (exp);
         return (stop_reason);
@@ -11866,6 +13963,7 @@ restart:if (sleep5) OutputBoth (thread_num, ERRMSG2);
 
 /* Return so that last continuation file is read in */
 
+        residue_snapshot_term (&snap);
         gwdone (&gwdata);
         free (N);
         free (exp);
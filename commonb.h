@@ -73,6 +73,9 @@ struct PriorityInfo {
         };
 };
 void SetPriority (struct PriorityInfo *);
+#define MAX_NUMA_MAP_THREADS    256     /* Largest multithreaded FFT partitioned by NUMA node */
+int fft_numa_map (struct PriorityInfo *, int, int *);
+unsigned int worker_num_cores (int);
 
 /* Internal routines that do the real work */
 
@@ -90,6 +93,10 @@ int prime (int, struct PriorityInfo *, struct work_unit *, int);
 int prp (int, struct PriorityInfo *, struct work_unit *, int);
 int ecm (int, struct PriorityInfo *, struct work_unit *);
 int pminus1 (int, struct PriorityInfo *, struct work_unit *);
+void pm1_stage2_help (int, struct PriorityInfo *);
+void stage2_handoff_init (void);
+void stage2_handoff_discard (int, struct work_unit *);
+void preemptCheckpointDiscard (int);
 int pfactor (int, struct PriorityInfo *, struct work_unit *);
 double guess_pminus1_probability (struct work_unit *w);
 void autoBench (void);
@@ -97,7 +104,12 @@ void autoBench (void);
 /* Utility routines */
 
 int isKnownMersennePrime (unsigned long);
-void makestr (unsigned long, unsigned long, unsigned long, char *);
+void gmp_arena_init (void);
+void gmp_arena_term (int);
+unsigned long gmp_arena_mem (int);
+void gmp_arena_begin (int, gwhandle *);
+void gmp_arena_end (void);
+void makestr (unsigned long, unsigned long, unsigned long, unsigned long, char *);
 
 /* Stop routines */
 
@@ -117,11 +129,14 @@ void makestr (unsigned long, unsigned long, unsigned long, char *);
 #define STOP_PRIORITY_WORK      51      /* Priority work, restart thread */
 #define STOP_BATTERY            52      /* On battery - pause */
 #define STOP_AUTOBENCH          53      /* Stop worker for a little while to run auto-benchmarks */
+#define STOP_STAGE2_HELP        54      /* Help another worker with its P-1 stage 2 */
 #define STOP_REREAD_INI         100     /* Reread prime.ini because a */
                                         /* during/else time period has changed */
 #define STOP_RESTART            101     /* Important INI option changed */
 #define STOP_MEM_CHANGED        102     /* Day/night memory change */
 #define STOP_NOT_ENOUGH_MEM     103     /* Not enough memory for P-1 stage 2 */
+#define STOP_PERF_ANOMALY       104     /* Performance anomaly detector is restarting the work unit */
+#define STOP_FFT_TRIAL          105     /* Restarting the work unit with a different FFT implementation */
 
 EXTERNC int stopCheck (int);
 void stop_workers_for_escape (void);
@@ -138,6 +153,7 @@ void stop_workers_for_reread_ini (void);
 void restart_waiting_workers (int);
 void restart_one_waiting_worker (int, int);
 void stop_worker_for_abort (int);
+void stop_worker_for_stage2_help (int);
 
 /* Routines dealing with day/night memory settings */
 
@@ -192,6 +208,29 @@ double get_load_average (void);         /* Implemented by each OS */
 void checkLoadAverage (void);
 void implement_loadavg (int thread_num);
 
+/* Routines to coordinate with other processes on this host */
+
+#define HOST_LOCK_SIZE  128     /* Bytes reserved for the OS-specific interprocess lock */
+#define HOST_CHECK_FREQ 30      /* Check on other processes every 30 seconds */
+void host_attach (void);
+void host_detach (void);
+void host_claim_cores (void);
+void host_release (void);
+unsigned long host_others_memory (void);
+void host_set_memory (unsigned long);
+void host_write_bench_data (void);
+void start_host_timer (void);
+void stop_host_timer (void);
+void host_check (void);
+void *host_shm_attach (const char *, unsigned long, int *); /* Implemented by each OS */
+void host_shm_detach (void *, unsigned long);           /* Implemented by each OS */
+void host_shm_remove (const char *);                    /* Implemented by each OS */
+void host_shm_lock_init (void *);                       /* Implemented by each OS */
+void host_shm_lock (void *);                            /* Implemented by each OS */
+void host_shm_unlock (void *);                          /* Implemented by each OS */
+unsigned long host_getpid (void);                       /* Implemented by each OS */
+int host_process_alive (unsigned long);                 /* Implemented by each OS */
+
 /* throttle routines */
 
 void start_throttle_timer (void);
@@ -212,6 +251,9 @@ int ecm_QA (int, struct PriorityInfo *);
 int pminus1_QA (int, struct PriorityInfo *);
 int test_randomly (int, struct PriorityInfo *);
 int test_all_impl (int, struct PriorityInfo *);
+int test_all_impl_sweep (int, struct PriorityInfo *);
+int test_sincos_tables (int);
+int test_gmp_mul (int);
 
 /* Messages */
 
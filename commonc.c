@@ -48,6 +48,7 @@ unsigned long volatile ITER_OUTPUT = 0;
 unsigned long volatile ITER_OUTPUT_RES = 999999999;
 unsigned long volatile DISK_WRITE_TIME = 30;
 unsigned long volatile JACOBI_TIME = 12; /* Run a Jacobi test every 12 hours */
+unsigned long volatile CONFIG_GENERATION = 0; /* Incremented when live INI settings are reloaded */
 unsigned int MODEM_RETRY_TIME = 2;
 unsigned int NETWORK_RETRY_TIME = 70;
 float   DAYS_BETWEEN_CHECKINS = 1.0;
@@ -1088,6 +1089,8 @@ void nameAndReadIniFiles (
         gwmutex_init (&OUTPUT_MUTEX);
         gwmutex_init (&LOG_MUTEX);
         gwmutex_init (&WORKTODO_MUTEX);
+        gmp_arena_init ();
+        stage2_handoff_init ();
 
 /* Figure out the names of the INI files */
 
@@ -1372,6 +1375,164 @@ void read_cores_per_test (void)
         }
 }
 
+/* INI settings that do not affect FFT selection, thread layout, or memory */
+/* allocation.  The worker threads consult these globals as they run, so a */
+/* change to any of them can be applied without restarting the workers. */
+/* readLiveIniSettings reads each setting in this table, and a change to any */
+/* other setting means the workers must restart.  Entries without a variable */
+/* are read by the code at the end of readLiveIniSettings. */
+
+#define LIVE_INT        0
+#define LIVE_UINT       1
+#define LIVE_ULONG      2
+
+struct live_ini_setting {
+        const char *keyword;
+        const char *filename;   /* INI_FILE or LOCALINI_FILE */
+        int     type;
+        volatile void *value;   /* Global to set, NULL if read by other code */
+        long    def;            /* Default value */
+        long    min, max;       /* Clamp to this range unless both are zero */
+};
+
+static const struct live_ini_setting LIVE_INI_SETTINGS[] = {
+        {"DaysOfWork", INI_FILE, LIVE_UINT, &DAYS_OF_WORK, 3, 0, 180},
+        {"CPUHours", LOCALINI_FILE, LIVE_UINT, &CPU_HOURS, 24, 1, 24},
+        {"PercentPrecision", INI_FILE, LIVE_UINT, &PRECISION, 2, 0, 6},
+        {"ClassicOutput", INI_FILE, LIVE_INT, &CLASSIC_OUTPUT, 0, 0, 0},
+        {"OutputRoundoff", INI_FILE, LIVE_INT, &OUTPUT_ROUNDOFF, 0, 0, 0},
+        {"OutputIterations", INI_FILE, LIVE_ULONG, &ITER_OUTPUT, 10000, 1, 999999999},
+        {"ResultsFileIterations", INI_FILE, LIVE_ULONG, &ITER_OUTPUT_RES, 999999999, 1000, 999999999},
+        {"DiskWriteTime", INI_FILE, LIVE_ULONG, &DISK_WRITE_TIME, 30, 0, 0},
+        {"JacobiErrorCheckingInterval", INI_FILE, LIVE_ULONG, &JACOBI_TIME, 12, 1, 0x7FFFFFFF},
+        {"NetworkRetryTime", INI_FILE, LIVE_UINT, &MODEM_RETRY_TIME, 2, 1, 300},
+        {"NetworkRetryTime2", INI_FILE, LIVE_UINT, NULL},
+        {"DaysBetweenCheckins", INI_FILE, LIVE_INT, NULL},
+        {"SilentVictory", INI_FILE, LIVE_INT, &SILENT_VICTORY, 0, 0, 0},
+        {"SilentVictoryPRP", INI_FILE, LIVE_INT, &SILENT_VICTORY_PRP, 1, 0, 0},
+        {"BatteryPercent", INI_FILE, LIVE_INT, &BATTERY_PERCENT, 0, 0, 0},
+        {"Priority", INI_FILE, LIVE_UINT, &PRIORITY, 1, 1, 10},
+        {"TwoBackupFiles", INI_FILE, LIVE_INT, NULL},
+        {"NumBackupFiles", INI_FILE, LIVE_INT, NULL},
+        {"JacobiBackupFiles", INI_FILE, LIVE_INT, &NUM_JACOBI_BACKUP_FILES, 2, 0, 0},
+        {"TimeStamp", INI_FILE, LIVE_INT, &TIMESTAMPING, 1, 0, 0},
+        {"CumulativeTiming", INI_FILE, LIVE_INT, &CUMULATIVE_TIMING, 0, 0, 0},
+        {"CumulativeRoundoff", INI_FILE, LIVE_INT, &CUMULATIVE_ROUNDOFF, 1, 0, 0},
+        {"PauseWhileRunning", INI_FILE, LIVE_INT, NULL},
+        {"PauseCheckInterval", INI_FILE, LIVE_INT, NULL},
+        {"LowMemWhileRunning", INI_FILE, LIVE_INT, NULL},
+        {"InterimFiles", INI_FILE, LIVE_ULONG, &INTERIM_FILES, 0, 0, 0},
+        {"InterimResidues", INI_FILE, LIVE_ULONG, NULL},
+        {"HyperthreadingBackoff", INI_FILE, LIVE_ULONG, &HYPERTHREADING_BACKOFF, 0, 0, 0}, //bug default CPU_HYPERTHREADS <= 1 ? 0 : 30
+        {"Throttle", INI_FILE, LIVE_INT, &THROTTLE_PCT, 0, 0, 0},     /* Sleep after every iteration to keep temperatures down */
+        {"HotConfigReload", INI_FILE, LIVE_INT, NULL}};
+
+#define NUM_LIVE_INI_SETTINGS   (sizeof (LIVE_INI_SETTINGS) / sizeof (LIVE_INI_SETTINGS[0]))
+
+/* The NULL-terminated keyword list IniFileSignature wants */
+
+static const char *LIVE_INI_KEYWORDS[NUM_LIVE_INI_SETTINGS + 1] = {NULL};
+
+const char * const *liveIniKeywords (void)
+{
+        unsigned int i;
+
+        if (LIVE_INI_KEYWORDS[0] == NULL)
+                for (i = 0; i < NUM_LIVE_INI_SETTINGS; i++)
+                        LIVE_INI_KEYWORDS[i] = LIVE_INI_SETTINGS[i].keyword;
+        return (LIVE_INI_KEYWORDS);
+}
+
+/* Read the live INI settings.  Worker threads may be reading these globals */
+/* concurrently, so clamp values in a temporary before storing them. */
+
+void readLiveIniSettings (void)
+{
+        const struct live_ini_setting *setting;
+        long    temp;
+
+        for (setting = LIVE_INI_SETTINGS; setting < LIVE_INI_SETTINGS + NUM_LIVE_INI_SETTINGS; setting++) {
+                if (setting->value == NULL) continue;
+                temp = IniGetInt (setting->filename, setting->keyword, setting->def);
+                if (setting->min || setting->max) {
+                        if (temp < setting->min) temp = setting->min;
+                        if (temp > setting->max) temp = setting->max;
+                }
+                if (setting->type == LIVE_INT) * (volatile int *) setting->value = (int) temp;
+                else if (setting->type == LIVE_UINT) * (volatile unsigned int *) setting->value = (unsigned int) temp;
+                else * (volatile unsigned long *) setting->value = (unsigned long) temp;
+        }
+
+/* Settings whose default depends on another setting */
+
+        temp = IniGetInt (INI_FILE, "NetworkRetryTime2", MODEM_RETRY_TIME > 70 ? MODEM_RETRY_TIME : 70);
+        if (temp < 1) temp = 1;
+        if (temp > 300) temp = 300;
+        NETWORK_RETRY_TIME = (unsigned int) temp;
+        INTERIM_RESIDUES = IniGetInt (INI_FILE, "InterimResidues", INTERIM_FILES);
+
+/* Convert old TwoBackupFiles boolean to new NumBackupFiles integer.  Old default */
+/* was 2 save files, new default is 3 save files. */
+
+        temp = IniGetInt (INI_FILE, "TwoBackupFiles", 2);
+        NUM_BACKUP_FILES = (int) IniGetInt (INI_FILE, "NumBackupFiles", temp+1);
+
+        DAYS_BETWEEN_CHECKINS = IniGetFloat (INI_FILE, "DaysBetweenCheckins", 1.0);
+        if (DAYS_BETWEEN_CHECKINS > 7.0) DAYS_BETWEEN_CHECKINS = 7.0;                           /* 7 day maximum */
+        if (DAYS_BETWEEN_CHECKINS * 24.0 < 1.0) DAYS_BETWEEN_CHECKINS = (float) (1.0 / 24.0);   /* 1 hour minimum */
+
+        read_pause_info ();
+}
+
+/* Reread the INI files while worker threads are running.  If the only */
+/* settings that changed are live settings, apply them and bump the config */
+/* generation that workers poll in stopCheck.  Returns FALSE if the workers */
+/* must be restarted for the new settings to take effect. */
+
+int reloadLiveIniSettings (void)
+{
+        unsigned long ini_sig, localini_sig, old_disk_write_time, old_jacobi_time;
+        int     old_throttle_pct;
+
+        if (! IniGetInt (INI_FILE, "HotConfigReload", 1)) return (FALSE);
+
+/* Take signatures of the settings we are running with, then reread. */
+/* Any worktodo.add file requires a full restart. */
+
+        ini_sig = IniFileSignature (INI_FILE, liveIniKeywords ());
+        localini_sig = IniFileSignature (LOCALINI_FILE, liveIniKeywords ());
+        IniFileReread (INI_FILE);
+        IniFileReread (LOCALINI_FILE);
+        incorporateIniAddFiles ();
+        if (addFileExists ()) return (FALSE);
+        if (ini_sig != IniFileSignature (INI_FILE, liveIniKeywords ()) ||
+            localini_sig != IniFileSignature (LOCALINI_FILE, liveIniKeywords ()))
+                return (FALSE);
+
+/* Apply the live settings.  Restart the timers whose period changed. */
+
+        old_disk_write_time = DISK_WRITE_TIME;
+        old_jacobi_time = JACOBI_TIME;
+        old_throttle_pct = THROTTLE_PCT;
+        readLiveIniSettings ();
+        if (WORKER_THREADS_ACTIVE && LAUNCH_TYPE == LD_CONTINUE) {
+                if (DISK_WRITE_TIME != old_disk_write_time) {
+                        stop_save_files_timer ();
+                        start_save_files_timer ();
+                }
+                if (JACOBI_TIME != old_jacobi_time) {
+                        stop_Jacobi_timer ();
+                        start_Jacobi_timer ();
+                }
+                if (THROTTLE_PCT != old_throttle_pct) {
+                        stop_throttle_timer ();
+                        start_throttle_timer ();
+                }
+        }
+        CONFIG_GENERATION++;
+        return (TRUE);
+}
+
 /* Read or re-read the INI files & and do other initialization */
 
 int readIniFiles (void)
@@ -1414,12 +1575,6 @@ int readIniFiles (void)
         sanitizeString (COMPID);
         USE_PRIMENET = (int) IniGetInt (INI_FILE, "UsePrimenet", 0);
         DIAL_UP = (int) IniGetInt (INI_FILE, "DialUp", 0);
-        DAYS_OF_WORK = (unsigned int) IniGetInt (INI_FILE, "DaysOfWork", 3);
-        if (DAYS_OF_WORK > 180) DAYS_OF_WORK = 180;
-
-        CPU_HOURS = (unsigned int) IniGetInt (LOCALINI_FILE, "CPUHours", 24);
-        if (CPU_HOURS < 1) CPU_HOURS = 1;
-        if (CPU_HOURS > 24) CPU_HOURS = 24;
 
         ROLLING_AVERAGE = (unsigned int) IniGetInt (LOCALINI_FILE, "RollingAverage", 1000);
         if (ROLLING_AVERAGE < 10) ROLLING_AVERAGE = 10;
@@ -1431,36 +1586,7 @@ int readIniFiles (void)
                 IniWriteInt (LOCALINI_FILE, "RollingAverageIsFromV27", 1);
         }
 
-        PRECISION = (unsigned int) IniGetInt (INI_FILE, "PercentPrecision", 2);
-        if (PRECISION > 6) PRECISION = 6;
-
-        CLASSIC_OUTPUT = IniGetInt (INI_FILE, "ClassicOutput", 0);
-        OUTPUT_ROUNDOFF = IniGetInt (INI_FILE, "OutputRoundoff", 0);
-        ITER_OUTPUT = IniGetInt (INI_FILE, "OutputIterations", 10000);
-        if (ITER_OUTPUT > 999999999) ITER_OUTPUT = 999999999;
-        if (ITER_OUTPUT <= 0) ITER_OUTPUT = 1;
-        ITER_OUTPUT_RES = IniGetInt (INI_FILE, "ResultsFileIterations", 999999999);
-        if (ITER_OUTPUT_RES > 999999999) ITER_OUTPUT_RES = 999999999;
-        if (ITER_OUTPUT_RES < 1000) ITER_OUTPUT_RES = 1000;
-        DISK_WRITE_TIME = IniGetInt (INI_FILE, "DiskWriteTime", 30);
-        JACOBI_TIME = IniGetInt (INI_FILE, "JacobiErrorCheckingInterval", 12);
-        if (JACOBI_TIME < 1) JACOBI_TIME = 1;
-        MODEM_RETRY_TIME = (unsigned int) IniGetInt (INI_FILE, "NetworkRetryTime", 2);
-        if (MODEM_RETRY_TIME < 1) MODEM_RETRY_TIME = 1;
-        if (MODEM_RETRY_TIME > 300) MODEM_RETRY_TIME = 300;
-        NETWORK_RETRY_TIME = (unsigned int)
-                IniGetInt (INI_FILE, "NetworkRetryTime2",
-                           MODEM_RETRY_TIME > 70 ? MODEM_RETRY_TIME : 70);
-        if (NETWORK_RETRY_TIME < 1) NETWORK_RETRY_TIME = 1;
-        if (NETWORK_RETRY_TIME > 300) NETWORK_RETRY_TIME = 300;
-
-        DAYS_BETWEEN_CHECKINS = IniGetFloat (INI_FILE, "DaysBetweenCheckins", 1.0);
-        if (DAYS_BETWEEN_CHECKINS > 7.0) DAYS_BETWEEN_CHECKINS = 7.0;                           /* 7 day maximum */
-        if (DAYS_BETWEEN_CHECKINS * 24.0 < 1.0) DAYS_BETWEEN_CHECKINS = (float) (1.0 / 24.0);   /* 1 hour minimum */
-        SILENT_VICTORY = (int) IniGetInt (INI_FILE, "SilentVictory", 0);
-        SILENT_VICTORY_PRP = (int) IniGetInt (INI_FILE, "SilentVictoryPRP", 1);
         RUN_ON_BATTERY = (int) IniGetInt (LOCALINI_FILE, "RunOnBattery", 1);
-        BATTERY_PERCENT = (int) IniGetInt (INI_FILE, "BatteryPercent", 0);
         DEFEAT_POWER_SAVE = (int) IniGetInt (LOCALINI_FILE, "DefeatPowerSave", 1);
 
         STRESS_TESTER = (int) IniGetInt (INI_FILE, "StressTester", 99);
@@ -1472,9 +1598,6 @@ int readIniFiles (void)
         if (NUM_WORKER_THREADS < 1) NUM_WORKER_THREADS = 1;
         if (NUM_WORKER_THREADS > MAX_NUM_WORKER_THREADS) NUM_WORKER_THREADS = MAX_NUM_WORKER_THREADS;
         IniWriteInt (LOCALINI_FILE, "WorkerThreads", NUM_WORKER_THREADS); // Write in case future prime95 changes good_default_for_num_workers
-        PRIORITY = (unsigned int) IniGetInt (INI_FILE, "Priority", 1);
-        if (PRIORITY < 1) PRIORITY = 1;
-        if (PRIORITY > 10) PRIORITY = 10;
         PTOGetAll (INI_FILE, "WorkPreference", WORK_PREFERENCE, 0);
         read_cores_per_test ();         // Get CORES_PER_TEST array, may require upgrading old INI settings
         HYPERTHREAD_TF = IniGetInt (LOCALINI_FILE, "HyperthreadTF", OS_CAN_SET_AFFINITY);
@@ -1484,13 +1607,6 @@ int readIniFiles (void)
         TRAY_ICON = (int) IniGetInt (INI_FILE, "TrayIcon", 1);
         MERGE_WINDOWS = (int) IniGetInt (INI_FILE, "MergeWindows", MERGE_MAINCOMM_WINDOWS);
 
-/* Convert old TwoBackupFiles boolean to new NumBackupFiles integer.  Old default */
-/* was 2 save files, new default is 3 save files. */
-
-        temp = (int) IniGetInt (INI_FILE, "TwoBackupFiles", 2);
-        NUM_BACKUP_FILES = (int) IniGetInt (INI_FILE, "NumBackupFiles", temp+1);
-        NUM_JACOBI_BACKUP_FILES = (int) IniGetInt (INI_FILE, "JacobiBackupFiles", 2);
-
 /* Convert the old DAY_MEMORY, NIGHT_MEMORY settings into the simpler, all-inclusive */
 /* and more powerful MEMORY setting. */
 
@@ -1520,26 +1636,14 @@ int readIniFiles (void)
 
 /* Other oddball options */
 
-        TIMESTAMPING = IniGetInt (INI_FILE, "TimeStamp", 1);
-        CUMULATIVE_TIMING = IniGetInt (INI_FILE, "CumulativeTiming", 0);
-        CUMULATIVE_ROUNDOFF = IniGetInt (INI_FILE, "CumulativeRoundoff", 1);
         SEQUENTIAL_WORK = IniGetInt (INI_FILE, "SequentialWorkToDo", 1);
         WELL_BEHAVED_WORK = IniGetInt (INI_FILE, "WellBehavedWork", 0);
 
-        read_pause_info ();
         read_load_average_info ();
 
-        INTERIM_FILES = IniGetInt (INI_FILE, "InterimFiles", 0);
-        INTERIM_RESIDUES = IniGetInt (INI_FILE, "InterimResidues", INTERIM_FILES);
-        HYPERTHREADING_BACKOFF =
-                IniGetInt (INI_FILE, "HyperthreadingBackoff",
-0);//bug                   CPU_HYPERTHREADS <= 1 ? 0 : 30);
+/* Read the settings that can change while worker threads are running */
 
-/* Option to slow down the program by sleeping after every iteration.  You */
-/* might use this on a laptop or a computer running in a hot room to keep */
-/* temperatures down and thus reduce the chance of a hardware error.  */
-
-        THROTTLE_PCT = IniGetInt (INI_FILE, "Throttle", 0);
+        readLiveIniSettings ();
 
 /* Now read the work-to-do file */
 
@@ -1721,7 +1825,7 @@ static  int     worktodo_add_disabled = FALSE;
 
 /* Grow the work_unit array if necessary and add this entry */
 
-                rc = addToWorkUnitArray (tnum, w, FALSE);
+                rc = addToWorkUnitArray (tnum, w, ADD_BEFORE_BLANK_LINES);
                 if (rc) goto retrc;
         }
 
@@ -2256,7 +2360,7 @@ void addKnownFermatFactors (
 int addToWorkUnitArray (
         unsigned int tnum,      /* Thread number that will run work unit */
         struct work_unit *w,    /* Work unit to add to array */
-        int     add_to_end)     /* TRUE if we are to add to end of array */
+        int     where)          /* ADD_BEFORE_BLANK_LINES, ADD_TO_END, or ADD_AFTER_CURRENT */
 {
         struct work_unit *insertion_point;
 
@@ -2266,17 +2370,27 @@ int addToWorkUnitArray (
 
         tnum = tnum % NUM_WORKER_THREADS;
 
-/* If add_to_end is set, then we are reading the worktodo.txt file. */
+/* If where is ADD_TO_END, then we are reading the worktodo.txt file. */
 /* Add the entry to the end of the array */
 
-        if (add_to_end)
+        if (where == ADD_TO_END)
                 insertion_point = WORK_UNITS[tnum].last;
 
-/* Otherwise, add ADVANCEDTEST work units to the front of the array after */
-/* any comment lines. */
+/* Add the work unit right after the one the worker is processing, so that */
+/* the worker runs it next.  If the worker is not processing a work unit, */
+/* add it to the front of the array like an ADVANCEDTEST work unit. */
+/* Add ADVANCEDTEST work units to the front of the array after any comment lines. */
 
-        else if (w->work_type == WORK_ADVANCEDTEST) {
-                if (WORK_UNITS[tnum].first != NULL &&
+        else if (where == ADD_AFTER_CURRENT || w->work_type == WORK_ADVANCEDTEST) {
+                insertion_point = NULL;
+                if (where == ADD_AFTER_CURRENT)
+                        for (insertion_point = WORK_UNITS[tnum].first;
+                             insertion_point != NULL;
+                             insertion_point = insertion_point->next) {
+                                if (insertion_point->in_use_count & 0x80000000) break;
+                        }
+                if (insertion_point == NULL &&
+                    WORK_UNITS[tnum].first != NULL &&
                     WORK_UNITS[tnum].first->work_type == WORK_NONE)
                         for (insertion_point = WORK_UNITS[tnum].first;
                              insertion_point->next != NULL;
@@ -2284,8 +2398,6 @@ int addToWorkUnitArray (
                                 if (insertion_point->next->work_type != WORK_NONE)
                                         break;
                         }
-                else
-                        insertion_point = NULL;
         }
 
 /* Add all other work units before the last blank line. */
@@ -2327,410 +2439,328 @@ int addToWorkUnitArray (
         return (0);
 }
 
-/* Read the entire worktodo.txt file into memory.  Return error_code */
-/* if we have a memory or file I/O error. */
+/* Parse one line of worktodo.txt into a work unit structure.  The caller */
+/* must have zeroed the work unit.  Lines that are not keyword=value, as well */
+/* as lines we cannot process, are saved as comment lines.  Optionally returns */
+/* the kind of line parsed.  Returns an error code if out of memory. */
 
-int readWorkToDoFile (void)
+int parseWorkToDoLine (
+        char    *line,          /* Line to parse, CRLF removed */
+        struct work_unit *w,    /* Returned work unit */
+        int     *line_type)     /* Returned WORKTODO_LINE_* value or NULL */
 {
-        FILE    *fd;
-        unsigned int tnum, i, linenum;
-        int     rc;
-        char    line[16384];
-
-/* Grab the lock so that comm thread cannot try to add work units while */
-/* file is being read in. */
-
-        for (i = 1; ; i++) {
-                gwmutex_lock (&WORKTODO_MUTEX);
-
-/* Make sure no other threads are accessing work units right now. */
-/* There should be no worker threads active so any use should be short-lived. */
-
-                if (WORKTODO_IN_USE_COUNT == 0 && !WORKTODO_CHANGED) break;
-                gwmutex_unlock (&WORKTODO_MUTEX);
-                if (i <= 10) {
-                        Sleep (50);
-                        continue;
-                }
-
-/* Uh oh, the lock hasn't been released after half-a-second.  This happens processing large */
-/* worktodo.txt files in communicateWithServer (see James Heinrich's complaints in 26.4 thread). */
-/* As a workaround, we'll simply not re-read the worktodo.txt file now.  We only reread the file */
-/* to pick up any manual edits that may have taken place since the last time worktodo.txt was */
-/* read in (and to process worktodo.add).  Hopefully the comm-with-server thread will finish up */
-/* and we can successfully re-read the worktodo.txt file at a later time. */
-
-                return (0);
-        }
-
-/* Clear file needs writing flag and count of worktodo lines */
+        char    keyword[20];
+        char    *value;
+        unsigned int i;
 
-        WORKTODO_CHANGED = FALSE;
-        WORKTODO_COUNT = 0;
+/* All lines other than keyword=value are saved as comment lines. */
 
-/* Free old work_units for each worker thread. */
-/* We sometimes reread the worktodo.txt file in case the user */
-/* manually edits the file while the program is running. */
+        if (line_type != NULL) *line_type = WORKTODO_LINE_COMMENT;
 
-        for (tnum = 0; tnum < MAX_NUM_WORKER_THREADS; tnum++) {
-                struct work_unit *w, *next_w;
-                for (w = WORK_UNITS[tnum].first; w != NULL; w = next_w) {
-                        next_w = w->next;
-                        free (w->known_factors);
-                        free (w->comment);
-                        free (w);
-                }
-                WORK_UNITS[tnum].first = NULL;
-                WORK_UNITS[tnum].last = NULL;
+        if (((line[0] < 'A' || line[0] > 'Z') &&
+             (line[0] < 'a' || line[0] > 'z'))) {
+comment:    w->work_type = WORK_NONE;
+            w->comment = (char *) malloc (strlen (line) + 1);
+            if (w->comment == NULL) return (OutOfMemory (MAIN_THREAD_NUM));
+            strcpy (w->comment, line);
+            return (0);
         }
 
-/* Read the lines of the work file.  It is OK if the worktodo.txt file */
-/* does not exist. */
-
-        fd = fopen (WORKTODO_FILE, "r");
-        if (fd == NULL) goto done;
-
-        tnum = 0;
-        linenum = 0;
-        while (fgets (line, sizeof (line), fd)) {
-            struct work_unit *w;
-            char keyword[20];
-            char *value;
-
-/* Remove trailing CRLFs */
-
-            if (line[strlen(line)-1] == '\n') line[strlen(line)-1] = 0;
-            if (line[0] && line[strlen(line)-1] == '\r') line[strlen(line)-1] = 0;
-            linenum++;
-
-/* Allocate a work unit structure */
-
-            w = (struct work_unit *) malloc (sizeof (struct work_unit));
-            if (w == NULL) goto nomem;
-            memset (w, 0, sizeof (struct work_unit));
-
-/* A section header precedes each worker thread's work units.  The first */
-/* section need not be preceeded by a section header. */
-
-            if (line[0] == '[' && linenum > 1) {
-                tnum++;
-                if (tnum >= NUM_WORKER_THREADS) {
-                    char        buf[100];
-                    sprintf (buf,
-                             "Too many sections in worktodo.txt.  Moving work from section #%u to #%u.\n",
-                             tnum + 1, tnum % NUM_WORKER_THREADS + 1);
-                    OutputSomewhere (MAIN_THREAD_NUM, buf);
-                    safe_strcpy (line + 9, line);
-                    memcpy (line, ";;MOVED;;", 9);
-                    WORKTODO_CHANGED = TRUE;
-                }
-            }
-
-/* All lines other than keyword=value are saved as comment lines. */
-
-            if (((line[0] < 'A' || line[0] > 'Z') &&
-                 (line[0] < 'a' || line[0] > 'z'))) {
-comment:        w->work_type = WORK_NONE;
-                w->comment = (char *) malloc (strlen (line) + 1);
-                if (w->comment == NULL) goto nomem;
-                strcpy (w->comment, line);
-                goto wdone;
-            }
-
 /* Otherwise, parse keyword=value lines */
 
-            value = strchr (line, '=');
-            if (value == NULL || (int) (value - (char *) line) >= sizeof (keyword) - 1) {
-                char    buf[2100];
+        value = strchr (line, '=');
+        if (value == NULL || (int) (value - (char *) line) >= sizeof (keyword) - 1) {
+            char    buf[2100];
 illegal_line:   sprintf (buf, "Illegal line in worktodo.txt file: %s\n", line);
-                OutputSomewhere (MAIN_THREAD_NUM, buf);
-                goto comment;
-            }
-            *value = 0;
-            strcpy (keyword, line);
-            *value++ = '=';
+            OutputSomewhere (MAIN_THREAD_NUM, buf);
+            if (line_type != NULL) *line_type = WORKTODO_LINE_ILLEGAL;
+            goto comment;
+        }
+        *value = 0;
+        strcpy (keyword, line);
+        *value++ = '=';
 
 /* Set some default values.  Historically, this program worked on */
 /* Mersenne numbers only.  Default to an FFT length chosen by gwnum library. */
 
-            w->k = 1.0;
-            w->b = 2;
-            w->c = -1;
-            w->minimum_fftlen = 0;
-            w->extension[0] = 0;
+        w->k = 1.0;
+        w->b = 2;
+        w->c = -1;
+        w->minimum_fftlen = 0;
+        w->extension[0] = 0;
 
 /* Parse the optional assignment_uid */
 
-            if ((value[0] == 'N' || value[0] == 'n') &&
-                (value[1] == '/') &&
-                (value[2] == 'A' || value[2] == 'a') &&
-                (value[3] == ',')) {
-                w->ra_failed = TRUE;
-                safe_strcpy (value, value+4);
-            }
-            for (i = 0; ; i++) {
-                if (!(value[i] >= '0' && value[i] <= '9') &&
-                    !(value[i] >= 'A' && value[i] <= 'F') &&
-                    !(value[i] >= 'a' && value[i] <= 'f')) break;
-                if (i == 31) {
-                        if (value[32] != ',') break;
-                        value[32] = 0;
-                        strcpy (w->assignment_uid, value);
-                        safe_strcpy (value, value+33);
-                        break;
-                }
+        if ((value[0] == 'N' || value[0] == 'n') &&
+            (value[1] == '/') &&
+            (value[2] == 'A' || value[2] == 'a') &&
+            (value[3] == ',')) {
+            w->ra_failed = TRUE;
+            safe_strcpy (value, value+4);
+        }
+        for (i = 0; ; i++) {
+            if (!(value[i] >= '0' && value[i] <= '9') &&
+                !(value[i] >= 'A' && value[i] <= 'F') &&
+                !(value[i] >= 'a' && value[i] <= 'f')) break;
+            if (i == 31) {
+                    if (value[32] != ',') break;
+                    value[32] = 0;
+                    strcpy (w->assignment_uid, value);
+                    safe_strcpy (value, value+33);
+                    break;
             }
+        }
 
 /* Parse the FFT length to use.  The syntax is FFT_length for x87 cpus and */
 /* FFT2_length for SSE2 machines.  We support two syntaxes so that an */
 /* assignment moved from an x87 to-or-from an SSE2 machine will recalculate */
 /* the soft FFT crossover. */
 
-            if ((value[0] == 'F' || value[0] == 'f') &&
-                (value[1] == 'F' || value[1] == 'f') &&
-                (value[2] == 'T' || value[2] == 't')) {
-                int     sse2;
-                unsigned long fftlen;
-                char    *p;
+        if ((value[0] == 'F' || value[0] == 'f') &&
+            (value[1] == 'F' || value[1] == 'f') &&
+            (value[2] == 'T' || value[2] == 't')) {
+            int     sse2;
+            unsigned long fftlen;
+            char    *p;
 
-                if (value[3] == '2') {
-                        sse2 = TRUE;
-                        p = value+5;
-                } else {
-                        sse2 = FALSE;
-                        p = value+4;
-                }
-                fftlen = atoi (p);
-                while (isdigit (*p)) p++;
-                if (*p == 'K' || *p == 'k') fftlen <<= 10, p++;
-                if (*p == 'M' || *p == 'm') fftlen <<= 20, p++;
-                if (*p == ',') p++;
-                safe_strcpy (value, p);
-                if ((sse2 && (CPU_FLAGS & CPU_SSE2)) ||
-                    (!sse2 && ! (CPU_FLAGS & CPU_SSE2)))
-                        w->minimum_fftlen = fftlen;
+            if (value[3] == '2') {
+                    sse2 = TRUE;
+                    p = value+5;
+            } else {
+                    sse2 = FALSE;
+                    p = value+4;
             }
+            fftlen = atoi (p);
+            while (isdigit (*p)) p++;
+            if (*p == 'K' || *p == 'k') fftlen <<= 10, p++;
+            if (*p == 'M' || *p == 'm') fftlen <<= 20, p++;
+            if (*p == ',') p++;
+            safe_strcpy (value, p);
+            if ((sse2 && (CPU_FLAGS & CPU_SSE2)) ||
+                (!sse2 && ! (CPU_FLAGS & CPU_SSE2)))
+                    w->minimum_fftlen = fftlen;
+        }
 
 /* Parse the optional file extension to use on save files (no good use */
 /* right now, was formerly used for multiple workers ECMing the same number) */
 
-            if ((value[0] == 'E' || value[0] == 'e') &&
-                (value[1] == 'X' || value[1] == 'x') &&
-                (value[2] == 'T' || value[2] == 't') &&
-                value[3] == '=') {
-                char    *comma, *p;
-
-                p = value+4;
-                comma = strchr (p, ',');
-                if (comma != NULL) {
-                        *comma = 0;
-                        if (strlen (p) > 8) p[8] = 0;
-                        strcpy (w->extension, p);
-                        safe_strcpy (value, comma+1);
-                }
+        if ((value[0] == 'E' || value[0] == 'e') &&
+            (value[1] == 'X' || value[1] == 'x') &&
+            (value[2] == 'T' || value[2] == 't') &&
+            value[3] == '=') {
+            char    *comma, *p;
+
+            p = value+4;
+            comma = strchr (p, ',');
+            if (comma != NULL) {
+                    *comma = 0;
+                    if (strlen (p) > 8) p[8] = 0;
+                    strcpy (w->extension, p);
+                    safe_strcpy (value, comma+1);
             }
+        }
 
 /* Handle Test= and DoubleCheck= lines.                                 */
 /*      Test=exponent,how_far_factored,has_been_pminus1ed               */
 /*      DoubleCheck=exponent,how_far_factored,has_been_pminus1ed        */
 
-            if (_stricmp (keyword, "Test") == 0) {
-                float   sieve_depth;
-                w->work_type = WORK_TEST;
-                sieve_depth = 0.0;
-                sscanf (value, "%lu,%f,%d",
-                                &w->n, &sieve_depth, &w->pminus1ed);
-                w->sieve_depth = sieve_depth;
-                w->tests_saved = 2.0;
-            }
-            else if (_stricmp (keyword, "DoubleCheck") == 0) {
-                float   sieve_depth;
-                w->work_type = WORK_DBLCHK;
-                sieve_depth = 0.0;
-                sscanf (value, "%lu,%f,%d",
-                                &w->n, &sieve_depth, &w->pminus1ed);
-                w->sieve_depth = sieve_depth;
-                w->tests_saved = 1.0;
-            }
+        if (_stricmp (keyword, "Test") == 0) {
+            float   sieve_depth;
+            w->work_type = WORK_TEST;
+            sieve_depth = 0.0;
+            sscanf (value, "%lu,%f,%d",
+                            &w->n, &sieve_depth, &w->pminus1ed);
+            w->sieve_depth = sieve_depth;
+            w->tests_saved = 2.0;
+        }
+        else if (_stricmp (keyword, "DoubleCheck") == 0) {
+            float   sieve_depth;
+            w->work_type = WORK_DBLCHK;
+            sieve_depth = 0.0;
+            sscanf (value, "%lu,%f,%d",
+                            &w->n, &sieve_depth, &w->pminus1ed);
+            w->sieve_depth = sieve_depth;
+            w->tests_saved = 1.0;
+        }
 
 /* Handle AdvancedTest= lines. */
 /*      AdvancedTest=exponent */
 
-            else if (_stricmp (keyword, "AdvancedTest") == 0) {
-                w->work_type = WORK_ADVANCEDTEST;
-                sscanf (value, "%lu", &w->n);
-            }
+        else if (_stricmp (keyword, "AdvancedTest") == 0) {
+            w->work_type = WORK_ADVANCEDTEST;
+            sscanf (value, "%lu", &w->n);
+        }
 
 /* Handle Factor= lines.  Old style is:                                 */
 /*      Factor=exponent,how_far_factored                                */
 /* New style is:                                                        */
 /*      Factor=exponent,how_far_factored,how_far_to_factor_to           */
 
-            else if (_stricmp (keyword, "Factor") == 0) {
-                float   sieve_depth, factor_to;
-                w->work_type = WORK_FACTOR;
-                sieve_depth = 0.0;
-                factor_to = 0.0;
-                sscanf (value, "%lu,%f,%f",
-                                &w->n, &sieve_depth, &factor_to);
-                w->sieve_depth = sieve_depth;
-                w->factor_to = factor_to;
-            }
+        else if (_stricmp (keyword, "Factor") == 0) {
+            float   sieve_depth, factor_to;
+            w->work_type = WORK_FACTOR;
+            sieve_depth = 0.0;
+            factor_to = 0.0;
+            sscanf (value, "%lu,%f,%f",
+                            &w->n, &sieve_depth, &factor_to);
+            w->sieve_depth = sieve_depth;
+            w->factor_to = factor_to;
+        }
 
 /* Handle Pfactor= lines.  Old style is:                                */
 /*      Pfactor=exponent,how_far_factored,double_check_flag             */
 /* New style is:                                                        */
 /*      Pfactor=k,b,n,c,how_far_factored,ll_tests_saved_if_factor_found */
 
-            else if (_stricmp (keyword, "PFactor") == 0) {
-                float   sieve_depth;
-                w->work_type = WORK_PFACTOR;
-                sieve_depth = 0.0;
-                if (countCommas (value) > 3) {          /* New style */
-                        char    *q;
-                        float   tests_saved;
-                        tests_saved = 0.0;
-                        q = strchr (value, ','); *q = 0; w->k = atof (value);
-                        sscanf (q+1, "%lu,%lu,%ld,%f,%f",
-                                &w->b, &w->n, &w->c, &sieve_depth,
-                                &tests_saved);
-                        w->sieve_depth = sieve_depth;
-                        w->tests_saved = tests_saved;
-                } else {                                /* Old style */
-                        int     dblchk;
-                        sscanf (value, "%lu,%f,%d",
-                                &w->n, &sieve_depth, &dblchk);
-                        w->sieve_depth = sieve_depth;
-                        w->tests_saved = dblchk ? 1.0 : 2.0;
-                }
+        else if (_stricmp (keyword, "PFactor") == 0) {
+            float   sieve_depth;
+            w->work_type = WORK_PFACTOR;
+            sieve_depth = 0.0;
+            if (countCommas (value) > 3) {          /* New style */
+                    char    *q;
+                    float   tests_saved;
+                    tests_saved = 0.0;
+                    q = strchr (value, ','); *q = 0; w->k = atof (value);
+                    sscanf (q+1, "%lu,%lu,%ld,%f,%f",
+                            &w->b, &w->n, &w->c, &sieve_depth,
+                            &tests_saved);
+                    w->sieve_depth = sieve_depth;
+                    w->tests_saved = tests_saved;
+            } else {                                /* Old style */
+                    int     dblchk;
+                    sscanf (value, "%lu,%f,%d",
+                            &w->n, &sieve_depth, &dblchk);
+                    w->sieve_depth = sieve_depth;
+                    w->tests_saved = dblchk ? 1.0 : 2.0;
             }
+        }
 
 /* Handle ECM= lines.  Old style is: */
 /*   ECM=exponent,B1,B2,curves_to_do,unused[,specific_sigma,plus1,B2_start] */
 /* New style is: */
 /*   ECM2=k,b,n,c,B1,B2,curves_to_do[,specific_sigma,B2_start][,"factors"] */
 
-            else if (_stricmp (keyword, "ECM") == 0) {
-                char    *q;
-                w->work_type = WORK_ECM;
-                sscanf (value, "%ld", &w->n);
-                if ((q = strchr (value, ',')) == NULL) goto illegal_line;
-                w->B1 = atof (q+1);
-                if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
-                w->B2 = atof (q+1);
-                if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
-                w->curves_to_do = atoi (q+1);
-                if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
-                q = strchr (q+1, ',');
-                w->curve = 0;
-                if (q != NULL) {
-                        w->curve = atof (q+1);
-                        q = strchr (q+1, ',');
-                }
-                if (q != NULL) {
-                        w->c = atoi (q+1);
-                        if (w->c == 0) w->c = -1; /* old plus1 arg */
-                        q = strchr (q+1, ',');
-                }
-                w->B2_start = w->B1;
-                if (q != NULL) {
-                        double j;
-                        j = atof (q+1);
-                        if (j > w->B1) w->B2_start = j;
-                }
-            } else if (_stricmp (keyword, "ECM2") == 0) {
-                int     i;
-                char    *q;
-                w->work_type = WORK_ECM;
-                w->k = atof (value);
-                if ((q = strchr (value, ',')) == NULL) goto illegal_line;
-                sscanf (q+1, "%lu,%lu,%ld", &w->b, &w->n, &w->c);
-                for (i = 1; i <= 3; i++)
-                        if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
-                w->B1 = atof (q+1);
-                if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
-                w->B2 = atof (q+1);
-                if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
-                w->curves_to_do = atoi (q+1);
-                q = strchr (q+1, ',');
-                w->curve = 0;
-                if (q != NULL && q[1] != '"') {
-                        w->curve = atof (q+1);
-                        q = strchr (q+1, ',');
-                }
-                w->B2_start = w->B1;
-                if (q != NULL && q[1] != '"') {
-                        double j;
-                        j = atof (q+1);
-                        if (j > w->B1) w->B2_start = j;
-                        q = strchr (q+1, ',');
-                }
-                if (q != NULL && q[1] == '"') {
-                        w->known_factors = (char *) malloc (strlen (q));
-                        if (w->known_factors == NULL) goto nomem;
-                        strcpy (w->known_factors, q+2);
-                }
+        else if (_stricmp (keyword, "ECM") == 0) {
+            char    *q;
+            w->work_type = WORK_ECM;
+            sscanf (value, "%ld", &w->n);
+            if ((q = strchr (value, ',')) == NULL) goto illegal_line;
+            w->B1 = atof (q+1);
+            if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
+            w->B2 = atof (q+1);
+            if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
+            w->curves_to_do = atoi (q+1);
+            if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
+            q = strchr (q+1, ',');
+            w->curve = 0;
+            if (q != NULL) {
+                    w->curve = atof (q+1);
+                    q = strchr (q+1, ',');
             }
+            if (q != NULL) {
+                    w->c = atoi (q+1);
+                    if (w->c == 0) w->c = -1; /* old plus1 arg */
+                    q = strchr (q+1, ',');
+            }
+            w->B2_start = w->B1;
+            if (q != NULL) {
+                    double j;
+                    j = atof (q+1);
+                    if (j > w->B1) w->B2_start = j;
+            }
+        } else if (_stricmp (keyword, "ECM2") == 0) {
+            int     i;
+            char    *q;
+            w->work_type = WORK_ECM;
+            w->k = atof (value);
+            if ((q = strchr (value, ',')) == NULL) goto illegal_line;
+            sscanf (q+1, "%lu,%lu,%ld", &w->b, &w->n, &w->c);
+            for (i = 1; i <= 3; i++)
+                    if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
+            w->B1 = atof (q+1);
+            if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
+            w->B2 = atof (q+1);
+            if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
+            w->curves_to_do = atoi (q+1);
+            q = strchr (q+1, ',');
+            w->curve = 0;
+            if (q != NULL && q[1] != '"') {
+                    w->curve = atof (q+1);
+                    q = strchr (q+1, ',');
+            }
+            w->B2_start = w->B1;
+            if (q != NULL && q[1] != '"') {
+                    double j;
+                    j = atof (q+1);
+                    if (j > w->B1) w->B2_start = j;
+                    q = strchr (q+1, ',');
+            }
+            if (q != NULL && q[1] == '"') {
+                    w->known_factors = (char *) malloc (strlen (q));
+                    if (w->known_factors == NULL) return (OutOfMemory (MAIN_THREAD_NUM));
+                    strcpy (w->known_factors, q+2);
+            }
+        }
 
 /* Handle Pminus1 lines:  Old style:                            */
 /*      Pminus1=exponent,B1,B2,plus1[,B2_start]                 */
 /* New style is:                                                */
 /*      Pminus1=k,b,n,c,B1,B2[,how_far_factored][,B2_start][,"factors"] */
 
-            else if (_stricmp (keyword, "Pminus1") == 0) {
-                char    *q;
-                w->work_type = WORK_PMINUS1;
-                if (countCommas (value) <= 4) {
-                        sscanf (value, "%ld", &w->n);
-                        if ((q = strchr (value, ',')) == NULL)
-                                goto illegal_line;
-                        w->B1 = atof (q+1);
-                        if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
-                        w->B2 = atof (q+1);
-                        if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
-                        sscanf (q+1, "%ld", &w->c);
-                        q = strchr (q+1, ',');
-                        if (w->c == 0) w->c = -1; /* old plus1 arg */
-                        if (q != NULL) {
-                                double j;
-                                j = atof (q+1);
-                                if (j > w->B1) w->B2_start = j;
-                        }
-                } else {
-                        w->k = atof (value);
-                        if ((q = strchr (value, ',')) == NULL)
-                                goto illegal_line;
-                        sscanf (q+1, "%lu,%lu,%ld", &w->b, &w->n, &w->c);
-                        for (i = 1; i <= 3; i++)
-                                if ((q = strchr (q+1, ',')) == NULL)
-                                        goto illegal_line;
-                        w->B1 = atof (q+1);
-                        if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
-                        w->B2 = atof (q+1);
-                        q = strchr (q+1, ',');
-                        w->sieve_depth = 0.0;
-                        if (q != NULL && q[1] != '"') {
-                                double  j;
-                                j = atof (q+1);
-                                if (j < 100.0) {
-                                        w->sieve_depth = j;
-                                        q = strchr (q+1, ',');
-                                }
-                        }
-                        w->B2_start = 0;
-                        if (q != NULL && q[1] != '"') {
-                                double  j;
-                                j = atof (q+1);
-                                if (j > w->B1) w->B2_start = j;
-                                q = strchr (q+1, ',');
-                        }
-                        if (q != NULL && q[1] == '"') {
-                                w->known_factors = (char *) malloc (strlen (q));
-                                if (w->known_factors == NULL) goto nomem;
-                                strcpy (w->known_factors, q+2);
-                        }
-                }
+        else if (_stricmp (keyword, "Pminus1") == 0) {
+            char    *q;
+            w->work_type = WORK_PMINUS1;
+            if (countCommas (value) <= 4) {
+                    sscanf (value, "%ld", &w->n);
+                    if ((q = strchr (value, ',')) == NULL)
+                            goto illegal_line;
+                    w->B1 = atof (q+1);
+                    if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
+                    w->B2 = atof (q+1);
+                    if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
+                    sscanf (q+1, "%ld", &w->c);
+                    q = strchr (q+1, ',');
+                    if (w->c == 0) w->c = -1; /* old plus1 arg */
+                    if (q != NULL) {
+                            double j;
+                            j = atof (q+1);
+                            if (j > w->B1) w->B2_start = j;
+                    }
+            } else {
+                    w->k = atof (value);
+                    if ((q = strchr (value, ',')) == NULL)
+                            goto illegal_line;
+                    sscanf (q+1, "%lu,%lu,%ld", &w->b, &w->n, &w->c);
+                    for (i = 1; i <= 3; i++)
+                            if ((q = strchr (q+1, ',')) == NULL)
+                                    goto illegal_line;
+                    w->B1 = atof (q+1);
+                    if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
+                    w->B2 = atof (q+1);
+                    q = strchr (q+1, ',');
+                    w->sieve_depth = 0.0;
+                    if (q != NULL && q[1] != '"') {
+                            double  j;
+                            j = atof (q+1);
+                            if (j < 100.0) {
+                                    w->sieve_depth = j;
+                                    q = strchr (q+1, ',');
+                            }
+                    }
+                    w->B2_start = 0;
+                    if (q != NULL && q[1] != '"') {
+                            double  j;
+                            j = atof (q+1);
+                            if (j > w->B1) w->B2_start = j;
+                            q = strchr (q+1, ',');
+                    }
+                    if (q != NULL && q[1] == '"') {
+                            w->known_factors = (char *) malloc (strlen (q));
+                            if (w->known_factors == NULL) return (OutOfMemory (MAIN_THREAD_NUM));
+                            strcpy (w->known_factors, q+2);
+                    }
             }
+        }
 
 /* Handle PRP= lines.                                                                   */
 /*      PRP=k,b,n,c[,how_far_factored,tests_saved[,base,residue_type]][,known_factors]  */
@@ -2738,102 +2768,102 @@ illegal_line:   sprintf (buf, "Illegal line in worktodo.txt file: %s\n", line);
 /* A tests_saved value of 0.0 will bypass any P-1 factoring                             */
 /* The PRP residue type is defined in primenet.h                                        */
 
-            else if (_stricmp (keyword, "PRP") == 0 || _stricmp (keyword, "PRPDC") == 0) {
-                char    *q;
-
-                w->work_type = WORK_PRP;
-                w->prp_dblchk = (keyword[3] != 0);
-                w->k = atof (value);
-                if ((q = strchr (value, ',')) == NULL) goto illegal_line;
-                sscanf (q+1, "%lu,%lu,%ld", &w->b, &w->n, &w->c);
-                for (i = 1; i <= 2; i++)
-                        if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
-                q = strchr (q+1, ',');
-
-                w->sieve_depth = 0.0;
-                w->tests_saved = 0.0;
-                w->prp_base = 0;
-                w->prp_residue_type = 0;
-                if (q != NULL && q[1] != '"') {
-                        w->sieve_depth = atof (q+1);
-                        if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
-                        w->tests_saved = atof (q+1);
-                        q = strchr (q+1, ',');
-                        if (q != NULL && q[1] != '"') {
-                                w->prp_base = atoi (q+1);
-                                if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
-                                w->prp_residue_type = atoi (q+1);
-                                q = strchr (q+1, ',');
-                        }
-                }
-                if (q != NULL && q[1] == '"') {
-                        w->known_factors = (char *) malloc (strlen (q));
-                        if (w->known_factors == NULL) goto nomem;
-                        strcpy (w->known_factors, q+2);
-                }
+        else if (_stricmp (keyword, "PRP") == 0 || _stricmp (keyword, "PRPDC") == 0) {
+            char    *q;
+
+            w->work_type = WORK_PRP;
+            w->prp_dblchk = (keyword[3] != 0);
+            w->k = atof (value);
+            if ((q = strchr (value, ',')) == NULL) goto illegal_line;
+            sscanf (q+1, "%lu,%lu,%ld", &w->b, &w->n, &w->c);
+            for (i = 1; i <= 2; i++)
+                    if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
+            q = strchr (q+1, ',');
+
+            w->sieve_depth = 0.0;
+            w->tests_saved = 0.0;
+            w->prp_base = 0;
+            w->prp_residue_type = 0;
+            if (q != NULL && q[1] != '"') {
+                    w->sieve_depth = atof (q+1);
+                    if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
+                    w->tests_saved = atof (q+1);
+                    q = strchr (q+1, ',');
+                    if (q != NULL && q[1] != '"') {
+                            w->prp_base = atoi (q+1);
+                            if ((q = strchr (q+1, ',')) == NULL) goto illegal_line;
+                            w->prp_residue_type = atoi (q+1);
+                            q = strchr (q+1, ',');
+                    }
             }
+            if (q != NULL && q[1] == '"') {
+                    w->known_factors = (char *) malloc (strlen (q));
+                    if (w->known_factors == NULL) return (OutOfMemory (MAIN_THREAD_NUM));
+                    strcpy (w->known_factors, q+2);
+            }
+        }
 
 /* Uh oh.  We have a worktodo.txt line we cannot process. */
 
-            else if (_stricmp (keyword, "AdvancedFactor") == 0) {
-                OutputSomewhere (MAIN_THREAD_NUM, "Worktodo error: AdvancedFactor no longer supported\n");
-                goto comment;
-            } else {
-                goto illegal_line;
-            }
+        else if (_stricmp (keyword, "AdvancedFactor") == 0) {
+            OutputSomewhere (MAIN_THREAD_NUM, "Worktodo error: AdvancedFactor no longer supported\n");
+            goto comment;
+        } else {
+            goto illegal_line;
+        }
 
 /* Trim trailing non-digit characters from known factors list (this should be the closing double quote) */
 /* Turn all non-digit characters into commas (they should be anyway) */
 
-            if (w->known_factors != NULL) {
-                for (i = (unsigned int) strlen (w->known_factors);
-                     i > 0 && !isdigit (w->known_factors[i-1]);
-                     i--);
-                w->known_factors[i] = 0;
-                for (i = 0; i < (unsigned int) strlen (w->known_factors); i++)
-                        if (!isdigit (w->known_factors[i])) w->known_factors[i] = ',';
-            }
+        if (w->known_factors != NULL) {
+            for (i = (unsigned int) strlen (w->known_factors);
+                 i > 0 && !isdigit (w->known_factors[i-1]);
+                 i--);
+            w->known_factors[i] = 0;
+            for (i = 0; i < (unsigned int) strlen (w->known_factors); i++)
+                    if (!isdigit (w->known_factors[i])) w->known_factors[i] = ',';
+        }
 
 /* If this is ECM or P-1 on a Fermat number, then automatically add known Fermat factors */
 
-            addKnownFermatFactors (w);
+        addKnownFermatFactors (w);
 
 /* Make sure this line of work from the file makes sense. The exponent */
 /* should be a prime number, bounded by values we can handle, and we */
 /* should never be asked to factor a number more than we are capable of. */
 
-            if (w->k == 1.0 && w->b == 2 && !isPrime (w->n) && w->c == -1 && w->known_factors == NULL &&
-                w->work_type != WORK_ECM && w->work_type != WORK_PMINUS1 &&
-                !(w->work_type == WORK_PRP && IniGetInt (INI_FILE, "PhiExtensions", 0))) {
-                char    buf[80];
-                sprintf (buf, "Error: Worktodo.txt file contained composite exponent: %ld\n", w->n);
-                OutputBoth (MAIN_THREAD_NUM, buf);
-                goto illegal_line;
-            }
-            if ((w->work_type == WORK_TEST ||
-                 w->work_type == WORK_DBLCHK ||
-                 w->work_type == WORK_ADVANCEDTEST) &&
-                (w->n < MIN_PRIME ||
-                 (w->minimum_fftlen == 0 &&
-                  w->n > (unsigned long) (CPU_FLAGS & CPU_FMA3 ? MAX_PRIME_FMA3 :
-                                          (CPU_FLAGS & (CPU_AVX | CPU_SSE2) ? MAX_PRIME_SSE2 : MAX_PRIME))))) {
-                char    buf[80];
-                sprintf (buf, "Error: Worktodo.txt file contained bad LL exponent: %ld\n", w->n);
-                OutputBoth (MAIN_THREAD_NUM, buf);
-                goto illegal_line;
-            }
-            if (w->work_type == WORK_FACTOR && w->n < 20000) {
-                char    buf[100];
-                sprintf (buf, "Error: Use ECM instead of trial factoring for exponent: %ld\n", w->n);
-                OutputBoth (MAIN_THREAD_NUM, buf);
-                goto illegal_line;
-            }
-            if (w->work_type == WORK_FACTOR && w->n > MAX_FACTOR && !IniGetInt (INI_FILE, "LargeTFexponents", 0)) {
-                char    buf[100];
-                sprintf (buf, "Error: Worktodo.txt file contained bad factoring assignment: %ld\n", w->n);
-                OutputBoth (MAIN_THREAD_NUM, buf);
-                goto illegal_line;
-            }
+        if (w->k == 1.0 && w->b == 2 && !isPrime (w->n) && w->c == -1 && w->known_factors == NULL &&
+            w->work_type != WORK_ECM && w->work_type != WORK_PMINUS1 &&
+            !(w->work_type == WORK_PRP && IniGetInt (INI_FILE, "PhiExtensions", 0))) {
+            char    buf[80];
+            sprintf (buf, "Error: Worktodo.txt file contained composite exponent: %ld\n", w->n);
+            OutputBoth (MAIN_THREAD_NUM, buf);
+            goto illegal_line;
+        }
+        if ((w->work_type == WORK_TEST ||
+             w->work_type == WORK_DBLCHK ||
+             w->work_type == WORK_ADVANCEDTEST) &&
+            (w->n < MIN_PRIME ||
+             (w->minimum_fftlen == 0 &&
+              w->n > (unsigned long) (CPU_FLAGS & CPU_FMA3 ? MAX_PRIME_FMA3 :
+                                      (CPU_FLAGS & (CPU_AVX | CPU_SSE2) ? MAX_PRIME_SSE2 : MAX_PRIME))))) {
+            char    buf[80];
+            sprintf (buf, "Error: Worktodo.txt file contained bad LL exponent: %ld\n", w->n);
+            OutputBoth (MAIN_THREAD_NUM, buf);
+            goto illegal_line;
+        }
+        if (w->work_type == WORK_FACTOR && w->n < 20000) {
+            char    buf[100];
+            sprintf (buf, "Error: Use ECM instead of trial factoring for exponent: %ld\n", w->n);
+            OutputBoth (MAIN_THREAD_NUM, buf);
+            goto illegal_line;
+        }
+        if (w->work_type == WORK_FACTOR && w->n > MAX_FACTOR && !IniGetInt (INI_FILE, "LargeTFexponents", 0)) {
+            char    buf[100];
+            sprintf (buf, "Error: Worktodo.txt file contained bad factoring assignment: %ld\n", w->n);
+            OutputBoth (MAIN_THREAD_NUM, buf);
+            goto illegal_line;
+        }
 
 /* A user discovered a case where a computer that dual boots between 32-bit prime95 */
 /* and 64-bit prime95 can run into problems.  If near the FFT limit an FFT length is */
@@ -2854,11 +2884,117 @@ illegal_line:   sprintf (buf, "Illegal line in worktodo.txt file: %s\n", line);
 
 /* Do more initialization of the work_unit structure */
 
-            auxiliaryWorkUnitInit (w);
+        auxiliaryWorkUnitInit (w);
+        if (line_type != NULL) *line_type = WORKTODO_LINE_WORK;
+        return (0);
+}
+
+/* Read the entire worktodo.txt file into memory.  Return error_code */
+/* if we have a memory or file I/O error. */
+
+int readWorkToDoFile (void)
+{
+        FILE    *fd;
+        unsigned int tnum, i, linenum;
+        int     rc;
+        char    line[16384];
+
+/* Grab the lock so that comm thread cannot try to add work units while */
+/* file is being read in. */
+
+        for (i = 1; ; i++) {
+                gwmutex_lock (&WORKTODO_MUTEX);
+
+/* Make sure no other threads are accessing work units right now. */
+/* There should be no worker threads active so any use should be short-lived. */
+
+                if (WORKTODO_IN_USE_COUNT == 0 && !WORKTODO_CHANGED) break;
+                gwmutex_unlock (&WORKTODO_MUTEX);
+                if (i <= 10) {
+                        Sleep (50);
+                        continue;
+                }
+
+/* Uh oh, the lock hasn't been released after half-a-second.  This happens processing large */
+/* worktodo.txt files in communicateWithServer (see James Heinrich's complaints in 26.4 thread). */
+/* As a workaround, we'll simply not re-read the worktodo.txt file now.  We only reread the file */
+/* to pick up any manual edits that may have taken place since the last time worktodo.txt was */
+/* read in (and to process worktodo.add).  Hopefully the comm-with-server thread will finish up */
+/* and we can successfully re-read the worktodo.txt file at a later time. */
+
+                return (0);
+        }
+
+/* Clear file needs writing flag and count of worktodo lines */
+
+        WORKTODO_CHANGED = FALSE;
+        WORKTODO_COUNT = 0;
+
+/* Free old work_units for each worker thread. */
+/* We sometimes reread the worktodo.txt file in case the user */
+/* manually edits the file while the program is running. */
+
+        for (tnum = 0; tnum < MAX_NUM_WORKER_THREADS; tnum++) {
+                struct work_unit *w, *next_w;
+                for (w = WORK_UNITS[tnum].first; w != NULL; w = next_w) {
+                        next_w = w->next;
+                        free (w->known_factors);
+                        free (w->comment);
+                        free (w);
+                }
+                WORK_UNITS[tnum].first = NULL;
+                WORK_UNITS[tnum].last = NULL;
+        }
+
+/* Read the lines of the work file.  It is OK if the worktodo.txt file */
+/* does not exist. */
+
+        fd = fopen (WORKTODO_FILE, "r");
+        if (fd == NULL) goto done;
+
+        tnum = 0;
+        linenum = 0;
+        while (fgets (line, sizeof (line), fd)) {
+            struct work_unit *w;
+
+/* Remove trailing CRLFs */
+
+            if (line[strlen(line)-1] == '\n') line[strlen(line)-1] = 0;
+            if (line[0] && line[strlen(line)-1] == '\r') line[strlen(line)-1] = 0;
+            linenum++;
+
+/* Allocate a work unit structure */
+
+            w = (struct work_unit *) malloc (sizeof (struct work_unit));
+            if (w == NULL) goto nomem;
+            memset (w, 0, sizeof (struct work_unit));
+
+/* A section header precedes each worker thread's work units.  The first */
+/* section need not be preceeded by a section header. */
+
+            if (line[0] == '[' && linenum > 1) {
+                tnum++;
+                if (tnum >= NUM_WORKER_THREADS) {
+                    char        buf[100];
+                    sprintf (buf,
+                             "Too many sections in worktodo.txt.  Moving work from section #%u to #%u.\n",
+                             tnum + 1, tnum % NUM_WORKER_THREADS + 1);
+                    OutputSomewhere (MAIN_THREAD_NUM, buf);
+                    safe_strcpy (line + 9, line);
+                    memcpy (line, ";;MOVED;;", 9);
+                    WORKTODO_CHANGED = TRUE;
+                }
+            }
+
+/* Parse the line into a work unit.  Comments and illegal lines are saved */
+/* as comment lines. */
+
+            rc = parseWorkToDoLine (line, w, NULL);
+            if (rc) goto retrc;
 
 /* Grow the work_unit array if necessary and add this entry */
 
-wdone:      rc = addToWorkUnitArray (tnum, w, TRUE);
+            rc = addToWorkUnitArray (tnum, w, ADD_TO_END);
             if (rc) goto retrc;
         }
 
@@ -3255,11 +3391,12 @@ void decrementWorkUnitUseCount (
         gwmutex_unlock (&WORKTODO_MUTEX);
 }
 
-/* Add a line of work to the work-to-do INI file. */
+/* Add a line of work to the work-to-do INI file, at the given spot in the worker's list */
 
-int addWorkToDoLine (
+int addWorkToDoLineWhere (
         int     tnum,           /* Worker thread to process this work unit */
-        struct work_unit *w)    /* Type of work */
+        struct work_unit *w,    /* Type of work */
+        int     where)          /* Where addToWorkUnitArray puts the work unit */
 {
         struct work_unit *malloc_w;
         int     rc;
@@ -3286,7 +3423,7 @@ int addWorkToDoLine (
 /* Add the work unit to the end of the array.  Well, actually before the */
 /* last set of blank lines. */
 
-        rc = addToWorkUnitArray (tnum, malloc_w, FALSE);
+        rc = addToWorkUnitArray (tnum, malloc_w, where);
         if (rc) goto retrc;
 
 /* Set flag indicating worktodo needs writing */
@@ -3304,6 +3441,127 @@ retrc:  gwmutex_unlock (&WORKTODO_MUTEX);
         return (rc);
 }
 
+/* Add a line of work to the work-to-do INI file. */
+
+int addWorkToDoLine (
+        int     tnum,           /* Worker thread to process this work unit */
+        struct work_unit *w)    /* Type of work */
+{
+        return (addWorkToDoLineWhere (tnum, w, ADD_BEFORE_BLANK_LINES));
+}
+
+/* Add a line to the worktodo file that the worker will process as soon as */
+/* it finishes the work unit it is processing now */
+
+int addWorkToDoLineNext (
+        int     tnum,           /* Worker thread to process this work unit */
+        struct work_unit *w)    /* Type of work */
+{
+        return (addWorkToDoLineWhere (tnum, w, ADD_AFTER_CURRENT));
+}
+
+/* Add a batch of worktodo lines while the program is running.  Unlike */
+/* worktodo.add files, the batch does not wait for the next poll and does not */
+/* require re-reading the entire worktodo.txt file.  Each line is validated */
+/* just like a worktodo.txt line.  Work goes to the first worker unless a */
+/* "[Worker #n]" section header selects a different worker.  The whole batch */
+/* is added under one lock and worktodo.txt is written once.  A malloc'ed */
+/* reply with a status line for every input line is returned for the caller */
+/* to free. */
+
+int addWorkToDoBatch (
+        char    *batch,         /* Newline separated worktodo lines */
+        char    **reply)        /* Returned status of each line */
+{
+        struct work_unit *w;
+        unsigned int tnum, num_lines, num_added, num_rejected;
+        char    *line, *eol, *p;
+        int     rc, line_type;
+        char    copy[2048];
+
+/* Allocate a reply buffer big enough to echo every line with a status */
+
+        for (num_lines = 1, p = batch; *p; p++) if (*p == '\n') num_lines++;
+        *reply = (char *) malloc (strlen (batch) + num_lines * 40 + 80);
+        if (*reply == NULL) return (OutOfMemory (MAIN_THREAD_NUM));
+        p = *reply;
+        *p = 0;
+
+/* Grab the lock so that comm thread and/or worker threads do not */
+/* access structure while we are adding lines. */
+
+        gwmutex_lock (&WORKTODO_MUTEX);
+        tnum = 0;
+        num_added = num_rejected = 0;
+        for (line = batch; *line; line = eol) {
+
+/* Isolate the line and remove trailing CRLFs */
+
+                eol = strchr (line, '\n');
+                if (eol == NULL) eol = line + strlen (line);
+                else *eol++ = 0;
+                if (line[0] && line[strlen(line)-1] == '\r') line[strlen(line)-1] = 0;
+                if (line[0] == 0) continue;
+                if (strlen (line) >= sizeof (copy)) {
+                        p += sprintf (p, "ERROR line too long\n");
+                        num_rejected++;
+                        continue;
+                }
+                strcpy (copy, line);
+
+/* Section headers select the worker for subsequent lines */
+
+                if (line[0] == '[') {
+                        unsigned int worker;
+                        if (sscanf (line, "[Worker #%u]", &worker) != 1 || worker < 1 || worker > NUM_WORKER_THREADS) {
+                                p += sprintf (p, "ERROR bad section header: %s\n", copy);
+                                num_rejected++;
+                        } else
+                                tnum = worker - 1;
+                        continue;
+                }
+
+/* Parse the line.  Only lines of work are accepted. */
+
+                w = (struct work_unit *) malloc (sizeof (struct work_unit));
+                if (w == NULL) goto nomem;
+                memset (w, 0, sizeof (struct work_unit));
+                rc = parseWorkToDoLine (line, w, &line_type);
+                if (rc || line_type != WORKTODO_LINE_WORK) {
+                        free (w->known_factors);
+                        free (w->comment);
+                        free (w);
+                        if (rc) goto retrc;
+                        p += sprintf (p, "ERROR %s: %s\n", line_type == WORKTODO_LINE_ILLEGAL ? "illegal line" : "not a work line", copy);
+                        num_rejected++;
+                        continue;
+                }
+
+/* Add the work unit to the end of the worker's list.  This also wakes up */
+/* the worker if it is waiting for work to do. */
+
+                rc = addToWorkUnitArray (tnum, w, ADD_BEFORE_BLANK_LINES);
+                if (rc) goto retrc;
+                p += sprintf (p, "OK worker #%u: %s\n", tnum + 1, copy);
+                num_added++;
+        }
+
+/* Unlock and write the worktodo.txt file to disk.  Return a summary line. */
+
+        if (num_added) WORKTODO_CHANGED = TRUE;
+        gwmutex_unlock (&WORKTODO_MUTEX);
+        sprintf (p, "ADDED %u REJECTED %u\n", num_added, num_rejected);
+        return (writeWorkToDoFile (FALSE));
+
+/* Unlock and return error code */
+
+nomem:  rc = OutOfMemory (MAIN_THREAD_NUM);
+retrc:  if (num_added) WORKTODO_CHANGED = TRUE;
+        gwmutex_unlock (&WORKTODO_MUTEX);
+        sprintf (p, "ERROR out of memory after adding %u lines\n", num_added);
+        return (rc);
+}
+
 /* Caller has updated a work unit structure such that the work-to-do */
 /* INI file needs to be written.  */
 
@@ -3337,6 +3595,10 @@ int deleteWorkToDoLine (
 
         if (w->work_type == WORK_DELETED) return (0);
 
+/* Free any stage 1 result another worker handed off for this work unit */
+
+        if (w->work_type == WORK_ECM || w->work_type == WORK_PMINUS1) stage2_handoff_discard (tnum, w);
+
 /* Grab the lock so that comm thread and/or worker threads do not */
 /* access structure while the other is adding/deleting lines. */
 
@@ -4077,24 +4339,198 @@ int write_gwnum (
         unsigned long *sum)
 {
         giant   tmp;
-        unsigned long i, len, bytes;
+        int     retval;
 
         tmp = popg (&gwdata->gdata, ((int) gwdata->bit_length >> 5) + 10);
         if (tmp == NULL) return (FALSE);
-        if (gwtogiant (gwdata, g, tmp)) goto err;
-        len = tmp->sign;
-        if (len == 0) goto err;
-        if (!write_long (fd, len, sum)) goto err;
-        bytes = len * sizeof (uint32_t);
-        if (_write (fd, tmp->n, bytes) != bytes) goto err;
-        *sum = (uint32_t) (*sum + len);
-        for (i = 0; i < len; i++) *sum = (uint32_t) (*sum + tmp->n[i]);
+        retval = (gwtogiant (gwdata, g, tmp) == 0 && write_giant (fd, tmp, sum));
         pushg (&gwdata->gdata, 1);
+        return (retval);
+}
+
+/* Routines to read and write a gwnum in its raw in-memory form, header */
+/* included.  This is much faster than write_gwnum and keeps FFTed values */
+/* FFTed, but the data can only be read back into a gwnum whose handle has */
+/* the same gwnum_layout_id.  The header words gwalloc uses to track the */
+/* allocation (size at offset -8, must-free flag at offset -32) are */
+/* preserved on read. */
+
+int read_gwnum_raw (
+        int     fd,
+        gwhandle *gwdata,
+        gwnum   g,
+        unsigned long *sum)
+{
+        char    *p;
+        uint32_t size, freeable;
+        unsigned long i, bytes;
+
+        p = (char *) g - GW_HEADER_SIZE;
+        bytes = GW_HEADER_SIZE + gwnum_datasize (gwdata);
+        size = * (uint32_t *) ((char *) g - 8);
+        freeable = * (uint32_t *) ((char *) g - 32);
+        if (_read (fd, p, bytes) != bytes) goto err;
+        for (i = 0; i < bytes / sizeof (uint32_t); i++) *sum = (uint32_t) (*sum + ((uint32_t *) p)[i]);
+        if (* (uint32_t *) ((char *) g - 8) != size) goto err;
+        * (uint32_t *) ((char *) g - 32) = freeable;
         return (TRUE);
-err:    pushg (&gwdata->gdata, 1);
+err:    * (uint32_t *) ((char *) g - 8) = size;
+        * (uint32_t *) ((char *) g - 32) = freeable;
         return (FALSE);
 }
 
+int write_gwnum_raw (
+        int     fd,
+        gwhandle *gwdata,
+        gwnum   g,
+        unsigned long *sum)
+{
+        char    *p;
+        unsigned long i, bytes;
+
+        p = (char *) g - GW_HEADER_SIZE;
+        bytes = GW_HEADER_SIZE + gwnum_datasize (gwdata);
+        if (_write (fd, p, bytes) != bytes) return (FALSE);
+        for (i = 0; i < bytes / sizeof (uint32_t); i++) *sum = (uint32_t) (*sum + ((uint32_t *) p)[i]);
+        return (TRUE);
+}
+
+/* Write a giant in the same format as write_gwnum */
+
+int write_giant (
+        int     fd,
+        giant   g,
+        unsigned long *sum)
+{
+        unsigned long i, len, bytes;
+
+        len = g->sign;
+        if (len == 0) return (FALSE);
+        if (!write_long (fd, len, sum)) return (FALSE);
+        bytes = len * sizeof (uint32_t);
+        if (_write (fd, g->n, bytes) != bytes) return (FALSE);
+        *sum = (uint32_t) (*sum + len);
+        for (i = 0; i < len; i++) *sum = (uint32_t) (*sum + g->n[i]);
+        return (TRUE);
+}
+
+/* Routines to share one binary conversion of a gwnum between several consumers. */
+/* The LL and PRP loops take a snapshot of the current residue once per iteration. */
+/* The Jacobi check, save file writers, and residue printers all ask the snapshot */
+/* for the binary value.  The expensive gwtogiant conversion is done at most once */
+/* no matter how many consumers need the value in the same iteration.  The giant */
+/* buffer is allocated once and reused for the life of the snapshot. */
+
+void residue_snapshot_init (
+        residue_snapshot *snap,
+        gwhandle *gwdata)
+{
+        snap->gwdata = gwdata;
+        snap->value = NULL;
+        snap->g = NULL;
+        snap->converted = FALSE;
+        snap->err_code = 0;
+}
+
+/* Take a new snapshot.  The caller must not modify the gwnum until */
+/* residue_snapshot_invalidate is called. */
+
+void residue_snapshot_take (
+        residue_snapshot *snap,
+        gwnum   value)
+{
+        snap->value = value;
+        snap->converted = FALSE;
+}
+
+/* Forget the snapshot, typically because the gwnum is about to change */
+
+void residue_snapshot_invalidate (
+        residue_snapshot *snap)
+{
+        snap->value = NULL;
+        snap->converted = FALSE;
+}
+
+/* Free the snapshot's giant buffer */
+
+void residue_snapshot_term (
+        residue_snapshot *snap)
+{
+        free (snap->g);
+        snap->g = NULL;
+        residue_snapshot_invalidate (snap);
+}
+
+/* Return the binary value of a gwnum.  If the snapshot is of this gwnum, the */
+/* conversion is done only on first request.  Returns NULL if no snapshot of the */
+/* gwnum exists, memory could not be allocated, or the conversion failed (in */
+/* which case err_code is set to the gwtogiant error code).  The returned giant */
+/* is owned by the snapshot and must not be modified. */
+
+giant residue_snapshot_giant (
+        residue_snapshot *snap,
+        gwnum   value,
+        int     *err_code)
+{
+        if (err_code != NULL) *err_code = 0;
+        if (snap == NULL || snap->value == NULL || snap->value != value) return (NULL);
+        if (!snap->converted) {
+                if (snap->g == NULL) {
+                        snap->g = allocgiant (((int) snap->gwdata->bit_length >> 5) + 10);
+                        if (snap->g == NULL) return (NULL);
+                }
+                snap->err_code = gwtogiant (snap->gwdata, snap->value, snap->g);
+                snap->converted = TRUE;
+
+/* Zero the word above an odd length value now so that gtompz_view never needs */
+/* to write to the giant, which may also be read by a background save writer. */
+
+                if (snap->err_code >= 0 && (abs (snap->g->sign) & 1))
+                        snap->g->n[abs (snap->g->sign)] = 0;
+        }
+        if (err_code != NULL) *err_code = snap->err_code;
+        if (snap->err_code < 0) return (NULL);
+        return (snap->g);
+}
+
+/* Hand the binary value of a gwnum over to the caller, who must free it.  Returns */
+/* NULL if the snapshot cannot supply the value.  The snapshot allocates a new */
+/* giant buffer the next time one is needed. */
+
+giant residue_snapshot_release (
+        residue_snapshot *snap,
+        gwnum   value)
+{
+        giant   g;
+
+        if (residue_snapshot_giant (snap, value, NULL) == NULL) return (NULL);
+        g = snap->g;
+        snap->g = NULL;
+        residue_snapshot_invalidate (snap);
+        return (g);
+}
+
+/* Write a gwnum to a save file using the snapshot's binary value if there is one. */
+/* If the snapshot's giant could not be allocated, do an ordinary conversion. */
+
+int write_gwnum_snapshot (
+        int     fd,
+        residue_snapshot *snap,
+        gwhandle *gwdata,
+        gwnum   g,
+        unsigned long *sum)
+{
+        giant   tmp;
+        int     err_code;
+
+        if (snap == NULL || snap->value != g) return (write_gwnum (fd, gwdata, g, sum));
+        tmp = residue_snapshot_giant (snap, g, &err_code);
+        if (err_code) return (FALSE);
+        if (tmp == NULL) return (write_gwnum (fd, gwdata, g, sum));
+        return (write_giant (fd, tmp, sum));
+}
+
 /* Routines to read and write values from and to a save file */
 
 int read_short (                        /* Used for old-style save files */
@@ -5220,7 +5656,7 @@ int getProgramOptions (void)
                         PRIORITY = pkt.priority;
                         IniWriteInt (INI_FILE, "Priority", PRIORITY);
                         IniWriteInt (LOCALINI_FILE, "SrvrPO2", PRIORITY);
-                        restart = TRUE;
+                        CONFIG_GENERATION++;
                 }
 
                 if (pkt.daysOfWork != -1) {
@@ -5288,7 +5724,7 @@ int getProgramOptions (void)
 
         IniWriteInt (LOCALINI_FILE, "SrvrP00", pkt.options_counter);
 
-/* If memory settings, priority, num_workers, or run-on-battery changed, */
+/* If memory settings, num_workers, or run-on-battery changed, */
 /* then restart threads that may be affected by the change. */
 
         if (mem_readable && mem_changed) mem_settings_have_changed ();
@@ -6480,6 +6916,10 @@ void timed_events_scheduler (void *arg)
                                 timed_events[i].active = FALSE;
                                 JacobiTimer ();
                                 break;
+                        case TE_HOST_CHECK:     /* Check on other processes sharing this host */
+                                timed_events[i].time_to_fire = this_time + HOST_CHECK_FREQ;
+                                host_check ();
+                                break;
                         }
                 }
 
@@ -167,6 +167,7 @@ extern unsigned long volatile ITER_OUTPUT_RES;/* Iterations between results */
 extern unsigned long volatile DISK_WRITE_TIME;
                                         /* Number of minutes between writing */
                                         /* intermediate results to disk */
+extern unsigned long volatile CONFIG_GENERATION; /* Incremented when live INI settings are reloaded */
 extern unsigned long volatile JACOBI_TIME; /* Run a Jacobi test every N hours */
 extern unsigned int MODEM_RETRY_TIME;   /* How often to try sending msgs */
                                         /* to primenet server whem modem off */
@@ -280,6 +281,8 @@ int read_memory_settings (unsigned int *, unsigned int *, unsigned int *, unsign
 void nameAndReadIniFiles (int named_ini_files);
 void initCommCode (void);
 int readIniFiles (void);
+void readLiveIniSettings (void);
+int reloadLiveIniSettings (void);
 
 void processTimedIniFile (const char *);
 
@@ -377,14 +380,23 @@ struct work_unit_array {        /* All the lines for one worker thread */
 
 int readWorkToDoFile (void);
 int writeWorkToDoFile (int);
+#define WORKTODO_LINE_WORK      0       /* Line parsed into a work unit */
+#define WORKTODO_LINE_COMMENT   1       /* Comment or section header */
+#define WORKTODO_LINE_ILLEGAL   2       /* Line we could not process */
+int parseWorkToDoLine (char *, struct work_unit *, int *);
 #define SHORT_TERM_USE          0
 #define LONG_TERM_USE           1
 struct work_unit *getNextWorkToDoLine (int, struct work_unit *, int);
 void decrementWorkUnitUseCount (struct work_unit *, int);
 int addWorkToDoLine (int, struct work_unit *);
+int addWorkToDoLineNext (int, struct work_unit *);
+int addWorkToDoBatch (char *, char **);
 int updateWorkToDoLine (int, struct work_unit *);
 int deleteWorkToDoLine (int, struct work_unit *, int);
 int isWorkUnitActive (struct work_unit *);
+#define ADD_BEFORE_BLANK_LINES  0       /* Add work unit before the worker's trailing blank lines */
+#define ADD_TO_END              1       /* Add work unit at the end, used when reading worktodo.txt */
+#define ADD_AFTER_CURRENT       2       /* Add work unit right after the one the worker is processing */
 int addToWorkUnitArray (unsigned int, struct work_unit *, int);
 
 void rolling_average_work_unit_complete (int, struct work_unit *);
@@ -406,6 +418,27 @@ int read_array (int fd, char *buf, unsigned long len, unsigned long *sum);
 int write_array (int fd, const char *buf, unsigned long len, unsigned long *sum);
 int read_gwnum (int fd, gwhandle *gwdata, gwnum g, unsigned long *sum);
 int write_gwnum (int fd, gwhandle *gwdata, gwnum g, unsigned long *sum);
+int write_giant (int fd, giant g, unsigned long *sum);
+int read_gwnum_raw (int fd, gwhandle *gwdata, gwnum g, unsigned long *sum);
+int write_gwnum_raw (int fd, gwhandle *gwdata, gwnum g, unsigned long *sum);
+
+/* A snapshot of a residue shared by save file writers, residue printers, and error checks */
+
+typedef struct {
+        gwhandle *gwdata;       /* Handle used to convert the gwnum */
+        gwnum   value;          /* The gwnum snapshotted or NULL */
+        giant   g;              /* Reusable buffer holding the binary value */
+        int     converted;      /* TRUE if g holds the binary value of "value" */
+        int     err_code;       /* Result of the gwtogiant conversion */
+} residue_snapshot;
+
+void residue_snapshot_init (residue_snapshot *snap, gwhandle *gwdata);
+void residue_snapshot_take (residue_snapshot *snap, gwnum value);
+void residue_snapshot_invalidate (residue_snapshot *snap);
+void residue_snapshot_term (residue_snapshot *snap);
+giant residue_snapshot_giant (residue_snapshot *snap, gwnum value, int *err_code);
+giant residue_snapshot_release (residue_snapshot *snap, gwnum value);
+int write_gwnum_snapshot (int fd, residue_snapshot *snap, gwhandle *gwdata, gwnum g, unsigned long *sum);
 int read_short (int fd, short *val);
 int read_long (int fd, unsigned long *val, unsigned long *sum);
 int write_long (int fd, unsigned long val, unsigned long *sum);
@@ -478,8 +511,9 @@ int PRIMENET (short, void *);
 #define TE_LOAD_AVERAGE         13      /* Linux/FreeBSD/Apple load average check */
 #define TE_BENCH                14      /* Generate benchmark data for best FFT selection */
 #define TE_JACOBI               15      /* Trigger a Jacobi error check */
+#define TE_HOST_CHECK           16      /* Check on other processes sharing this host */
 
-#define MAX_TIMED_EVENTS        16      /* Maximum number of timed events */
+#define MAX_TIMED_EVENTS        17      /* Maximum number of timed events */
 
 void init_timed_event_handler (void);
 
@@ -93,9 +93,20 @@ int isProbablePrime (
 #define POOL_3MULT      2       /* Modinv algorithm that takes 3 multiplies */
 #define POOL_N_SQUARED  4       /* Use O(N^2) multiplies modinv algorithm */
 
+/* Auxiliary threads working on stage 2 ranges (see stage2_num_ranges) */
+
+typedef struct {
+        int     num_ranges;     /* Number of ranges, the worker does the first one */
+        volatile int abort;     /* Set when the auxiliary threads must quit early */
+        volatile int active;    /* Count of auxiliary threads still running */
+        gwmutex lock;           /* Lock protecting active */
+        gwevent all_done;       /* Signalled when the last auxiliary thread finishes */
+} stage2_ranges;
+
 typedef struct {
         gwhandle gwdata;        /* GWNUM handle */
         int     thread_num;     /* Worker thread number */
+        int     aux_thread;     /* TRUE for an auxiliary stage 2 thread's copy, which must not use the worker's GMP arena */
         unsigned long D;        /* Stage 2 loop size */
         unsigned long E;        /* Suyama's power in stage 2 */
         gwnum   *nQx;           /* Array of data used in stage 2 */
@@ -111,18 +122,27 @@ typedef struct {
         gwnum   *poolz_values;  /* Array of z values we are normalize */
         unsigned long modinv_count; /* Stats - count of modinv calls */
         void    *sieve_info;
+        stage2_ranges range_ctl; /* Stage 2 ranges done by auxiliary threads */
+        struct ecm_stage2_range_struct *ranges;
+        uint64_t plan_B;        /* Stage 1 bound of the plan below */
+        unsigned long plan_num_primes; /* Number of odd primes in the plan */
+        unsigned char *plan_chains; /* Stage 1 Lucas chain for each odd prime (see ecm_stage1_plan) */
 } ecmhandle;
 
+void ecm_stage2_ranges_free (ecmhandle *ecmdata);
+
 /* Perform cleanup functions. */
 
 void ecm_cleanup (
         ecmhandle *ecmdata)
 {
+        ecm_stage2_ranges_free (ecmdata);
         free (ecmdata->nQx);
         free (ecmdata->pool_values);
         free (ecmdata->poolz_values);
         free (ecmdata->mQx);
         free (ecmdata->pairings);
+        free (ecmdata->plan_chains);
         gwdone (&ecmdata->gwdata);
         end_sieve (ecmdata->sieve_info);
         memset (ecmdata, 0, sizeof (ecmhandle));
@@ -134,6 +154,7 @@ void ecm_cleanup (
 void ecm_partial_cleanup (
         ecmhandle *ecmdata)
 {
+        ecm_stage2_ranges_free (ecmdata);
         free (ecmdata->nQx); ecmdata->nQx = NULL;
         free (ecmdata->pool_values); ecmdata->pool_values = NULL;
         free (ecmdata->poolz_values); ecmdata->poolz_values = NULL;
@@ -572,12 +593,22 @@ int lucas_mul (
         gwnum   zz,
         uint64_t n,
         double  inv_v,
-        gwnum   Ad4)
+        gwnum   Ad4,
+        gwnum   *temps)         /* Eight preallocated temporaries or NULL */
 {
         uint64_t d, e, t, dmod3, emod3;
         gwnum   xA, zA, xB, zB, xC, zC, xs, zs, xt, zt;
         int     stop_reason;
 
+        if (temps != NULL) {
+                xA = temps[0]; zA = temps[1];
+                xB = temps[2]; zB = temps[3];
+                xC = temps[4]; zC = temps[5];
+                xt = temps[6]; zt = temps[7];
+                xs = xx;
+                zs = zz;
+                goto allocated;
+        }
         xA = gwalloc (&ecmdata->gwdata);
         if (xA == NULL) goto oom;
         zA = gwalloc (&ecmdata->gwdata);
@@ -597,6 +628,7 @@ int lucas_mul (
         zt = gwalloc (&ecmdata->gwdata);
         if (zt == NULL) goto oom;
 
+allocated:
         while (n != 1) {
             ell_begin_fft (ecmdata, xx, zz, xA, zA);            /* A */
             stop_reason = ell_dbl_fft (ecmdata, xA, zA, xB, zB, Ad4);           /* B = 2*A */
@@ -698,6 +730,10 @@ int lucas_mul (
 
             n = d;
         }
+
+/* The gwswaps above only shuffle the eight temporaries among themselves */
+
+        if (temps != NULL) return (0);
         gwfree (&ecmdata->gwdata, xA);
         gwfree (&ecmdata->gwdata, zA);
         gwfree (&ecmdata->gwdata, xB);
@@ -808,12 +844,48 @@ oom:    return (OutOfMemory (ecmdata->thread_num));
 /* then (5+3*v)/(3+2*v), etc.  Finally, execute the cheapest. */
 /* This is much faster than bin_ell_mul, but uses more memory. */
 
+#define NUM_LUCAS_V     10
+const double LUCAS_V[NUM_LUCAS_V] = {
+        0.6180339887498948,             /*v=(1+sqrt(5))/2*/
+        0.7236067977499790,             /*(2+v)/(1+v)*/
+        0.5801787282954641,             /*(3+2*v)/(2+v)*/
+        0.6328398060887063,             /*(5+3*v)/(3+2*v)*/
+        0.6124299495094950,             /*(8+5*v)/(5+3*v)*/
+        0.6201819808074158,             /*(13+8*v)/(8+5*v)*/
+        0.6172146165344039,             /*(21+13*v)/(13+8*v)*/
+        0.6183471196562281,             /*(34+21*v)/(21+13*v)*/
+        0.6179144065288179,             /*(55+34*v)/(34+21*v)*/
+        0.6180796684698958};            /*(89+55*v)/(55+34*v)*/
+
+/* Return the index into LUCAS_V of the cheapest Lucas chain for odd n */
+
+int lucas_best_v (
+        uint64_t n)
+{
+        unsigned long c, min;
+        int     i, best;
+
+        best = 0;
+        min = lucas_cost (n, LUCAS_V[0]);
+        for (i = 1; i < NUM_LUCAS_V; i++) {
+                c = lucas_cost (n, LUCAS_V[i]);
+                if (c < min) min = c, best = i;
+        }
+        return (best);
+}
+
+/* Multiply the point (xx,zz) by n.  Chain is the LUCAS_V index to use for */
+/* the odd part of n, or -1 to find the cheapest one.  Temps is NULL or */
+/* eight preallocated temporaries for lucas_mul. */
+
 int ell_mul (
         ecmhandle *ecmdata,
         gwnum   xx,
         gwnum   zz,
         uint64_t n,
-        gwnum   Ad4)
+        int     chain,
+        gwnum   Ad4,
+        gwnum   *temps)
 {
         unsigned long zeros;
         int     stop_reason;
@@ -821,40 +893,8 @@ int ell_mul (
         for (zeros = 0; (n & 1) == 0; zeros++) n >>= 1;
 
         if (n > 1) {
-                unsigned long c, min;
-                double  minv;
-
-                minv = 0.6180339887498948;              /*v=(1+sqrt(5))/2*/
-                min = lucas_cost (n, minv);
-
-                c = lucas_cost (n, 0.7236067977499790); /*(2+v)/(1+v)*/
-                if (c < min) min = c, minv = 0.7236067977499790;
-
-                c = lucas_cost (n, 0.5801787282954641); /*(3+2*v)/(2+v)*/
-                if (c < min) min = c, minv = 0.5801787282954641;
-
-                c = lucas_cost (n, 0.6328398060887063); /*(5+3*v)/(3+2*v)*/
-                if (c < min) min = c, minv = 0.6328398060887063;
-
-                c = lucas_cost (n, 0.6124299495094950); /*(8+5*v)/(5+3*v)*/
-                if (c < min) min = c, minv = 0.6124299495094950;
-
-                c = lucas_cost (n, 0.6201819808074158); /*(13+8*v)/(8+5*v)*/
-                if (c < min) min = c, minv = 0.6201819808074158;
-
-                c = lucas_cost (n, 0.6172146165344039); /*(21+13*v)/(13+8*v)*/
-                if (c < min) min = c, minv = 0.6172146165344039;
-
-                c = lucas_cost (n, 0.6183471196562281); /*(34+21*v)/(21+13*v)*/
-                if (c < min) min = c, minv = 0.6183471196562281;
-
-                c = lucas_cost (n, 0.6179144065288179); /*(55+34*v)/(34+21*v)*/
-                if (c < min) min = c, minv = 0.6179144065288179;
-
-                c = lucas_cost (n, 0.6180796684698958); /*(89+55*v)/(55+34*v)*/
-                if (c < min) min = c, minv = 0.6180796684698958;
-
-                stop_reason = lucas_mul (ecmdata, xx, zz, n, minv, Ad4);
+                if (chain < 0) chain = lucas_best_v (n);
+                stop_reason = lucas_mul (ecmdata, xx, zz, n, LUCAS_V[chain], Ad4, temps);
                 if (stop_reason) return (stop_reason);
         }
         while (zeros--) {
@@ -864,6 +904,78 @@ int ell_mul (
         return (0);
 }
 
+/* Every curve with the same B1 runs stage 1 over the same primes with the */
+/* same Lucas chains.  Picking a chain takes ten lucas_cost calls per prime, */
+/* which adds up next to the small FFTs ECM is often run with.  So the */
+/* chains for all the odd primes below B1 are picked once, four bits each, */
+/* and kept for the next curve and the next work unit.  Stage1ChainLimit */
+/* (default 100000000) is the largest B1 a plan is built for.  A plan takes */
+/* about B1 / (2 ln B1) bytes. */
+
+gwmutex ECM_PLAN_MUTEX;                 /* Lock for accessing the cached stage 1 plan */
+int     ECM_PLAN_MUTEX_INITIALIZED = FALSE;
+struct {
+        uint64_t B;                     /* Stage 1 bound the plan was built for */
+        unsigned long num_primes;       /* Number of odd primes in the plan */
+        unsigned char *chains;          /* LUCAS_V index for each odd prime, two per byte */
+} ECM_PLAN = {0};
+
+#define plan_chain(chains,i)    (((chains)[(i) >> 1] >> (((i) & 1) << 2)) & 0xF)
+
+/* Get this worker's copy of the stage 1 plan for B, building it if the */
+/* cached one is for a different B.  Leaves the worker without a plan if B */
+/* is too large or memory is short. */
+
+int ecm_stage1_plan (
+        int     thread_num,
+        ecmhandle *ecmdata,
+        uint64_t B)
+{
+        unsigned long max_primes, i;
+        uint64_t prime;
+        int     stop_reason;
+
+        if (ecmdata->plan_B == B) return (0);
+        free (ecmdata->plan_chains);
+        ecmdata->plan_chains = NULL;
+        ecmdata->plan_B = 0;
+        if (B < 3 || (double) B > IniGetFloat (INI_FILE, "Stage1ChainLimit", 100000000.0)) return (0);
+
+        if (!ECM_PLAN_MUTEX_INITIALIZED) {
+                ECM_PLAN_MUTEX_INITIALIZED = 1;
+                gwmutex_init (&ECM_PLAN_MUTEX);
+        }
+        gwmutex_lock (&ECM_PLAN_MUTEX);
+
+/* Build the plan if the cached one is not for this B1 */
+
+        stop_reason = 0;
+        if (ECM_PLAN.B != B) {
+                free (ECM_PLAN.chains);
+                ECM_PLAN.chains = NULL;
+                ECM_PLAN.B = 0;
+                max_primes = (unsigned long) ((double) B / (log ((double) B) - 1.1) * 1.01) + 100;
+                ECM_PLAN.chains = (unsigned char *) calloc (max_primes / 2 + 1, 1);
+                if (ECM_PLAN.chains == NULL) goto done;
+                stop_reason = start_sieve (thread_num, 3, &ecmdata->sieve_info);
+                if (stop_reason) goto done;
+                for (i = 0; (prime = sieve (ecmdata->sieve_info)) <= B && i < max_primes; i++)
+                        ECM_PLAN.chains[i >> 1] |= (unsigned char) (lucas_best_v (prime) << ((i & 1) << 2));
+                ECM_PLAN.num_primes = i;
+                ECM_PLAN.B = B;
+        }
+
+/* Copy the plan for this worker */
+
+        ecmdata->plan_chains = (unsigned char *) malloc (ECM_PLAN.num_primes / 2 + 1);
+        if (ecmdata->plan_chains == NULL) goto done;
+        memcpy (ecmdata->plan_chains, ECM_PLAN.chains, ECM_PLAN.num_primes / 2 + 1);
+        ecmdata->plan_num_primes = ECM_PLAN.num_primes;
+        ecmdata->plan_B = B;
+done:   gwmutex_unlock (&ECM_PLAN_MUTEX);
+        return (stop_reason);
+}
+
 /* Test if factor divides N, return TRUE if it does */
 
 int testFactor (
@@ -1064,7 +1176,7 @@ int gcd (
         giant   *factor)        /* Factor found if any */
 {
         giant   v;
-        mpz_t   a, b;
+        mpz_t   a, v_view, N_view;
 
 /* Assume a factor will not be found */
 
@@ -1073,24 +1185,25 @@ int gcd (
 /* Convert input number to binary */
 
         v = popg (&gwdata->gdata, ((int) gwdata->bit_length >> 5) + 10);
-        if (v == NULL) goto oom;
+        if (v == NULL) return (OutOfMemory (thread_num));
         if (gwtogiant (gwdata, gg, v)) {        // On unexpected error, return no factor found
                 pushg (&gwdata->gdata, 1);
                 return (0);
         }
 
-/* Do the GCD */
+/* Do the GCD.  GMP reads the giants' memory directly and takes its */
+/* temporaries from this worker's arena. */
 
+        gmp_arena_begin (thread_num, gwdata);
         mpz_init (a);
-        mpz_init (b);
-        gtompz (v, a);
-        gtompz (N, b);
+        gtompz_view (v, v_view);
+        gtompz_view (N, N_view);
+        mpz_gcd (a, v_view, N_view);
         pushg (&gwdata->gdata, 1);
-        mpz_gcd (a, a, b);
 
 /* If a factor was found, save it in FAC */
 
-        if (mpz_cmp_ui (a, 1) && mpz_cmp (a, b)) {
+        if (mpz_cmp_ui (a, 1) && mpz_cmp (a, N_view)) {
                 *factor = allocgiant ((int) mpz_sizeinbase (a, 32));
                 if (*factor == NULL) goto oom;
                 mpztog (a, *factor);
@@ -1099,12 +1212,14 @@ int gcd (
 /* Cleanup and return */
 
         mpz_clear (a);
-        mpz_clear (b);
+        gmp_arena_end ();
         return (0);
 
 /* Out of memory exit path */
 
-oom:    return (OutOfMemory (thread_num));
+oom:    mpz_clear (a);
+        gmp_arena_end ();
+        return (OutOfMemory (thread_num));
 }
 
 /* Computes the modular inverse of a number.  This is done using the */
@@ -1168,22 +1283,27 @@ int ecm_modinv (
         {
         mpz_t   __v, __N, __gcd, __inv;
 
-/* Do the extended GCD */
+/* Do the extended GCD.  GMP reads the giants' memory directly and takes */
+/* its temporaries from this worker's arena.  Auxiliary stage 2 threads run */
+/* concurrently with the worker, they use GMP's default allocator. */
 
-        mpz_init (__v);
-        mpz_init (__N);
+        if (!ecmdata->aux_thread) gmp_arena_begin (ecmdata->thread_num, &ecmdata->gwdata);
         mpz_init (__gcd);
         mpz_init (__inv);
-        gtompz (v, __v);
-        gtompz (N, __N);
+        gtompz_view (v, __v);
+        gtompz_view (N, __N);
         mpz_gcdext (__gcd, __inv, NULL, __v, __N);
-        mpz_clear (__v);
 
 /* If a factor was found (gcd != 1 && gcd != N), save it in FAC */
 
         if (mpz_cmp_ui (__gcd, 1) && mpz_cmp (__gcd, __N)) {
                 *factor = allocgiant ((int) mpz_sizeinbase (__gcd, 32));
-                if (*factor == NULL) goto oom;
+                if (*factor == NULL) {
+                        mpz_clear (__gcd);
+                        mpz_clear (__inv);
+                        gmp_arena_end ();
+                        goto oom;
+                }
                 mpztog (__gcd, *factor);
         }
 
@@ -1200,7 +1320,7 @@ int ecm_modinv (
 
         mpz_clear (__gcd);
         mpz_clear (__inv);
-        mpz_clear (__N);
+        gmp_arena_end ();
         }
 #endif
 
@@ -1756,6 +1876,57 @@ void mQ_term (
         gwfree (&ecmdata->gwdata, ecmdata->Q2Dxminus1);
 }
 
+/* Accumulate the primes between m-D and m+D into gg, pairing up primes */
+/* m-i and m+i so that they need only one multiply.  Prime is the first */
+/* prime at or above m-D.  Returns the first prime at or above m+D. */
+
+uint64_t ecm_stage2_pairs (
+        ecmhandle *ecmdata,
+        uint64_t m,
+        uint64_t prime,
+        gwnum   mQx,
+        gwnum   mQz,            /* Not used in the 2 FFT continuation */
+        gwnum   t1,
+        gwnum   gg)
+{
+        unsigned long i;
+
+        memset (ecmdata->pairings, 0, (ecmdata->D + 15) >> 4);
+        for ( ; ; prime = sieve (ecmdata->sieve_info)) {
+                if (prime < m) {        /* Do the m-D to m range */
+                        i = (unsigned long) (m - prime) >> 1;
+                        bitset (ecmdata->pairings, i);
+                } else if (prime < m+ecmdata->D) { /* Do the m to m+D range */
+                        i = (unsigned long) (prime - m) >> 1;
+                        if (bittst (ecmdata->pairings, i)) continue;
+                } else
+                        break;
+
+/* 2 FFT per prime continuation - deals with all normalized values */
+
+                if (ecmdata->TWO_FFT_STAGE2) {
+                        gwfftsub3 (&ecmdata->gwdata, mQx, ecmdata->nQx[i], t1);
+                        gwstartnextfft (&ecmdata->gwdata, TRUE);
+                        gwfftmul (&ecmdata->gwdata, t1, gg);
+                        gwstartnextfft (&ecmdata->gwdata, FALSE);
+                }
+
+/* 4 FFT per prime continuation - deals with only nQx values normalized */
+
+                else {
+                        gwstartnextfft (&ecmdata->gwdata, TRUE);
+                        gwfftfftmul (&ecmdata->gwdata, ecmdata->nQx[i], mQz, t1);
+                        gwstartnextfft (&ecmdata->gwdata, FALSE);
+                        gwfft (&ecmdata->gwdata, t1, t1);
+                        gwfftsub3 (&ecmdata->gwdata, mQx, t1, t1);
+                        gwstartnextfft (&ecmdata->gwdata, TRUE);
+                        gwfftmul (&ecmdata->gwdata, t1, gg);
+                        gwstartnextfft (&ecmdata->gwdata, FALSE);
+                }
+        }
+        return (prime);
+}
+
 /* Record the amount of memory being used by this thread.  Until we get to */
 /* stage 2, ECM uses 13 gwnums (see comments in the code). */
 
@@ -2159,6 +2330,983 @@ error:
 }
 
 
+/**************************************************************
+ *
+ *      Stage 1 / stage 2 pipelining
+ *
+ **************************************************************/
+
+/* Stage 1 of P-1 and ECM needs little memory, stage 2 wants a lot.  When the */
+/* Stage2Worker=n option is set, other workers do not run stage 2 themselves. */
+/* At the end of stage 1 they hand the stage 1 result to worker n and move on */
+/* to their next stage 1.  The hand off is a work unit added to worker n's */
+/* worktodo section, right after the work unit worker n is processing, plus an */
+/* in-memory copy of the stage 1 values.  A P-1 run also writes its usual save */
+/* file, so the stage 2 worker can resume from it if the in-memory copy is lost. */
+/* A handed off ECM curve becomes a one curve work unit with a specific sigma, */
+/* so at worst the curve's stage 1 is recomputed.  The stage 1 worker takes the */
+/* curve out of its own work unit's curve count, so the curve is reported once, */
+/* by the worker that runs its stage 2.  Deleting a hand off work unit frees */
+/* the in-memory copy. */
+
+#define MAX_HANDOFF_VALUES      2
+
+struct stage2_handoff {
+        struct stage2_handoff *next;
+        int     stage2_thread;          /* Worker the hand off was given to */
+        int     work_type;              /* Identifies the work unit handed off */
+        double  k;
+        unsigned long b;
+        unsigned long n;
+        signed long c;
+        double  sigma;                  /* ECM curve or zero for P-1 */
+        uint64_t B;                     /* Stage 1 bound that was completed */
+        int     num_values;             /* Number of gwnums handed off */
+        giant   values[MAX_HANDOFF_VALUES]; /* Binary values of the gwnums */
+};
+
+gwmutex STAGE2_HANDOFF_MUTEX;           /* Lock for accessing the hand off list */
+struct stage2_handoff *STAGE2_HANDOFFS = NULL;
+int     STAGE2_HANDOFF_COUNT = 0;
+
+/* Initialize the hand off list's lock.  Called once at program startup */
+/* before any worker threads are launched. */
+
+void stage2_handoff_init (void)
+{
+        gwmutex_init (&STAGE2_HANDOFF_MUTEX);
+}
+
+/* Return the worker that should run stage 2 for this work unit or -1 */
+/* if this worker should run stage 2 itself. */
+
+int stage2_worker (
+        int     thread_num,
+        uint64_t B,
+        uint64_t C)
+{
+        int     worker;
+
+        if (QA_IN_PROGRESS || C <= B) return (-1);
+        worker = IniGetInt (INI_FILE, "Stage2Worker", 0);
+        if (worker < 1 || worker > (int) NUM_WORKER_THREADS || worker == thread_num + 1) return (-1);
+        return (worker - 1);
+}
+
+void stage2_handoff_free (
+        struct stage2_handoff *h)
+{
+        int     i;
+
+        for (i = 0; i < MAX_HANDOFF_VALUES; i++) free (h->values[i]);
+        free (h);
+}
+
+/* Hand off the end of stage 1 to the stage 2 worker.  Returns TRUE if the */
+/* stage 2 worker now owns stage 2, FALSE if the caller must run it.  To */
+/* bound the memory held by the list, stage 1 workers run their own stage 2 */
+/* while too many hand offs are waiting. */
+
+int stage2_handoff (
+        int     thread_num,
+        int     stage2_thread,
+        struct work_unit *w,
+        double  sigma,
+        int     last_curve,             /* TRUE if the hand off completes the assignment */
+        uint64_t B,
+        gwhandle *gwdata,
+        int     num_values,
+        gwnum   *values)
+{
+        struct stage2_handoff *h;
+        struct work_unit new_w;
+        int     i, count;
+        char    buf[200];
+
+        gwmutex_lock (&STAGE2_HANDOFF_MUTEX);
+        count = STAGE2_HANDOFF_COUNT;
+        gwmutex_unlock (&STAGE2_HANDOFF_MUTEX);
+        if (count >= IniGetInt (INI_FILE, "Stage2HandoffLimit", 4)) return (FALSE);
+
+/* Copy the stage 1 values */
+
+        h = (struct stage2_handoff *) malloc (sizeof (struct stage2_handoff));
+        if (h == NULL) return (FALSE);
+        memset (h, 0, sizeof (struct stage2_handoff));
+        for (i = 0; i < num_values; i++) {
+                h->values[i] = allocgiant (((int) gwdata->bit_length >> 5) + 10);
+                if (h->values[i] == NULL || gwtogiant (gwdata, values[i], h->values[i])) {
+                        stage2_handoff_free (h);
+                        return (FALSE);
+                }
+        }
+        h->stage2_thread = stage2_thread;
+        h->work_type = w->work_type;
+        h->k = w->k;
+        h->b = w->b;
+        h->n = w->n;
+        h->c = w->c;
+        h->sigma = sigma;
+        h->B = B;
+        h->num_values = num_values;
+
+/* Build the stage 2 worker's copy of the work unit.  An ECM curve becomes a */
+/* one curve work unit.  It keeps the assignment ID only if it is the stage 1 */
+/* worker's last curve.  Finishing that curve completes the assignment, other */
+/* curves are reported without the ID just like any other ECM result. */
+
+        memcpy (&new_w, w, sizeof (struct work_unit));
+        new_w.known_factors = NULL;
+        new_w.comment = NULL;
+        new_w.next = new_w.prev = NULL;
+        new_w.in_use_count = 0;
+        new_w.high_memory_usage = 0;
+        new_w.stage[0] = 0;
+        new_w.pct_complete = 0.0;
+        new_w.fftlen = 0;
+        if (w->known_factors != NULL) {
+                new_w.known_factors = (char *) malloc (strlen (w->known_factors) + 1);
+                if (new_w.known_factors == NULL) {
+                        stage2_handoff_free (h);
+                        return (FALSE);
+                }
+                strcpy (new_w.known_factors, w->known_factors);
+        }
+        if (sigma != 0.0) {
+                new_w.curves_to_do = 1;
+                new_w.curve = sigma;
+                if (!last_curve) new_w.assignment_uid[0] = 0;
+        }
+
+/* Publish the values before the work unit so the stage 2 worker finds them */
+
+        gwmutex_lock (&STAGE2_HANDOFF_MUTEX);
+        h->next = STAGE2_HANDOFFS;
+        STAGE2_HANDOFFS = h;
+        STAGE2_HANDOFF_COUNT++;
+        gwmutex_unlock (&STAGE2_HANDOFF_MUTEX);
+        if (addWorkToDoLineNext (stage2_thread, &new_w)) {
+                struct stage2_handoff **prevp;
+                int     taken_back = FALSE;
+                gwmutex_lock (&STAGE2_HANDOFF_MUTEX);
+                for (prevp = &STAGE2_HANDOFFS; *prevp != NULL; prevp = &(*prevp)->next) {
+                        if (*prevp != h) continue;
+                        *prevp = h->next;
+                        STAGE2_HANDOFF_COUNT--;
+                        taken_back = TRUE;
+                        break;
+                }
+                gwmutex_unlock (&STAGE2_HANDOFF_MUTEX);
+                if (taken_back) {               /* Work unit was not added, run stage 2 ourselves */
+                        stage2_handoff_free (h);
+                        return (FALSE);
+                }
+        }
+
+        sprintf (buf, "Handing off stage 2 to worker #%d.\n", stage2_thread + 1);
+        OutputStr (thread_num, buf);
+        return (TRUE);
+}
+
+/* Free any stage 1 result handed off for a work unit that is being deleted */
+
+void stage2_handoff_discard (
+        int     thread_num,             /* Worker whose work unit is being deleted */
+        struct work_unit *w)
+{
+        struct stage2_handoff *h, **prevp;
+        double  sigma;
+
+        sigma = (w->work_type == WORK_ECM) ? w->curve : 0.0;
+        gwmutex_lock (&STAGE2_HANDOFF_MUTEX);
+        for (prevp = &STAGE2_HANDOFFS; (h = *prevp) != NULL; ) {
+                if (h->stage2_thread == thread_num && h->work_type == w->work_type &&
+                    h->k == w->k && h->b == w->b && h->n == w->n && h->c == w->c && h->sigma == sigma) {
+                        *prevp = h->next;
+                        STAGE2_HANDOFF_COUNT--;
+                        stage2_handoff_free (h);
+                } else
+                        prevp = &h->next;
+        }
+        gwmutex_unlock (&STAGE2_HANDOFF_MUTEX);
+}
+
+/* Take a stage 1 result handed off by another worker.  Returns TRUE and */
+/* fills in the gwnums if one matches this work unit, FALSE otherwise. */
+/* An ECM curve must also match the stage 1 bound, P-1 returns the bound */
+/* from the stage 1 worker. */
+
+int stage2_handoff_take (
+        struct work_unit *w,
+        double  sigma,
+        uint64_t *B,                    /* Stage 1 bound */
+        gwhandle *gwdata,
+        int     num_values,
+        gwnum   *values)
+{
+        struct stage2_handoff *h, **prevp;
+        int     i;
+
+        gwmutex_lock (&STAGE2_HANDOFF_MUTEX);
+        for (prevp = &STAGE2_HANDOFFS; (h = *prevp) != NULL; prevp = &h->next) {
+                if (h->work_type == w->work_type &&
+                    h->k == w->k && h->b == w->b && h->n == w->n && h->c == w->c &&
+                    h->sigma == sigma && (sigma == 0.0 || h->B == *B) && h->num_values == num_values) break;
+        }
+        if (h != NULL) {
+                *prevp = h->next;
+                STAGE2_HANDOFF_COUNT--;
+        }
+        gwmutex_unlock (&STAGE2_HANDOFF_MUTEX);
+        if (h == NULL) return (FALSE);
+
+        *B = h->B;
+        for (i = 0; i < num_values; i++) gianttogw (gwdata, h->values[i], values[i]);
+        stage2_handoff_free (h);
+        return (TRUE);
+}
+
+
+/**************************************************************
+ *
+ *      Stage 2 state files
+ *
+ **************************************************************/
+
+/* Stage 2 init builds tables of FFTed values (nQx for ECM, nQx and eQx for */
+/* P-1) that can take a long time to compute for large D and big numbers. */
+/* When Stage2StateFiles=1 is set, the tables are written to a .s2t file in */
+/* raw FFT form.  P-1 writes them when stage 2 init completes, ECM writes */
+/* them with the first save file of each curve's stage 2 so that curves that */
+/* finish between save files never pay for the write.  For P-1, the few values that */
+/* change as stage 2 progresses are written to a .s2p file every time a save */
+/* file is written.  A restarted stage 2 reads them back instead of redoing */
+/* stage 2 init.  The regular save file remains the record of which primes */
+/* have been processed -- the state files are only used when they agree */
+/* with it. */
+
+#define S2STATE_MAGICNUM        0x53325431
+#define S2STATE_VERSION         1
+
+int stage2_state_files (void)
+{
+        return (IniGetInt (INI_FILE, "Stage2StateFiles", 0));
+}
+
+void s2state_filename (
+        writeSaveFileState *state,
+        char    *ext,
+        char    *filename)
+{
+        sprintf (filename, "%s.%s", state->base_filename, ext);
+}
+
+/* Delete the state files, typically because stage 2 is complete */
+
+void s2state_unlink (
+        writeSaveFileState *state)
+{
+        char    filename[100];
+
+        s2state_filename (state, "s2t", filename);
+        _unlink (filename);
+        s2state_filename (state, "s2p", filename);
+        _unlink (filename);
+}
+
+/* Both state files start with a header identifying the number, the FFT */
+/* data layout, the stage 2 plan (the keys), and the tables the file */
+/* belongs to.  A progress file is only used with the tables file whose id */
+/* it carries. */
+
+int s2state_write_header (
+        int     fd,
+        struct work_unit *w,
+        gwhandle *gwdata,
+        uint32_t table_id,
+        int     num_keys,
+        uint64_t *keys,
+        unsigned long *sum)
+{
+        int     i;
+
+        if (!write_long (fd, S2STATE_MAGICNUM, sum)) return (FALSE);
+        if (!write_long (fd, S2STATE_VERSION, sum)) return (FALSE);
+        if (!write_double (fd, w->k, NULL)) return (FALSE);     /* write_double and read_double checksums differ */
+        if (!write_long (fd, w->b, sum)) return (FALSE);
+        if (!write_long (fd, w->n, sum)) return (FALSE);
+        if (!write_slong (fd, w->c, sum)) return (FALSE);
+        if (!write_long (fd, gwnum_layout_id (gwdata), sum)) return (FALSE);
+        if (!write_long (fd, table_id, sum)) return (FALSE);
+        if (!write_long (fd, num_keys, sum)) return (FALSE);
+        for (i = 0; i < num_keys; i++)
+                if (!write_longlong (fd, keys[i], sum)) return (FALSE);
+        return (TRUE);
+}
+
+int s2state_read_header (
+        int     fd,
+        struct work_unit *w,
+        gwhandle *gwdata,
+        uint32_t *table_id,             /* Zero means accept any table id */
+        int     num_keys,
+        uint64_t *keys,
+        unsigned long *sum)
+{
+        unsigned long magicnum, version, b, n, layout_id, id, file_num_keys;
+        long    c;
+        double  k;
+        uint64_t key;
+        int     i;
+
+        if (!read_long (fd, &magicnum, sum) || magicnum != S2STATE_MAGICNUM) return (FALSE);
+        if (!read_long (fd, &version, sum) || version != S2STATE_VERSION) return (FALSE);
+        if (!read_double (fd, &k, NULL) || k != w->k) return (FALSE);
+        if (!read_long (fd, &b, sum) || b != w->b) return (FALSE);
+        if (!read_long (fd, &n, sum) || n != w->n) return (FALSE);
+        if (!read_slong (fd, &c, sum) || c != w->c) return (FALSE);
+        if (!read_long (fd, &layout_id, sum) || layout_id != gwnum_layout_id (gwdata)) return (FALSE);
+        if (!read_long (fd, &id, sum) || id == 0) return (FALSE);
+        if (*table_id != 0 && id != *table_id) return (FALSE);
+        *table_id = (uint32_t) id;
+        if (!read_long (fd, &file_num_keys, sum) || file_num_keys != (unsigned long) num_keys) return (FALSE);
+        for (i = 0; i < num_keys; i++)
+                if (!read_longlong (fd, &key, sum) || key != keys[i]) return (FALSE);
+        return (TRUE);
+}
+
+/* Write the tables file.  NULL entries in the tables array are skipped. */
+/* If fft_one (the FFT of 1) is given, the tables have been FFTed and are */
+/* written in unFFTed form.  Returns the id the progress files must carry, */
+/* zero if the write failed. */
+
+uint32_t s2state_write_tables (
+        writeSaveFileState *state,
+        struct work_unit *w,
+        gwhandle *gwdata,
+        int     num_keys,
+        uint64_t *keys,
+        unsigned long num_tables,
+        gwnum   *tables,
+        gwnum   fft_one)
+{
+        char    filename[100];
+        int     fd;
+        unsigned long sum = 0, i, count;
+        uint32_t table_id;
+        gwnum   tmp = NULL;
+
+        do
+                table_id = ((uint32_t) rand () << 16) ^ (uint32_t) rand () ^ (uint32_t) time (NULL);
+        while (table_id == 0);
+
+        for (i = count = 0; i < num_tables; i++)
+                if (tables[i] != NULL) count++;
+        if (fft_one != NULL) {
+                tmp = gwalloc (gwdata);
+                if (tmp == NULL) return (0);
+        }
+
+        s2state_filename (state, "s2t", filename);
+        fd = _open (filename, _O_BINARY | _O_WRONLY | _O_TRUNC | _O_CREAT, CREATE_FILE_ACCESS);
+        if (fd < 0) goto openerr;
+        if (!s2state_write_header (fd, w, gwdata, table_id, num_keys, keys, &sum)) goto writeerr;
+        if (!write_long (fd, num_tables, &sum)) goto writeerr;
+        if (!write_long (fd, count, &sum)) goto writeerr;
+        for (i = 0; i < num_tables; i++) {
+                if (tables[i] == NULL) continue;
+                if (!write_long (fd, i, &sum)) goto writeerr;
+                if (fft_one == NULL) {
+                        if (!write_gwnum_raw (fd, gwdata, tables[i], &sum)) goto writeerr;
+                } else {
+                        gwfftfftmul (gwdata, fft_one, tables[i], tmp);
+                        if (!write_gwnum_raw (fd, gwdata, tmp, &sum)) goto writeerr;
+                }
+        }
+        if (!write_long (fd, sum, NULL)) goto writeerr;
+        _commit (fd);
+        _close (fd);
+        if (tmp != NULL) gwfree (gwdata, tmp);
+        return (table_id);
+
+writeerr:
+        _close (fd);
+        _unlink (filename);
+openerr:
+        if (tmp != NULL) gwfree (gwdata, tmp);
+        return (0);
+}
+
+/* Read the tables file written for table_id.  Gwnums are allocated for the */
+/* entries present in the file, other entries of the tables array are left */
+/* NULL.  Returns the number of entries read, zero if the file is unusable. */
+
+unsigned long s2state_read_tables (
+        writeSaveFileState *state,
+        struct work_unit *w,
+        gwhandle *gwdata,
+        uint32_t table_id,
+        int     num_keys,
+        uint64_t *keys,
+        unsigned long num_tables,
+        gwnum   *tables)
+{
+        char    filename[100];
+        int     fd;
+        unsigned long sum = 0, filesum, file_num_tables, count, i, j;
+
+        s2state_filename (state, "s2t", filename);
+        fd = _open (filename, _O_BINARY | _O_RDONLY);
+        if (fd < 0) return (0);
+        if (!s2state_read_header (fd, w, gwdata, &table_id, num_keys, keys, &sum)) goto readerr;
+        if (!read_long (fd, &file_num_tables, &sum) || file_num_tables != num_tables) goto readerr;
+        if (!read_long (fd, &count, &sum) || count == 0 || count > num_tables) goto readerr;
+        for (i = 0; i < count; i++) {
+                if (!read_long (fd, &j, &sum) || j >= num_tables || tables[j] != NULL) goto readerr;
+                tables[j] = gwalloc (gwdata);
+                if (tables[j] == NULL) goto readerr;
+                if (!read_gwnum_raw (fd, gwdata, tables[j], &sum)) goto readerr;
+        }
+        if (!read_long (fd, &filesum, NULL) || filesum != sum) goto readerr;
+        _close (fd);
+        return (count);
+
+readerr:
+        _close (fd);
+        for (i = 0; i < num_tables; i++) {
+                if (tables[i] == NULL) continue;
+                gwfree (gwdata, tables[i]);
+                tables[i] = NULL;
+        }
+        return (0);
+}
+
+/* Write the progress file.  It holds a few integers describing where stage */
+/* 2 is (such as the next m value to process) and the gwnums that change as */
+/* stage 2 progresses. */
+
+void s2state_write_progress (
+        writeSaveFileState *state,
+        struct work_unit *w,
+        gwhandle *gwdata,
+        uint32_t table_id,
+        int     num_keys,
+        uint64_t *keys,
+        int     num_pos,
+        uint64_t *pos,
+        int     num_values,
+        gwnum   *values)
+{
+        char    filename[100];
+        int     fd, i;
+        unsigned long sum = 0;
+
+        if (table_id == 0) return;
+        s2state_filename (state, "s2p", filename);
+        fd = _open (filename, _O_BINARY | _O_WRONLY | _O_TRUNC | _O_CREAT, CREATE_FILE_ACCESS);
+        if (fd < 0) return;
+        if (!s2state_write_header (fd, w, gwdata, table_id, num_keys, keys, &sum)) goto writeerr;
+        for (i = 0; i < num_pos; i++)
+                if (!write_longlong (fd, pos[i], &sum)) goto writeerr;
+        for (i = 0; i < num_values; i++)
+                if (!write_gwnum_raw (fd, gwdata, values[i], &sum)) goto writeerr;
+        if (!write_long (fd, sum, NULL)) goto writeerr;
+        _commit (fd);
+        _close (fd);
+        return;
+
+writeerr:
+        _close (fd);
+        _unlink (filename);
+}
+
+/* Read the progress file into caller-allocated gwnums.  Returns the id of */
+/* the tables file it belongs to, zero if the file is unusable. */
+
+uint32_t s2state_read_progress (
+        writeSaveFileState *state,
+        struct work_unit *w,
+        gwhandle *gwdata,
+        int     num_keys,
+        uint64_t *keys,
+        int     num_pos,
+        uint64_t *pos,
+        int     num_values,
+        gwnum   *values)
+{
+        char    filename[100];
+        int     fd, i;
+        unsigned long sum = 0, filesum;
+        uint32_t table_id = 0;
+
+        s2state_filename (state, "s2p", filename);
+        fd = _open (filename, _O_BINARY | _O_RDONLY);
+        if (fd < 0) return (0);
+        if (!s2state_read_header (fd, w, gwdata, &table_id, num_keys, keys, &sum)) goto readerr;
+        for (i = 0; i < num_pos; i++)
+                if (!read_longlong (fd, &pos[i], &sum)) goto readerr;
+        for (i = 0; i < num_values; i++)
+                if (!read_gwnum_raw (fd, gwdata, values[i], &sum)) goto readerr;
+        if (!read_long (fd, &filesum, NULL) || filesum != sum) goto readerr;
+        _close (fd);
+        return (table_id);
+
+readerr:
+        _close (fd);
+        return (0);
+}
+
+/* ECM stage 2 state.  The tables are the normalized nQx values followed by */
+/* the normalized Q^2D.  These depend only on the curve, B1, and D, so a */
+/* tables file can be used with any stage 2 save file of the same curve. */
+/* There is no progress file.  The Q^m values are cheap to recompute. */
+
+#define ECM_S2STATE_KEYS        3
+
+void ecm_s2state_keys (
+        ecmhandle *ecmdata,
+        double  sigma,
+        uint64_t B,
+        uint64_t *keys)
+{
+        keys[0] = (uint64_t) sigma;
+        keys[1] = B;
+        keys[2] = ecmdata->D;
+}
+
+void ecm_s2state_save_tables (
+        ecmhandle *ecmdata,
+        writeSaveFileState *state,
+        struct work_unit *w,
+        double  sigma,
+        uint64_t B,
+        gwnum   fft_one)        /* FFT of 1 */
+{
+        uint64_t keys[ECM_S2STATE_KEYS];
+        gwnum   *tables, Q2Dx;
+
+/* By now the nQx values are FFTed and mQ_init has turned Q^2D into the */
+/* FFT of Q^2D+1.  Recover the FFT of Q^2D, the tables writer unFFTs it */
+/* along with the nQx values. */
+
+        Q2Dx = gwalloc (&ecmdata->gwdata);
+        if (Q2Dx == NULL) return;
+        gwfftfftmul (&ecmdata->gwdata, fft_one, ecmdata->Q2Dxplus1, Q2Dx);
+        gwaddsmall (&ecmdata->gwdata, Q2Dx, -1);
+        gwfft (&ecmdata->gwdata, Q2Dx, Q2Dx);
+        tables = (gwnum *) malloc ((ecmdata->D/2 + 1) * sizeof (gwnum));
+        if (tables != NULL) {
+                memcpy (tables, ecmdata->nQx, (ecmdata->D/2) * sizeof (gwnum));
+                tables[ecmdata->D/2] = Q2Dx;
+                ecm_s2state_keys (ecmdata, sigma, B, keys);
+                s2state_write_tables (state, w, &ecmdata->gwdata, ECM_S2STATE_KEYS, keys, ecmdata->D/2 + 1, tables, fft_one);
+                free (tables);
+        }
+        gwfree (&ecmdata->gwdata, Q2Dx);
+}
+
+/* Read the nQx values from the tables file.  Returns the normalized Q^2D */
+/* or NULL if stage 2 init must be done the usual way. */
+
+gwnum ecm_s2state_restore (
+        ecmhandle *ecmdata,
+        writeSaveFileState *state,
+        struct work_unit *w,
+        double  sigma,
+        uint64_t B)
+{
+        uint64_t keys[ECM_S2STATE_KEYS];
+        gwnum   *tables, Q2Dx;
+        unsigned long i, num_tables;
+
+        num_tables = ecmdata->D/2 + 1;
+        tables = (gwnum *) calloc (num_tables, sizeof (gwnum));
+        if (tables == NULL) return (NULL);
+        ecm_s2state_keys (ecmdata, sigma, B, keys);
+        if (!s2state_read_tables (state, w, &ecmdata->gwdata, 0, ECM_S2STATE_KEYS, keys, num_tables, tables) ||
+            tables[0] == NULL || tables[num_tables-1] == NULL) {
+                for (i = 0; i < num_tables; i++)
+                        if (tables[i] != NULL) gwfree (&ecmdata->gwdata, tables[i]);
+                free (tables);
+                return (NULL);
+        }
+        memcpy (ecmdata->nQx, tables, (ecmdata->D/2) * sizeof (gwnum));
+        Q2Dx = tables[num_tables-1];
+        free (tables);
+        return (Q2Dx);
+}
+
+
+/**************************************************************
+ *
+ *      Stage 2 range partitioning
+ *
+ **************************************************************/
+
+/* gwnum cannot split a small FFT efficiently across threads -- it runs */
+/* one-pass FFTs on a single thread.  When the Stage2Ranges=n option is set */
+/* and the worker's FFT ended up single-threaded, ECM and P-1 stage 2 split */
+/* the m values into n ranges instead.  The worker does the first range. */
+/* Auxiliary threads do the others, each with its own gwnum handle using the */
+/* same FFT, its own Q^m (or x^(m^e)) values and its own accumulator.  All */
+/* of them read the worker's nQx table.  The accumulators are multiplied */
+/* together before the GCD.  Save files only record the worker's progress, */
+/* an interrupted stage 2 redoes the other ranges when it resumes.  The */
+/* memory the auxiliary threads use is not counted -- it is small next to */
+/* the nQx table. */
+
+/* Return the number of ranges to split stage 2 into, one to not split it */
+
+int stage2_num_ranges (
+        int     thread_num,
+        struct PriorityInfo *sp_info,
+        gwhandle *gwdata)
+{
+        int     num_ranges, num_threads;
+
+        num_ranges = IniGetInt (INI_FILE, "Stage2Ranges", 0);
+        num_threads = worker_num_cores (thread_num) * sp_info->normal_work_hyperthreads;
+        if (num_ranges > num_threads) num_ranges = num_threads;
+        if (num_ranges < 2 || gwget_num_threads (gwdata) > 1) return (1);
+        return (num_ranges);
+}
+
+/* Return the first m value of a range.  Range num_ranges returns the end */
+/* of the last range.  Stage 2 does m values below C+D in steps of incr. */
+
+uint64_t stage2_range_start (
+        uint64_t m,             /* First m value of stage 2 */
+        uint64_t C,             /* Stage 2 bound */
+        unsigned long D,
+        unsigned long incr,
+        int     num_ranges,
+        int     range)
+{
+        uint64_t count;
+
+        count = (C + D > m) ? (C + D - m + incr - 1) / incr : 0;
+        return (m + count * range / num_ranges * incr);
+}
+
+/* Set up a gwnum handle whose gwnums can be used with the worker's handle. */
+/* That takes the same FFT implementation, which gwinfo may not pick for a */
+/* different thread count, so try each implementation of the FFT length */
+/* until the worker's comes up.  Returns FALSE on failure. */
+
+int stage2_clone_gwhandle (
+        gwhandle *gwdata,       /* The worker's handle */
+        gwhandle *clone,        /* Handle to set up */
+        struct work_unit *w,
+        int     error_check,    /* Passed to gwsetnormroutine */
+        int     num_threads,    /* Threads for the clone's FFTs */
+        struct PriorityInfo *sp_info) /* Affinity for the clone's helper threads, or NULL */
+{
+        int     nth;
+
+        for (nth = 0; nth < 50; nth++) {
+                gwinit (clone);
+                clone->cpu_flags = gwdata->cpu_flags;
+                gwset_num_threads (clone, num_threads);
+                if (sp_info != NULL) {
+                        gwset_thread_callback (clone, SetAuxThreadPriority);
+                        gwset_thread_callback_data (clone, sp_info);
+                }
+                gwset_sum_inputs_checking (clone, gwdata->sum_inputs_checking);
+                if (gwdata->use_large_pages) gwset_use_large_pages (clone);
+                clone->will_error_check = gwdata->will_error_check;
+                gwset_safety_margin (clone, gwdata->safety_margin);
+                gwset_minimum_fftlen (clone, gwdata->FFTLEN);
+                clone->bench_pick_nth_fft = nth;
+                if (gwsetup (clone, w->k, w->b, w->n, w->c) || clone->FFTLEN != gwdata->FFTLEN) {
+                        gwdone (clone);
+                        return (FALSE);
+                }
+                if (clone->GWPROCPTRS[0] == gwdata->GWPROCPTRS[0] &&
+                    gwnum_datasize (clone) == gwnum_datasize (gwdata)) {
+                        clone->MAXDIFF = gwdata->MAXDIFF;
+                        gwsetnormroutine (clone, 0, error_check, 0);
+                        return (TRUE);
+                }
+                gwdone (clone);
+        }
+        return (FALSE);
+}
+
+/* Reset the control structure before the auxiliary threads are launched */
+
+void stage2_ranges_begin (
+        stage2_ranges *ctl)
+{
+        if (ctl->lock == NULL) {
+                gwmutex_init (&ctl->lock);
+                gwevent_init (&ctl->all_done);
+        }
+        ctl->abort = FALSE;
+        ctl->active = ctl->num_ranges - 1;
+        gwevent_reset (&ctl->all_done);
+}
+
+/* Called by each auxiliary thread when it is done with its range.  A range */
+/* done by a thread the worker never joins (see pm1_stage2_help) passes an */
+/* exited flag.  It is set once the thread has let go of the lock, the worker */
+/* must see it before freeing the control structure. */
+
+void stage2_range_done (
+        stage2_ranges *ctl,
+        volatile int *exited)   /* Flag to set when done with ctl, or NULL if the thread is joined */
+{
+        gwmutex_lock (&ctl->lock);
+        if (--ctl->active == 0) gwevent_signal (&ctl->all_done);
+        gwmutex_unlock (&ctl->lock);
+        if (exited != NULL) *exited = TRUE;
+}
+
+/* Wait for the auxiliary threads to finish their ranges.  If the worker */
+/* must stop first, tell the auxiliary threads to quit and return the stop */
+/* reason.  The caller still has to join the threads. */
+
+int stage2_ranges_wait (
+        int     thread_num,
+        stage2_ranges *ctl)
+{
+        int     stop_reason;
+
+        while (ctl->active) {
+                gwevent_wait (&ctl->all_done, 1);
+                if (ctl->active == 0) break;
+                stop_reason = stopCheck (thread_num);
+                if (stop_reason) {
+                        ctl->abort = TRUE;
+                        return (stop_reason);
+                }
+        }
+        return (0);
+}
+
+/* Free the control structure's lock and event */
+
+void stage2_ranges_end (
+        stage2_ranges *ctl)
+{
+        if (ctl->lock != NULL) {
+                gwmutex_destroy (&ctl->lock);
+                gwevent_destroy (&ctl->all_done);
+        }
+        memset (ctl, 0, sizeof (stage2_ranges));
+}
+
+/* An ECM stage 2 range.  The handle shares the worker's nQx array. */
+
+typedef struct ecm_stage2_range_struct {
+        ecmhandle ecmdata;      /* Handle with its own gwdata, mQ state and pools */
+        gwthread thread_id;     /* Thread doing this range */
+        stage2_ranges *ctl;     /* The worker's control structure */
+        int     aux_thread_num; /* Passed to SetAuxThreadPriority */
+        struct PriorityInfo *sp_info;
+        giant   N;              /* This thread's copy of the number being factored */
+        gwnum   x, Q2Dx, Ad4;   /* Copies of the values mQ_init needs */
+        uint64_t m;             /* First m value of the range */
+        uint64_t m_end;         /* First m value past the range */
+        uint64_t C;             /* Stage 2 bound */
+        gwnum   gg;             /* The range's accumulator */
+        giant   factor;         /* Factor found normalizing Q^m values, if any */
+        int     stop_reason;    /* Out of memory or similar */
+        int     error;          /* TRUE if there was an FFT error */
+} ecm_stage2_range;
+
+/* Auxiliary thread that accumulates one range of ECM stage 2 */
+
+void ecm_stage2_range_thread (
+        void    *arg)
+{
+        ecm_stage2_range *r = (ecm_stage2_range *) arg;
+        ecmhandle *ecmdata = &r->ecmdata;
+        gwnum   mQx, mQz = NULL, t1;
+        uint64_t m, prime;
+
+        SetAuxThreadPriority (r->aux_thread_num, 0, r->sp_info);
+
+/* Compute Q^m for the start of the range and init the accumulator */
+
+        r->stop_reason = mQ_init (ecmdata, r->x, r->m, r->Q2Dx, r->Ad4);
+        if (r->stop_reason) goto done;
+        r->gg = gwalloc (&ecmdata->gwdata);
+        t1 = gwalloc (&ecmdata->gwdata);
+        if (r->gg == NULL || t1 == NULL) {
+                r->stop_reason = OutOfMemory (ecmdata->thread_num);
+                goto done;
+        }
+        dbltogw (&ecmdata->gwdata, 1.0, r->gg);
+        r->stop_reason = start_sieve (ecmdata->thread_num, r->m - ecmdata->D, &ecmdata->sieve_info);
+        if (r->stop_reason) goto done;
+        prime = sieve (ecmdata->sieve_info);
+
+/* Same loop as the worker's, without the output and save files */
+
+        for (m = r->m; m < r->m_end && r->C > m - ecmdata->D; m += ecmdata->D + ecmdata->D) {
+                if (r->ctl->abort) break;
+                r->stop_reason = mQ_next (ecmdata, &mQx, &mQz, r->N, &r->factor);
+                if (r->stop_reason || r->factor != NULL) break;
+                prime = ecm_stage2_pairs (ecmdata, m, prime, mQx, mQz, t1, r->gg);
+                if (gw_test_for_error (&ecmdata->gwdata)) {
+                        r->error = TRUE;
+                        break;
+                }
+        }
+
+/* Tell the worker we are done */
+
+done:   stage2_range_done (r->ctl, NULL);
+        SetAuxThreadPriority (r->aux_thread_num, 1, NULL);
+}
+
+/* Set up the auxiliary threads' handles and copy the values mQ_init needs */
+/* before the worker's mQ_init changes them.  Returns the first m value */
+/* past the worker's own range. */
+
+uint64_t ecm_stage2_ranges_create (
+        ecmhandle *ecmdata,
+        struct work_unit *w,
+        struct PriorityInfo *sp_info,
+        uint64_t m,             /* First m value of stage 2 */
+        uint64_t C,             /* Stage 2 bound */
+        gwnum   x,              /* Normalized Q^1 */
+        gwnum   Q2Dx,           /* Normalized Q^2D */
+        gwnum   Ad4,
+        giant   N)              /* Number being factored */
+{
+        stage2_ranges *ctl = &ecmdata->range_ctl;
+        ecm_stage2_range *r;
+        unsigned long incr = ecmdata->D + ecmdata->D;
+        int     i, num_ranges;
+        char    buf[100];
+
+        ctl->num_ranges = 1;
+        num_ranges = stage2_num_ranges (ecmdata->thread_num, sp_info, &ecmdata->gwdata);
+        if (num_ranges == 1 ||
+            stage2_range_start (m, C, ecmdata->D, incr, num_ranges, 1) == m) return ((uint64_t) -1);
+
+        ecmdata->ranges = (ecm_stage2_range *) calloc (num_ranges - 1, sizeof (ecm_stage2_range));
+        if (ecmdata->ranges == NULL) return ((uint64_t) -1);
+        for (i = 1; i < num_ranges; i++) {
+                r = &ecmdata->ranges[i-1];
+                if (!stage2_clone_gwhandle (&ecmdata->gwdata, &r->ecmdata.gwdata, w, ERRCHK, 1, NULL)) break;
+                ctl->num_ranges++;
+                r->ecmdata.thread_num = ecmdata->thread_num;
+                r->ecmdata.aux_thread = TRUE;
+                r->ecmdata.D = ecmdata->D;
+                r->ecmdata.E = ecmdata->E;
+                r->ecmdata.nQx = ecmdata->nQx;
+                r->ecmdata.TWO_FFT_STAGE2 = ecmdata->TWO_FFT_STAGE2;
+                r->ecmdata.pool_type = ecmdata->pool_type;
+                r->ecmdata.pairings = (char *) malloc ((ecmdata->D + 15) >> 4);
+                r->ecmdata.mQx = (gwnum *) malloc (ecmdata->E * sizeof (gwnum));
+                r->ecmdata.pool_values = (gwnum *) malloc (ecmdata->E * sizeof (gwnum));
+                r->ecmdata.poolz_values = (gwnum *) malloc (ecmdata->E * sizeof (gwnum));
+                r->N = allocgiant (N->sign);
+                r->x = gwalloc (&r->ecmdata.gwdata);
+                r->Q2Dx = gwalloc (&r->ecmdata.gwdata);
+                r->Ad4 = gwalloc (&r->ecmdata.gwdata);
+                if (r->ecmdata.pairings == NULL || r->ecmdata.mQx == NULL || r->ecmdata.pool_values == NULL ||
+                    r->ecmdata.poolz_values == NULL || r->N == NULL || r->x == NULL || r->Q2Dx == NULL || r->Ad4 == NULL) break;
+                gtog (N, r->N);
+                gwcopy (&r->ecmdata.gwdata, x, r->x);
+                gwcopy (&r->ecmdata.gwdata, Q2Dx, r->Q2Dx);
+                gwcopy (&r->ecmdata.gwdata, Ad4, r->Ad4);
+                r->ctl = ctl;
+                r->aux_thread_num = i;
+                r->sp_info = sp_info;
+                r->m = stage2_range_start (m, C, ecmdata->D, incr, num_ranges, i);
+                r->m_end = stage2_range_start (m, C, ecmdata->D, incr, num_ranges, i+1);
+                r->C = C;
+        }
+
+/* Fall back to doing all of stage 2 in the worker if a handle could not be set up */
+
+        if (ctl->num_ranges != num_ranges) {
+                OutputStr (ecmdata->thread_num, "Unable to split stage 2 into ranges.\n");
+                ecm_stage2_ranges_free (ecmdata);
+                return ((uint64_t) -1);
+        }
+        sprintf (buf, "Splitting stage 2 into %d ranges.\n", num_ranges);
+        OutputStr (ecmdata->thread_num, buf);
+        return (stage2_range_start (m, C, ecmdata->D, incr, num_ranges, 1));
+}
+
+/* Launch the auxiliary threads once the nQx table is ready */
+
+void ecm_stage2_ranges_launch (
+        ecmhandle *ecmdata)
+{
+        int     i;
+
+        stage2_ranges_begin (&ecmdata->range_ctl);
+        for (i = 0; i < ecmdata->range_ctl.num_ranges - 1; i++)
+                gwthread_create_waitable (&ecmdata->ranges[i].thread_id, &ecm_stage2_range_thread, &ecmdata->ranges[i]);
+}
+
+/* Wait for the auxiliary threads and multiply their accumulators into gg. */
+/* Returns a stop reason if the worker must stop, the worker then writes */
+/* a save file with its own progress. */
+
+int ecm_stage2_ranges_finish (
+        ecmhandle *ecmdata,
+        gwnum   gg,             /* The worker's accumulator */
+        giant   *factor,        /* Factor found by an auxiliary thread */
+        int     *error)         /* Set if an auxiliary thread had an FFT error */
+{
+        ecm_stage2_range *r;
+        gwnum   t1;
+        int     i, stop_reason;
+
+        stop_reason = stage2_ranges_wait (ecmdata->thread_num, &ecmdata->range_ctl);
+        if (stop_reason) return (stop_reason);
+        for (i = 0; i < ecmdata->range_ctl.num_ranges - 1; i++) {
+                r = &ecmdata->ranges[i];
+                gwthread_wait_for_exit (&r->thread_id);
+                r->thread_id = NULL;
+                if (r->stop_reason) return (r->stop_reason);
+                if (r->error) *error = TRUE;
+                if (r->factor != NULL) *factor = r->factor, r->factor = NULL;
+                if (*error || *factor != NULL) return (0);
+                t1 = gwalloc (&ecmdata->gwdata);
+                if (t1 == NULL) return (OutOfMemory (ecmdata->thread_num));
+                gwcopy (&ecmdata->gwdata, r->gg, t1);
+                gwmul (&ecmdata->gwdata, t1, gg);
+                gwfree (&ecmdata->gwdata, t1);
+        }
+        ecm_stage2_ranges_free (ecmdata);
+        return (0);
+}
+
+/* Stop the auxiliary threads if they are running and free the ranges */
+
+void ecm_stage2_ranges_free (
+        ecmhandle *ecmdata)
+{
+        ecm_stage2_range *r;
+        int     i;
+
+        if (ecmdata->ranges == NULL) return;
+        ecmdata->range_ctl.abort = TRUE;
+        for (i = 0; i < ecmdata->range_ctl.num_ranges - 1; i++) {
+                r = &ecmdata->ranges[i];
+                if (r->thread_id != NULL) gwthread_wait_for_exit (&r->thread_id);
+                free (r->ecmdata.pairings);
+                free (r->ecmdata.mQx);
+                free (r->ecmdata.pool_values);
+                free (r->ecmdata.poolz_values);
+                end_sieve (r->ecmdata.sieve_info);
+                gwdone (&r->ecmdata.gwdata);
+                free (r->N);
+                free (r->factor);
+        }
+        free (ecmdata->ranges);
+        ecmdata->ranges = NULL;
+        stage2_ranges_end (&ecmdata->range_ctl);
+}
+
+
 /**************************************************************
  *
  *      Main ECM Function
@@ -2174,17 +3322,22 @@ int ecm (
         uint64_t B;             /* Stage 1 bound */
         uint64_t C_start;       /* Stage 2 starting point (usually B) */
         uint64_t C;             /* Stage 2 ending point */
-        uint64_t sieve_start, prime, m;
+        uint64_t sieve_start, prime, m, m_end;
         unsigned long SQRT_B;
         double  sigma, last_output, last_output_t, one_over_B, one_over_C_minus_B;
         double  output_frequency, output_title_frequency;
         unsigned long i, j, curve, min_memory;
+        int     save_after_handoff;     /* TRUE if the save file must be rewritten for the curve after a hand off */
+        int     s2state_tables_unsaved; /* TRUE if the stage 2 tables are due in the state file */
         readSaveFileState read_save_file_state; /* Manage savefile names during reading */
         writeSaveFileState write_save_file_state; /* Manage savefile names during writing */
         char    filename[32], buf[255], JSONbuf[4000], fft_desc[200];
         int     res, stop_reason, stage, first_iter_msg;
+        int     numa_map[MAX_NUMA_MAP_THREADS];
         gwnum   x, z, t1, t2, gg;
         gwnum   Q2x, Q2z, Qiminus2x, Qiminus2z, Qdiffx, Qdiffz;
+        gwnum   lucas_temps[8]; /* Stage 1 temporaries for lucas_mul */
+        unsigned long plan_index; /* Index of the next odd prime in the stage 1 plan */
         giant   N;              /* Number being factored */
         giant   factor;         /* Factor found, if any */
         gwnum   Ad4 = NULL;
@@ -2205,6 +3358,7 @@ int ecm (
         factor = NULL;
         str = NULL;
         msg = NULL;
+        save_after_handoff = FALSE;
 
 /* Clear all timers */
 
@@ -2428,7 +3582,8 @@ return 0;
         gwset_bench_cores (&ecmdata.gwdata, NUM_CPUS);
         gwset_bench_workers (&ecmdata.gwdata, NUM_WORKER_THREADS);
         if (ERRCHK) gwset_will_error_check (&ecmdata.gwdata);
-        gwset_num_threads (&ecmdata.gwdata, CORES_PER_TEST[thread_num] * sp_info->normal_work_hyperthreads);
+        gwset_num_threads (&ecmdata.gwdata, worker_num_cores (thread_num) * sp_info->normal_work_hyperthreads);
+        gwset_numa_nodes (&ecmdata.gwdata, fft_numa_map (sp_info, gwget_num_threads (&ecmdata.gwdata), numa_map), numa_map);
         gwset_thread_callback (&ecmdata.gwdata, SetAuxThreadPriority);
         gwset_thread_callback_data (&ecmdata.gwdata, sp_info);
         gwset_safety_margin (&ecmdata.gwdata, IniGetFloat (INI_FILE, "ExtraSafetyMargin", 0.0));
@@ -2659,6 +3814,30 @@ restart0:
         if (factor != NULL) goto bingo;
         sieve_start = 2;
 
+/* If another worker ran stage 1 of this curve and handed it off to us, go straight to stage 2 */
+
+        if (w->curve > 5.0) {
+                gwnum   values[2];
+                values[0] = x;
+                values[1] = z;
+                if (stage2_handoff_take (w, sigma, &B, &ecmdata.gwdata, 2, values)) {
+                        OutputStr (thread_num, "Using stage 1 result from another worker.\n");
+                        stage = 1;
+                        stop_reason = start_sieve (thread_num, B + 1, &ecmdata.sieve_info);
+                        if (stop_reason) goto exit;
+                        prime = sieve (ecmdata.sieve_info);
+                        goto restart3;
+                }
+        }
+
+/* After a hand off, replace the save file of the handed off curve with one for */
+/* this curve.  Otherwise a restart would redo the handed off curve. */
+
+        if (save_after_handoff) {
+                ecm_save (&ecmdata, &write_save_file_state, w, ECM_STAGE1, curve, sigma, B, sieve_start - 1, 0, x, z);
+                save_after_handoff = FALSE;
+        }
+
 /* The stage 1 restart point */
 
 restart1:
@@ -2668,23 +3847,50 @@ restart1:
         sprintf (w->stage, "C%ldS1", curve);
         w->pct_complete = sieve_start * one_over_B;
         start_timer (timers, 0);
+
+/* Get the Lucas chains for this B1 and find our place in them */
+
+        stop_reason = ecm_stage1_plan (thread_num, &ecmdata, B);
+        if (stop_reason) goto exit;
+        plan_index = 0;
+        if (ecmdata.plan_chains != NULL && sieve_start > 3) {
+                stop_reason = start_sieve (thread_num, 3, &ecmdata.sieve_info);
+                if (stop_reason) goto exit;
+                while (sieve (ecmdata.sieve_info) < sieve_start) plan_index++;
+        }
+
+/* Allocate the lucas_mul temporaries once rather than for every prime */
+
+        for (i = 0; i < 8; i++) {
+                lucas_temps[i] = gwalloc (&ecmdata.gwdata);
+                if (lucas_temps[i] == NULL) goto oom;
+        }
+
         stop_reason = start_sieve (thread_num, sieve_start, &ecmdata.sieve_info);
         if (stop_reason) goto exit;
         for ( ; ; ) {
+                int     chain;
+
                 prime = sieve (ecmdata.sieve_info);
                 if (prime > B) break;
 
+/* Look up the prime's Lucas chain in the plan */
+
+                chain = -1;
+                if (prime > 2 && plan_index < ecmdata.plan_num_primes)
+                        chain = plan_chain (ecmdata.plan_chains, plan_index), plan_index++;
+
 /* Apply as many powers of prime as long as prime^n <= B */
-/* MEMUSED: 3 gwnums (x, z, AD4) + 10 for ell_mul */
+/* MEMUSED: 3 gwnums (x, z, AD4) + 8 for ell_mul */
 
-                stop_reason = ell_mul (&ecmdata, x, z, prime, Ad4);
+                stop_reason = ell_mul (&ecmdata, x, z, prime, chain, Ad4, lucas_temps);
                 if (stop_reason) goto exit;
                 if (prime <= SQRT_B) {
                         uint64_t mult, max;
                         mult = prime;
                         max = B / prime;
                         for ( ; ; ) {
-                                stop_reason = ell_mul (&ecmdata, x, z, prime, Ad4);
+                                stop_reason = ell_mul (&ecmdata, x, z, prime, chain, Ad4, lucas_temps);
                                 if (stop_reason) goto exit;
                                 mult *= prime;
                                 if (mult > max) break;
@@ -2745,6 +3951,7 @@ restart1:
 
 /* Stage 1 complete */
 
+        for (i = 0; i < 8; i++) gwfree (&ecmdata.gwdata, lucas_temps[i]);
         end_timer (timers, 0);
         sprintf (buf, "Stage 1 complete. %.0f transforms, %lu modular inverses. Time: ",
                  gw_get_fft_count (&ecmdata.gwdata), ecmdata.modinv_count);
@@ -2761,6 +3968,30 @@ restart1:
                 gw_clear_maxerr (&ecmdata.gwdata);
         }
 
+/* If pipelining, let the stage 2 worker run this curve's stage 2 and start the next curve. */
+/* The curve now belongs to the stage 2 worker's work unit, take it out of ours.  The next */
+/* curve reuses this curve number.  If this was our only curve left, we are done. */
+
+        if (w->curve < 5.0) {
+                int     stage2_thread = stage2_worker (thread_num, B, C);
+                gwnum   values[2];
+                values[0] = x;
+                values[1] = z;
+                if (stage2_thread >= 0 && stage2_handoff (thread_num, stage2_thread, w, sigma, w->curves_to_do == 1, B, &ecmdata.gwdata, 2, values)) {
+                        w->curves_to_do--;
+                        if (w->curves_to_do == 0) {
+                                unlinkSaveFiles (&write_save_file_state);
+                                stop_reason = STOP_WORK_UNIT_COMPLETE;
+                                goto exit;
+                        }
+                        stop_reason = updateWorkToDoLine (thread_num, w);
+                        if (stop_reason) goto exit;
+                        save_after_handoff = TRUE;
+                        curve--;
+                        goto more_curves;
+                }
+        }
+
 /* If we aren't doing a stage 2, then check to see if we found a factor. */
 /* If we are doing a stage 2, then the stage 2 init will do this GCD for us. */
 
@@ -2888,6 +4119,20 @@ restart3:
                 if (ecmdata.pairings == NULL) goto oom;
         }
 
+/* When resuming stage 2 from a save file, try to read the nQx values */
+/* from the state file rather than computing them. */
+
+        s2state_tables_unsaved = FALSE;
+        if (gg != NULL && stage2_state_files ()) {
+                Q2x = ecm_s2state_restore (&ecmdata, &write_save_file_state, w, sigma, B);
+                if (Q2x != NULL) {
+                        OutputStr (thread_num, "Restored stage 2 tables from state file.\n");
+                        gwfree (&ecmdata.gwdata, x);
+                        gwfree (&ecmdata.gwdata, z);
+                        goto s2state_restored;
+                }
+        }
+
 /* Allocate memory for computing nQx values */
 /* MEMUSED: 9 gwnums (x, z, AD4, 6 for nQx) */
 
@@ -3006,19 +4251,30 @@ restart3:
         gwfree (&ecmdata.gwdata, Qiminus2x);
         gwfree (&ecmdata.gwdata, Qiminus2z);
 
+/* The nQx values go to the stage 2 state file with the first save file */
+
+        s2state_tables_unsaved = stage2_state_files ();
+
 /* Init code that computes Q^m */
 /* MEMUSED: 6 + nQx gwnums (6 for computing mQx, nQx values) */
 /* MEMPEAK: 6 + nQx + 6 for bin_ell_mul temporaries */
 
+s2state_restored:
         m = (prime / ecmdata.D + 1) * ecmdata.D;
+        m_end = ecm_stage2_ranges_create (&ecmdata, w, sp_info, m, C, ecmdata.nQx[0], Q2x, Ad4, N);
         stop_reason = mQ_init (&ecmdata, ecmdata.nQx[0], m, Q2x, Ad4);
         if (stop_reason) goto exit;
 
-/* Precompute the transforms of nQx */
+/* Precompute the transforms of nQx.  Then the auxiliary threads, if any, */
+/* can start on their ranges. */
 
         for (i = 0; i < ecmdata.D/2; i++)
                 if (ecmdata.nQx[i] != NULL)
                         gwfft (&ecmdata.gwdata, ecmdata.nQx[i], ecmdata.nQx[i]);
+        if (ecmdata.range_ctl.num_ranges > 1) {
+                ecm_stage2_ranges_launch (&ecmdata);
+                one_over_C_minus_B *= ecmdata.range_ctl.num_ranges;
+        }
 
 /* Now init the accumulator unless this value was read */
 /* from a continuation file */
@@ -3051,8 +4307,8 @@ restart3:
 
         start_timer (timers, 0);
         stage = 2;
-        for ( ; C > m-ecmdata.D; m += ecmdata.D+ecmdata.D) {
-                gwnum   mQx, mQz;
+        for ( ; C > m-ecmdata.D && m < m_end; m += ecmdata.D+ecmdata.D) {
+                gwnum   mQx, mQz = NULL;
 
 /* Compute next Q^m value */
 /* MEMUSED: 7 + nQx + E gwnums (6 for computing mQx, gg, nQx and E values) */
@@ -3061,7 +4317,9 @@ restart3:
                 stop_reason = mQ_next (&ecmdata, &mQx, &mQz, N, &factor);
                 if (stop_reason) {
                         // In case stop_reason is out-of-memory, free some up
-                        // before calling ecm_save.
+                        // before calling ecm_save.  Stop the auxiliary threads
+                        // before nQx[0] is changed.
+                        ecm_stage2_ranges_free (&ecmdata);
                         mQ_term (&ecmdata);
                         t1 = gwalloc (&ecmdata.gwdata);
                         if (t1 == NULL) goto oom;
@@ -3074,51 +4332,9 @@ restart3:
                         goto exit;
                 }
                 if (factor != NULL) goto bingo;
-                memset (ecmdata.pairings, 0, (ecmdata.D + 15) >> 4);
                 t1 = gwalloc (&ecmdata.gwdata);
-                if (t1 == NULL) goto oom;
-
-/* 2 FFT per prime continuation - deals with all normalized values */
-
-                if (ecmdata.TWO_FFT_STAGE2) {
-                    for ( ; ; prime = sieve (ecmdata.sieve_info)) {
-                        if (prime < m) {        /* Do the m-D to m range */
-                                i = (unsigned long) (m - prime) >> 1;
-                                bitset (ecmdata.pairings, i);
-                        } else if (prime < m+ecmdata.D) { /* Do the m to m+D range */
-                                i = (unsigned long) (prime - m) >> 1;
-                                if (bittst (ecmdata.pairings, i)) continue;
-                        } else
-                                break;
-                        gwfftsub3 (&ecmdata.gwdata, mQx, ecmdata.nQx[i], t1);
-                        gwstartnextfft (&ecmdata.gwdata, TRUE);
-                        gwfftmul (&ecmdata.gwdata, t1, gg);
-                        gwstartnextfft (&ecmdata.gwdata, FALSE);
-                    }
-                }
-
-/* 4 FFT per prime continuation - deals with only nQx values normalized */
-
-                else {
-                    for ( ; ; prime = sieve (ecmdata.sieve_info)) {
-                        if (prime < m) {        /* Do the m-D to m range */
-                                i = (unsigned long) (m - prime) >> 1;
-                                bitset (ecmdata.pairings, i);
-                        } else if (prime < m+ecmdata.D) { /* Do the m to m+D range */
-                                i = (unsigned long) (prime - m) >> 1;
-                                if (bittst (ecmdata.pairings, i)) continue;
-                        } else
-                                break;
-                        gwstartnextfft (&ecmdata.gwdata, TRUE);
-                        gwfftfftmul (&ecmdata.gwdata, ecmdata.nQx[i], mQz, t1);
-                        gwstartnextfft (&ecmdata.gwdata, FALSE);
-                        gwfft (&ecmdata.gwdata, t1, t1);
-                        gwfftsub3 (&ecmdata.gwdata, mQx, t1, t1);
-                        gwstartnextfft (&ecmdata.gwdata, TRUE);
-                        gwfftmul (&ecmdata.gwdata, t1, gg);
-                        gwstartnextfft (&ecmdata.gwdata, FALSE);
-                    }
-                }
+                if (t1 == NULL) goto oom;
+                prime = ecm_stage2_pairs (&ecmdata, m, prime, mQx, mQz, t1, gg);
                 gwfree (&ecmdata.gwdata, t1);
 
 /* Calculate stage 2 percent complete */
@@ -3172,6 +4388,10 @@ restart3:
                         if (t1 == NULL) goto oom;
                         dbltogw (&ecmdata.gwdata, 1.0, t1);
                         gwmul (&ecmdata.gwdata, t1, gg);
+                        if (s2state_tables_unsaved) {
+                                ecm_s2state_save_tables (&ecmdata, &write_save_file_state, w, sigma, B, t1);
+                                s2state_tables_unsaved = FALSE;
+                        }
                         gwfftfftmul (&ecmdata.gwdata, t1, ecmdata.nQx[0], t1);
                         ecm_save (&ecmdata, &write_save_file_state, w, ECM_STAGE2, curve,
                                   sigma, B, B, prime, t1, gg);
@@ -3180,11 +4400,33 @@ restart3:
                 }
         }
         mQ_term (&ecmdata);
+
+/* Multiply in the auxiliary threads' accumulators.  If we must stop */
+/* while waiting for them, save the worker's progress. */
+
+        if (ecmdata.range_ctl.num_ranges > 1) {
+                int     range_error = FALSE;
+                stop_reason = ecm_stage2_ranges_finish (&ecmdata, gg, &factor, &range_error);
+                if (stop_reason) {
+                        ecm_stage2_ranges_free (&ecmdata);
+                        t1 = gwalloc (&ecmdata.gwdata);
+                        if (t1 == NULL) goto oom;
+                        dbltogw (&ecmdata.gwdata, 1.0, t1);
+                        gwmul (&ecmdata.gwdata, t1, gg);
+                        gwfftfftmul (&ecmdata.gwdata, t1, ecmdata.nQx[0], t1);
+                        ecm_save (&ecmdata, &write_save_file_state, w, ECM_STAGE2, curve,
+                                  sigma, B, B, prime, t1, gg);
+                        goto exit;
+                }
+                if (range_error) goto error;
+                if (factor != NULL) goto bingo;
+        }
         t1 = gwalloc (&ecmdata.gwdata);
         if (t1 == NULL) goto oom;
         dbltogw (&ecmdata.gwdata, 1.0, t1);
         gwmul (&ecmdata.gwdata, t1, gg);
         gwfree (&ecmdata.gwdata, t1);
+        s2state_unlink (&write_save_file_state);
 
 /* Stage 2 is complete */
 
@@ -3589,8 +4831,13 @@ typedef struct {
         unsigned long pairs_done;/* Number of pairs completed */
         double  pct_mem_to_use; /* If we get memory allocation errors, we */
                                 /* progressively try using less and less. */
+        stage2_ranges range_ctl; /* Stage 2 ranges done by auxiliary threads */
+        struct pm1_stage2_range_struct *ranges;
+        gwnum   help_x;         /* Copy of stage 2's starting value for other workers' ranges */
 } pm1handle;
 
+void pm1_stage2_ranges_free (pm1handle *pm1data);
+
 /* Perform cleanup functions. */
 
 void pm1_cleanup (
@@ -3599,6 +4846,7 @@ void pm1_cleanup (
 
 /* Free memory */
 
+        pm1_stage2_ranges_free (pm1data);
         free (pm1data->nQx);
         free (pm1data->eQx);
         free (pm1data->bitarray);
@@ -3607,38 +4855,86 @@ void pm1_cleanup (
         memset (pm1data, 0, sizeof (pm1handle));
 }
 
-/* Raises number to the given power */
+/* Pick the sliding window width for raising x to an exponent of len bits. */
+/* A width of w takes 2^(w-1) multiplies to build the table of odd powers */
+/* and about len/(w+1) multiplies while scanning the exponent.  A width of */
+/* one is plain binary exponentiation, about len/2 multiplies. */
 
-void pm1_mul (
-        pm1handle *pm1data,
-        gwnum   xx,
-        gwnum   orig_xx_fft,
-        uint64_t n)
+int pm1_window_width (
+        unsigned long len,
+        int     max_width)
 {
-        uint64_t c;
+        int     w, best_w;
+        double  cost, best_cost;
 
-/* Find most significant bit and then ignore it */
+        best_w = 1;
+        best_cost = (double) len / 2.0;
+        for (w = 2; w <= max_width; w++) {
+                cost = (double) (1 << (w - 1)) + (double) len / (double) (w + 1);
+                if (cost < best_cost) best_w = w, best_cost = cost;
+        }
+        return (best_w);
+}
 
-        c = 1;
-        c <<= 63;
-        while ((c&n) == 0) c >>= 1;
-        c >>= 1;
+/* Raise xx to a large exponent using a sliding window of width w.  Table */
+/* must have room for 2^(w-1) gwnums which are set to the FFTs of xx^1, */
+/* xx^3, ..., xx^(2^w-1).  The exponent's bits are read straight from its */
+/* limbs. */
 
-/* Handle the second most significant bit */
+#define exp_bit(limbs,i)        (int) (((limbs)[(i) / GMP_NUMB_BITS] >> ((i) % GMP_NUMB_BITS)) & 1)
 
-        gwstartnextfft (&pm1data->gwdata, c > 1);
-        gwfft (&pm1data->gwdata, xx, orig_xx_fft);
-        gwfftfftmul (&pm1data->gwdata, orig_xx_fft, orig_xx_fft, xx);
-        if (c&n) gwfftmul (&pm1data->gwdata, orig_xx_fft, xx);
-        c >>= 1;
+void pm1_window_exp (
+        pm1handle *pm1data,
+        gwnum   xx,
+        mpz_t   exp,
+        int     w,
+        gwnum   *table)
+{
+        const mp_limb_t *limbs;
+        long    i, j, n, len;
+        unsigned long val;
+        int     k;
+
+        limbs = mpz_limbs_read (exp);
+        len = (long) mpz_sizeinbase (exp, 2);
+        if (len < 2) return;
+
+/* Build the table of odd powers.  The last entry doubles as room for xx^2 */
+/* while building the others. */
+
+        gwstartnextfft (&pm1data->gwdata, FALSE);
+        gwfft (&pm1data->gwdata, xx, table[0]);
+        if (w > 1) {
+                gwnum   x2 = table[(1 << (w - 1)) - 1];
+                gwfftfftmul (&pm1data->gwdata, table[0], table[0], x2);
+                gwfft (&pm1data->gwdata, x2, x2);
+                for (k = 1; k < (1 << (w - 1)); k++) {
+                        gwfftfftmul (&pm1data->gwdata, table[k-1], x2, table[k]);
+                        gwfft (&pm1data->gwdata, table[k], table[k]);
+                }
+        }
 
-/* Do the rest of the bits */
+/* Scan the exponent from the top.  The most significant bit is xx itself. */
+/* The first squaring reuses the FFT of xx in the table. */
 
-        while (c) {
-                gwstartnextfft (&pm1data->gwdata, c > 1);
-                gwsquare (&pm1data->gwdata, xx);
-                if (c&n) gwfftmul (&pm1data->gwdata, orig_xx_fft, xx);
-                c >>= 1;
+        for (i = len - 2, k = TRUE; i >= 0; ) {
+                if (!exp_bit (limbs, i)) {
+                        j = i;
+                        val = 0;
+                } else {
+                        j = (i >= w - 1) ? i - (w - 1) : 0;
+                        while (!exp_bit (limbs, j)) j++;
+                        for (val = 0, n = i; n >= j; n--) val = (val << 1) + exp_bit (limbs, n);
+                }
+                for ( ; i >= j; i--) {
+                        gwstartnextfft (&pm1data->gwdata, i > 0 || val);
+                        if (k) gwfftfftmul (&pm1data->gwdata, table[0], table[0], xx), k = FALSE;
+                        else gwsquare (&pm1data->gwdata, xx);
+                }
+                if (val) {
+                        gwstartnextfft (&pm1data->gwdata, j > 0);
+                        gwfftmul (&pm1data->gwdata, table[val >> 1], xx);
+                }
         }
 }
 
@@ -3757,7 +5053,7 @@ void fd_term (
 /* Routines to create and read save files for a P-1 factoring job */
 
 #define PM1_MAGICNUM    0x317a394b
-#define PM1_VERSION     2                               /* Changed in 29.4 build 7 -- corrected calc_exp bug */
+#define PM1_VERSION     3                               /* Changed in 29.8 -- stage 0 exponent no longer depends on n */
 
 void pm1_save (
         pm1handle *pm1data,
@@ -3847,7 +5143,7 @@ int pm1_restore (                       /* For version 25 and later save files *
 
         if (! read_magicnum (fd, PM1_MAGICNUM)) goto readerr;
         if (! read_header (fd, &version, w, &filesum)) goto readerr;
-        if (version != 1 && version != 2) goto readerr;
+        if (version < 1 || version > PM1_VERSION) goto readerr;
 
 /* Read the file data */
 
@@ -3872,8 +5168,9 @@ int pm1_restore (                       /* For version 25 and later save files *
         if (! read_long (fd, &pm1data->pairs_done, &sum)) goto readerr;
 
 /* Note version 29.4 build 7 changed the calc_exp algorithm which invalidates earlier save files that are in stage 0. */
+/* Version 29.8 changed it again so that the product of small primes can be shared by P-1 runs with the same B1. */
 
-        if (version == 1 && pm1data->stage == PM1_STAGE0) {
+        if (version < PM1_VERSION && pm1data->stage == PM1_STAGE0) {
                 OutputBoth (thread_num, "P-1 save file incompatible with this program version.  Restarting stage 1 from the beginning.\n");
                 goto readerr;
         }
@@ -3908,6 +5205,97 @@ error:
         return (FALSE);
 }
 
+/* P-1 stage 2 state.  The tables are the nQx values of one pass of a */
+/* multi-pass stage 2.  The progress values are the eQx finite differences */
+/* and the m value they have been advanced to. */
+
+#define PM1_S2STATE_KEYS        6
+
+void pm1_s2state_keys (
+        pm1handle *pm1data,
+        uint64_t *keys)
+{
+        keys[0] = pm1data->B_done;
+        keys[1] = pm1data->C_start;
+        keys[2] = pm1data->C;
+        keys[3] = pm1data->D;
+        keys[4] = pm1data->E;
+        keys[5] = pm1data->rels_done;
+}
+
+uint32_t pm1_s2state_save_tables (
+        pm1handle *pm1data,
+        writeSaveFileState *state,
+        struct work_unit *w)
+{
+        uint64_t keys[PM1_S2STATE_KEYS];
+
+        pm1_s2state_keys (pm1data, keys);
+        return (s2state_write_tables (state, w, &pm1data->gwdata, PM1_S2STATE_KEYS, keys, pm1data->D >> 1, pm1data->nQx, NULL));
+}
+
+void pm1_s2state_save_progress (
+        pm1handle *pm1data,
+        writeSaveFileState *state,
+        struct work_unit *w,
+        uint32_t table_id,
+        uint64_t eqx_m)                 /* The m value eQx[0] corresponds to */
+{
+        uint64_t keys[PM1_S2STATE_KEYS];
+
+        pm1_s2state_keys (pm1data, keys);
+        s2state_write_progress (state, w, &pm1data->gwdata, table_id, PM1_S2STATE_KEYS, keys,
+                                1, &eqx_m, pm1data->E + 1, pm1data->eQx);
+}
+
+/* Restore this pass' nQx values and the eQx values from the state files. */
+/* The nQx array must be cleared before calling.  Returns the id of the */
+/* tables file or zero if stage 2 init must be done the usual way. */
+
+uint32_t pm1_s2state_restore (
+        pm1handle *pm1data,
+        writeSaveFileState *state,
+        struct work_unit *w,
+        uint64_t *eqx_m,                /* Returned m value eQx[0] corresponds to */
+        unsigned long *numrels)         /* Returned count of nQx values */
+{
+        uint64_t keys[PM1_S2STATE_KEYS];
+        unsigned long i;
+        uint32_t table_id;
+
+        for (i = 0; i <= pm1data->E; i++) pm1data->eQx[i] = NULL;
+        for (i = 0; i <= pm1data->E; i++) {
+                pm1data->eQx[i] = gwalloc (&pm1data->gwdata);
+                if (pm1data->eQx[i] == NULL) goto fail;
+        }
+
+/* Read the progress file, then the tables it belongs to.  The tables may */
+/* hold fewer relative primes than this pass would otherwise process (if */
+/* more memory is available now), but not more. */
+
+        pm1_s2state_keys (pm1data, keys);
+        table_id = s2state_read_progress (state, w, &pm1data->gwdata, PM1_S2STATE_KEYS, keys, 1, eqx_m, pm1data->E + 1, pm1data->eQx);
+        if (table_id == 0) goto fail;
+        *numrels = s2state_read_tables (state, w, &pm1data->gwdata, table_id, PM1_S2STATE_KEYS, keys, pm1data->D >> 1, pm1data->nQx);
+        if (*numrels == 0) goto fail;
+        if (*numrels > pm1data->rels_this_pass) {
+                for (i = 0; i < pm1data->D >> 1; i++) {
+                        if (pm1data->nQx[i] == NULL) continue;
+                        gwfree (&pm1data->gwdata, pm1data->nQx[i]);
+                        pm1data->nQx[i] = NULL;
+                }
+                goto fail;
+        }
+        pm1data->rels_this_pass = *numrels;
+        return (table_id);
+
+/* Failure, free the memory we allocated */
+
+fail:   for (i = 0; i <= pm1data->E; i++)
+                if (pm1data->eQx[i] != NULL) gwfree (&pm1data->gwdata, pm1data->eQx[i]);
+        return (0);
+}
+
 
 /* Compute how many values we can allocate.  This function can calculate */
 /* the value using either the maximum available memory or the currently */
@@ -4343,16 +5731,11 @@ errexit:        pm1data->bitarray_len = 0;
         return (0);
 }
 
-/* Recursively compute exp used in initial 3^exp calculation of a P-1 */
-/* factoring run.  Don't forget to include 2*n in exp when factoring */
-/* Mersenne numbers since factors must be 1 mod 2n */
+/* Recursively compute the product of small prime powers used in the initial */
+/* 3^exp calculation of a P-1 factoring run. */
 
 void calc_exp (
         pm1handle *pm1data,
-        double  k,              /* K in K*B^N+C */
-        unsigned long b,        /* B in K*B^N+C */
-        unsigned long n,        /* N in K*B^N+C */
-        signed long c,          /* C in K*B^N+C */
         mpz_t   g,              /* Variable to accumulate multiplied small primes */
         uint64_t B1,            /* P-1 stage 1 bound */
         uint64_t *p,            /* Variable to fetch next small prime into */
@@ -4370,25 +5753,17 @@ void calc_exp (
 
         if (len >= 1024) {
                 mpz_t   x;
-                calc_exp (pm1data, k, b, n, c, g, B1, p, lower, lower + (len >> 1));
+                calc_exp (pm1data, g, B1, p, lower, lower + (len >> 1));
                 mpz_init (x);
-                calc_exp (pm1data, k, b, n, c, x, B1, p, lower + (len >> 1), upper);
+                calc_exp (pm1data, x, B1, p, lower + (len >> 1), upper);
                 mpz_mul (g, x, g);
                 mpz_clear (x);
                 return;
         }
 
-/* For Mersenne numbers, 2^n-1, make sure we include 2n in the calculated exponent (since factors */
-/* are of the form 2kn+1).  For generalized Fermat numbers, b^n+1 (n is a power of 2), make sure n */
-/* is included in the calculated exponent as factors are of the form kn+1 (actually forum posters */
-/* have pointed out that Fermat numbers should include 4n and generalized Fermat should include 2n). */
-/* Heck, maybe other forms may also need n included, so just always include 2n -- it is very cheap. */
-
-        if (lower == 0) mpz_set_ui (g, 2*n);
-        else mpz_set_ui (g, 1);
-
 /* Find all the primes in the range and use as many powers as possible */
 
+        mpz_set_ui (g, 1);
         for ( ; *p <= B1 && mpz_sizeinbase (g, 2) < len; *p = sieve (pm1data->sieve_info)) {
                 uint64_t val, max;
                 val = *p;
@@ -4404,6 +5779,546 @@ void calc_exp (
         }
 }
 
+/* The product of small primes computed by calc_exp depends only on B1.  In a queue */
+/* of P-1 work units with the same B1 there is no need to recompute it for every */
+/* exponent.  We keep the most recently built product around for the next work unit. */
+
+gwmutex STAGE0_EXP_MUTEX;               /* Lock for accessing the cached stage 0 exponent */
+int     STAGE0_EXP_MUTEX_INITIALIZED = FALSE;
+struct {
+        int     initialized;            /* TRUE if exp has been mpz_init'ed */
+        int     valid;                  /* TRUE if exp has been built */
+        uint64_t B;                     /* Stage 1 bound exp was built for */
+        unsigned long bits;             /* Number of bits requested from calc_exp */
+        uint64_t next_prime;            /* First prime not included in exp */
+        mpz_t   exp;                    /* The product of small prime powers */
+} STAGE0_EXP = {0};
+
+/* Compute the exponent for stage 0 of P-1.  This is the cached product of small */
+/* primes times 2n.  For Mersenne numbers, 2^n-1, we must include 2n in the exponent */
+/* (since factors are of the form 2kn+1).  For generalized Fermat numbers, b^n+1 */
+/* (n is a power of 2), make sure n is included in the calculated exponent as factors */
+/* are of the form kn+1 (actually forum posters have pointed out that Fermat numbers */
+/* should include 4n and generalized Fermat should include 2n).  Heck, maybe other */
+/* forms may also need n included, so just always include 2n -- it is very cheap. */
+/* On return, the sieve is positioned so that *prime is the first prime that is not */
+/* part of the exponent. */
+
+int stage0_exp (
+        int     thread_num,
+        pm1handle *pm1data,
+        unsigned long n,        /* N in K*B^N+C */
+        uint64_t B1,            /* P-1 stage 1 bound */
+        unsigned long bits,     /* Number of bits of small primes to include */
+        mpz_t   exp,            /* Returned exponent */
+        uint64_t *prime)        /* Returned next prime */
+{
+        int     stop_reason;
+
+        if (!STAGE0_EXP_MUTEX_INITIALIZED) {
+                STAGE0_EXP_MUTEX_INITIALIZED = 1;
+                gwmutex_init (&STAGE0_EXP_MUTEX);
+        }
+        gwmutex_lock (&STAGE0_EXP_MUTEX);
+
+/* Build the product of small primes if the cached copy is not for this B1 */
+
+        if (!STAGE0_EXP.valid || STAGE0_EXP.B != B1 || STAGE0_EXP.bits != bits) {
+                if (!STAGE0_EXP.initialized) {
+                        mpz_init (STAGE0_EXP.exp);
+                        STAGE0_EXP.initialized = TRUE;
+                }
+                STAGE0_EXP.valid = FALSE;
+                stop_reason = start_sieve (thread_num, 2, &pm1data->sieve_info);
+                if (stop_reason) goto done;
+                *prime = sieve (pm1data->sieve_info);
+                calc_exp (pm1data, STAGE0_EXP.exp, B1, prime, 0, bits);
+                STAGE0_EXP.valid = TRUE;
+                STAGE0_EXP.B = B1;
+                STAGE0_EXP.bits = bits;
+                STAGE0_EXP.next_prime = *prime;
+        }
+
+/* Otherwise, position the sieve just past the primes in the cached product */
+
+        else {
+                stop_reason = start_sieve (thread_num, STAGE0_EXP.next_prime, &pm1data->sieve_info);
+                if (stop_reason) goto done;
+                *prime = sieve (pm1data->sieve_info);
+        }
+
+/* Include 2n in this work unit's copy of the exponent */
+
+        mpz_mul_ui (exp, STAGE0_EXP.exp, 2 * n);
+done:   gwmutex_unlock (&STAGE0_EXP_MUTEX);
+        return (stop_reason);
+}
+
+/* A P-1 stage 2 range.  The handle shares the worker's nQx array and bit */
+/* array.  The auxiliary thread only reads the bit array, the worker clears */
+/* the range's bits after joining the thread.  A range offered to other */
+/* workers (see pm1_stage2_help) gets its handle from whoever claims it. */
+
+typedef struct pm1_stage2_range_struct {
+        pm1handle pm1data;      /* Handle with its own gwdata and eQx values */
+        gwthread thread_id;     /* Thread doing this range */
+        stage2_ranges *ctl;     /* The worker's control structure */
+        int     aux_thread_num; /* Passed to SetAuxThreadPriority */
+        struct PriorityInfo *sp_info;
+        gwnum   x;              /* Copy of the FFT of stage 2's starting value */
+        uint64_t m;             /* First m value of the range */
+        uint64_t m_end;         /* First m value past the range */
+        unsigned long stage2incr;
+        unsigned long first_rel, last_rel; /* Relative primes done this pass */
+        double  allowable_maxerr;
+        gwnum   gg;             /* The range's accumulator */
+        int     stop_reason;    /* Out of memory or similar */
+        int     error;          /* TRUE if there was an FFT error */
+        int     helper;         /* TRUE if offered to other workers */
+        int     claimed;        /* TRUE once a worker took this helper range */
+        volatile int exited;    /* TRUE once whoever claimed this helper range no longer uses the ranges' lock */
+        int     handle_ready;   /* TRUE once pm1data.gwdata is set up */
+        int     error_check;    /* Passed to gwsetnormroutine */
+        gwhandle *owner_gwdata; /* The P-1 worker's handle */
+        gwnum   owner_x;        /* The P-1 worker's help_x */
+        struct work_unit *w;    /* The P-1 worker's work unit */
+        struct PriorityInfo helper_sp_info; /* Affinity of the claiming worker */
+} pm1_stage2_range;
+
+/* Accumulate one range of a P-1 stage 2 pass.  The range's handle and x */
+/* must be set up. */
+
+void pm1_stage2_range_accumulate (
+        pm1_stage2_range *r)
+{
+        pm1handle *pm1data = &r->pm1data;
+        gwnum   t3;
+        unsigned long i, j;
+        uint64_t m;
+
+/* Compute x^(m^e) for the start of the range and init the accumulator */
+
+        r->stop_reason = fd_init (pm1data, r->m, r->stage2incr, r->x);
+        if (r->stop_reason) return;
+        gwfree (&pm1data->gwdata, r->x);
+        r->gg = gwalloc (&pm1data->gwdata);
+        t3 = gwalloc (&pm1data->gwdata);
+        if (r->gg == NULL || t3 == NULL) {
+                r->stop_reason = OutOfMemory (pm1data->thread_num);
+                return;
+        }
+        dbltogw (&pm1data->gwdata, 1.0, r->gg);
+
+/* Same loop as the worker's, without clearing bits, output and save files. */
+/* Quitting early leaves the range unfinished, so report a stop reason. */
+
+        for (m = r->m; m < r->m_end && pm1data->C > m - pm1data->D; m += r->stage2incr) {
+                if (r->ctl->abort || WORKER_THREADS_STOPPING) {
+                        r->stop_reason = STOP_ESCAPE;
+                        break;
+                }
+                for (i = r->first_rel; i <= r->last_rel; i += 2) {
+                        j = i >> 1;
+                        if (pm1data->nQx[j] == NULL) continue;
+                        if (! bittst (pm1data->bitarray, bitcvt (m - i, pm1data))) continue;
+                        gwfftsub3 (&pm1data->gwdata, pm1data->eQx[0], pm1data->nQx[j], t3);
+                        gwstartnextfft (&pm1data->gwdata, TRUE);
+                        gwfftmul (&pm1data->gwdata, t3, r->gg);
+                }
+                fd_next (pm1data);
+                if (gw_test_for_error (&pm1data->gwdata) || gw_get_maxerr (&pm1data->gwdata) > r->allowable_maxerr) {
+                        r->error = TRUE;
+                        break;
+                }
+        }
+        gwstartnextfft (&pm1data->gwdata, FALSE);
+}
+
+/* Auxiliary thread that accumulates one range of a P-1 stage 2 pass */
+
+void pm1_stage2_range_thread (
+        void    *arg)
+{
+        pm1_stage2_range *r = (pm1_stage2_range *) arg;
+
+        SetAuxThreadPriority (r->aux_thread_num, 0, r->sp_info);
+        pm1_stage2_range_accumulate (r);
+        stage2_range_done (r->ctl, NULL);
+        SetAuxThreadPriority (r->aux_thread_num, 1, NULL);
+}
+
+/* With Stage2Helpers=n a P-1 worker also offers n ranges of each stage 2 */
+/* pass to other workers, even when its own FFT is multithreaded.  Those */
+/* workers stop their own work unit (writing a save file as for any other */
+/* stop), claim a range, set up a handle of the same FFT using their own */
+/* cores, accumulate the range and go back to their work.  The P-1 worker */
+/* does any range still unclaimed once its own range is done, so a paused */
+/* or busy helper never holds up stage 2.  Only one P-1 worker at a time */
+/* can offer ranges.  The memory a helper uses is counted against the */
+/* helper: a few gwnums next to the P-1 worker's nQx table. */
+
+gwmutex STAGE2_HELP_MUTEX;              /* Lock for claiming ranges */
+int     STAGE2_HELP_MUTEX_INITIALIZED = FALSE;
+pm1handle *STAGE2_HELP = NULL;          /* P-1 handle offering ranges, if any */
+
+/* Return the number of ranges to offer other workers */
+
+int pm1_stage2_num_helpers (
+        int     thread_num)
+{
+        int     num_helpers;
+
+        if (LAUNCH_TYPE != LD_CONTINUE) return (0);
+        num_helpers = IniGetInt (INI_FILE, "Stage2Helpers", 0);
+        if (num_helpers > (int) WORKER_THREADS_ACTIVE - 1) num_helpers = WORKER_THREADS_ACTIVE - 1;
+        if (num_helpers < 0) num_helpers = 0;
+        return (num_helpers);
+}
+
+/* Claim an unclaimed helper range.  STAGE2_HELP_MUTEX must be held. */
+
+pm1_stage2_range *pm1_stage2_claim_range (
+        pm1handle *pm1data)
+{
+        int     i;
+
+        for (i = 0; i < pm1data->range_ctl.num_ranges - 1; i++) {
+                pm1_stage2_range *r = &pm1data->ranges[i];
+                if (r->helper && !r->claimed) {
+                        r->claimed = TRUE;
+                        return (r);
+                }
+        }
+        return (NULL);
+}
+
+/* Set up a handle for a claimed helper range and accumulate the range. */
+/* Called by the helping worker, or by the P-1 worker itself.  A helping */
+/* worker's thread count may never give the P-1 worker's FFT implementation. */
+/* Then the helper gives the range back and the P-1 worker does it with its */
+/* own thread count, which reproduces its implementation.  Returns FALSE if */
+/* the range was given back. */
+
+int pm1_stage2_range_run_claimed (
+        int     thread_num,             /* Worker doing the range */
+        struct PriorityInfo *sp_info,   /* That worker's affinity */
+        pm1_stage2_range *r)
+{
+        pm1handle *pm1data = &r->pm1data;
+        int     owner;
+
+        owner = (thread_num == pm1data->thread_num);
+        r->helper_sp_info = *sp_info;
+        if (!stage2_clone_gwhandle (r->owner_gwdata, &pm1data->gwdata, r->w, r->error_check,
+                                    owner ? gwget_num_threads (r->owner_gwdata) :
+                                            worker_num_cores (thread_num) * sp_info->normal_work_hyperthreads,
+                                    &r->helper_sp_info)) {
+                if (!owner) {
+                        gwmutex_lock (&STAGE2_HELP_MUTEX);
+                        if (STAGE2_HELP != NULL && &STAGE2_HELP->gwdata == r->owner_gwdata)
+                                r->claimed = FALSE;
+                        else {          /* P-1 worker withdrew, finish the range as pm1_stage2_help_withdraw does */
+                                r->stop_reason = STOP_ABORT;
+                                stage2_range_done (r->ctl, &r->exited);
+                        }
+                        gwmutex_unlock (&STAGE2_HELP_MUTEX);
+                        return (FALSE);
+                }
+                OutputStr (thread_num, "Unable to set up a handle for a stage 2 range.\n");
+                r->stop_reason = STOP_OUT_OF_MEM;
+                goto done;
+        }
+        r->handle_ready = TRUE;
+        if (thread_num != pm1data->thread_num)
+                set_memory_usage (thread_num, 0, cvt_gwnums_to_mem (&pm1data->gwdata, pm1data->E + 4));
+        pm1data->eQx = (gwnum *) malloc ((pm1data->E + 1) * sizeof (gwnum));
+        r->x = gwalloc (&pm1data->gwdata);
+        if (pm1data->eQx == NULL || r->x == NULL) {
+                r->stop_reason = OutOfMemory (pm1data->thread_num);
+                goto done;
+        }
+        gwcopy (&pm1data->gwdata, r->owner_x, r->x);
+        pm1_stage2_range_accumulate (r);
+done:   stage2_range_done (r->ctl, &r->exited);
+        return (TRUE);
+}
+
+/* Called by a worker that was stopped to help another worker's P-1 */
+/* stage 2.  Does one of the offered ranges, if there is still one left. */
+
+void pm1_stage2_help (
+        int     thread_num,
+        struct PriorityInfo *sp_info)
+{
+        pm1_stage2_range *r;
+        char    buf[80];
+
+        if (!STAGE2_HELP_MUTEX_INITIALIZED) return;
+        gwmutex_lock (&STAGE2_HELP_MUTEX);
+        r = NULL;
+        if (STAGE2_HELP != NULL && STAGE2_HELP->thread_num != thread_num) r = pm1_stage2_claim_range (STAGE2_HELP);
+        gwmutex_unlock (&STAGE2_HELP_MUTEX);
+        if (r == NULL) return;
+
+        sprintf (buf, "Helping worker #%d with P-1 stage 2.\n", r->pm1data.thread_num + 1);
+        OutputStr (thread_num, buf);
+        title (thread_num, "Helping with P-1 stage 2");
+        if (pm1_stage2_range_run_claimed (thread_num, sp_info, r))
+                OutputStr (thread_num, "Done helping with P-1 stage 2.\n");
+        else
+                OutputStr (thread_num, "Could not match the FFT of the P-1 worker.  Range returned.\n");
+        set_default_memory_usage (thread_num);
+}
+
+/* Stop offering ranges to other workers.  Unclaimed ranges are marked */
+/* done without being accumulated, the caller must not use their results. */
+
+void pm1_stage2_help_withdraw (
+        pm1handle *pm1data)
+{
+        pm1_stage2_range *r;
+
+        if (!STAGE2_HELP_MUTEX_INITIALIZED) return;
+        gwmutex_lock (&STAGE2_HELP_MUTEX);
+        if (STAGE2_HELP == pm1data) {
+                STAGE2_HELP = NULL;
+                memset (STOP_FOR_STAGE2_HELP, 0, sizeof (STOP_FOR_STAGE2_HELP));
+        }
+        if (pm1data->range_ctl.lock != NULL) {
+                while ((r = pm1_stage2_claim_range (pm1data)) != NULL) {
+                        r->stop_reason = STOP_ABORT;
+                        stage2_range_done (r->ctl, &r->exited);
+                }
+        }
+        gwmutex_unlock (&STAGE2_HELP_MUTEX);
+}
+
+/* Split the rest of this stage 2 pass into ranges, launch the auxiliary */
+/* threads and ask other workers for help.  Called after the worker's */
+/* fd_init while x is still FFTed.  Returns the first m value past the */
+/* worker's own range. */
+
+uint64_t pm1_stage2_ranges_launch (
+        pm1handle *pm1data,
+        struct work_unit *w,
+        struct PriorityInfo *sp_info,
+        uint64_t m,             /* First m value of this pass */
+        unsigned long stage2incr,
+        unsigned long first_rel,
+        unsigned long last_rel,
+        gwnum   x,              /* FFT of stage 2's starting value */
+        int     error_check,    /* Passed to gwsetnormroutine */
+        double  allowable_maxerr)
+{
+        stage2_ranges *ctl = &pm1data->range_ctl;
+        pm1_stage2_range *r;
+        int     i, t, num_ranges, num_helpers, total_ranges;
+        char    buf[100];
+
+        ctl->num_ranges = 1;
+        num_ranges = stage2_num_ranges (pm1data->thread_num, sp_info, &pm1data->gwdata);
+        num_helpers = pm1_stage2_num_helpers (pm1data->thread_num);
+
+/* The helpers need a copy of x that the worker leaves alone */
+
+        if (num_helpers) {
+                pm1data->help_x = gwalloc (&pm1data->gwdata);
+                if (pm1data->help_x == NULL) num_helpers = 0;
+                else gwcopy (&pm1data->gwdata, x, pm1data->help_x);
+        }
+        total_ranges = num_ranges + num_helpers;
+        if (total_ranges == 1 ||
+            stage2_range_start (m, pm1data->C, pm1data->D, stage2incr, total_ranges, 1) == m) {
+                pm1_stage2_ranges_free (pm1data);
+                return ((uint64_t) -1);
+        }
+
+        pm1data->ranges = (pm1_stage2_range *) calloc (total_ranges - 1, sizeof (pm1_stage2_range));
+        if (pm1data->ranges == NULL) {
+                pm1_stage2_ranges_free (pm1data);
+                return ((uint64_t) -1);
+        }
+        for (i = 1; i < total_ranges; i++) {
+                r = &pm1data->ranges[i-1];
+                r->helper = (i >= num_ranges);
+                if (!r->helper) {
+                        if (!stage2_clone_gwhandle (&pm1data->gwdata, &r->pm1data.gwdata, w, error_check, 1, NULL)) break;
+                        r->handle_ready = TRUE;
+                }
+                ctl->num_ranges++;
+                r->pm1data.thread_num = pm1data->thread_num;
+                r->pm1data.D = pm1data->D;
+                r->pm1data.E = pm1data->E;
+                r->pm1data.C = pm1data->C;
+                r->pm1data.nQx = pm1data->nQx;
+                r->pm1data.bitarray = pm1data->bitarray;
+                r->pm1data.bitarray_first_number = pm1data->bitarray_first_number;
+                r->ctl = ctl;
+                r->aux_thread_num = i;
+                r->sp_info = sp_info;
+                r->m = stage2_range_start (m, pm1data->C, pm1data->D, stage2incr, total_ranges, i);
+                r->m_end = stage2_range_start (m, pm1data->C, pm1data->D, stage2incr, total_ranges, i+1);
+                r->stage2incr = stage2incr;
+                r->first_rel = first_rel;
+                r->last_rel = last_rel;
+                r->allowable_maxerr = allowable_maxerr;
+                r->error_check = error_check;
+                r->owner_gwdata = &pm1data->gwdata;
+                r->owner_x = pm1data->help_x;
+                r->w = w;
+                if (r->helper) continue;
+                r->pm1data.eQx = (gwnum *) malloc ((pm1data->E + 1) * sizeof (gwnum));
+                r->x = gwalloc (&r->pm1data.gwdata);
+                if (r->pm1data.eQx == NULL || r->x == NULL) break;
+                gwcopy (&r->pm1data.gwdata, x, r->x);
+        }
+
+/* Fall back to doing the whole pass in the worker if a handle could not be set up */
+
+        if (ctl->num_ranges != total_ranges) {
+                OutputStr (pm1data->thread_num, "Unable to split stage 2 into ranges.\n");
+                pm1_stage2_ranges_free (pm1data);
+                return ((uint64_t) -1);
+        }
+        if (num_helpers)
+                sprintf (buf, "Splitting stage 2 into %d ranges, %d offered to other workers.\n", total_ranges, num_helpers);
+        else
+                sprintf (buf, "Splitting stage 2 into %d ranges.\n", total_ranges);
+        OutputStr (pm1data->thread_num, buf);
+
+        stage2_ranges_begin (ctl);
+        for (i = 0; i < total_ranges - 1; i++)
+                if (!pm1data->ranges[i].helper)
+                        gwthread_create_waitable (&pm1data->ranges[i].thread_id, &pm1_stage2_range_thread, &pm1data->ranges[i]);
+
+/* Offer the helper ranges and stop that many other workers to come take */
+/* them.  If another P-1 worker is already offering ranges, this worker */
+/* does its helper ranges itself. */
+
+        if (num_helpers) {
+                if (!STAGE2_HELP_MUTEX_INITIALIZED) {
+                        STAGE2_HELP_MUTEX_INITIALIZED = 1;
+                        gwmutex_init (&STAGE2_HELP_MUTEX);
+                }
+                gwmutex_lock (&STAGE2_HELP_MUTEX);
+                if (STAGE2_HELP == NULL) STAGE2_HELP = pm1data;
+                gwmutex_unlock (&STAGE2_HELP_MUTEX);
+                if (STAGE2_HELP == pm1data) {
+                        for (t = 0; t < (int) WORKER_THREADS_ACTIVE && num_helpers; t++) {
+                                if (t == pm1data->thread_num || !ACTIVE_WORKERS[t]) continue;
+                                stop_worker_for_stage2_help (t);
+                                num_helpers--;
+                        }
+                }
+        }
+        return (stage2_range_start (m, pm1data->C, pm1data->D, stage2incr, total_ranges, 1));
+}
+
+/* Do the helper ranges no other worker claimed, wait for the others, */
+/* multiply their accumulators into gg and clear the bits of the pairs */
+/* they did.  Returns a stop reason if the worker must stop, the worker */
+/* then writes a save file with its own progress. */
+
+int pm1_stage2_ranges_finish (
+        pm1handle *pm1data,
+        struct PriorityInfo *sp_info,
+        gwnum   gg,             /* The worker's accumulator */
+        int     *error)         /* Set if an auxiliary thread had an FFT error */
+{
+        pm1_stage2_range *r;
+        gwnum   t1;
+        unsigned long i;
+        uint64_t m;
+        int     range, stop_reason;
+
+/* A helper that could not set up its handle gives its range back, so keep */
+/* looking for unclaimed ranges until every range is done. */
+
+        for ( ; ; ) {
+                r = NULL;
+                if (STAGE2_HELP_MUTEX_INITIALIZED) {
+                        gwmutex_lock (&STAGE2_HELP_MUTEX);
+                        r = pm1_stage2_claim_range (pm1data);
+                        gwmutex_unlock (&STAGE2_HELP_MUTEX);
+                }
+                if (r != NULL) {
+                        pm1_stage2_range_run_claimed (pm1data->thread_num, sp_info, r);
+                        continue;
+                }
+                if (pm1data->range_ctl.active == 0) break;
+                gwevent_wait (&pm1data->range_ctl.all_done, 1);
+                stop_reason = stopCheck (pm1data->thread_num);
+                if (stop_reason) {
+                        pm1data->range_ctl.abort = TRUE;
+                        return (stop_reason);
+                }
+        }
+        pm1_stage2_help_withdraw (pm1data);
+        for (range = 0; range < pm1data->range_ctl.num_ranges - 1; range++) {
+                r = &pm1data->ranges[range];
+                if (r->thread_id != NULL) {
+                        gwthread_wait_for_exit (&r->thread_id);
+                        r->thread_id = NULL;
+                }
+                if (r->stop_reason) return (r->stop_reason);
+                if (r->error) {
+                        *error = TRUE;
+                        return (0);
+                }
+                t1 = gwalloc (&pm1data->gwdata);
+                if (t1 == NULL) return (OutOfMemory (pm1data->thread_num));
+                gwcopy (&pm1data->gwdata, r->gg, t1);
+                gwmul (&pm1data->gwdata, t1, gg);
+                gwfree (&pm1data->gwdata, t1);
+                for (m = r->m; m < r->m_end && pm1data->C > m - pm1data->D; m += r->stage2incr) {
+                        for (i = r->first_rel; i <= r->last_rel; i += 2) {
+                                if (pm1data->nQx[i>>1] == NULL) continue;
+                                if (! bittst (pm1data->bitarray, bitcvt (m - i, pm1data))) continue;
+                                bitclr (pm1data->bitarray, bitcvt (m - i, pm1data));
+                                if (pm1data->E >= 2)
+                                        bitclr (pm1data->bitarray, bitcvt (m + i, pm1data));
+                                pm1data->pairs_done++;
+                        }
+                }
+        }
+        pm1_stage2_ranges_free (pm1data);
+        return (0);
+}
+
+/* Stop the auxiliary threads and helpers if they are running and free */
+/* the ranges */
+
+void pm1_stage2_ranges_free (
+        pm1handle *pm1data)
+{
+        pm1_stage2_range *r;
+        int     i;
+
+        if (pm1data->help_x != NULL) {
+                pm1_stage2_help_withdraw (pm1data);
+        }
+        if (pm1data->ranges != NULL) {
+                pm1data->range_ctl.abort = TRUE;
+                while (pm1data->range_ctl.active)
+                        gwevent_wait (&pm1data->range_ctl.all_done, 1);
+                for (i = 0; i < pm1data->range_ctl.num_ranges - 1; i++) {
+                        r = &pm1data->ranges[i];
+                        if (r->thread_id != NULL) gwthread_wait_for_exit (&r->thread_id);
+                        /* Helper ranges are not joined.  Wait until the helper is done with the lock. */
+                        while (r->helper && r->claimed && !r->exited) Sleep (1);
+                        free (r->pm1data.eQx);
+                        if (r->handle_ready) gwdone (&r->pm1data.gwdata);
+                }
+                free (pm1data->ranges);
+                pm1data->ranges = NULL;
+        }
+        if (pm1data->help_x != NULL) {
+                gwfree (&pm1data->gwdata, pm1data->help_x);
+                pm1data->help_x = NULL;
+        }
+        stage2_ranges_end (&pm1data->range_ctl);
+}
+
 /* Main P-1 entry point */
 
 int pminus1 (
@@ -4419,13 +6334,21 @@ int pminus1 (
         giant   N;              /* Number being factored */
         giant   factor;         /* Factor found, if any */
         mpz_t   exp;
+        const mp_limb_t *exp_limbs;
         int     exp_initialized;
         uint64_t stage_0_limit, prime, m;
         unsigned long memused, SQRT_B;
         unsigned long numrels, first_rel, last_rel;
         unsigned long i, j, stage2incr, len, bit_number;
+        uint64_t eqx_m;         /* The m value eQx[0] corresponds to */
+        uint64_t m_end;         /* First m value past the worker's stage 2 range */
+        uint32_t s2_table_id;   /* Id of the stage 2 state files, zero if none */
         unsigned long error_recovery_mode = 0;
-        gwnum   x, gg, tmp_gwnum, t3;
+        gwnum   x, gg, t3;
+        gwnum   window_table[512];      /* Odd powers of x for stage 1's sliding window */
+        unsigned long seg_bits;         /* Size of stage 1 exponent segments */
+        int     max_window;             /* Largest stage 1 sliding window width */
+        int     numa_map[MAX_NUMA_MAP_THREADS];
         readSaveFileState read_save_file_state; /* Manage savefile names during reading */
         writeSaveFileState write_save_file_state; /* Manage savefile names during writing */
         char    filename[32], buf[255], JSONbuf[4000], testnum[100];
@@ -4534,7 +6457,8 @@ restart:
         gwset_bench_workers (&pm1data.gwdata, NUM_WORKER_THREADS);
         if (ERRCHK) gwset_will_error_check (&pm1data.gwdata);
         else gwset_will_error_check_near_limit (&pm1data.gwdata);
-        gwset_num_threads (&pm1data.gwdata, CORES_PER_TEST[thread_num] * sp_info->normal_work_hyperthreads);
+        gwset_num_threads (&pm1data.gwdata, worker_num_cores (thread_num) * sp_info->normal_work_hyperthreads);
+        gwset_numa_nodes (&pm1data.gwdata, fft_numa_map (sp_info, gwget_num_threads (&pm1data.gwdata), numa_map), numa_map);
         gwset_thread_callback (&pm1data.gwdata, SetAuxThreadPriority);
         gwset_thread_callback_data (&pm1data.gwdata, sp_info);
         gwset_safety_margin (&pm1data.gwdata, IniGetFloat (INI_FILE, "ExtraSafetyMargin", 0.0));
@@ -4592,7 +6516,24 @@ restart:
         have_save_file = FALSE;
         readSaveFileStateInit (&read_save_file_state, thread_num, filename);
         writeSaveFileStateInit (&write_save_file_state, filename, 0);
-        for ( ; ; ) {
+
+/* If another worker ran stage 1 and handed stage 2 off to us, use its result rather than the save file */
+
+        if (w->work_type == WORK_PMINUS1) {
+                x = gwalloc (&pm1data.gwdata);
+                if (x == NULL) goto oom;
+                if (stage2_handoff_take (w, 0.0, &pm1data.B_done, &pm1data.gwdata, 1, &x)) {
+                        OutputStr (thread_num, "Using stage 1 result from another worker.\n");
+                        pm1data.stage = PM1_DONE;
+                        pm1data.B = pm1data.C_done = pm1data.B_done;
+                        processed = 0;
+                        gg = NULL;
+                        have_save_file = TRUE;
+                } else
+                        gwfree (&pm1data.gwdata, x);
+        }
+
+        while (!have_save_file) {
                 if (! saveFileExists (&read_save_file_state)) {
                         /* If there were save files, they are all bad.  Report a message */
                         /* and temporarily abandon the work unit.  We do this in hopes that */
@@ -4764,16 +6705,16 @@ restart0:
         pm1data.stage = PM1_STAGE0;
         start_timer (timers, 0);
         start_timer (timers, 1);
-        stop_reason = start_sieve (thread_num, 2, &pm1data.sieve_info);
-        if (stop_reason) goto exit;
-        prime = sieve (pm1data.sieve_info);
         stage_0_limit = (pm1data.B > 13333333) ? 13333333 : pm1data.B;
         mpz_init (exp);  exp_initialized = TRUE;
-        calc_exp (&pm1data, w->k, w->b, w->n, w->c, exp, pm1data.B, &prime, 0, (unsigned long) (stage_0_limit * 1.5));
+        stop_reason = stage0_exp (thread_num, &pm1data, w->n, pm1data.B, (unsigned long) (stage_0_limit * 1.5), exp, &prime);
+        if (stop_reason) goto exit;
 
-/* Find number of bits, ignoring the most significant bit */
+/* Find number of bits, ignoring the most significant bit.  The exponent is scanned */
+/* a limb at a time directly out of the mpz rather than through mpz_tstbit. */
 
         len = (unsigned long) mpz_sizeinbase (exp, 2) - 1;
+        exp_limbs = mpz_limbs_read (exp);
         one_over_len = 1.0 / (double) len;
         if (prime < B) one_over_len *= (double) prime / (double) B;
 
@@ -4787,7 +6728,7 @@ restart0:
 
                 if (error_recovery_mode && bit_number == error_recovery_mode) {
                         gwstartnextfft (&pm1data.gwdata, FALSE);
-                        gwsetnormroutine (&pm1data.gwdata, 0, 0, mpz_tstbit (exp, len - bit_number - 1));
+                        gwsetnormroutine (&pm1data.gwdata, 0, 0, exp_bit (exp_limbs, len - bit_number - 1));
                         gwsquare_carefully (&pm1data.gwdata, x);
                         error_recovery_mode = 0;
                         saving = TRUE;
@@ -4804,7 +6745,7 @@ restart0:
 
 #ifndef SERVER_TESTING
                         gwstartnextfft (&pm1data.gwdata, !stop_reason && !saving && bit_number+1 != error_recovery_mode && bit_number+1 != len);
-                        gwsetnormroutine (&pm1data.gwdata, 0, echk, mpz_tstbit (exp, len - bit_number - 1));
+                        gwsetnormroutine (&pm1data.gwdata, 0, echk, exp_bit (exp_limbs, len - bit_number - 1));
                         if (bit_number < 30) gwsquare_carefully (&pm1data.gwdata, x);
                         else gwsquare (&pm1data.gwdata, x);
 #endif
@@ -4893,8 +6834,13 @@ restart0:
 
         if (B > stage_0_limit && B < pm1data.B) pm1data.B = B;
 
-/* Second restart point.  Do the larger primes of stage 1. */
-/* This stage uses 2.5 transforms per exponent bit. */
+/* Second restart point.  Do the larger primes of stage 1.  Here the base */
+/* is no longer a small constant, so multiplies are not free.  The prime */
+/* powers are gathered into exponent segments of about Stage1SegmentBits */
+/* bits.  x is raised to each segment with a sliding window whose width */
+/* is picked for the segment (see pm1_window_width).  Stage1MaxWindow caps */
+/* the width and thus the table of 2^(width-1) gwnums.  Save files and */
+/* stop checks happen between segments. */
 
 restart1:
         one_over_B = 1.0 / (double) B;
@@ -4903,36 +6849,56 @@ restart1:
         start_timer (timers, 0);
         start_timer (timers, 1);
         pm1data.stage = PM1_STAGE1;
-        tmp_gwnum = gwalloc (&pm1data.gwdata);
-        if (tmp_gwnum == NULL) goto oom;
+        seg_bits = IniGetInt (INI_FILE, "Stage1SegmentBits", 1024);
+        if (seg_bits < 64) seg_bits = 64;
+        max_window = IniGetInt (INI_FILE, "Stage1MaxWindow", 5);
+        if (max_window < 1) max_window = 1;
+        if (max_window > 10) max_window = 10;
+        for (i = 0; i < (1UL << (max_window - 1)); i++) {
+                window_table[i] = gwalloc (&pm1data.gwdata);
+                if (window_table[i] == NULL) break;
+        }
+        if (i == 0) goto oom;
+        for (max_window = 1; (2UL << (max_window - 1)) <= i; max_window++);
+        while (i > (1UL << (max_window - 1))) gwfree (&pm1data.gwdata, window_table[--i]);
+        set_memory_usage (thread_num, 0, cvt_gwnums_to_mem (&pm1data.gwdata, 1 + (1 << (max_window - 1))));
+        mpz_init (exp);  exp_initialized = TRUE;
         SQRT_B = (unsigned long) sqrt ((double) pm1data.B);
-        for ( ; prime <= pm1data.B; prime = sieve (pm1data.sieve_info)) {
+        for (i = 0; prime <= pm1data.B; i++) {
 
 /* Test for user interrupt, save files, and error checking */
 
                 stop_reason = stopCheck (thread_num);
                 saving = testSaveFilesFlag (thread_num);
-                echk = stop_reason || saving || ERRCHK || near_fft_limit || ((prime & 127) == 127);
+                echk = stop_reason || saving || ERRCHK || near_fft_limit || ((i & 3) == 3);
                 gwsetnormroutine (&pm1data.gwdata, 0, echk, 0);
 
-/* Apply as many powers of prime as long as prime^n <= B */
+/* Gather the next segment, an empty one if we are about to stop or save. */
+/* Apply as many powers of each prime as long as prime^n <= B. */
 
-                if (prime > pm1data.B_done) {
-                        pm1_mul (&pm1data, x, tmp_gwnum, prime);
-                }
-                if (prime <= SQRT_B) {
+                mpz_set_ui (exp, 1);
+                for ( ; !stop_reason && !saving && prime <= pm1data.B && mpz_sizeinbase (exp, 2) < seg_bits;
+                     prime = sieve (pm1data.sieve_info)) {
                         uint64_t mult, max;
-                        mult = prime;
-                        max = pm1data.B / prime;
-                        for ( ; ; ) {
-                                mult *= prime;
+                        for (mult = prime, max = pm1data.B / prime; ; mult *= prime) {
                                 if (mult > pm1data.B_done) {
-                                        pm1_mul (&pm1data, x, tmp_gwnum, prime);
+                                        if (sizeof (unsigned long) == 4 && prime > 0xFFFFFFFF) {
+                                                mpz_t   mpz_val;
+                                                mpz_init_set_d (mpz_val, (double) prime);       /* Works for B1 up to 2^53 */
+                                                mpz_mul (exp, exp, mpz_val);
+                                                mpz_clear (mpz_val);
+                                        } else
+                                                mpz_mul_ui (exp, exp, (unsigned long) prime);
                                 }
-                                if (mult > max) break;
+                                if (prime > SQRT_B || mult > max) break;
                         }
                 }
 
+/* Raise x to the segment */
+
+                pm1_window_exp (&pm1data, x, exp, pm1_window_width ((unsigned long) mpz_sizeinbase (exp, 2), max_window),
+                                window_table);
+
 /* Test for an error */
 
                 if (gw_test_for_error (&pm1data.gwdata) || gw_get_maxerr (&pm1data.gwdata) > allowable_maxerr) goto error;
@@ -4984,14 +6950,17 @@ restart1:
                         last_output_r = gw_get_fft_count (&pm1data.gwdata);
                 }
 
-/* Check for escape and/or if its time to write a save file */
+/* Check for escape and/or if its time to write a save file.  Every prime */
+/* below the next one to gather is done. */
 
                 if (stop_reason || saving) {
-                        pm1_save (&pm1data, &write_save_file_state, w, prime, x, NULL);
+                        pm1_save (&pm1data, &write_save_file_state, w, prime - 1, x, NULL);
                         if (stop_reason) goto exit;
                 }
         }
-        gwfree (&pm1data.gwdata, tmp_gwnum);
+        for (i = 0; i < (1UL << (max_window - 1)); i++) gwfree (&pm1data.gwdata, window_table[i]);
+        mpz_clear (exp), exp_initialized = FALSE;
+        set_memory_usage (thread_num, 0, cvt_gwnums_to_mem (&pm1data.gwdata, 1));
         pm1data.B_done = pm1data.B;
         pm1data.C_done = pm1data.B;
         end_timer (timers, 0);
@@ -5057,6 +7026,21 @@ restart2:
 
         if (C <= B) goto msg_and_exit;
 
+/* If pipelining, hand stage 2 off to the stage 2 worker and move on to our next */
+/* work unit.  The save file lets the stage 2 worker resume if it has to. */
+
+        if (w->work_type == WORK_PMINUS1) {
+                int     stage2_thread = stage2_worker (thread_num, pm1data.B_done, C);
+                if (stage2_thread >= 0) {
+                        pm1data.stage = PM1_DONE;
+                        pm1_save (&pm1data, &write_save_file_state, w, 0, x, NULL);
+                        if (stage2_handoff (thread_num, stage2_thread, w, 0.0, TRUE, pm1data.B_done, &pm1data.gwdata, 1, &x)) {
+                                stop_reason = STOP_WORK_UNIT_COMPLETE;
+                                goto exit;
+                        }
+                }
+        }
+
 /*
    Stage 2:  Use ideas from Crandall, Zimmermann, and Montgomery on each
    prime below C.  This code is more efficient the more memory you can
@@ -5171,6 +7155,21 @@ replan: stop_reason = choose_pminus1_implementation (&pm1data, w, &using_t3);
                 if (++j > pm1data.rels_done) break;
         }
         first_rel = i;
+
+/* If the state files of an interrupted run of this pass are available, */
+/* read the nQx and eQx values rather than computing them */
+
+        s2_table_id = 0;
+        if (stage2_state_files ()) {
+                s2_table_id = pm1_s2state_restore (&pm1data, &write_save_file_state, w, &eqx_m, &numrels);
+                if (s2_table_id) {
+                        for (i = last_rel = first_rel; i < pm1data.D; i += 2)
+                                if (pm1data.nQx[i>>1] != NULL) last_rel = i;
+                        goto s2state_restored;
+                }
+        }
+s2state_recompute:
+        i = first_rel;
         gwfft (&pm1data.gwdata, x, x);          /* fd_init requires fft of x */
         stop_reason = fd_init (&pm1data, i, 2, x);
         if (stop_reason) goto exit;
@@ -5207,6 +7206,7 @@ replan: stop_reason = choose_pminus1_implementation (&pm1data, w, &using_t3);
 /* For the count of paired primes to be accurate, this code must exactly mirror */
 /* the calculation of adjusted_C_start and first_m in fill_pminus1_bitarray. */
 
+s2state_restored:
         if (pm1data.D >= 2310) m = pm1data.C / 13;
         else if (pm1data.D >= 210) m = pm1data.C / 11;
         else m = pm1data.C / 7;
@@ -5214,6 +7214,7 @@ replan: stop_reason = choose_pminus1_implementation (&pm1data, w, &using_t3);
         if (m < pm1data.C_start) m = pm1data.C_start;
         m = (m / pm1data.D + 1) * pm1data.D;
         stage2incr = (pm1data.E == 1) ? pm1data.D : pm1data.D + pm1data.D;
+        m_end = (uint64_t) -1;
 
 /* Scan the bit array until we find the first group with a bit set. */
 /* When continuing from a save file there could be many groups that */
@@ -5228,16 +7229,51 @@ replan: stop_reason = choose_pminus1_implementation (&pm1data, w, &using_t3);
         }
 found_a_bit:;
 
+/* If eQx was read from a state file, advance it to m.  Should the save */
+/* file be older than the state files, compute nQx and eQx the usual way. */
+
+        if (s2_table_id) {
+                if (eqx_m > m || (m - eqx_m) % stage2incr) {
+                        fd_term (&pm1data);
+                        for (i = first_rel; i <= last_rel; i += 2) {
+                                j = i >> 1;
+                                if (pm1data.nQx[j] == NULL) continue;
+                                gwfree (&pm1data.gwdata, pm1data.nQx[j]);
+                                pm1data.nQx[j] = NULL;
+                        }
+                        s2_table_id = 0;
+                        goto s2state_recompute;
+                }
+                for ( ; eqx_m < m; eqx_m += stage2incr) fd_next (&pm1data);
+                OutputStr (thread_num, "Restored stage 2 tables from state files.\n");
+        }
+
 /* Initialize for computing successive x^(m^e) */
 
-        fd_init (&pm1data, m, stage2incr, x);
+        else {
+                fd_init (&pm1data, m, stage2incr, x);
+                eqx_m = m;
+
+/* Hand all but the first range of this pass to auxiliary threads, if requested */
+
+                m_end = pm1_stage2_ranges_launch (&pm1data, w, sp_info, m, stage2incr, first_rel, last_rel,
+                                                  x, ERRCHK || near_fft_limit, allowable_maxerr);
+                if (pm1data.range_ctl.num_ranges > 1) one_pair_pct *= pm1data.range_ctl.num_ranges;
 
 /* Unfft x for use in save files.  Actually this generates x^2 which */
 /* is just fine - no stage 2 factors will be missed (in fact it could */
 /* find more factors) */
 
-        gwstartnextfft (&pm1data.gwdata, FALSE);
-        gwfftfftmul (&pm1data.gwdata, x, x, x);
+                gwstartnextfft (&pm1data.gwdata, FALSE);
+                gwfftfftmul (&pm1data.gwdata, x, x, x);
+
+/* Write this pass' tables to the state files */
+
+                if (stage2_state_files ()) {
+                        s2_table_id = pm1_s2state_save_tables (&pm1data, &write_save_file_state, w);
+                        pm1_s2state_save_progress (&pm1data, &write_save_file_state, w, s2_table_id, eqx_m);
+                }
+        }
 
 /* Now touch all the nQx and eQx values so that when gg is used, x is */
 /* swapped out rather than a value we will need in the near future. */
@@ -5267,9 +7303,9 @@ found_a_bit:;
                 t3 = gwalloc (&pm1data.gwdata);
                 if (t3 == NULL) goto lowmem;
         }
-        for ( ; pm1data.C > m-pm1data.D; m += stage2incr) {
+        for ( ; pm1data.C > m-pm1data.D && m < m_end; m += stage2incr) {
             int inner_loop_done = FALSE;
-            int last_pass = (m - pm1data.D + stage2incr >= pm1data.C);
+            int last_pass = (m - pm1data.D + stage2incr >= pm1data.C || m + stage2incr >= m_end);
             saving = testSaveFilesFlag (thread_num);
 
 /* Test all the relprimes between m-D and m */
@@ -5279,7 +7315,10 @@ found_a_bit:;
 /* Move onto the next m value when we are done with all the relprimes */
 
                 if (i > last_rel) {     /* Compute next x^(m^e) */
-                        if (!last_pass) fd_next (&pm1data);
+                        if (!last_pass) {
+                                fd_next (&pm1data);
+                                eqx_m += stage2incr;
+                        }
                         inner_loop_done = TRUE;
                         stop_reason = stopCheck (thread_num);
                         goto errchk;
@@ -5375,6 +7414,7 @@ errchk:         if (gw_test_for_error (&pm1data.gwdata) || gw_get_maxerr (&pm1da
 /* swaps out one of the eQx or nQx values rather than gg. */
 
                 if (stop_reason || saving) {
+                        pm1_s2state_save_progress (&pm1data, &write_save_file_state, w, s2_table_id, eqx_m);
                         if (stop_reason) fd_term (&pm1data);
                         if (using_t3) gwfree (&pm1data.gwdata, t3);
                         gwtouch (&pm1data.gwdata, gg);
@@ -5395,6 +7435,20 @@ errchk:         if (gw_test_for_error (&pm1data.gwdata) || gw_get_maxerr (&pm1da
         if (using_t3) gwfree (&pm1data.gwdata, t3);
         fd_term (&pm1data);
 
+/* Multiply in the auxiliary threads' accumulators.  If we must stop while */
+/* waiting for them, save the worker's progress. */
+
+        if (pm1data.range_ctl.num_ranges > 1) {
+                int     range_error = FALSE;
+                stop_reason = pm1_stage2_ranges_finish (&pm1data, sp_info, gg, &range_error);
+                if (stop_reason) {
+                        pm1_stage2_ranges_free (&pm1data);
+                        pm1_save (&pm1data, &write_save_file_state, w, 0, x, gg);
+                        goto exit;
+                }
+                if (range_error) goto error;
+        }
+
 /* Free up the nQx values for the next pass */
 
         for (i = first_rel; i <= last_rel; i += 2) {
@@ -5424,6 +7478,7 @@ errchk:         if (gw_test_for_error (&pm1data.gwdata) || gw_get_maxerr (&pm1da
 
         pm1data.C_done = pm1data.C;
         if (C > pm1data.C_done) goto more_C;
+        s2state_unlink (&write_save_file_state);
 
 /* Stage 2 is complete */
 
@@ -761,16 +761,13 @@ int modinv (
         {
         mpz_t   __v, __N, __gcd, __inv;
 
-/* Do the extended GCD */
+/* Do the extended GCD.  GMP reads the giants' memory directly. */
 
-        mpz_init (__v);
-        mpz_init (__N);
         mpz_init (__gcd);
         mpz_init (__inv);
-        gtompz (v, __v);
-        gtompz (N, __N);
+        gtompz_view (v, __v);
+        gtompz_view (N, __N);
         mpz_gcdext (__gcd, __inv, NULL, __v, __N);
-        mpz_clear (__v);
 
 /* If a factor was found (gcd != 1 && gcd != N), save it in FAC */
 
@@ -791,7 +788,6 @@ int modinv (
 
         mpz_clear (__gcd);
         mpz_clear (__inv);
-        mpz_clear (__N);
         }
 #endif
 
@@ -141,6 +141,9 @@ giant allocgiant (              /* Create a new giant */
 
         ASSERTG (count > 0);
 
+/* Allocate an even number of words so that the giant can be viewed as an array of 64-bit GMP limbs */
+
+        count = (count + 1) & ~1;
         size = sizeof (giantstruct) + count * sizeof (uint32_t);
         thegiant = (giant) malloc (size);
         thegiant->sign = 0;
@@ -1769,6 +1772,11 @@ giant popg (
 
         ASSERTG (size >= 0);
 
+/* Allocate an even number of words so that the giant can be viewed as an array of 64-bit GMP */
+/* limbs (see gtompz_view).  On 64-bit builds this also keeps every giant's array 8-byte aligned. */
+
+        size = (size + 1) & ~1;
+
 /* Malloc our giant */
 
         memsize = sizeof (gstacknode) + sizeof (giantstruct) + size * sizeof (uint32_t);
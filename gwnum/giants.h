@@ -67,8 +67,10 @@ typedef giantstruct *giant;
 
 #ifdef GDEBUG
 #define setmaxsize(g,s) (g)->maxsize = s
+#define ASSERTG_ROOM(g,s) assert ((int) (s) <= (g)->maxsize)
 #else
 #define setmaxsize(g,s)
+#define ASSERTG_ROOM(g,s) ((void) 0)
 #endif
 
 /**************************************************************
@@ -77,11 +79,12 @@ typedef giantstruct *giant;
  *
  **************************************************************/
 
-/* Create a new giant variable on the stack */
+/* Create a new giant variable on the stack.  Like allocgiant, round the array up to an even */
+/* number of words so that gtompz_view always has room to complete the top GMP limb. */
 #ifdef GDEBUG
-#define stackgiant(name,count) uint32_t name##_data[count]; giantstruct name##_struct = {0, (uint32_t *) &name##_data, count}; const giant name = &name##_struct
+#define stackgiant(name,count) uint32_t name##_data[((count)+1)&~1]; giantstruct name##_struct = {0, (uint32_t *) &name##_data, ((count)+1)&~1}; const giant name = &name##_struct
 #else
-#define stackgiant(name,count) uint32_t name##_data[count]; giantstruct name##_struct = {0, (uint32_t *) &name##_data}; const giant name = &name##_struct
+#define stackgiant(name,count) uint32_t name##_data[((count)+1)&~1]; giantstruct name##_struct = {0, (uint32_t *) &name##_data}; const giant name = &name##_struct
 #endif
 
 /* Creates a new giant allocating an array of uint32_t */
@@ -285,6 +288,28 @@ extern int (*StopCheckRoutine)(int);
 /* Also responsible for allocating the giant with appropriate size. */
 
 #define gtompz(g,m)     mpz_import (m, (g)->sign, -1, sizeof ((g)->n[0]), 0, 0, (g)->n)
-#define mpztog(m,g)     {size_t count; mpz_export ((g)->n, &count, -1, sizeof ((g)->n[0]), 0, 0, m); (g)->sign = (int) count;}
+
+/* On the little-endian machines we support, a giant's array of 32-bit words is laid out exactly like */
+/* an array of GMP limbs.  Thus mpztog can copy the limbs directly.  Only the 32-bit words that hold the */
+/* value are copied, so the giant needs no more room than any other giant of that value.  GDEBUG builds */
+/* check the giant is big enough. */
+
+#define mpztog(m,g)     {size_t count = mpz_sgn (m) ? (mpz_sizeinbase (m, 2) + 31) / 32 : 0; \
+                         ASSERTG_ROOM (g, count); \
+                         if (count) memcpy ((g)->n, mpz_limbs_read (m), count * sizeof ((g)->n[0])); \
+                         (g)->sign = (int) count;}
+
+/* Zero-copy view of a giant as an mpz_t.  The giant's value is never changed, but when its length is */
+/* odd the unused word just above the value is zeroed to complete the top limb.  allocgiant, popg and */
+/* stackgiant always allocate room for that word.  The word is only written if it is not already zero, */
+/* so a giant whose owner zeroed it beforehand can be viewed by several threads at once.  The view */
+/* shares the giant's memory, so do not pass it as an mpz destination, do not mpz_clear it, and do not */
+/* use it after the giant changes. */
+
+#define gtompz_view(g,m) \
+        ((abs ((g)->sign) & 1 && (ASSERTG_ROOM (g, abs ((g)->sign) + 1), (g)->n[abs ((g)->sign)] != 0) ? \
+                (g)->n[abs ((g)->sign)] = 0 : 0), \
+         mpz_roinit_n (m, (const mp_limb_t *) (g)->n, ((g)->sign < 0 ? -1 : 1) * \
+                       (mp_size_t) ((abs ((g)->sign) * sizeof ((g)->n[0]) + sizeof (mp_limb_t) - 1) / sizeof (mp_limb_t))))
 
 #endif
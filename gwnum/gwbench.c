@@ -26,6 +26,7 @@
 #include "gwbench.h"
 #include "gwini.h"
 #include "gwthread.h"
+#include "gwutil.h"
 
 /* Include the open source SQL database */
 
@@ -93,6 +94,7 @@
 
 /* Global variables */
 
+char    GWNUMINI_FILE[260] = "gwnum.txt";          /* INI file holding the bench data */
 int     BENCH_DB_INITIALIZED = 0;
 gwmutex SQL_MUTEX;                              /* Lock for accessing SQL database */
 sqlite3 *BENCH_DB = NULL;                       /* SQL database storing the bench data */
@@ -111,63 +113,29 @@ int     BENCH_NUM_WORKERS = 0;
 /*          Routines to read and write bench data in INI file               */
 /****************************************************************************/
 
-void gwbench_read_data (void)
+/* Insert the BenchData lines from gwnum.txt into the SQL table.  When merging, skip lines */
+/* that are already in the table.  Caller must hold SQL_MUTEX.  Returns FALSE on a SQL error. */
+
+int gwbench_load_rows (
+        int     skip_existing)
 {
-        char    sqlite_file[80];                // Write SQLite database to disk for debugging
-        char    gwnum_version_string[10];
-        char    cpuid_brand_string[49];
         char    bench_data[250];
         int     i, errcode;
         sqlite3_stmt *sql_stmt;
 
-/* Return if we've already initialized the SQL benchmark database */
-
-        if (BENCH_DB_INITIALIZED) return;
-        BENCH_DB_INITIALIZED = 1;
-
-/* Initialize and acquire the lock */
-
-        gwmutex_init (&SQL_MUTEX);
-        gwmutex_lock (&SQL_MUTEX);
-
-/* Read in #cores/#workers overrides from gwnum.txt */
-
-        BENCH_NUM_CORES = IniGetInt (GWNUMINI_FILE, "BenchCores", 0);
-        BENCH_NUM_WORKERS = IniGetInt (GWNUMINI_FILE, "BenchWorkers", 0);
-
-/* Create the in-memory SQL DB */
-
-        IniGetString (GWNUMINI_FILE, "SQLiteFile", sqlite_file, sizeof (sqlite_file), ":memory:");
-        errcode = sqlite3_open_v2 (sqlite_file, &BENCH_DB, SQLITE_OPEN_FULLMUTEX | SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
-        if (errcode != SQLITE_OK) goto db_error;
-
-/* Create the table to hold the bench data */
-
-        errcode = sqlite3_exec (BENCH_DB,
-                                "CREATE TABLE bench_data (fftlen INT, num_cores INT, num_workers INT, num_hyperthreads INT, \
-                                                          impl INT, bench_date DATE, bench_length INT, throughput REAL)",
-                                NULL, NULL, NULL);
-        if (errcode != SQLITE_OK) goto db_error;
-
-/* Get the gwnum version when the benchmark data was created.  If this does not match the current */
-/* gwnum version then we must discard the benchmark data (and start regenerating using the current gwnum code). */
-
-        IniGetString (GWNUMINI_FILE, "GwnumVersion", gwnum_version_string, sizeof (gwnum_version_string), NULL);
-        if (strcmp (gwnum_version_string, GWNUM_FFT_IMPL_VERSION)) goto empty_the_db;
-
-/* Get the CPUID brand string when the benchmark data was created.  If this does not match the current */
-/* CPUID brand string as may happen when a local.txt is inadvisably copied to a new computer, then we */
-/* must discard the benchmark data (and start regenerating using the new CPU). */
-
-        IniGetString (GWNUMINI_FILE, "CpuBrand", cpuid_brand_string, sizeof (cpuid_brand_string), NULL);
-        if (strcmp (cpuid_brand_string, CPU_BRAND)) goto empty_the_db;
-
 /* Prepare a SQL statement to insert benchmark data */
 
-        errcode = sqlite3_prepare_v2 (BENCH_DB, "INSERT INTO bench_data VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8)", -1, &sql_stmt, NULL);
+        if (!skip_existing)
+                errcode = sqlite3_prepare_v2 (BENCH_DB, "INSERT INTO bench_data VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8)", -1, &sql_stmt, NULL);
+        else
+                errcode = sqlite3_prepare_v2 (BENCH_DB,
+                                "INSERT INTO bench_data SELECT ?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8 WHERE NOT EXISTS ( \
+                                        SELECT 1 FROM bench_data WHERE fftlen = ?1 AND num_cores = ?2 AND num_workers = ?3 AND \
+                                                num_hyperthreads = ?4 AND impl = ?5 AND bench_date = ?6 AND bench_length = ?7 AND \
+                                                ABS (throughput - ?8) < 0.01)", -1, &sql_stmt, NULL);
         if (errcode != SQLITE_OK) goto stmt_error;
 
-/* Read the existing throughput benchmark data.  Format for benchmark data is: */
+/* Read the throughput benchmark data.  Format for benchmark data is: */
 /*      BenchData=fftlen,num_cores,num_workers,num_hyperthreads,impl_id,date,bench_length_in_seconds,throughput */
 
         for (i = 1; ; i++) {
@@ -225,6 +193,65 @@ void gwbench_read_data (void)
                 if (errcode != SQLITE_OK) goto stmt_error;
         }
         sqlite3_finalize (sql_stmt);
+        return (TRUE);
+
+stmt_error:
+        sqlite3_finalize (sql_stmt);
+        return (FALSE);
+}
+
+void gwbench_read_data (void)
+{
+        char    sqlite_file[80];                // Write SQLite database to disk for debugging
+        char    gwnum_version_string[10];
+        char    cpuid_brand_string[49];
+        int     errcode;
+
+/* Return if we've already initialized the SQL benchmark database */
+
+        if (BENCH_DB_INITIALIZED) return;
+        BENCH_DB_INITIALIZED = 1;
+
+/* Initialize and acquire the lock */
+
+        gwmutex_init (&SQL_MUTEX);
+        gwmutex_lock (&SQL_MUTEX);
+
+/* Read in #cores/#workers overrides from gwnum.txt */
+
+        BENCH_NUM_CORES = IniGetInt (GWNUMINI_FILE, "BenchCores", 0);
+        BENCH_NUM_WORKERS = IniGetInt (GWNUMINI_FILE, "BenchWorkers", 0);
+
+/* Create the in-memory SQL DB */
+
+        IniGetString (GWNUMINI_FILE, "SQLiteFile", sqlite_file, sizeof (sqlite_file), ":memory:");
+        errcode = sqlite3_open_v2 (sqlite_file, &BENCH_DB, SQLITE_OPEN_FULLMUTEX | SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+        if (errcode != SQLITE_OK) goto db_error;
+
+/* Create the table to hold the bench data */
+
+        errcode = sqlite3_exec (BENCH_DB,
+                                "CREATE TABLE bench_data (fftlen INT, num_cores INT, num_workers INT, num_hyperthreads INT, \
+                                                          impl INT, bench_date DATE, bench_length INT, throughput REAL)",
+                                NULL, NULL, NULL);
+        if (errcode != SQLITE_OK) goto db_error;
+
+/* Get the gwnum version when the benchmark data was created.  If this does not match the current */
+/* gwnum version then we must discard the benchmark data (and start regenerating using the current gwnum code). */
+
+        IniGetString (GWNUMINI_FILE, "GwnumVersion", gwnum_version_string, sizeof (gwnum_version_string), NULL);
+        if (strcmp (gwnum_version_string, GWNUM_FFT_IMPL_VERSION)) goto empty_the_db;
+
+/* Get the CPUID brand string when the benchmark data was created.  If this does not match the current */
+/* CPUID brand string as may happen when a local.txt is inadvisably copied to a new computer, then we */
+/* must discard the benchmark data (and start regenerating using the new CPU). */
+
+        IniGetString (GWNUMINI_FILE, "CpuBrand", cpuid_brand_string, sizeof (cpuid_brand_string), NULL);
+        if (strcmp (cpuid_brand_string, CPU_BRAND)) goto empty_the_db;
+
+/* Read the existing throughput benchmark data */
+
+        if (!gwbench_load_rows (FALSE)) goto db_error;
 
 /* Create a view to examine the best 3 throughput numbers for each FFT implementation */
 
@@ -259,14 +286,62 @@ empty_the_db:
 
 /* Error returns */
 
-stmt_error:
-        sqlite3_finalize (sql_stmt);
 db_error:
         sqlite3_close_v2 (BENCH_DB);
         BENCH_DB = NULL;
         gwmutex_unlock (&SQL_MUTEX);
 }
 
+/* Merge benchmark data another process wrote to gwnum.txt into the SQL database. */
+/* Several processes can share one gwnum.txt (see gwbench_set_file). */
+
+void gwbench_merge_data (void)
+{
+        char    gwnum_version_string[10];
+        char    cpuid_brand_string[49];
+
+/* If the database has not been read yet, the first read will see the data */
+
+        if (!BENCH_DB_INITIALIZED || BENCH_DB == NULL) return;
+
+/* Obtain the lock to the database */
+
+        gwmutex_lock (&SQL_MUTEX);
+
+/* Reread the file.  Ignore it if it was written by a different gwnum version or CPU. */
+
+        IniFileReread (GWNUMINI_FILE);
+        IniGetString (GWNUMINI_FILE, "GwnumVersion", gwnum_version_string, sizeof (gwnum_version_string), NULL);
+        IniGetString (GWNUMINI_FILE, "CpuBrand", cpuid_brand_string, sizeof (cpuid_brand_string), NULL);
+        if (!strcmp (gwnum_version_string, GWNUM_FFT_IMPL_VERSION) && !strcmp (cpuid_brand_string, CPU_BRAND)) {
+
+/* As in gwbench_add_data, close get_max_thoughput's prepared statement so the new rows are used */
+
+                if (get_max_sql_stmt_prepared) {
+                        get_max_sql_stmt_prepared = FALSE;
+                        sqlite3_finalize (get_max_sql_stmt);
+                }
+                if (!gwbench_load_rows (TRUE)) {
+                        sqlite3_close_v2 (BENCH_DB);
+                        BENCH_DB = NULL;
+                }
+        }
+
+/* Release the lock */
+
+        gwmutex_unlock (&SQL_MUTEX);
+}
+
+/* Change the INI file holding benchmark data.  Used when several processes share one gwnum.txt. */
+
+void gwbench_set_file (
+        const char *filename)
+{
+        if (!strcmp (GWNUMINI_FILE, filename)) return;
+        truncated_strcpy (GWNUMINI_FILE, sizeof (GWNUMINI_FILE), filename);
+        gwbench_merge_data ();
+}
+
 /* Write the benchmark data to gwnum.txt */
 
 void gwbench_write_data (void)
@@ -279,6 +354,11 @@ void gwbench_write_data (void)
 
         if (BENCH_DB == NULL) return;
 
+/* Pick up rows another process sharing gwnum.txt wrote since we last read it */
+
+        gwbench_merge_data ();
+        if (BENCH_DB == NULL) return;
+
 /* Obtain the lock to the database */
 
         gwmutex_lock (&SQL_MUTEX);
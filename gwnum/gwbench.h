@@ -25,7 +25,7 @@ extern "C" {
 
 /* Defines */
 
-#define GWNUMINI_FILE   "gwnum.txt"             /* Name of the INI file */
+extern char GWNUMINI_FILE[];            /* Name of the INI file, "gwnum.txt" unless changed by gwbench_set_file */
 
 #define GWNUM_FFT_IMPL_VERSION  "29.2"          /* This version number changes whenever FFT implementations change - meaning */
                                                 /* we need to toss benchmarking data from older gwnum versions. */
@@ -58,6 +58,8 @@ struct gwbench_add_struct {
 };
 void gwbench_add_data (gwhandle *, struct gwbench_add_struct *);
 void gwbench_write_data (void);
+void gwbench_merge_data (void);         /* Merge in bench data written to gwnum.txt by another process */
+void gwbench_set_file (const char *);   /* Share bench data with other processes by using their gwnum.txt */
 void gwbench_get_num_benchmarks (double, unsigned long, unsigned long, signed long, unsigned long, int, int, int, int,
                                  unsigned long *, unsigned long *, int *, int *);
 
@@ -66,6 +68,7 @@ void gwbench_get_num_benchmarks (double, unsigned long, unsigned long, signed lo
 ******************************************************************************/
 
 void gwbench_read_data (void);
+int gwbench_load_rows (int);
 int gwbench_implementation_id (gwhandle *, int);
 int internal_implementation_id (int, int, int, int, int, int, int, int, int);
 int internal_implementation_ids_match (int, int, int, int, int, int, int, int);
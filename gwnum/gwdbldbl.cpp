@@ -272,20 +272,88 @@ void gwsincos1by (
 	gwsincos12345by (x, N, results, incr, 1);
 }
 
-extern "C"
-void gwsincos12345by (
+// Routines ending in _run fill in count columns of a sin/cos table using the
+// angles for x, x+step, x+2*step, ...  Rather than calling the expensive
+// doubledouble sincos routine for every column, the previous column's sin/cos
+// is rotated by the sin/cos of the step.  Each rotation adds an absolute error
+// of at most 2^-104, so after SINCOS_RUN_ROTATIONS rotations the sin/cos values
+// are accurate to about 2^-100.  Non-zero table angles are at least 2*pi/N, so
+// the relative error is below 2^-70 for any supported FFT length -- far more
+// than the 53 bits we store.  A stored double can only differ from what the
+// single column routine produces if the exact value is within that error of a
+// rounding boundary.  If the angle or one of the multiples of the angle that
+// the output routines compute is a multiple of pi/2, then the column is always
+// computed from scratch.  The sines and cosines that should be zero are just
+// roundoff noise, which must match the single column routines exactly.
+
+#define SINCOS_RUN_ROTATIONS	8
+#define SINCOS_RUN_MAX_MULTIPLE	16	/* Largest multiple of the angle used by an output routine */
+
+static int sincos_run_special_angle (
 	unsigned long x,
+	unsigned long N)
+{
+	uint64_t quarter_turns;
+	int	m;
+
+	quarter_turns = (uint64_t) (x % N) * 4;
+	for (m = 1; m <= SINCOS_RUN_MAX_MULTIPLE; m++)
+		if (quarter_turns * m % N == 0) return (TRUE);
+	return (FALSE);
+}
+
+int	gwdbldbl_scalar_tables = 0;	// QA can set this to have the _run routines compute every column from scratch
+
+static void sincos_run (
+	void	(*output)(dd_real &, dd_real &, double *, int, int),
+	unsigned long x,
+	unsigned long step,
 	unsigned long N,
 	double	*results,
 	int	incr,
+	int	amt,
+	int	count)
+{
+	dd_real arg1, sine, cosine, step_sine, step_cosine, tmp;
+	int	i, rotations;
+
+	x86_FIX
+	arg1 = dd_real::_2pi * (double) step / (double) N;
+	sincos (arg1, step_sine, step_cosine);
+	rotations = SINCOS_RUN_ROTATIONS;
+	for (i = 0; i < count; i++, x += step) {
+		if (rotations == SINCOS_RUN_ROTATIONS || gwdbldbl_scalar_tables || sincos_run_special_angle (x, N)) {
+			arg1 = dd_real::_2pi * (double) x / (double) N;
+			sincos (arg1, sine, cosine);
+			rotations = 0;
+		} else {
+			tmp = sine * step_cosine + cosine * step_sine;
+			cosine = cosine * step_cosine - sine * step_sine;
+			sine = tmp;
+			rotations++;
+		}
+		(*output) (sine, cosine, results + i, incr, amt);
+	}
+	END_x86_FIX
+}
+
+extern "C"
+void gwdbldbl_set_scalar_tables (
+	int	state)
+{
+	gwdbldbl_scalar_tables = state;
+}
+
+static void sincos12345by_output (
+	dd_real	&sine,
+	dd_real	&cosine,
+	double	*results,
+	int	incr,
 	int	amt)
 {
-	dd_real arg1, sine, cosine, sine2, cosine2, sine3, cosine3, sine4, cosine4, sine5, cosine5, sine6, cosine6, sine7, cosine7;
+	dd_real sine2, cosine2, sine3, cosine3, sine4, cosine4, sine5, cosine5, sine6, cosine6, sine7, cosine7;
 	dd_real	sine8, cosine8;
 
-	x86_FIX
-	arg1 = dd_real::_2pi * (double) x / (double) N;
-	sincos (arg1, sine, cosine);
 	results[0] = sine;
 	results[0] += epsilon;		/* Protect against divide by zero */
 	results[incr] = cosine / results[0];
@@ -346,23 +414,48 @@ void gwsincos12345by (
 	results[0] += epsilon;		/* Protect against divide by zero */
 	results[incr] = cosine8 / results[0];
 done:	;
-	END_x86_FIX
 }
 
 extern "C"
-void gwsincos13579by (
+void gwsincos12345by (
 	unsigned long x,
 	unsigned long N,
 	double	*results,
 	int	incr,
 	int	amt)
 {
-	dd_real arg1, sine, cosine, sine2, cosine2, sine3, cosine3, sine5, cosine5, sine7, cosine7, sine9, cosine9, sine11, cosine11;
-	dd_real sine13, cosine13, sine15, cosine15;
+	dd_real arg1, sine, cosine;
 
 	x86_FIX
 	arg1 = dd_real::_2pi * (double) x / (double) N;
 	sincos (arg1, sine, cosine);
+	sincos12345by_output (sine, cosine, results, incr, amt);
+	END_x86_FIX
+}
+
+extern "C"
+void gwsincos12345by_run (
+	unsigned long x,
+	unsigned long step,
+	unsigned long N,
+	double	*results,
+	int	incr,
+	int	amt,
+	int	count)
+{
+	sincos_run (sincos12345by_output, x, step, N, results, incr, amt, count);
+}
+
+static void sincos13579by_output (
+	dd_real	&sine,
+	dd_real	&cosine,
+	double	*results,
+	int	incr,
+	int	amt)
+{
+	dd_real sine2, cosine2, sine3, cosine3, sine5, cosine5, sine7, cosine7, sine9, cosine9, sine11, cosine11;
+	dd_real sine13, cosine13, sine15, cosine15;
+
 	results[0] = sine;
 	results[0] += epsilon;		/* Protect against divide by zero */
 	results[incr] = cosine / results[0];
@@ -433,22 +526,47 @@ void gwsincos13579by (
 	results[0] += epsilon;		/* Protect against divide by zero */
 	results[incr] = cosine15 / results[0];
 done:	;
-	END_x86_FIX
 }
 
 extern "C"
-void gwsincos159by (
+void gwsincos13579by (
 	unsigned long x,
 	unsigned long N,
 	double	*results,
 	int	incr,
 	int	amt)
 {
-	dd_real arg1, sine, cosine, sine2, cosine2, sine4, cosine4, sine5, cosine5, sine9, cosine9, sine13, cosine13;
+	dd_real arg1, sine, cosine;
 
 	x86_FIX
 	arg1 = dd_real::_2pi * (double) x / (double) N;
 	sincos (arg1, sine, cosine);
+	sincos13579by_output (sine, cosine, results, incr, amt);
+	END_x86_FIX
+}
+
+extern "C"
+void gwsincos13579by_run (
+	unsigned long x,
+	unsigned long step,
+	unsigned long N,
+	double	*results,
+	int	incr,
+	int	amt,
+	int	count)
+{
+	sincos_run (sincos13579by_output, x, step, N, results, incr, amt, count);
+}
+
+static void sincos159by_output (
+	dd_real	&sine,
+	dd_real	&cosine,
+	double	*results,
+	int	incr,
+	int	amt)
+{
+	dd_real sine2, cosine2, sine4, cosine4, sine5, cosine5, sine9, cosine9, sine13, cosine13;
+
 	results[0] = sine;
 	results[0] += epsilon;		/* Protect against divide by zero */
 	results[incr] = cosine / results[0];
@@ -486,9 +604,38 @@ void gwsincos159by (
 	results[0] += epsilon;		/* Protect against divide by zero */
 	results[incr] = cosine13 / results[0];
 done:	;
+}
+
+extern "C"
+void gwsincos159by (
+	unsigned long x,
+	unsigned long N,
+	double	*results,
+	int	incr,
+	int	amt)
+{
+	dd_real arg1, sine, cosine;
+
+	x86_FIX
+	arg1 = dd_real::_2pi * (double) x / (double) N;
+	sincos (arg1, sine, cosine);
+	sincos159by_output (sine, cosine, results, incr, amt);
 	END_x86_FIX
 }
 
+extern "C"
+void gwsincos159by_run (
+	unsigned long x,
+	unsigned long step,
+	unsigned long N,
+	double	*results,
+	int	incr,
+	int	amt,
+	int	count)
+{
+	sincos_run (sincos159by_output, x, step, N, results, incr, amt, count);
+}
+
 extern "C"
 void gwsincos125by (
 	unsigned long x,
@@ -526,19 +673,15 @@ void gwsincos125by (
 	END_x86_FIX
 }
 
-extern "C"
-void gwsincos1234by_raw (
-	unsigned long x,
-	unsigned long N,
+static void sincos1234by_raw_output (
+	dd_real	&sine,
+	dd_real	&cosine,
 	double	*results,
 	int	incr,
 	int	amt)
 {
-	dd_real arg1, sine, cosine, sine2, cosine2, sine3, cosine3, sine4, cosine4;
+	dd_real sine2, cosine2, sine3, cosine3, sine4, cosine4;
 
-	x86_FIX
-	arg1 = dd_real::_2pi * (double) x / (double) N;
-	sincos (arg1, sine, cosine);
 	results[0] = sine;
 	results[incr] = cosine;
 	results += incr + incr;
@@ -563,9 +706,38 @@ void gwsincos1234by_raw (
 	results[0] = sine4;
 	results[incr] = cosine4;
 done:	;
+}
+
+extern "C"
+void gwsincos1234by_raw (
+	unsigned long x,
+	unsigned long N,
+	double	*results,
+	int	incr,
+	int	amt)
+{
+	dd_real arg1, sine, cosine;
+
+	x86_FIX
+	arg1 = dd_real::_2pi * (double) x / (double) N;
+	sincos (arg1, sine, cosine);
+	sincos1234by_raw_output (sine, cosine, results, incr, amt);
 	END_x86_FIX
 }
 
+extern "C"
+void gwsincos1234by_raw_run (
+	unsigned long x,
+	unsigned long step,
+	unsigned long N,
+	double	*results,
+	int	incr,
+	int	amt,
+	int	count)
+{
+	sincos_run (sincos1234by_raw_output, x, step, N, results, incr, amt, count);
+}
+
 
 extern "C"
 void gwsincos1plusby (
@@ -1027,6 +1199,53 @@ void gwfft_weights3 (
 	END_x86_FIX
 }
 
+// Compute the weights for count consecutive FFT words starting at word j.  The results
+// for word j+i are stored at fft_weight[i], etc.  Any of the output arrays may be NULL.
+// As with the sin/cos _run routines, rather than calling the doubledouble exp routine
+// for every word we multiply the previous weight by b^(ceil(j*nbpw) - ceil((j-1)*nbpw) - nbpw).
+// The integer part of that exponent is always floor(nbpw) or floor(nbpw)+1, so only two
+// multipliers are needed.  We go back to exp every SINCOS_RUN_ROTATIONS words.
+
+extern "C"
+void gwfft_weights3_run (
+	void	*dd_data_arg,
+	unsigned long j,
+	int	count,
+	double	*fft_weight,
+	double	*fft_weight_inverse,
+	double	*fft_weight_inverse_over_fftlen)
+{
+	dd_real temp, bpower, weight, mult_small, mult_big, prev_ceil, this_ceil, integral;
+	int	i, steps;
+
+	x86_FIX
+	integral = gwfloor (dd_data->gw__num_b_per_word);
+	bpower = integral - dd_data->gw__num_b_per_word;
+	if (! dd_data->gw__c_is_one) bpower += dd_data->gw__logb_abs_c_div_fftlen;
+	mult_small = exp (dd_data->gw__logb * bpower);
+	mult_big = mult_small * dd_data->gw__b;
+	steps = SINCOS_RUN_ROTATIONS;
+	for (i = 0; i < count; i++, j++) {
+		temp = (double) j * dd_data->gw__num_b_per_word;
+		this_ceil = gwceil (temp);
+		if (steps == SINCOS_RUN_ROTATIONS || gwdbldbl_scalar_tables) {
+			bpower = this_ceil - temp;
+			if (! dd_data->gw__c_is_one) bpower += dd_data->gw__logb_abs_c_div_fftlen * (double) j;
+			weight = exp (dd_data->gw__logb * bpower);
+			steps = 0;
+		} else {
+			if (this_ceil - prev_ceil == integral) weight = weight * mult_small;
+			else weight = weight * mult_big;
+			steps++;
+		}
+		prev_ceil = this_ceil;
+		if (fft_weight != NULL) fft_weight[i] = double (weight);
+		if (fft_weight_inverse != NULL) fft_weight_inverse[i] = double (1.0 / weight);
+		if (fft_weight_inverse_over_fftlen != NULL) fft_weight_inverse_over_fftlen[i] = double (dd_data->gw__over_fftlen / weight);
+	}
+	END_x86_FIX
+}
+
 // Returns logb(fft_weight).  This is used in determining the FFT weight
 // fudge factor in two-pass FFTs.  This is much faster than computing the
 // fft_weight because it eliminates a call to the double-double exp routine.
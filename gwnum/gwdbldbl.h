@@ -52,6 +52,19 @@ void gwsincos1by (unsigned long, unsigned long, double *, int);
 #define gwsincos12345678by8(a,b,c)      gwsincos12345by(a,b,c,8,8)
 void gwsincos12345by (unsigned long, unsigned long, double *, int, int);
 
+/* The _run versions compute count columns of the table, using angles */
+/* x, x+step, x+2*step, ... and writing column i at results + i. */
+
+#define gwsincos1by4_run(a,s,c,d,n)             gwsincos12345by_run(a,s,c,d,4,1,n)
+#define gwsincos12by4_run(a,s,c,d,n)            gwsincos12345by_run(a,s,c,d,4,2,n)
+#define gwsincos12by8_run(a,s,c,d,n)            gwsincos12345by_run(a,s,c,d,8,2,n)
+#define gwsincos123by8_run(a,s,c,d,n)           gwsincos12345by_run(a,s,c,d,8,3,n)
+#define gwsincos1234by8_run(a,s,c,d,n)          gwsincos12345by_run(a,s,c,d,8,4,n)
+#define gwsincos12345by8_run(a,s,c,d,n)         gwsincos12345by_run(a,s,c,d,8,5,n)
+#define gwsincos123456by8_run(a,s,c,d,n)        gwsincos12345by_run(a,s,c,d,8,6,n)
+#define gwsincos12345678by8_run(a,s,c,d,n)      gwsincos12345by_run(a,s,c,d,8,8,n)
+void gwsincos12345by_run (unsigned long, unsigned long, unsigned long, double *, int, int, int);
+
 #define gwsincos13by1(a,b,c)            gwsincos13579by(a,b,c,1,2)
 #define gwsincos13by2(a,b,c)            gwsincos13579by(a,b,c,2,2)
 #define gwsincos13by4(a,b,c)            gwsincos13579by(a,b,c,4,2)
@@ -65,6 +78,15 @@ void gwsincos12345by (unsigned long, unsigned long, double *, int, int);
 #define gwsincos13579BDFby8(a,b,c)      gwsincos13579by(a,b,c,8,8)
 void gwsincos13579by (unsigned long, unsigned long, double *, int, int);
 
+#define gwsincos13by4_run(a,s,c,d,n)            gwsincos13579by_run(a,s,c,d,4,2,n)
+#define gwsincos13by8_run(a,s,c,d,n)            gwsincos13579by_run(a,s,c,d,8,2,n)
+#define gwsincos135by8_run(a,s,c,d,n)           gwsincos13579by_run(a,s,c,d,8,3,n)
+#define gwsincos1357by8_run(a,s,c,d,n)          gwsincos13579by_run(a,s,c,d,8,4,n)
+#define gwsincos13579by8_run(a,s,c,d,n)         gwsincos13579by_run(a,s,c,d,8,5,n)
+#define gwsincos13579Bby8_run(a,s,c,d,n)        gwsincos13579by_run(a,s,c,d,8,6,n)
+#define gwsincos13579BDFby8_run(a,s,c,d,n)      gwsincos13579by_run(a,s,c,d,8,8,n)
+void gwsincos13579by_run (unsigned long, unsigned long, unsigned long, double *, int, int, int);
+
 #define gwsincos15by1(a,b,c)            gwsincos159by(a,b,c,1,2)
 #define gwsincos15by2(a,b,c)            gwsincos159by(a,b,c,2,2)
 #define gwsincos15by4(a,b,c)            gwsincos159by(a,b,c,4,2)
@@ -73,6 +95,11 @@ void gwsincos13579by (unsigned long, unsigned long, double *, int, int);
 #define gwsincos159Dby8(a,b,c)          gwsincos159by(a,b,c,8,4)
 void gwsincos159by (unsigned long, unsigned long, double *, int, int);
 
+#define gwsincos15by4_run(a,s,c,d,n)            gwsincos159by_run(a,s,c,d,4,2,n)
+#define gwsincos159Dby4_run(a,s,c,d,n)          gwsincos159by_run(a,s,c,d,4,4,n)
+#define gwsincos159Dby8_run(a,s,c,d,n)          gwsincos159by_run(a,s,c,d,8,4,n)
+void gwsincos159by_run (unsigned long, unsigned long, unsigned long, double *, int, int, int);
+
 #define gwsincos125by2(a,b,c)           gwsincos125by(a,b,c,2)
 #define gwsincos125by4(a,b,c)           gwsincos125by(a,b,c,4)
 #define gwsincos125by8(a,b,c)           gwsincos125by(a,b,c,8)
@@ -90,6 +117,11 @@ void gwsincos125by (unsigned long, unsigned long, double *, int);
 #define gwsincos1234by8_raw(a,b,c)      gwsincos1234by_raw(a,b,c,8,4)
 void gwsincos1234by_raw (unsigned long, unsigned long, double *, int, int);
 
+#define gwsincos12by4_raw_run(a,s,c,d,n)        gwsincos1234by_raw_run(a,s,c,d,4,2,n)
+#define gwsincos1234by4_raw_run(a,s,c,d,n)      gwsincos1234by_raw_run(a,s,c,d,4,4,n)
+#define gwsincos1234by8_raw_run(a,s,c,d,n)      gwsincos1234by_raw_run(a,s,c,d,8,4,n)
+void gwsincos1234by_raw_run (unsigned long, unsigned long, unsigned long, double *, int, int, int);
+
 #define gwsincos1plus0123by1(a,b,c,d)           gwsincos1plusby(a,b,c,d,1,4)
 #define gwsincos1plus0123by2(a,b,c,d)           gwsincos1plusby(a,b,c,d,2,4)
 #define gwsincos1plus0123by4(a,b,c,d)           gwsincos1plusby(a,b,c,d,4,4)
@@ -140,6 +172,7 @@ double gwfft_weight_inverse_squared (void *, unsigned long);
 double gwfft_weight_inverse_sloppy (void *, unsigned long);
 double gwfft_weight_inverse_over_fftlen (void *, unsigned long);
 void gwfft_weights3 (void *, unsigned long, double *, double *, double *);
+void gwfft_weights3_run (void *, unsigned long, int, double *, double *, double *);
 double gwfft_weight_exponent (void *, unsigned long);
 double gwfft_weight_no_c (void *, unsigned long);
 unsigned long gwfft_base (void *, unsigned long);
@@ -151,6 +184,10 @@ double gwfft_partial_weight_inverse (void *, unsigned long, unsigned long);
 double gwfft_partial_weight_inverse_sloppy (void *, unsigned long, unsigned long);
 void gwfft_colweights (void *, void *, int);
 
+/* QA hook.  If set, the _run routines compute every column from scratch. */
+
+void gwdbldbl_set_scalar_tables (int);
+
 #ifdef __cplusplus
 }
 #endif
@@ -229,6 +229,40 @@ void IniAddFileMerge (
         gwmutex_unlock (&INI_ADD_MUTEX);
 }
 
+/* Compute a signature of an INI file's settings.  Comments are ignored, as are any keywords */
+/* in the NULL-terminated exclusion list.  Prime95 compares signatures taken before and after */
+/* a reread to decide if the changed settings can be applied without restarting the workers. */
+
+unsigned long IniFileSignature (
+        const char *filename,
+        const char * const *excluded_keywords)
+{
+        struct IniCache *p;
+        unsigned int j;
+        unsigned long sig;
+        const char * const *ex;
+        const char *q;
+
+        if (INI_MUTEX == NULL) gwmutex_init (&INI_MUTEX);
+        gwmutex_lock (&INI_MUTEX);
+        p = openIniFile (filename, 0);
+        sig = 2166136261UL;
+        for (j = 0; j < p->num_lines; j++) {
+                if (p->lines[j]->line_type == INI_LINE_COMMENT) continue;
+                if (p->lines[j]->line_type == INI_LINE_NORMAL && excluded_keywords != NULL) {
+                        for (ex = excluded_keywords; *ex != NULL; ex++)
+                                if (_stricmp (p->lines[j]->keyword, *ex) == 0) break;
+                        if (*ex != NULL) continue;
+                }
+                for (q = p->lines[j]->keyword; *q; q++) sig = ((sig ^ (unsigned char) tolower (*q)) * 16777619UL) & 0xFFFFFFFFUL;
+                sig = ((sig ^ '=') * 16777619UL) & 0xFFFFFFFFUL;
+                for (q = p->lines[j]->value; *q; q++) sig = ((sig ^ (unsigned char) *q) * 16777619UL) & 0xFFFFFFFFUL;
+                sig = ((sig ^ '\n') * 16777619UL) & 0xFFFFFFFFUL;
+        }
+        gwmutex_unlock (&INI_MUTEX);
+        return (sig);
+}
+
 /****************************************************************************/
 /*               Routines to read and write string values                   */
 /****************************************************************************/
@@ -71,6 +71,7 @@ extern void (*INI_ERROR_CALLBACK)(const char *, int, const char *);     /* Callb
 
 void IniFileReread (const char *);                                      /* Force the INI file to be re-read from disk */
 void IniAddFileMerge (const char *, const char *, const char *);        /* Merge one INI file into another.  Prime95 calls these .add files */
+unsigned long IniFileSignature (const char *, const char * const *);    /* Hash of an INI file's settings, ignoring comments and the listed keywords */
 
 const char *IniSectionGetStringRaw (const char *, const char *, const char *);
 const char *IniSectionGetNthStringRaw (const char *, const char *, const char *, int);
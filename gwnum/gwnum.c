@@ -24,6 +24,9 @@
 #include "gwutil.h"
 #include "gwdbldbl.h"
 #include "gwbench.h"
+#ifdef GW_GMP_FALLBACK
+#include "gmp.h"                // GMP library
+#endif
 
 //#define GDEBUG_MEM    1                       // Print out memory used
 
@@ -88,19 +91,33 @@ void pause_for_count (int count);
 
 /* gwnum assembly routine pointers */
 
-#define gw_fft(h,a)     (*(h)->GWPROCPTRS[0])(a)
-#define gw_add(h,a)     (*(h)->GWPROCPTRS[1])(a)
-#define gw_addq(h,a)    (*(h)->GWPROCPTRS[2])(a)
-#define gw_addf(h,a)    (*(h)->GWPROCPTRS[2])(a)
-#define gw_sub(h,a)     (*(h)->GWPROCPTRS[3])(a)
-#define gw_subq(h,a)    (*(h)->GWPROCPTRS[4])(a)
-#define gw_subf(h,a)    (*(h)->GWPROCPTRS[4])(a)
-#define gw_addsub(h,a)  (*(h)->GWPROCPTRS[5])(a)
-#define gw_addsubq(h,a) (*(h)->GWPROCPTRS[6])(a)
-#define gw_addsubf(h,a) (*(h)->GWPROCPTRS[6])(a)
-#define gw_copyzero(h,a) (*(h)->GWPROCPTRS[7])(a)
-#define gw_adds(h,a)    (*(h)->GWPROCPTRS[8])(a)
-#define gw_muls(h,a)    (*(h)->GWPROCPTRS[9])(a)
+/* The AVX and AVX-512 assembly code returns with the upper halves of the YMM/ZMM registers dirty. */
+/* The SSE2 instructions in our C code that follows then pay a state transition penalty.  For tiny FFTs */
+/* this penalty costs about as much as the FFT itself, so gwinfo sets ZERO_UPPER for one-pass FFTs. */
+
+#if defined (_MSC_VER)
+#include <immintrin.h>
+#define gw_zeroupper()  _mm256_zeroupper ()
+#elif defined (__WATCOMC__)
+#define gw_zeroupper()
+#else
+#define gw_zeroupper()  __asm__ __volatile__ (".byte 0xC5\n .byte 0xF8\n .byte 0x77\n")    /* VZEROUPPER */
+#endif
+#define gw_asm_call(h,n,a) do { (*(h)->GWPROCPTRS[n])(a); if ((h)->ZERO_UPPER) gw_zeroupper (); } while (0)
+
+#define gw_fft(h,a)     gw_asm_call (h, 0, a)
+#define gw_add(h,a)     gw_asm_call (h, 1, a)
+#define gw_addq(h,a)    gw_asm_call (h, 2, a)
+#define gw_addf(h,a)    gw_asm_call (h, 2, a)
+#define gw_sub(h,a)     gw_asm_call (h, 3, a)
+#define gw_subq(h,a)    gw_asm_call (h, 4, a)
+#define gw_subf(h,a)    gw_asm_call (h, 4, a)
+#define gw_addsub(h,a)  gw_asm_call (h, 5, a)
+#define gw_addsubq(h,a) gw_asm_call (h, 6, a)
+#define gw_addsubf(h,a) gw_asm_call (h, 6, a)
+#define gw_copyzero(h,a) gw_asm_call (h, 7, a)
+#define gw_adds(h,a)    gw_asm_call (h, 8, a)
+#define gw_muls(h,a)    gw_asm_call (h, 9, a)
 #define norm_routines   10
 #define zerohigh_routines 14
 
@@ -466,6 +483,45 @@ void pass2_aux_entry_point (void*);
 void create_auxiliary_hyperthread (struct gwasm_data *);
 void auxiliary_hyperthread (void *);
 
+/* The GMP fallback (see gwset_gmp_fallback in gwnum.h) is only compiled when */
+/* GW_GMP_FALLBACK is defined so that the gwnum library does not otherwise need */
+/* GMP.  Without it gwset_gmp_fallback is ignored and GMP_MOD is never set, so the */
+/* stubs below are never called. */
+
+#ifdef GW_GMP_FALLBACK
+#define gmp_fallback_allowed(h)         ((h)->gmp_fallback)
+int gwgmp_setup (gwhandle *gwdata, double k, unsigned long n, signed long c);
+void gwgmp_done (gwhandle *gwdata);
+unsigned long gwgmp_datasize (gwhandle *gwdata);
+void gwgmp_mul (gwhandle *gwdata, gwnum s1, gwnum s2, gwnum d);
+void gwgmp_addsub (gwhandle *gwdata, gwnum s1, gwnum s2, gwnum sum, gwnum diff);
+void gwgmp_smallop (gwhandle *gwdata, double addin, double mult, gwnum g);
+void gwgmp_gianttogw (gwhandle *gwdata, giant a, gwnum g);
+void gwgmp_gwtogiant (gwhandle *gwdata, gwnum g, giant v);
+
+/* The modulus and temporaries GMP uses when the number is too large for our FFTs */
+
+struct gwgmp_data {
+        mpz_t   N;              /* The modulus, k*2^n+c */
+        mpz_t   K;              /* k as an mpz_t */
+        mpz_t   prod;           /* Product before modular reduction */
+        mpz_t   hi;             /* Bits above 2^n during reduction */
+        mpz_t   q;              /* Quotient of hi / k during reduction */
+        unsigned long num_limbs; /* Number of limbs in every gwnum */
+        long    mulbyconst;     /* Value set by gwsetmulbyconst */
+};
+#else
+#define gmp_fallback_allowed(h)         0
+#define gwgmp_setup(h,k,n,c)            GWERROR_TOO_LARGE
+#define gwgmp_done(h)
+#define gwgmp_datasize(h)               0
+#define gwgmp_mul(h,s1,s2,d)
+#define gwgmp_addsub(h,s1,s2,sum,diff)
+#define gwgmp_smallop(h,addin,mult,g)
+#define gwgmp_gianttogw(h,a,g)
+#define gwgmp_gwtogiant(h,g,v)
+#endif
+
 /* Routine to split a r4dwpn FFT word into column and group multiplier indexes */
 /* We remove bit(s) associated with the upper SSE2/AVX/AVX-512 words because those are */
 /* handled by the group multipliers. */
@@ -1676,6 +1732,11 @@ next3:          prev_proc_ptrs[4] = prev_proc_ptrs[3];
         if (gwdata->PASS2_SIZE) gwdata->PASS1_SIZE = gwdata->FFTLEN / gwdata->PASS2_SIZE; /* Real values in a pass1 section */
         if (gwdata->PASS1_SIZE == 2) gwdata->PASS1_SIZE = 0;    /* Don't treat AVX-512 one-pass wrapper as a true pass 1 */
 
+/* One-pass AVX and AVX-512 FFTs are L1/L2 cache resident.  Their per-call overhead matters, so clear the dirty */
+/* upper register state after each assembly call.  Callers (e.g. the benchmark code) may turn this off after gwsetup. */
+
+        gwdata->ZERO_UPPER = (gwdata->cpu_flags & (CPU_AVX512F | CPU_AVX)) && (gwdata->PASS2_SIZE == 0 || gwdata->PASS1_SIZE == 0);
+
 /* Set more info so that addr_offset called from gwmap_to_estimated_size can work without a call to gwsetup. */
 
         gwdata->GW_ALIGNMENT = 4096;    /* Guess an alignment so gwsize can return a reasonable value for */
@@ -2112,7 +2173,7 @@ int gwsetup (
         unsigned long n,        /* N in K*B^N+C. Exponent to test. */
         signed long c)          /* C in K*B^N+C. */
 {
-        int     gcd, error_code, setup_completed;
+        int     gcd, error_code, setup_completed, too_large;
         double  orig_k;
         unsigned long orig_n;
 
@@ -2128,19 +2189,21 @@ int gwsetup (
 
         if (k < 1.0) return (GWERROR_K_TOO_SMALL);
         if (k > 9007199254740991.0) return (GWERROR_K_TOO_LARGE);
+        too_large = FALSE;
         if (gwdata->minimum_fftlen == 0) {
                 if (gwdata->cpu_flags & CPU_AVX512F) {
-                        if (log2(b) * (double) n > MAX_PRIME_AVX512) return (GWERROR_TOO_LARGE);
+                        if (log2(b) * (double) n > MAX_PRIME_AVX512) too_large = TRUE;
                 } else if (gwdata->cpu_flags & CPU_FMA3) {
-                        if (log2(b) * (double) n > MAX_PRIME_FMA3) return (GWERROR_TOO_LARGE);
+                        if (log2(b) * (double) n > MAX_PRIME_FMA3) too_large = TRUE;
                 } else if (gwdata->cpu_flags & CPU_AVX) {
-                        if (log2(b) * (double) n > MAX_PRIME_AVX) return (GWERROR_TOO_LARGE);
+                        if (log2(b) * (double) n > MAX_PRIME_AVX) too_large = TRUE;
                 } else if (gwdata->cpu_flags & CPU_SSE2) {
-                        if (log2(b) * (double) n > MAX_PRIME_SSE2) return (GWERROR_TOO_LARGE);
+                        if (log2(b) * (double) n > MAX_PRIME_SSE2) too_large = TRUE;
                 } else {
-                        if (log2(b) * (double) n > MAX_PRIME) return (GWERROR_TOO_LARGE);
+                        if (log2(b) * (double) n > MAX_PRIME) too_large = TRUE;
                 }
         }
+        if (too_large && ! (gmp_fallback_allowed (gwdata) && b == 2)) return (GWERROR_TOO_LARGE);
         if ((k == 1.0 && n == 0 && c == 0) ||
             (c < 0 && n * log ((double) b) + log (k) <= log ((double) 1-c)))
                 return (GWERROR_TOO_SMALL);
@@ -2180,6 +2243,15 @@ int gwsetup (
                 gcd = cg->n[0];
         }
 
+/* Have GMP do the math if the number is too large for our FFTs or the caller */
+/* insists (see gwset_gmp_fallback).  GMP's reduction needs b = 2. */
+
+        if (b == 2 && (too_large || gmp_fallback_allowed (gwdata) == 2)) {
+                error_code = gwgmp_setup (gwdata, k, n, c);
+                if (error_code) return (error_code);
+                setup_completed = TRUE;
+        }
+
 /* Call the internal setup routine when we can.  Gcd (k, c) must be 1, */
 /* k * mulbyconst and c * mulbyconst cannot be too large.  Also, the FFT */
 /* code has bugs when there are too few bits per FFT.  Rather than make */
@@ -2187,13 +2259,15 @@ int gwsetup (
 /* reduction.  In truth, the caller should use a different math package for */
 /* these small numbers. */
 
-        if (gcd == 1 &&
+        if (!setup_completed && gcd == 1 &&
             k * gwdata->maxmulbyconst <= MAX_ZEROPAD_K &&
             labs (c) * gwdata->maxmulbyconst <= MAX_ZEROPAD_C &&
             log2(b) * (double) n >= 350.0 &&
             (b == 2 || (gwdata->cpu_flags & (CPU_AVX512F | CPU_AVX | CPU_SSE2))) &&
             !gwdata->force_general_mod) {
                 error_code = internal_gwsetup (gwdata, k, b, n, c);
+                if (error_code == GWERROR_TOO_LARGE && b == 2 && gmp_fallback_allowed (gwdata))
+                        error_code = gwgmp_setup (gwdata, k, n, c);
                 if (error_code == 0) setup_completed = TRUE;
                 else if (b == 2) return (error_code);
                 gwdata->GENERAL_MOD = FALSE;
@@ -5024,17 +5098,94 @@ static __inline void * pass2_premult_addr (
         return ((char *) gwdata->adjusted_pass2_premults + block * gwdata->pass2_premult_block_size);
 }
 
+/* When the compute threads span several NUMA nodes, pass 1 state 0 and pass 2 blocks are */
+/* split into one contiguous range per node, sized by the node's share of the threads.  Node d's */
+/* threads process node d's range in order so that each node keeps working on the same part of */
+/* the FFT data from one multiply to the next.  Pass 1 state 1 already gives each thread a */
+/* contiguous section.  When threads are numbered consecutively within a node, as they are when */
+/* prime95 sets affinity, those sections line up with the node ranges. */
+
+static __inline int numa_node_of_thread (
+        gwhandle *gwdata,
+        int     thread_num)
+{
+        return (gwdata->numa_thread_node[thread_num]);
+}
+
+static void numa_partition_blocks (
+        gwhandle *gwdata,
+        unsigned long num_blocks,
+        unsigned long granularity)
+{
+        int     node;
+        unsigned long threads_before;
+
+        threads_before = 0;
+        for (node = 0; node < gwdata->numa_nodes; node++) {
+                gwdata->numa_ranges[node].next_block =
+                        round_up_to_multiple_of (num_blocks * threads_before / gwdata->num_threads, granularity);
+                threads_before += gwdata->numa_ranges[node].num_threads;
+                gwdata->numa_ranges[node].last_block = (node == gwdata->numa_nodes - 1) ? num_blocks :
+                        round_up_to_multiple_of (num_blocks * threads_before / gwdata->num_threads, granularity);
+        }
+}
+
+/* Get the next unassigned pass 1 state 0 or pass 2 block.  Take from this thread's node if */
+/* possible.  Otherwise take from the end of the node with the most blocks remaining. */
+/* Returns FALSE if there are no unassigned blocks. */
+
+static __inline int take_shared_block (
+        gwhandle *gwdata,
+        struct gwasm_data *asm_data,
+        unsigned long num_blocks,
+        unsigned long increment,
+        unsigned long *block)
+{
+        struct numa_block_range *range;
+        int     node, victim;
+
+        if (gwdata->numa_ranges == NULL) {
+                if (gwdata->next_block >= num_blocks) return (FALSE);
+                *block = gwdata->next_block;
+                gwdata->next_block += increment;
+                return (TRUE);
+        }
+
+        range = &gwdata->numa_ranges[numa_node_of_thread (gwdata, asm_data->thread_num)];
+        if (range->next_block < range->last_block) {
+                *block = range->next_block;
+                range->next_block += increment;
+                return (TRUE);
+        }
+
+        victim = -1;
+        for (node = 0; node < gwdata->numa_nodes; node++) {
+                if (gwdata->numa_ranges[node].next_block >= gwdata->numa_ranges[node].last_block) continue;
+                if (victim < 0 ||
+                    gwdata->numa_ranges[node].last_block - gwdata->numa_ranges[node].next_block >
+                    gwdata->numa_ranges[victim].last_block - gwdata->numa_ranges[victim].next_block)
+                        victim = node;
+        }
+        if (victim < 0) return (FALSE);
+        gwdata->numa_ranges[victim].last_block -= increment;
+        *block = gwdata->numa_ranges[victim].last_block;
+        return (TRUE);
+}
+
 /* Assign a thread's first block to process in pass 1 state 0.  These are assigned in */
-/* sequential order. */
+/* sequential order.  Returns FALSE if there are no unassigned blocks. */
 
-static __inline void pass1_state0_assign_first_block (
+static __inline int pass1_state0_assign_first_block (
         gwhandle *gwdata,
         struct gwasm_data *asm_data)
 {
-        asm_data->this_block = gwdata->next_block;
+        unsigned long block;
+
+        if (! take_shared_block (gwdata, asm_data, gwdata->num_pass1_blocks, asm_data->cache_line_multiplier, &block)) return (FALSE);
+        asm_data->this_block = block;
         asm_data->data_addr = pass1_data_addr (gwdata, asm_data, asm_data->this_block);
         asm_data->premult_addr = pass1_premult_addr (gwdata, asm_data->this_block);
-        gwdata->next_block += asm_data->cache_line_multiplier;
+        return (TRUE);
 }
 
 /* Assign next available block in pass 1 state 0.  These are assigned in */
@@ -5044,9 +5195,10 @@ static __inline void pass1_state0_assign_next_block (
         gwhandle *gwdata,
         struct gwasm_data *asm_data)
 {
-        if (gwdata->next_block < gwdata->num_pass1_blocks) {
-                asm_data->next_block = gwdata->next_block;
-                gwdata->next_block += asm_data->cache_line_multiplier;
+        unsigned long block;
+
+        if (take_shared_block (gwdata, asm_data, gwdata->num_pass1_blocks, asm_data->cache_line_multiplier, &block)) {
+                asm_data->next_block = block;
                 /* Init prefetching for the next block */
                 if (gwdata->hyperthread_prefetching) {
                         asm_data->data_prefetch = asm_data->data_addr;
@@ -5078,6 +5230,7 @@ int pass1_state1_assign_first_block (
         /* If there are zero blocks in the section, see if we can find (part of) another section we can work on */
         if (gwdata->pass1_carry_sections[i].next_block == gwdata->pass1_carry_sections[i].last_block) {
                 unsigned int j, largest_unfinished, largest_unfinished_size, min_split_size;
+                int     same_node_only;
 
                 /* Calculate minimum split size.  It must be at least num_postfft_blocks. */
                 /* It must also be a multiple of 8 if AVX zero-padded (because of using YMM_SRC_INCR[0-7] in */
@@ -5088,13 +5241,17 @@ int pass1_state1_assign_first_block (
                     !(gwdata->cpu_flags & (CPU_AVX512F | CPU_AVX)))
                         min_split_size = round_up_to_multiple_of (min_split_size, 8);
 
-                /* Find largest unfinished section for splitting */
+                /* Find largest unfinished section for splitting.  When partitioning by NUMA node, */
+                /* first look for a section belonging to a thread on our node. */
                 largest_unfinished = i;
                 largest_unfinished_size = 0;
+                same_node_only = (gwdata->numa_ranges != NULL);
+same_node_retry:
                 for (j = 0; j < gwdata->num_threads; j++) {
                         unsigned int size;
 
                         if (gwdata->pass1_carry_sections[j].section_state >= 2) continue;
+                        if (same_node_only && numa_node_of_thread (gwdata, j) != numa_node_of_thread (gwdata, i)) continue;
                         /* Since new section must be at least num_postfft_blocks in size and the existing */
                         /* section is prefetching the next block, make sure we are splitting at least */
                         /* num_postfft_blocks + asm_data->cache_line_multiplier in size. */
@@ -5110,6 +5267,10 @@ int pass1_state1_assign_first_block (
                 }
 
                 /* If we found no sections that we can split, then return FALSE */
+                if (largest_unfinished_size == 0 && same_node_only) {
+                        same_node_only = FALSE;
+                        goto same_node_retry;
+                }
                 if (largest_unfinished_size == 0) return (FALSE);
 
                 /* If the target section hasn't even started, then take the entire section under */
@@ -5235,15 +5396,19 @@ void pass1_state1_assign_next_block (
 }
 
 /* Assign a thread's first pass 2 block.  These are assigned in */
-/* sequential order. */
+/* sequential order.  Returns FALSE if there are no unassigned blocks. */
 
-static __inline void pass2_assign_first_block (
+static __inline int pass2_assign_first_block (
         gwhandle *gwdata,
         struct gwasm_data *asm_data)
 {
-        asm_data->this_block = gwdata->next_block++;
+        unsigned long block;
+
+        if (! take_shared_block (gwdata, asm_data, gwdata->num_pass2_blocks, 1, &block)) return (FALSE);
+        asm_data->this_block = block;
         asm_data->data_addr = pass2_data_addr (gwdata, asm_data, asm_data->this_block);
         asm_data->premult_addr = pass2_premult_addr (gwdata, asm_data->this_block);
+        return (TRUE);
 }
 
 /* Assign next available block in pass 2.  These are assigned in sequential order. */
@@ -5252,8 +5417,10 @@ static __inline void pass2_assign_next_block (
         gwhandle *gwdata,
         struct gwasm_data *asm_data)
 {
-        if (gwdata->next_block < gwdata->num_pass2_blocks) {
-                asm_data->next_block = gwdata->next_block++;
+        unsigned long block;
+
+        if (take_shared_block (gwdata, asm_data, gwdata->num_pass2_blocks, 1, &block)) {
+                asm_data->next_block = block;
                 /* Init prefetching for the next block */
                 if (gwdata->hyperthread_prefetching) {
                         asm_data->data_prefetch = asm_data->data_addr;
@@ -5402,15 +5569,13 @@ void auxiliary_thread (void *arg)
 
                 asm_data->this_block = 0;
                 if (gwdata->pass1_state == 0) {
-                        if (gwdata->next_block >= gwdata->num_pass1_blocks) goto aux_out_of_work_locked;
-                        pass1_state0_assign_first_block (gwdata, asm_data);
+                        if (! pass1_state0_assign_first_block (gwdata, asm_data)) goto aux_out_of_work_locked;
                         pass1_state0_assign_next_block (gwdata, asm_data);
                 } else if (gwdata->pass1_state == 1) {
                         if (! pass1_state1_assign_first_block (gwdata, asm_data)) goto aux_out_of_work_locked;
                         pass1_state1_assign_next_block (gwdata, asm_data);
                 } else {
-                        if (gwdata->next_block >= gwdata->num_pass2_blocks) goto aux_out_of_work_locked;
-                        pass2_assign_first_block (gwdata, asm_data);
+                        if (! pass2_assign_first_block (gwdata, asm_data)) goto aux_out_of_work_locked;
                         pass2_assign_next_block (gwdata, asm_data);
                 }
 
@@ -5540,6 +5705,8 @@ void pass1_wake_up_threads (
 /* Set up the this_block and next_block values for the main thread */
 
                 gwdata->next_block = 0;
+                if (gwdata->numa_ranges != NULL)
+                        numa_partition_blocks (gwdata, gwdata->num_pass1_blocks, asm_data->cache_line_multiplier);
                 pass1_state0_assign_first_block (gwdata, asm_data);
                 pass1_state0_assign_next_block (gwdata, asm_data);
         }
@@ -6055,6 +6222,7 @@ void pass2_wake_up_threads (
 
         gwdata->pass1_state = PASS1_STATE_PASS2;
         gwdata->next_block = 0;
+        if (gwdata->numa_ranges != NULL) numa_partition_blocks (gwdata, gwdata->num_pass2_blocks, 1);
         pass2_assign_first_block (gwdata, asm_data);
         pass2_assign_next_block (gwdata, asm_data);
 
@@ -6230,6 +6398,28 @@ int multithread_init (
         gwdata->pass1_carry_sections = (struct pass1_carry_sections *) malloc (gwdata->num_threads * sizeof (struct pass1_carry_sections));
         if (gwdata->pass1_carry_sections == NULL) return (GWERROR_MALLOC);
 
+/* Allocate the per-node block ranges if the compute threads span several NUMA nodes.  Copy the */
+/* caller's thread to node map and count the threads on each node.  Ignore a map that is invalid. */
+
+        if (gwdata->numa_nodes > 1 && gwdata->numa_map != NULL) {
+                unsigned long i;
+                gwdata->numa_ranges = (struct numa_block_range *) malloc (gwdata->numa_nodes * sizeof (struct numa_block_range));
+                if (gwdata->numa_ranges == NULL) return (GWERROR_MALLOC);
+                gwdata->numa_thread_node = (int *) malloc (gwdata->num_threads * sizeof (int));
+                if (gwdata->numa_thread_node == NULL) return (GWERROR_MALLOC);
+                memset (gwdata->numa_ranges, 0, gwdata->numa_nodes * sizeof (struct numa_block_range));
+                for (i = 0; i < gwdata->num_threads; i++) {
+                        if (gwdata->numa_map[i] < 0 || gwdata->numa_map[i] >= gwdata->numa_nodes) break;
+                        gwdata->numa_thread_node[i] = gwdata->numa_map[i];
+                        gwdata->numa_ranges[gwdata->numa_map[i]].num_threads++;
+                }
+                if (i < gwdata->num_threads) {
+                        free (gwdata->numa_ranges);
+                        gwdata->numa_ranges = NULL;
+                }
+        }
+        gwdata->numa_map = NULL;
+
 /* Create the prefetching hyperthread for the main compute thread */
 
         create_auxiliary_hyperthread (asm_data);
@@ -6497,6 +6687,10 @@ void multithread_term (
 
         free (gwdata->pass1_carry_sections);
         gwdata->pass1_carry_sections = NULL;
+        free (gwdata->numa_ranges);
+        gwdata->numa_ranges = NULL;
+        free (gwdata->numa_thread_node);
+        gwdata->numa_thread_node = NULL;
 }
 
 /* Cleanup any memory allocated for multi-precision math */
@@ -6507,6 +6701,7 @@ void gwdone (
         unsigned int i;
 
         multithread_term (gwdata);
+        if (gwdata->gmp_data != NULL) gwgmp_done (gwdata);
 
         term_ghandle (&gwdata->gdata);
         if (gwdata->asm_data != NULL) {
@@ -7048,6 +7243,7 @@ unsigned long gwmemused (
 unsigned long gwnum_datasize (
         gwhandle *gwdata)       /* Handle initialized by gwsetup */
 {
+        if (gwdata->GMP_MOD) return (gwgmp_datasize (gwdata));
         return (addr_offset (gwdata, gwdata->FFTLEN - 1) + sizeof (double));
 }
 
@@ -7063,6 +7259,37 @@ unsigned long gwnum_size (
         return (mem - mem % (gwdata->GW_ALIGNMENT));
 }
 
+/* Return a value identifying the layout of a gwnum's raw FFT data.  Two */
+/* handles returning the same value lay out FFT data identically, so raw */
+/* data copied out of one handle's gwnum can be copied into the other's. */
+
+unsigned long gwnum_layout_id (
+        gwhandle *gwdata)       /* Handle initialized by gwsetup */
+{
+        uint32_t id;
+
+#define mix_id(v)       id = (uint32_t) ((id ^ (uint32_t) (v)) * 0x01000193)
+        id = 0x811C9DC5;
+        mix_id (gwdata->FFTLEN);
+        mix_id (gwdata->PASS1_SIZE);
+        mix_id (gwdata->PASS2_SIZE);
+        mix_id (gwdata->cpu_flags & (CPU_AVX512F | CPU_FMA3 | CPU_AVX | CPU_SSE2));
+        mix_id (gwdata->ZERO_PADDED_FFT);
+        mix_id (gwdata->ALL_COMPLEX_FFT);
+        mix_id (gwdata->RATIONAL_FFT);
+        mix_id (gwdata->GENERAL_MOD);
+        mix_id (gwdata->FFT_TYPE);
+        mix_id (gwdata->ARCH);
+        mix_id (gwdata->FOURKBGAPSIZE);
+        mix_id (gwdata->PASS2GAPSIZE);
+        mix_id (gwdata->PASS1_CACHE_LINES);
+        mix_id (gwdata->NUM_B_PER_SMALL_WORD);
+        mix_id (gwnum_datasize (gwdata));
+        if (gwdata->jmptab != NULL) mix_id (gwdata->jmptab->flags);
+#undef mix_id
+        return (id);
+}
+
 /* Each FFT word is multiplied by a two-to-phi value.  These */
 /* routines set and get the FFT value without the two-to-phi */
 /* multiplier. */
@@ -7232,6 +7459,14 @@ void gwfft_description (
 {
         char    *arch, *ffttype;
 
+#ifdef GW_GMP_FALLBACK
+        if (gwdata->GMP_MOD) {
+                sprintf (buf, "GMP multiplication, %lu limbs",
+                         ((struct gwgmp_data *) gwdata->gmp_data)->num_limbs);
+                return;
+        }
+#endif
+
         arch = "";
         if (gwdata->cpu_flags & CPU_AVX512F) {
                 // No output means Intel Skylake-X or Blend optimized
@@ -7327,11 +7562,13 @@ void gw_as_string (
 double gw_get_maxerr (
         gwhandle *gwdata)
 {
+        if (gwdata->GMP_MOD) return (0.0);
         return (((struct gwasm_data *) gwdata->asm_data)->MAXERR);
 }
 void gw_clear_maxerr (
         gwhandle *gwdata)
 {
+        if (gwdata->GMP_MOD) return;
         ((struct gwasm_data *) gwdata->asm_data)->MAXERR = 0.0;
 }
 
@@ -7347,8 +7584,9 @@ int gwnear_fft_limit (
 {
 
 /* Return TRUE if the virtual bits per word is near the maximum bits */
-/* per word. */
+/* per word.  GMP has no limit. */
 
+        if (gwdata->GMP_MOD) return (FALSE);
         return (virtual_bits_per_word (gwdata) >
                         (100.0 - pct) / 100.0 * gwdata->fft_max_bits_per_word);
 }
@@ -7794,6 +8032,15 @@ void gwsetmulbyconst (
         struct gwasm_data *asm_data;
         double  ktimesval, big_word;
 
+/* GMP multiplies by the constant after the product is computed */
+
+#ifdef GW_GMP_FALLBACK
+        if (gwdata->GMP_MOD) {
+                ((struct gwgmp_data *) gwdata->gmp_data)->mulbyconst = val;
+                return;
+        }
+#endif
+
 /* Perform common computations */
 
         asm_data = (struct gwasm_data *) gwdata->asm_data;
@@ -8256,6 +8503,13 @@ void gianttogw (
 {
         ASSERTG (a->sign >= 0);         /* We only handle positive numbers */
 
+/* GMP does the math for numbers too large for our FFTs */
+
+        if (gwdata->GMP_MOD) {
+                gwgmp_gianttogw (gwdata, a, g);
+                return;
+        }
+
 /* Jean Penne requested that we optimize the small number cases. */
 /* Setting the gwnum to zero is real easy. */
 
@@ -8683,6 +8937,13 @@ int gwtogiant (
         if (((uint32_t *) gg)[-7] == 3) return (GWERROR_FFT); /* Test the FFTed flag */
         if (((uint32_t *) gg)[-7] == 1) return (GWERROR_PARTIAL_FFT); /* Test the FFT-started flag */
 
+/* GMP does the math for numbers too large for our FFTs */
+
+        if (gwdata->GMP_MOD) {
+                gwgmp_gwtogiant (gwdata, gg, v);
+                return (0);
+        }
+
 /* If this is a general-purpose mod, then only convert the needed words */
 /* which will be less than half the FFT length.  If this is a zero padded */
 /* FFT, then only convert a little more than half of the FFT data words. */
@@ -8984,6 +9245,16 @@ int gwiszero (
         ASSERTG (((uint32_t *) gg)[-1] >= 1);
         ASSERTG (((uint32_t *) gg)[-7] == 0);
 
+/* GMP values are always fully reduced */
+
+#ifdef GW_GMP_FALLBACK
+        if (gwdata->GMP_MOD) {
+                mpz_t   view;
+                mpz_roinit_n (view, (const mp_limb_t *) gg, gwgmp_datasize (gwdata) / sizeof (mp_limb_t));
+                return (mpz_sgn (view) == 0);
+        }
+#endif
+
 /* If the input number is the result of an unormalized addition or subtraction, then */
 /* we had better normalize the number! */
 
@@ -9052,6 +9323,10 @@ int gwequal (
         ASSERTG (((uint32_t *) gw1)[-7] == 0);
         ASSERTG (((uint32_t *) gw2)[-7] == 0);
 
+/* GMP values are always fully reduced */
+
+        if (gwdata->GMP_MOD) return (memcmp (gw1, gw2, gwgmp_datasize (gwdata)) == 0);
+
 /* Allocate memory for the difference */
 
         gwdiff = gwalloc (gwdata);
@@ -9076,6 +9351,148 @@ int gwequal (
         return (result);
 }
 
+/* Fingerprint a gwnum without converting it to binary.  The fingerprint is the */
+/* fully reduced value (optionally rotated right by a shift count) modulo the prime */
+/* 2^61-1.  Because this prime is a Mersenne number, multiplying an FFT word by its */
+/* power of two is a simple 61-bit rotate.  The representation's integer value can */
+/* be a small multiple of k*2^n+c too large or too small.  We estimate this multiple */
+/* from the few topmost FFT words using floating point and subtract it out. */
+
+#define FP_PRIME        0x1FFFFFFFFFFFFFFFULL   /* 2^61-1 */
+
+static uint64_t fp_add (uint64_t a, uint64_t b)
+{
+        uint64_t r = a + b;
+        r = (r & FP_PRIME) + (r >> 61);
+        if (r >= FP_PRIME) r -= FP_PRIME;
+        return (r);
+}
+
+static uint64_t fp_rotl (uint64_t a, unsigned long shift)
+{
+        if (shift == 0) return (a);
+        return (((a << shift) & FP_PRIME) | (a >> (61 - shift)));
+}
+
+/* Fingerprint one or two gwnums in a single pass over the FFT words.  Doing both values */
+/* of a comparison together shares the per-word address, weight, and base computations. */
+
+static int fingerprint_pass (
+        gwhandle *gwdata,       /* Handle initialized by gwsetup */
+        int     count,          /* Number of gwnums to fingerprint (1 or 2) */
+        gwnum   *g,             /* Numbers to fingerprint */
+        unsigned long *shifts,  /* Rotate each value right by this many bits (Mersenne numbers only) */
+        uint64_t *fingerprints) /* Returned fingerprints */
+{
+        unsigned long i, j, base, next_base, e, n, offset;
+        uint64_t fp[2], nmod, kmul, addend;
+        double  approx[2], frac, weight, dval;
+        long    val, k;
+        int     weighted;
+
+/* Sanity check the input numbers */
+
+        for (j = 0; j < (unsigned long) count; j++) {
+                if (((uint32_t *) g[j])[-7] == 3) return (GWERROR_FFT); /* Test the FFTed flag */
+                if (((uint32_t *) g[j])[-7] == 1) return (GWERROR_PARTIAL_FFT); /* Test the FFT-started flag */
+        }
+
+/* Only plain 2^n+c DWT FFTs are supported.  Rotating is only supported for Mersenne numbers. */
+
+        if (gwdata->b != 2 || gwdata->k != 1.0 || (gwdata->c != 1 && gwdata->c != -1) ||
+            gwdata->GENERAL_MOD || gwdata->ZERO_PADDED_FFT || gwdata->GW_MODULUS != NULL) return (FALSE);
+        n = gwdata->n;
+        for (j = 0; j < (unsigned long) count; j++) {
+                if (shifts[j] && gwdata->c != -1) return (FALSE);
+                shifts[j] = shifts[j] % n;
+                fp[j] = 0;
+                approx[j] = 0.0;
+        }
+
+/* Sum each FFT word times its power of two mod 2^61-1.  Words landing in the */
+/* top 64 bits are also summed in floating point to estimate value / 2^n. */
+/* This is get_fft_value with the address and weight computed once for all the values. */
+
+        weighted = !gwdata->RATIONAL_FFT && !(gwdata->cpu_flags & CPU_AVX512F);
+        next_base = 0;
+        for (i = 0; i < gwdata->FFTLEN; i++) {
+                base = next_base;
+                next_base = gwfft_base (gwdata->dd_data, i+1);
+                offset = addr_offset (gwdata, i);
+                weight = 1.0;
+                if (weighted) {
+                        if (gwdata->FFT_TYPE == FFT_TYPE_RADIX_4_DWPN)
+                                weight = gwfft_partial_weight_inverse_sloppy (gwdata->dd_data, i, dwpn_col (gwdata, i));
+                        else
+                                weight = gwfft_weight_inverse_sloppy (gwdata->dd_data, i);
+                }
+                for (j = 0; j < (unsigned long) count; j++) {
+                        dval = * (double *) ((char *) g[j] + offset);
+                        if (! is_valid_double (dval)) return (GWERROR_BAD_FFT_DATA);
+                        dval = dval * weight;
+                        val = (dval < -0.5) ? (long) (dval - 0.5) : (long) (dval + 0.5);
+                        if (val == 0) continue;
+                        e = (base >= shifts[j]) ? base - shifts[j] : base + n - shifts[j];
+                        if (e + 64 >= n) approx[j] += ldexp ((double) val, (int) e - (int) n);
+                        fp[j] = fp_add (fp[j], fp_rotl (val >= 0 ? (uint64_t) val : FP_PRIME - (uint64_t) -val, e % 61));
+                }
+        }
+
+/* The integer value of the FFT words is k * (2^n+c) + r.  Deduce k from value / 2^n.  If */
+/* r is too close to 0 or 2^n we cannot be sure of k, let the caller do a full conversion. */
+/* This also makes sure a zero value is never fingerprinted. */
+
+        nmod = fp_rotl (1, n % 61);
+        nmod = (gwdata->c == 1) ? fp_add (nmod, 1) : fp_add (nmod, FP_PRIME - 1);
+        for (j = 0; j < (unsigned long) count; j++) {
+                k = (long) floor (approx[j]);
+                frac = approx[j] - (double) k;
+                if (frac < 1.0e-6 || frac > 1.0 - 1.0e-6) return (FALSE);
+
+/* Subtract k * (2^n+c) mod 2^61-1 */
+
+                kmul = 0;
+                addend = nmod;
+                for (val = labs (k); val; val >>= 1) {
+                        if (val & 1) kmul = fp_add (kmul, addend);
+                        addend = fp_add (addend, addend);
+                }
+                if (k > 0 && kmul) kmul = FP_PRIME - kmul;
+                fingerprints[j] = fp_add (fp[j], kmul);
+        }
+        return (TRUE);
+}
+
+int gwfingerprint (
+        gwhandle *gwdata,       /* Handle initialized by gwsetup */
+        gwnum   gg,             /* Number to fingerprint */
+        unsigned long shift,    /* Rotate the value right by this many bits (Mersenne numbers only) */
+        uint64_t *fingerprint)  /* Returned fingerprint */
+{
+        return (fingerprint_pass (gwdata, 1, &gg, &shift, fingerprint));
+}
+
+int gwfingerprint2 (
+        gwhandle *gwdata,       /* Handle initialized by gwsetup */
+        gwnum   g1,             /* First number to fingerprint */
+        unsigned long shift1,   /* Rotate the first value right by this many bits */
+        gwnum   g2,             /* Second number to fingerprint */
+        unsigned long shift2,   /* Rotate the second value right by this many bits */
+        uint64_t *fingerprint1, /* Returned fingerprint of the first value */
+        uint64_t *fingerprint2) /* Returned fingerprint of the second value */
+{
+        gwnum   g[2];
+        unsigned long shifts[2];
+        uint64_t fps[2];
+        int     result;
+
+        g[0] = g1, g[1] = g2;
+        shifts[0] = shift1, shifts[1] = shift2;
+        result = fingerprint_pass (gwdata, 2, g, shifts, fps);
+        if (result == TRUE) *fingerprint1 = fps[0], *fingerprint2 = fps[1];
+        return (result);
+}
+
 /******************************************************************/
 /* Wrapper routines for the multiplication assembly code routines */
 /******************************************************************/
@@ -9204,6 +9621,13 @@ void gwfft (                    /* Forward FFT */
 {
         struct gwasm_data *asm_data;
 
+/* GMP values are never FFTed */
+
+        if (gwdata->GMP_MOD) {
+                if (s != d) gwcopy (gwdata, s, d);
+                return;
+        }
+
         ASSERTG (((uint32_t *) s)[-1] >= 1);
         ASSERTG (((uint32_t *) s)[-7] != 3);    // Make sure input has not already been completely FFTed (we could turn this into a nop or copy)
 
@@ -9250,6 +9674,13 @@ void gwsquare2 (                /* Square a number */
 
         ASSERTG (((uint32_t *) s)[-1] >= 1);
 
+/* GMP does the math for numbers too large for our FFTs */
+
+        if (gwdata->GMP_MOD) {
+                gwgmp_mul (gwdata, s, s, d);
+                return;
+        }
+
 /* If we are converting gwsquare calls into gwsquare_carefully calls */
 /* do so now.  Turn off option to do a partial forward FFT on the result. */
 /* NOTE: We must clear count since gwsquare_carefully calls back to this */
@@ -9323,6 +9754,13 @@ void gwfftmul (                 /* Multiply already FFTed source with dest */
         ASSERTG (((uint32_t *) s)[-1] >= 1);
         ASSERTG (((uint32_t *) d)[-1] >= 1);
 
+/* GMP does the math for numbers too large for our FFTs */
+
+        if (gwdata->GMP_MOD) {
+                gwgmp_mul (gwdata, s, d, d);
+                return;
+        }
+
 /* Call the assembly code */
 
         asm_data = (struct gwasm_data *) gwdata->asm_data;
@@ -9347,6 +9785,13 @@ void gwfftfftmul (              /* Multiply two already FFTed sources */
         ASSERTG (((uint32_t *) s)[-1] >= 1);
         ASSERTG (((uint32_t *) s2)[-1] >= 1);
 
+/* GMP does the math for numbers too large for our FFTs */
+
+        if (gwdata->GMP_MOD) {
+                gwgmp_mul (gwdata, s, s2, d);
+                return;
+        }
+
 /* Get the unnormalized add count for later use */
 
         norm_count1 = ((uint32_t *) s)[-1];
@@ -9501,6 +9946,13 @@ void gwsquare2_carefully (
         double  saved_addin_value;
         unsigned long saved_extra_bits;
 
+/* GMP's products are exact, no need to be careful */
+
+        if (gwdata->GMP_MOD) {
+                gwgmp_mul (gwdata, s, s, d);
+                return;
+        }
+
 /* Generate a random number, if we have't already done so */
 
         if (gwdata->GW_RANDOM == NULL) {
@@ -9555,6 +10007,13 @@ void gwmul_carefully (
         double  saved_addin_value;
         unsigned long saved_extra_bits;
 
+/* GMP's products are exact, no need to be careful */
+
+        if (gwdata->GMP_MOD) {
+                gwgmp_mul (gwdata, s, t, t);
+                return;
+        }
+
 /* Generate a random number, if we have't already done so */
 
         if (gwdata->GW_RANDOM == NULL) {
@@ -9939,6 +10398,11 @@ void gwadd3quick (              /* Add two numbers without normalizing */
 {
         struct gwasm_data *asm_data = (struct gwasm_data *) gwdata->asm_data;
 
+        if (gwdata->GMP_MOD) {
+                gwgmp_addsub (gwdata, s1, s2, d, NULL);
+                return;
+        }
+
         ASSERTG (((uint32_t *) s1)[-1] >= 1);
         ASSERTG (((uint32_t *) s2)[-1] >= 1);
 
@@ -9981,6 +10445,11 @@ void gwsub3quick (              /* Compute s1 - s2 without normalizing */
 {
         struct gwasm_data *asm_data = (struct gwasm_data *) gwdata->asm_data;
 
+        if (gwdata->GMP_MOD) {
+                gwgmp_addsub (gwdata, s1, s2, NULL, d);
+                return;
+        }
+
         ASSERTG (((uint32_t *) s1)[-1] >= 1);
         ASSERTG (((uint32_t *) s2)[-1] >= 1);
 
@@ -10024,6 +10493,11 @@ void gwaddsub4quick (           /* Add & sub two numbers without normalizing */
 {
         struct gwasm_data *asm_data = (struct gwasm_data *) gwdata->asm_data;
 
+        if (gwdata->GMP_MOD) {
+                gwgmp_addsub (gwdata, s1, s2, d1, d2);
+                return;
+        }
+
         ASSERTG (((uint32_t *) s1)[-1] >= 1);
         ASSERTG (((uint32_t *) s2)[-1] >= 1);
 
@@ -10071,6 +10545,11 @@ void gwadd3 (                   /* Add two numbers normalizing if needed */
         struct gwasm_data *asm_data = (struct gwasm_data *) gwdata->asm_data;
         uint32_t normcnt1, normcnt2;
 
+        if (gwdata->GMP_MOD) {
+                gwgmp_addsub (gwdata, s1, s2, d, NULL);
+                return;
+        }
+
         ASSERTG (((uint32_t *) s1)[-1] >= 1);
         ASSERTG (((uint32_t *) s2)[-1] >= 1);
         ASSERTG (((uint32_t *) s1)[-7] == 0);
@@ -10116,6 +10595,11 @@ void gwsub3 (                   /* Compute s1 - s2 normalizing if needed */
         struct gwasm_data *asm_data = (struct gwasm_data *) gwdata->asm_data;
         uint32_t normcnt1, normcnt2;
 
+        if (gwdata->GMP_MOD) {
+                gwgmp_addsub (gwdata, s1, s2, NULL, d);
+                return;
+        }
+
         ASSERTG (((uint32_t *) s1)[-1] >= 1);
         ASSERTG (((uint32_t *) s2)[-1] >= 1);
         ASSERTG (((uint32_t *) s1)[-7] == 0);
@@ -10162,6 +10646,11 @@ void gwaddsub4 (                /* Add & sub two nums normalizing if needed */
         struct gwasm_data *asm_data = (struct gwasm_data *) gwdata->asm_data;
         uint32_t normcnt1, normcnt2;
 
+        if (gwdata->GMP_MOD) {
+                gwgmp_addsub (gwdata, s1, s2, d1, d2);
+                return;
+        }
+
         ASSERTG (((uint32_t *) s1)[-1] >= 1);
         ASSERTG (((uint32_t *) s2)[-1] >= 1);
         ASSERTG (((uint32_t *) s1)[-7] == 0);
@@ -10210,6 +10699,11 @@ void gwfftadd3 (                /* Add two FFTed numbers */
 {
         struct gwasm_data *asm_data = (struct gwasm_data *) gwdata->asm_data;
 
+        if (gwdata->GMP_MOD) {
+                gwgmp_addsub (gwdata, s1, s2, d, NULL);
+                return;
+        }
+
         ASSERTG (((uint32_t *) s1)[-1] >= 1);
         ASSERTG (((uint32_t *) s2)[-1] >= 1);
         ASSERTG (((uint32_t *) s1)[-7] == ((uint32_t *) s2)[-7]);
@@ -10259,6 +10753,11 @@ void gwfftsub3 (                /* Compute FFTed s1 - FFTed s2 */
 {
         struct gwasm_data *asm_data = (struct gwasm_data *) gwdata->asm_data;
 
+        if (gwdata->GMP_MOD) {
+                gwgmp_addsub (gwdata, s1, s2, NULL, d);
+                return;
+        }
+
         ASSERTG (((uint32_t *) s1)[-1] >= 1);
         ASSERTG (((uint32_t *) s2)[-1] >= 1);
         ASSERTG (((uint32_t *) s1)[-7] == ((uint32_t *) s2)[-7]);
@@ -10309,6 +10808,11 @@ void gwfftaddsub4 (             /* Add & sub two FFTed numbers */
 {
         struct gwasm_data *asm_data = (struct gwasm_data *) gwdata->asm_data;
 
+        if (gwdata->GMP_MOD) {
+                gwgmp_addsub (gwdata, s1, s2, d1, d2);
+                return;
+        }
+
         ASSERTG (((uint32_t *) s1)[-1] >= 1);
         ASSERTG (((uint32_t *) s2)[-1] >= 1);
         ASSERTG (((uint32_t *) s1)[-7] == ((uint32_t *) s2)[-7]);
@@ -10367,6 +10871,13 @@ void gwsmalladd (
 {
         int     cant_handle;
 
+/* GMP does the math for numbers too large for our FFTs */
+
+        if (gwdata->GMP_MOD) {
+                gwgmp_smallop (gwdata, addin, 1.0, g);
+                return;
+        }
+
 /* Assert unnormalized add count valid, input not completely/partially FFTed. */
 
         ASSERTG (((uint32_t *) g)[-1] >= 1);
@@ -10421,6 +10932,13 @@ void gwsmallmul (
 {
         struct gwasm_data *asm_data = (struct gwasm_data *) gwdata->asm_data;
 
+/* GMP does the math for numbers too large for our FFTs */
+
+        if (gwdata->GMP_MOD) {
+                gwgmp_smallop (gwdata, 0.0, mult, g);
+                return;
+        }
+
 /* Assert unnormalized add count valid, input not completely/partially FFTed. */
 
         ASSERTG (((uint32_t *) g)[-1] >= 1);
@@ -10502,3 +11020,240 @@ void gwsmallmul (
              * (double *) ((char *) g + gwdata->GW_GEN_MOD_MAX_OFFSET) > 0.0))
                 emulate_mod (gwdata, g);
 }
+
+/******************************************************************/
+/*      GMP math for numbers too large for our FFTs               */
+/******************************************************************/
+
+#ifdef GW_GMP_FALLBACK
+
+/* When gwset_gmp_fallback is in effect, gwsetup may choose to have GMP */
+/* do the math.  Each gwnum holds num_limbs GMP limbs containing a value */
+/* fully reduced modulo N = k*2^n+c.  Products are computed with mpz_mul */
+/* and reduced with shifts and adds rather than a division.  Writing */
+/* x = hi * 2^n + lo and hi = q * k + r, then x = r * 2^n + lo - c * q */
+/* modulo N.  Repeat until q is zero, then at most one subtraction of N */
+/* is needed. */
+
+int gwgmp_setup (
+        gwhandle *gwdata,       /* Handle initialized by gwinit */
+        double  k,              /* K in K*2^N+C */
+        unsigned long n,        /* N in K*2^N+C */
+        signed long c)          /* C in K*2^N+C */
+{
+        struct gwgmp_data *gd;
+
+/* Allocate and fill in the modulus */
+
+        gd = (struct gwgmp_data *) malloc (sizeof (struct gwgmp_data));
+        if (gd == NULL) return (GWERROR_MALLOC);
+        mpz_init_set_d (gd->K, k);
+        mpz_init (gd->N);
+        mpz_mul_2exp (gd->N, gd->K, n);
+        if (c >= 0) mpz_add_ui (gd->N, gd->N, (unsigned long) c);
+        else mpz_sub_ui (gd->N, gd->N, (unsigned long) -c);
+        mpz_init (gd->prod);
+        mpz_init (gd->hi);
+        mpz_init (gd->q);
+        gd->num_limbs = (unsigned long) mpz_size (gd->N);
+        gd->mulbyconst = gwdata->maxmulbyconst;
+        gwdata->gmp_data = gd;
+        gwdata->GMP_MOD = TRUE;
+
+/* Fill in the parts of the handle callers look at.  There is no FFT. */
+
+        gwdata->k = k;
+        gwdata->b = 2;
+        gwdata->n = n;
+        gwdata->c = c;
+        gwdata->bit_length = log2 (k) + (double) n;
+        gwdata->FFTLEN = 0;
+        gwdata->PASS1_SIZE = 0;
+        gwdata->PASS2_SIZE = 0;
+        gwdata->SCRATCH_SIZE = 0;
+        gwdata->EXTRA_BITS = 0.0;
+        gwdata->mem_needed = 0;
+        gwdata->num_threads = 1;
+        gwdata->GW_ALIGNMENT = 64;
+        gwdata->GW_ALIGNMENT_MOD = 0;
+        gwdata->GWERROR = 0;
+        gwdata->fft_count = 0.0;
+
+/* Init the gwnum allocation arrays and the giants / gwnum shared cache */
+
+        gwdata->gwnum_alloc = NULL;
+        gwdata->gwnum_alloc_count = 0;
+        gwdata->gwnum_alloc_array_size = 50;
+        gwdata->gwnum_free = NULL;
+        gwdata->gwnum_free_count = 0;
+        gwdata->gdata.blksize = gwnum_datasize (gwdata);
+        return (0);
+}
+
+void gwgmp_done (
+        gwhandle *gwdata)       /* Handle initialized by gwsetup */
+{
+        struct gwgmp_data *gd = (struct gwgmp_data *) gwdata->gmp_data;
+
+        mpz_clear (gd->N);
+        mpz_clear (gd->K);
+        mpz_clear (gd->prod);
+        mpz_clear (gd->hi);
+        mpz_clear (gd->q);
+        free (gd);
+        gwdata->gmp_data = NULL;
+}
+
+unsigned long gwgmp_datasize (
+        gwhandle *gwdata)       /* Handle initialized by gwsetup */
+{
+        return (((struct gwgmp_data *) gwdata->gmp_data)->num_limbs * sizeof (mp_limb_t));
+}
+
+/* Read-only view of a gwnum as an mpz_t.  Do not mpz_clear it. */
+
+static void gwgmp_view (
+        gwhandle *gwdata,
+        gwnum   g,
+        mpz_t   view)
+{
+        mpz_roinit_n (view, (const mp_limb_t *) g, ((struct gwgmp_data *) gwdata->gmp_data)->num_limbs);
+}
+
+/* Reduce x modulo N.  On input, x can be any size and sign.  We must stop as */
+/* soon as 0 <= x < N.  When c > 0 values in [k*2^n, N) have a non-zero q and */
+/* another pass would make them negative only to restore them on the next pass. */
+
+static void gwgmp_reduce (
+        gwhandle *gwdata,
+        mpz_t   x)
+{
+        struct gwgmp_data *gd = (struct gwgmp_data *) gwdata->gmp_data;
+
+        for ( ; ; ) {
+                if (mpz_sgn (x) >= 0 && mpz_cmp (x, gd->N) < 0) return;
+                mpz_fdiv_q_2exp (gd->hi, x, gwdata->n);
+                mpz_fdiv_qr (gd->q, gd->hi, gd->hi, gd->K);
+                if (mpz_sgn (gd->q) == 0) break;
+                mpz_fdiv_r_2exp (x, x, gwdata->n);
+                mpz_mul_2exp (gd->hi, gd->hi, gwdata->n);
+                mpz_add (x, x, gd->hi);
+                if (gwdata->c >= 0) mpz_submul_ui (x, gd->q, (unsigned long) gwdata->c);
+                else mpz_addmul_ui (x, gd->q, (unsigned long) -gwdata->c);
+        }
+        while (mpz_cmp (x, gd->N) >= 0) mpz_sub (x, x, gd->N);
+}
+
+/* Copy a reduced mpz_t into a gwnum */
+
+static void gwgmp_store (
+        gwhandle *gwdata,
+        mpz_t   x,
+        gwnum   g)
+{
+        unsigned long num_limbs = ((struct gwgmp_data *) gwdata->gmp_data)->num_limbs;
+        size_t  size = mpz_size (x);
+
+        if (size) memcpy (g, mpz_limbs_read (x), size * sizeof (mp_limb_t));
+        memset ((mp_limb_t *) g + size, 0, (num_limbs - size) * sizeof (mp_limb_t));
+        ((uint32_t *) g)[-1] = 1;       /* Unnormalized adds count */
+        ((uint32_t *) g)[-7] = 0;       /* Not FFTed */
+        g[-2] = 0.0;                    /* Suminp */
+        g[-3] = 0.0;                    /* Sumout */
+}
+
+/* Compute d = s1 * s2 mod N, applying mulbyconst if asked to */
+
+void gwgmp_mul (
+        gwhandle *gwdata,       /* Handle initialized by gwsetup */
+        gwnum   s1,             /* First source */
+        gwnum   s2,             /* Second source */
+        gwnum   d)              /* Destination */
+{
+        struct gwgmp_data *gd = (struct gwgmp_data *) gwdata->gmp_data;
+        mpz_t   v1, v2;
+
+        gwgmp_view (gwdata, s1, v1);
+        if (s1 == s2) mpz_mul (gd->prod, v1, v1);
+        else {
+                gwgmp_view (gwdata, s2, v2);
+                mpz_mul (gd->prod, v1, v2);
+        }
+        if (gwdata->NORMNUM & 2) mpz_mul_si (gd->prod, gd->prod, gd->mulbyconst);
+        gwgmp_reduce (gwdata, gd->prod);
+        gwgmp_store (gwdata, gd->prod, d);
+        gwdata->fft_count += 2;
+}
+
+/* Compute sum = s1 + s2 and diff = s1 - s2 mod N.  Either destination can be NULL. */
+
+void gwgmp_addsub (
+        gwhandle *gwdata,       /* Handle initialized by gwsetup */
+        gwnum   s1,             /* First source */
+        gwnum   s2,             /* Second source */
+        gwnum   sum,            /* Destination for the sum */
+        gwnum   diff)           /* Destination for the difference */
+{
+        struct gwgmp_data *gd = (struct gwgmp_data *) gwdata->gmp_data;
+        mpz_t   v1, v2;
+
+/* Compute both results before storing either, the destinations may be sources */
+
+        gwgmp_view (gwdata, s1, v1);
+        gwgmp_view (gwdata, s2, v2);
+        if (sum != NULL) {
+                mpz_add (gd->prod, v1, v2);
+                if (mpz_cmp (gd->prod, gd->N) >= 0) mpz_sub (gd->prod, gd->prod, gd->N);
+        }
+        if (diff != NULL) {
+                mpz_sub (gd->hi, v1, v2);
+                if (mpz_sgn (gd->hi) < 0) mpz_add (gd->hi, gd->hi, gd->N);
+        }
+        if (sum != NULL) gwgmp_store (gwdata, gd->prod, sum);
+        if (diff != NULL) gwgmp_store (gwdata, gd->hi, diff);
+}
+
+/* Compute g = g * mult + addin mod N */
+
+void gwgmp_smallop (
+        gwhandle *gwdata,       /* Handle initialized by gwsetup */
+        double  addin,          /* Small value to add */
+        double  mult,           /* Small value to multiply by */
+        gwnum   g)              /* Source and destination */
+{
+        struct gwgmp_data *gd = (struct gwgmp_data *) gwdata->gmp_data;
+        mpz_t   v;
+
+        gwgmp_view (gwdata, g, v);
+        mpz_set_d (gd->q, mult);
+        mpz_mul (gd->prod, v, gd->q);
+        mpz_set_d (gd->q, addin);
+        mpz_add (gd->prod, gd->prod, gd->q);
+        gwgmp_reduce (gwdata, gd->prod);
+        gwgmp_store (gwdata, gd->prod, g);
+}
+
+void gwgmp_gianttogw (
+        gwhandle *gwdata,       /* Handle initialized by gwsetup */
+        giant   a,              /* Source, any size */
+        gwnum   g)              /* Destination */
+{
+        struct gwgmp_data *gd = (struct gwgmp_data *) gwdata->gmp_data;
+
+        gtompz (a, gd->prod);
+        gwgmp_reduce (gwdata, gd->prod);
+        gwgmp_store (gwdata, gd->prod, g);
+}
+
+void gwgmp_gwtogiant (
+        gwhandle *gwdata,       /* Handle initialized by gwsetup */
+        gwnum   g,              /* Source */
+        giant   v)              /* Destination */
+{
+        mpz_t   view;
+
+        gwgmp_view (gwdata, g, view);
+        mpztog (view, v);
+}
+
+#endif
@@ -156,6 +156,14 @@ void gwdone (
 #define gwset_hyperthread_prefetch(h)   ((h)->hyperthread_prefetching = TRUE)
 #define gwclear_hyperthread_prefetch(h) ((h)->hyperthread_prefetching = FALSE)
 
+/* Prior to calling one of the gwsetup routines, you can tell the library the compute threads span several NUMA nodes. */
+/* Pass 1 and pass 2 blocks are then statically partitioned by node rather than handed out from one shared counter. */
+/* The map gives the node (0 to n-1) of each of the num_threads compute threads.  The library copies the map during gwsetup. */
+/* Each node gets a share of the blocks proportional to its number of threads.  A thread that exhausts its node's blocks */
+/* steals from the end of the node with the most blocks remaining. */
+
+#define gwset_numa_nodes(h,n,map)       ((h)->numa_nodes = n, (h)->numa_map = map)
+
 /* Specify a call back routine for the auxiliary threads to call when they */
 /* are created.  This lets the user of the gwnum library set the thread */
 /* priority and affinity as it sees fit.  You can also specify an arbitrary */
@@ -281,6 +289,23 @@ void gwdone (
 /* Only choose a specific FFT size if you know what you are doing!! */
 #define gwset_specific_fftlen(h,n)      ((h)->minimum_fftlen = n)
 
+/* Prior to calling gwsetup, you can let the library handle k*2^n+c numbers */
+/* that are too large for our FFTs.  Rather than return GWERROR_TOO_LARGE, */
+/* gwsetup will have GMP do the math using mpz_mul followed by a shift/add */
+/* reduction modulo k*2^n+c.  This is 10 to 30 times slower than an FFT of the */
+/* same size (QA exponent 9961 in prime95 measures this), but callers keep */
+/* using gwsquare2, gwmul, etc.  A value of 2 uses GMP even when an FFT */
+/* would work, which is only useful for testing and timing. */
+/* Only the multiply, add/sub, copy, small constant, and conversion routines */
+/* (and those built on them) are supported.  Gwsetaddin and partial FFTs are */
+/* not supported.  Gwstartnextfft and round off checking do nothing. */
+/* The fallback is only built when gwnum.c is compiled with GW_GMP_FALLBACK */
+/* defined, which also makes the gwnum library depend on GMP.  Otherwise this */
+/* setting is ignored and too large numbers get GWERROR_TOO_LARGE as before. */
+
+#define gwset_gmp_fallback(h,n)         ((h)->gmp_fallback = (char) (n))
+#define gw_using_gmp(h)                 ((h)->GMP_MOD)
+
 /*---------------------------------------------------------------------+
 |                     GWNUM MEMORY ALLOCATION ROUTINES                 |
 +---------------------------------------------------------------------*/
@@ -612,6 +637,21 @@ int gwiszero (gwhandle *, gwnum);
 
 int gwequal (gwhandle *, gwnum, gwnum);
 
+/* Compute a 64-bit fingerprint of a gwnum without converting it to binary.  Equal values */
+/* have equal fingerprints, and unequal values almost always have different fingerprints. */
+/* The value can optionally be rotated right by a shift count (Mersenne numbers only) so */
+/* that values with different shift counts can be compared.  Returns TRUE if the fingerprint */
+/* was computed, FALSE if the caller must do a full conversion (unsupported modulus or an */
+/* ambiguous reduction -- zero always returns FALSE), and a negative error code if a */
+/* problem is found. */
+
+int gwfingerprint (gwhandle *, gwnum, unsigned long, uint64_t *);
+
+/* Fingerprint two gwnums in one pass over the FFT data.  Returns TRUE only if both */
+/* fingerprints were computed.  Roughly half the cost of two gwfingerprint calls. */
+
+int gwfingerprint2 (gwhandle *, gwnum, unsigned long, gwnum, unsigned long, uint64_t *, uint64_t *);
+
 /*---------------------------------------------------------------------+
 |                      GWNUM ERROR-CHECKING ROUTINES                   |
 +---------------------------------------------------------------------*/
@@ -679,6 +719,12 @@ unsigned long gwnum_datasize (gwhandle *);
 
 unsigned long gwnum_size (gwhandle *);
 
+/* Get a value identifying the layout of a gwnum's raw FFT data.  Raw data */
+/* can only be copied between gwnums whose handles return the same value. */
+/* Programs that save FFTed data to disk use this to validate it on reload. */
+
+unsigned long gwnum_layout_id (gwhandle *);
+
 /* Get the fixed amount of memory allocated during gwsetup.  Programs can */
 /* use this and gwnum_size to determine working set size and act accordingly.*/
 unsigned long gwmemused (gwhandle *);
@@ -872,6 +918,15 @@ struct pass1_carry_sections {
                                         /* processing of its first block to propagate carries into */
 };
 
+/* Structure for maintaining the unassigned blocks of one NUMA node when */
+/* pass 1 and pass 2 blocks are partitioned by node. */
+
+struct numa_block_range {
+        unsigned long next_block;       /* First unassigned block */
+        unsigned long last_block;       /* End of the unassigned blocks */
+        unsigned long num_threads;      /* Number of compute threads on this node */
+};
+
 /* The FFT types currently implemented in assembly code */
 
 #define FFT_TYPE_HOME_GROWN             0
@@ -903,7 +958,8 @@ struct gwhandle_struct {
         char    use_benchmarks;         /* Use benchmark data in gwnum.txt to select fastest FFT implementations */
         char    will_hyperthread;       /* Set if FFTs will use hyperthreading (affects select fastest FFT implementation) */
         char    will_error_check;       /* Set if FFTs will error check (affects select fastest FFT implementation) */
-        char    unused_setup_flags[3];
+        char    gmp_fallback;           /* Have GMP do the math for numbers too large for our FFTs (see gwset_gmp_fallback) */
+        char    unused_setup_flags[2];
         int     bench_num_cores;        /* Set to expected number of cores that will FFT (affects select fastest FFT implementation) */
         int     bench_num_workers;      /* Set to expected number of workers that will FFT (affects select fastest FFT implementation) */
         /* End of variables affecting gwsetup */
@@ -923,7 +979,8 @@ struct gwhandle_struct {
         char    GENERAL_MOD;            /* True if doing general-purpose mod as defined in gwsetup_general_mod */
         char    NO_PREFETCH_FFT;        /* True if this FFT does no prefetching */
         char    IN_PLACE_FFT;           /* True if this FFT is in-place (no scratch area) */
-        char    UNUSED_CHARS[1];
+        char    ZERO_UPPER;             /* True if we clear the upper YMM/ZMM state after calling the assembly code */
+        char    GMP_MOD;                /* True if GMP rather than an FFT does the math (see gwset_gmp_fallback) */
         int     FFT_TYPE;               /* Home-grown, Radix-4, etc. */
         int     ARCH;                   /* Architecture.  Which CPU type the FFT is optimized for. */
         void    (*GWPROCPTRS[16])(void*); /* Ptrs to assembly routines */
@@ -1008,6 +1065,11 @@ struct gwhandle_struct {
         double  ZPAD_COPY7_ADJUST[7];   /* Adjustments for copying the 7 words around the halfway point of a zero pad FFT. */
         double  ZPAD_0_6_ADJUST[7];     /* Adjustments for ZPAD0_6 in a r4dwpn FFT */
         unsigned long wpn_count;        /* Count of r4dwpn pass 1 blocks that use the same ttp/ttmp grp multipliers */
+        int     numa_nodes;             /* Number of NUMA nodes the compute threads span (see gwset_numa_nodes) */
+        int     *numa_map;              /* Caller's map of compute threads to NUMA nodes (see gwset_numa_nodes) */
+        int     *numa_thread_node;      /* Our copy of numa_map */
+        struct numa_block_range *numa_ranges; /* Unassigned blocks for each NUMA node.  NULL if not partitioning by node. */
+        void    *gmp_data;              /* The modulus and temporaries used when GMP_MOD is set */
 };
 
 /* A psuedo declaration for our big numbers.  The actual pointers to */
@@ -176,11 +176,7 @@ double *zr4dwpn_build_pass1_table (
                         weights = table;
                         inverse_weights = weights + gwdata->PASS1_CACHE_LINES;
                         table = inverse_weights + gwdata->PASS1_CACHE_LINES;
-                        for (i = 0; i < gwdata->PASS1_CACHE_LINES; i++) {
-                                gwfft_weights3 (gwdata->dd_data, group + i, weights, NULL, inverse_weights);
-                                weights++;
-                                inverse_weights++;
-                        }
+                        gwfft_weights3_run (gwdata->dd_data, group, gwdata->PASS1_CACHE_LINES, weights, NULL, inverse_weights);
                 }
 
 /* Output the complex sin/cos values needed for a standard zr8sg_eight_complex_djbfft */
@@ -189,14 +185,7 @@ double *zr4dwpn_build_pass1_table (
                 for (i = 0; i < gwdata->PASS1_CACHE_LINES; i += 8) {
                         // Asm code swizzles the input so that upper_avx512_word is 1
                         temp = group + i;
-                        gwsincos1234by8_raw (temp, N, table);
-                        gwsincos1234by8_raw (temp + 1, N, table+1);
-                        gwsincos1234by8_raw (temp + 2, N, table+2);
-                        gwsincos1234by8_raw (temp + 3, N, table+3);
-                        gwsincos1234by8_raw (temp + 4, N, table+4);
-                        gwsincos1234by8_raw (temp + 5, N, table+5);
-                        gwsincos1234by8_raw (temp + 6, N, table+6);
-                        gwsincos1234by8_raw (temp + 7, N, table+7);
+                        gwsincos1234by8_raw_run (temp, 1, N, table, 8);
                         table += 64;
                 }
 
@@ -208,14 +197,7 @@ double *zr4dwpn_build_pass1_table (
 //bug - would gwsincos1357by8 work here?  If not, why not.
                                 // Asm code swizzles the input so that upper_avx512_word is 1
                                 temp = group + i;
-                                gwsincos159Dby8 (temp, N*2, table);
-                                gwsincos159Dby8 (temp + 1, N*2, table+1);
-                                gwsincos159Dby8 (temp + 2, N*2, table+2);
-                                gwsincos159Dby8 (temp + 3, N*2, table+3);
-                                gwsincos159Dby8 (temp + 4, N*2, table+4);
-                                gwsincos159Dby8 (temp + 5, N*2, table+5);
-                                gwsincos159Dby8 (temp + 6, N*2, table+6);
-                                gwsincos159Dby8 (temp + 7, N*2, table+7);
+                                gwsincos159Dby8_run (temp, 1, N*2, table, 8);
                                 table += 64;
                         }
                 }
@@ -275,28 +257,14 @@ double *zr4dwpn_build_pass1_table (
                         for (j = 0; j < N / 12; j += pass1_increment) {
                                 for (i = 0; i < gwdata->PASS1_CACHE_LINES; i++) {
                                         temp = (group + j + i);
-                                        gwsincos123456by8 (temp, N, table);
-                                        gwsincos123456by8 (temp + upper_avx512_word, N, table+1);
-                                        gwsincos123456by8 (temp + 2 * upper_avx512_word, N, table+2);
-                                        gwsincos123456by8 (temp + 3 * upper_avx512_word, N, table+3);
-                                        gwsincos123456by8 (temp + 4 * upper_avx512_word, N, table+4);
-                                        gwsincos123456by8 (temp + 5 * upper_avx512_word, N, table+5);
-                                        gwsincos123456by8 (temp + 6 * upper_avx512_word, N, table+6);
-                                        gwsincos123456by8 (temp + 7 * upper_avx512_word, N, table+7);
+                                        gwsincos123456by8_run (temp, upper_avx512_word, N, table, 8);
                                         table += 96;
 
 /* The zr12_csc_twentyfour_real building blocks require extra sin/cos values.  The twentyfour_real doubles N */
 /* because the real part of the FFT is one level behind the complex part of the FFT. */
 
                                         if (!gwdata->ALL_COMPLEX_FFT) {
-                                                gwsincos13579Bby8 (temp, N*2, table);
-                                                gwsincos13579Bby8 (temp + upper_avx512_word, N*2, table+1);
-                                                gwsincos13579Bby8 (temp + 2 * upper_avx512_word, N*2, table+2);
-                                                gwsincos13579Bby8 (temp + 3 * upper_avx512_word, N*2, table+3);
-                                                gwsincos13579Bby8 (temp + 4 * upper_avx512_word, N*2, table+4);
-                                                gwsincos13579Bby8 (temp + 5 * upper_avx512_word, N*2, table+5);
-                                                gwsincos13579Bby8 (temp + 6 * upper_avx512_word, N*2, table+6);
-                                                gwsincos13579Bby8 (temp + 7 * upper_avx512_word, N*2, table+7);
+                                                gwsincos13579Bby8_run (temp, upper_avx512_word, N*2, table, 8);
                                                 table += 96;
                                         }
                                 }
@@ -314,28 +282,14 @@ double *zr4dwpn_build_pass1_table (
                         for (j = 0; j < N / 10; j += pass1_increment) {
                                 for (i = 0; i < gwdata->PASS1_CACHE_LINES; i++) {
                                         temp = (group + j + i);
-                                        gwsincos12345by8 (temp, N, table);
-                                        gwsincos12345by8 (temp + upper_avx512_word, N, table+1);
-                                        gwsincos12345by8 (temp + 2 * upper_avx512_word, N, table+2);
-                                        gwsincos12345by8 (temp + 3 * upper_avx512_word, N, table+3);
-                                        gwsincos12345by8 (temp + 4 * upper_avx512_word, N, table+4);
-                                        gwsincos12345by8 (temp + 5 * upper_avx512_word, N, table+5);
-                                        gwsincos12345by8 (temp + 6 * upper_avx512_word, N, table+6);
-                                        gwsincos12345by8 (temp + 7 * upper_avx512_word, N, table+7);
+                                        gwsincos12345by8_run (temp, upper_avx512_word, N, table, 8);
                                         table += 80;
 
 /* The zr10_csc_twenty_real building blocks require extra sin/cos values.  The twenty_real doubles N */
 /* because the real part of the FFT is one level behind the complex part of the FFT. */
 
                                         if (!gwdata->ALL_COMPLEX_FFT) {
-                                                gwsincos13579by8 (temp, N*2, table);
-                                                gwsincos13579by8 (temp + upper_avx512_word, N*2, table+1);
-                                                gwsincos13579by8 (temp + 2 * upper_avx512_word, N*2, table+2);
-                                                gwsincos13579by8 (temp + 3 * upper_avx512_word, N*2, table+3);
-                                                gwsincos13579by8 (temp + 4 * upper_avx512_word, N*2, table+4);
-                                                gwsincos13579by8 (temp + 5 * upper_avx512_word, N*2, table+5);
-                                                gwsincos13579by8 (temp + 6 * upper_avx512_word, N*2, table+6);
-                                                gwsincos13579by8 (temp + 7 * upper_avx512_word, N*2, table+7);
+                                                gwsincos13579by8_run (temp, upper_avx512_word, N*2, table, 8);
                                                 table += 80;
                                         }
                                 }
@@ -353,28 +307,14 @@ double *zr4dwpn_build_pass1_table (
                         for (j = 0; j < N / 5; j += pass1_increment) {
                                 for (i = 0; i < gwdata->PASS1_CACHE_LINES; i++) {
                                         temp = (group + j + i);
-                                        gwsincos12by8 (temp, N, table);
-                                        gwsincos12by8 (temp + upper_avx512_word, N, table+1);
-                                        gwsincos12by8 (temp + 2 * upper_avx512_word, N, table+2);
-                                        gwsincos12by8 (temp + 3 * upper_avx512_word, N, table+3);
-                                        gwsincos12by8 (temp + 4 * upper_avx512_word, N, table+4);
-                                        gwsincos12by8 (temp + 5 * upper_avx512_word, N, table+5);
-                                        gwsincos12by8 (temp + 6 * upper_avx512_word, N, table+6);
-                                        gwsincos12by8 (temp + 7 * upper_avx512_word, N, table+7);
+                                        gwsincos12by8_run (temp, upper_avx512_word, N, table, 8);
                                         table += 32;
 
 /* The zr5_csc_ten_real building blocks require extra sin/cos values.  The ten_real doubles N */
 /* because the real part of the FFT is one level behind the complex part of the FFT. */
 
                                         if (!gwdata->ALL_COMPLEX_FFT) {
-                                                gwsincos13by8 (temp, N*2, table);
-                                                gwsincos13by8 (temp + upper_avx512_word, N*2, table+1);
-                                                gwsincos13by8 (temp + 2 * upper_avx512_word, N*2, table+2);
-                                                gwsincos13by8 (temp + 3 * upper_avx512_word, N*2, table+3);
-                                                gwsincos13by8 (temp + 4 * upper_avx512_word, N*2, table+4);
-                                                gwsincos13by8 (temp + 5 * upper_avx512_word, N*2, table+5);
-                                                gwsincos13by8 (temp + 6 * upper_avx512_word, N*2, table+6);
-                                                gwsincos13by8 (temp + 7 * upper_avx512_word, N*2, table+7);
+                                                gwsincos13by8_run (temp, upper_avx512_word, N*2, table, 8);
                                                 table += 32;
                                         }
                                 }
@@ -392,28 +332,14 @@ double *zr4dwpn_build_pass1_table (
                         for (j = 0; j < N / 6; j += pass1_increment) {
                                 for (i = 0; i < gwdata->PASS1_CACHE_LINES; i++) {
                                         temp = (group + j + i);
-                                        gwsincos123by8 (temp, N, table);
-                                        gwsincos123by8 (temp + upper_avx512_word, N, table+1);
-                                        gwsincos123by8 (temp + 2 * upper_avx512_word, N, table+2);
-                                        gwsincos123by8 (temp + 3 * upper_avx512_word, N, table+3);
-                                        gwsincos123by8 (temp + 4 * upper_avx512_word, N, table+4);
-                                        gwsincos123by8 (temp + 5 * upper_avx512_word, N, table+5);
-                                        gwsincos123by8 (temp + 6 * upper_avx512_word, N, table+6);
-                                        gwsincos123by8 (temp + 7 * upper_avx512_word, N, table+7);
+                                        gwsincos123by8_run (temp, upper_avx512_word, N, table, 8);
                                         table += 48;
 
 /* The zr6_csc_twelve_real building blocks require extra sin/cos values.  The twelve_real doubles N */
 /* because the real part of the FFT is one level behind the complex part of the FFT. */
 
                                         if (!gwdata->ALL_COMPLEX_FFT) {
-                                                gwsincos135by8 (temp, N*2, table);
-                                                gwsincos135by8 (temp + upper_avx512_word, N*2, table+1);
-                                                gwsincos135by8 (temp + 2 * upper_avx512_word, N*2, table+2);
-                                                gwsincos135by8 (temp + 3 * upper_avx512_word, N*2, table+3);
-                                                gwsincos135by8 (temp + 4 * upper_avx512_word, N*2, table+4);
-                                                gwsincos135by8 (temp + 5 * upper_avx512_word, N*2, table+5);
-                                                gwsincos135by8 (temp + 6 * upper_avx512_word, N*2, table+6);
-                                                gwsincos135by8 (temp + 7 * upper_avx512_word, N*2, table+7);
+                                                gwsincos135by8_run (temp, upper_avx512_word, N*2, table, 8);
                                                 table += 48;
                                         }
                                 }
@@ -471,28 +397,14 @@ double *zr4dwpn_build_pass1_table (
                         for (j = 0; j < N / 16; j += pass1_increment) {
                                 for (i = 0; i < gwdata->PASS1_CACHE_LINES; i++) {
                                         temp = (group + j + i);
-                                        gwsincos12345678by8 (temp, N, table);
-                                        gwsincos12345678by8 (temp + upper_avx512_word, N, table+1);
-                                        gwsincos12345678by8 (temp + 2 * upper_avx512_word, N, table+2);
-                                        gwsincos12345678by8 (temp + 3 * upper_avx512_word, N, table+3);
-                                        gwsincos12345678by8 (temp + 4 * upper_avx512_word, N, table+4);
-                                        gwsincos12345678by8 (temp + 5 * upper_avx512_word, N, table+5);
-                                        gwsincos12345678by8 (temp + 6 * upper_avx512_word, N, table+6);
-                                        gwsincos12345678by8 (temp + 7 * upper_avx512_word, N, table+7);
+                                        gwsincos12345678by8_run (temp, upper_avx512_word, N, table, 8);
                                         table += 128;
 
 /* The zr16_csc_thirtytwo_real building blocks require extra sin/cos values.  The thirtytwo_real doubles N */
 /* because the real part of the FFT is one level behind the complex part of the FFT. */
 
                                         if (!gwdata->ALL_COMPLEX_FFT) {
-                                                gwsincos13579BDFby8 (temp, N*2, table);
-                                                gwsincos13579BDFby8 (temp + upper_avx512_word, N*2, table+1);
-                                                gwsincos13579BDFby8 (temp + 2 * upper_avx512_word, N*2, table+2);
-                                                gwsincos13579BDFby8 (temp + 3 * upper_avx512_word, N*2, table+3);
-                                                gwsincos13579BDFby8 (temp + 4 * upper_avx512_word, N*2, table+4);
-                                                gwsincos13579BDFby8 (temp + 5 * upper_avx512_word, N*2, table+5);
-                                                gwsincos13579BDFby8 (temp + 6 * upper_avx512_word, N*2, table+6);
-                                                gwsincos13579BDFby8 (temp + 7 * upper_avx512_word, N*2, table+7);
+                                                gwsincos13579BDFby8_run (temp, upper_avx512_word, N*2, table, 8);
                                                 table += 128;
                                         }
                                 }
@@ -510,14 +422,7 @@ double *zr4dwpn_build_pass1_table (
                         for (j = 0; j < N / 8; j += pass1_increment) {
                                 for (i = 0; i < gwdata->PASS1_CACHE_LINES; i++) {
                                         temp = (group + j + i);
-                                        gwsincos1234by8 (temp, N, table);
-                                        gwsincos1234by8 (temp + upper_avx512_word, N, table+1);
-                                        gwsincos1234by8 (temp + 2 * upper_avx512_word, N, table+2);
-                                        gwsincos1234by8 (temp + 3 * upper_avx512_word, N, table+3);
-                                        gwsincos1234by8 (temp + 4 * upper_avx512_word, N, table+4);
-                                        gwsincos1234by8 (temp + 5 * upper_avx512_word, N, table+5);
-                                        gwsincos1234by8 (temp + 6 * upper_avx512_word, N, table+6);
-                                        gwsincos1234by8 (temp + 7 * upper_avx512_word, N, table+7);
+                                        gwsincos1234by8_run (temp, upper_avx512_word, N, table, 8);
 #ifdef TRY_SQRT2_TO_REDUCE_ROUNDOFF
 {
         gwsincos1234by8_sqrthalf (temp, N, table);
@@ -536,14 +441,7 @@ double *zr4dwpn_build_pass1_table (
 /* because the real part of the FFT is one level behind the complex part of the FFT. */
 
                                         if (!gwdata->ALL_COMPLEX_FFT) {
-                                                gwsincos1357by8 (temp, N*2, table);
-                                                gwsincos1357by8 (temp + upper_avx512_word, N*2, table+1);
-                                                gwsincos1357by8 (temp + 2 * upper_avx512_word, N*2, table+2);
-                                                gwsincos1357by8 (temp + 3 * upper_avx512_word, N*2, table+3);
-                                                gwsincos1357by8 (temp + 4 * upper_avx512_word, N*2, table+4);
-                                                gwsincos1357by8 (temp + 5 * upper_avx512_word, N*2, table+5);
-                                                gwsincos1357by8 (temp + 6 * upper_avx512_word, N*2, table+6);
-                                                gwsincos1357by8 (temp + 7 * upper_avx512_word, N*2, table+7);
+                                                gwsincos1357by8_run (temp, upper_avx512_word, N*2, table, 8);
                                                 table += 64;
                                         }
                                 }
@@ -2040,10 +1938,7 @@ double *yr4dwpn_build_pass1_table (
                         for (i = 0; i < gwdata->PASS1_CACHE_LINES; i += 4) {
                                 // Asm code swizzled the input so that upper_avx_word is 1
                                 temp = group + i;
-                                gwsincos1234by4_raw (temp, N, table);
-                                gwsincos1234by4_raw (temp + 1, N, table+1);
-                                gwsincos1234by4_raw (temp + 2, N, table+2);
-                                gwsincos1234by4_raw (temp + 3, N, table+3);
+                                gwsincos1234by4_raw_run (temp, 1, N, table, 4);
                                 table += 32;
                         }
 
@@ -2054,10 +1949,7 @@ double *yr4dwpn_build_pass1_table (
                                 for (i = 0; i < gwdata->PASS1_CACHE_LINES; i += 4) {
                                         // Asm code swizzled the input so that upper_avx_word is 1
                                         temp = group + i;
-                                        gwsincos159Dby4 (temp, N*2, table);
-                                        gwsincos159Dby4 (temp + 1, N*2, table+1);
-                                        gwsincos159Dby4 (temp + 2, N*2, table+2);
-                                        gwsincos159Dby4 (temp + 3, N*2, table+3);
+                                        gwsincos159Dby4_run (temp, 1, N*2, table, 4);
                                         table += 32;
                                 }
                         }
@@ -2204,10 +2096,7 @@ double *yr4dwpn_build_pass1_table (
                         for (i = 0; i < gwdata->PASS1_CACHE_LINES; i += 4) {
                                 // Asm code swizzled the input so that upper_avx_word is 1
                                 temp = group + i;
-                                gwsincos12by4_raw (temp, N, table);
-                                gwsincos12by4_raw (temp + 1, N, table+1);
-                                gwsincos12by4_raw (temp + 2, N, table+2);
-                                gwsincos12by4_raw (temp + 3, N, table+3);
+                                gwsincos12by4_raw_run (temp, 1, N, table, 4);
                                 table += 16;
                         }
 
@@ -2219,10 +2108,7 @@ double *yr4dwpn_build_pass1_table (
                                 for (i = 0; i < gwdata->PASS1_CACHE_LINES; i += 4) {
                                         // Asm code swizzled the input so that upper_avx_word is 1
                                         temp = group + i;
-                                        gwsincos15by4 (temp, N*2, table);
-                                        gwsincos15by4 (temp + 1, N*2, table+1);
-                                        gwsincos15by4 (temp + 2, N*2, table+2);
-                                        gwsincos15by4 (temp + 3, N*2, table+3);
+                                        gwsincos15by4_run (temp, 1, N*2, table, 4);
                                         table += 16;
                                 }
                         }
@@ -2373,10 +2259,7 @@ double *yr4dwpn_build_pass1_table (
                                 for (i = 0; i < gwdata->PASS1_CACHE_LINES; i += 4) {
                                         // Asm code swizzled the input so that upper_avx_word is 1
                                         temp = group + i;
-                                        gwsincos159Dby4 (temp, N*2, table);
-                                        gwsincos159Dby4 (temp + 1, N*2, table+1);
-                                        gwsincos159Dby4 (temp + 2, N*2, table+2);
-                                        gwsincos159Dby4 (temp + 3, N*2, table+3);
+                                        gwsincos159Dby4_run (temp, 1, N*2, table, 4);
                                         table += 32;
                                 }
                         }
@@ -2473,10 +2356,7 @@ double *yr4dwpn_build_pass1_table (
                                 for (i = 0; i < gwdata->PASS1_CACHE_LINES; i += 4) {
                                         // Asm code swizzled the input so that upper_avx_word is 1
                                         temp = group + i;
-                                        gwsincos15by4 (temp, N*2, table);
-                                        gwsincos15by4 (temp + 1, N*2, table+1);
-                                        gwsincos15by4 (temp + 2, N*2, table+2);
-                                        gwsincos15by4 (temp + 3, N*2, table+3);
+                                        gwsincos15by4_run (temp, 1, N*2, table, 4);
                                         table += 16;
                                 }
                         }
@@ -2606,10 +2486,7 @@ double *yr4dwpn_build_pass1_table (
                                 for (j = 0; j < N / 4; j += pass1_increment) {
                                     for (i = 0; i < gwdata->PASS1_CACHE_LINES; i++) {
                                         temp = (group + j + i);
-                                        gwsincos12by4 (temp, N, table);
-                                        gwsincos12by4 (temp + upper_avx_word, N, table+1);
-                                        gwsincos12by4 (temp + 2 * upper_avx_word, N, table+2);
-                                        gwsincos12by4 (temp + 3 * upper_avx_word, N, table+3);
+                                        gwsincos12by4_run (temp, upper_avx_word, N, table, 4);
                                         table += 16;
 
 /* For the yr4_4cl_csc_eight_reals_fft building block levels, output the extra */
@@ -2617,10 +2494,7 @@ double *yr4dwpn_build_pass1_table (
 /* the real part of the FFT is one level behind the complex part of the FFT. */
 
                                         if (!gwdata->ALL_COMPLEX_FFT) {
-                                                gwsincos15by4 (temp, N*2, table);
-                                                gwsincos15by4 (temp + upper_avx_word, N*2, table+1);
-                                                gwsincos15by4 (temp + 2 * upper_avx_word, N*2, table+2);
-                                                gwsincos15by4 (temp + 3 * upper_avx_word, N*2, table+3);
+                                                gwsincos15by4_run (temp, upper_avx_word, N*2, table, 4);
                                                 table += 16;
                                         }
 
@@ -2679,20 +2553,14 @@ double *yr4dwpn_build_pass1_table (
                         for (j = 0; j < N / 5; j += pass1_increment) {
                                 for (i = 0; i < gwdata->PASS1_CACHE_LINES; i++) {
                                         temp = (group + j + i);
-                                        gwsincos12by4 (temp, N, table);
-                                        gwsincos12by4 (temp + upper_avx_word, N, table+1);
-                                        gwsincos12by4 (temp + 2 * upper_avx_word, N, table+2);
-                                        gwsincos12by4 (temp + 3 * upper_avx_word, N, table+3);
+                                        gwsincos12by4_run (temp, upper_avx_word, N, table, 4);
                                         table += 16;
 
 /* The yr5_5cl_csc_ten_reals building blocks require extra sin/cos values.  The ten_reals doubles N */
 /* because the real part of the FFT is one level behind the complex part of the FFT. */
 
                                         if (!gwdata->ALL_COMPLEX_FFT) {
-                                                gwsincos13by4 (temp, N*2, table);
-                                                gwsincos13by4 (temp + upper_avx_word, N*2, table+1);
-                                                gwsincos13by4 (temp + 2 * upper_avx_word, N*2, table+2);
-                                                gwsincos13by4 (temp + 3 * upper_avx_word, N*2, table+3);
+                                                gwsincos13by4_run (temp, upper_avx_word, N*2, table, 4);
                                                 table += 16;
                                         }
                                 }
@@ -2710,20 +2578,14 @@ double *yr4dwpn_build_pass1_table (
                         for (j = 0; j < N / 3; j += pass1_increment) {
                                 for (i = 0; i < gwdata->PASS1_CACHE_LINES; i++) {
                                         temp = (group + j + i);
-                                        gwsincos1by4 (temp, N, table);
-                                        gwsincos1by4 (temp + upper_avx_word, N, table+1);
-                                        gwsincos1by4 (temp + 2 * upper_avx_word, N, table+2);
-                                        gwsincos1by4 (temp + 3 * upper_avx_word, N, table+3);
+                                        gwsincos1by4_run (temp, upper_avx_word, N, table, 4);
                                         table += 8;
 
 /* The yr3_3cl_csc_six_reals building blocks require an extra sin/cos value.  The six_reals doubles N */
 /* because the real part of the FFT is one level behind the complex part of the FFT. */
 
                                         if (!gwdata->ALL_COMPLEX_FFT) {
-                                                gwsincos1by4 (temp, N*2, table);
-                                                gwsincos1by4 (temp + upper_avx_word, N*2, table+1);
-                                                gwsincos1by4 (temp + 2 * upper_avx_word, N*2, table+2);
-                                                gwsincos1by4 (temp + 3 * upper_avx_word, N*2, table+3);
+                                                gwsincos1by4_run (temp, upper_avx_word, N*2, table, 4);
                                                 table += 8;
                                         }
                                 }
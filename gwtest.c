@@ -3,8 +3,14 @@
 |
 | This file contains routines to QA the gwnum FFT routines.
 | QA can be activated by using Advanced/Time menu choice on exponent 9900.
+| Exponents 9940 through 9959 run the parallel QA sweep of every FFT
+| implementation.  Exponent 9960 compares the sin/cos and weights tables
+| built a column at a time with those built by the faster _run routines.
+| Exponent 9961 checks and times the GMP fallback against our FFTs.
 +---------------------------------------------------------------------*/
 
+#include "gwdbldbl.h"
+
 /* TODO: test larger values of mul-by-const */
 /*      all_impl should work on small ffts by using the next large fft size */
 /*              to do the comparison (and/or x87) */
@@ -233,6 +239,178 @@ void set_seed (
 //      OutputBoth (thread_num, buf);
 }
 
+/* Run the standard set of gwnum operations on one FFT implementation. */
+/* The starting value is in g, the final value is returned in result. */
+/* Returns zero on success, GWERROR_MALLOC if we ran out of memory, or one */
+/* if GWERROR or the SUM(INPUTS) != SUM(OUTPUTS) check failed. */
+/* Used by both test_it_all and the parallel QA sweep. */
+
+int test_one_impl (
+        int     thread_num,             /* Worker thread number */
+        gwhandle *gwdata,               /* Handle already setup for the implementation to test */
+        giant   g,                      /* Starting value */
+        giant   result,                 /* Returned final value */
+        double  *maxerr)                /* Returned maximum roundoff error */
+{
+        gwnum   x, x2, x3, x4;
+        int     i, num_squarings, failed;
+        double  diff, maxdiff;
+        char    buf[256];
+
+        num_squarings = IniSectionGetInt (INI_FILE, "QA", "NUM_SQUARINGS", 50);
+
+/* Alloc and init numbers */
+
+        x = gwalloc (gwdata);
+        if (x == NULL) return (GWERROR_MALLOC);
+        x2 = gwalloc (gwdata);
+        if (x2 == NULL) return (GWERROR_MALLOC);
+        x3 = gwalloc (gwdata);
+        if (x3 == NULL) return (GWERROR_MALLOC);
+        x4 = gwalloc (gwdata);
+        if (x4 == NULL) return (GWERROR_MALLOC);
+        gianttogw (gwdata, g, x);
+
+/* Test 50 squarings */
+
+        gwcopy (gwdata, x, x2);
+        maxdiff = 0.0;
+        gwsetnormroutine (gwdata, 0, 1, 0); /* Enable error checking */
+        for (i = 0; i < num_squarings; i++) {
+
+                /* Test POSTFFT sometimes */
+                gwstartnextfft (gwdata, (i & 3) == 2);
+
+                /* Test gwsetaddin without and with POSTFFT set */
+                if ((i == 45 || i == 46) && labs (gwdata->c) == 1)
+                        gwsetaddin (gwdata, -31);
+
+                /* Test several different ways to square a number */
+                if (i >= 4 && i <= 7) {
+                        gwfft (gwdata, x, x);
+                        gwfftfftmul (gwdata, x, x, x);
+                } else if (i >= 12 && i <= 15) {
+                        gwfft (gwdata, x, x3);
+                        gwfftmul (gwdata, x3, x);
+                } else if (i >= 20 && i <= 23) {
+                        gwfft (gwdata, x, x3);
+                        gwcopy (gwdata, x3, x4);
+                        gwfftfftmul (gwdata, x3, x4, x);
+                } else
+                        gwsquare (gwdata, x);
+
+                /* Remember maximum difference */
+                diff = fabs (gwsuminp (gwdata, x) - gwsumout (gwdata, x));
+                if (diff > maxdiff) maxdiff = diff;
+                if ((i == 45 || i == 46) && labs (gwdata->c) == 1)
+                        gwsetaddin (gwdata, 0);
+        }
+        if (gwdata->MAXDIFF < 1e50)
+                sprintf (buf, "Squares complete. MaxErr=%.8g, SumoutDiff=%.8g/%.8g(%d to 1)\n", gw_get_maxerr (gwdata), maxdiff, gwdata->MAXDIFF, (int) (gwdata->MAXDIFF / maxdiff));
+        else
+                sprintf (buf, "Squares complete. MaxErr=%.10g\n", gw_get_maxerr (gwdata));
+        OutputBoth (thread_num, buf);
+
+/* Test mul by const */
+
+        gwsetmulbyconst (gwdata, 3);
+        gwsetnormroutine (gwdata, 0, 1, 1);
+        gwsquare (gwdata, x);
+        gwsetnormroutine (gwdata, 0, 1, 0);
+        diff = fabs (gwsuminp (gwdata, x) - gwsumout (gwdata, x));
+        if (diff > maxdiff) maxdiff = diff;
+
+/* Test square and mul carefully */
+
+        gwfree (gwdata, x3); gwfree (gwdata, x4);
+        if (labs (gwdata->c) == 1) gwsetaddin (gwdata, -42);
+        gwsquare_carefully (gwdata, x);
+        diff = fabs (gwsuminp (gwdata, x) - gwsumout (gwdata, x));
+        if (diff > maxdiff) maxdiff = diff;
+        gwmul_carefully (gwdata, x, x);
+        gwfree (gwdata, gwdata->GW_RANDOM); gwdata->GW_RANDOM = NULL;
+        diff = fabs (gwsuminp (gwdata, x) - gwsumout (gwdata, x));
+        if (diff > maxdiff) maxdiff = diff;
+        if (labs (gwdata->c) == 1) gwsetaddin (gwdata, 0);
+
+/* Test gwaddquick, gwsubquick */
+
+        x3 = gwalloc (gwdata); if (x3 == NULL) return (GWERROR_MALLOC);
+        x4 = gwalloc (gwdata); if (x4 == NULL) return (GWERROR_MALLOC);
+        gwadd3quick (gwdata, x, x2, x3);
+        gwsub3quick (gwdata, x, x2, x4);
+
+/* Test gwadd and gwsub */
+
+        gwadd (gwdata, x, x); gwadd (gwdata, x, x); gwadd (gwdata, x, x);
+        gwsub (gwdata, x3, x);
+        gwadd (gwdata, x4, x);
+        gwadd3 (gwdata, x3, x4, x2);
+        gwsub3 (gwdata, x3, x, x4);
+        gwadd (gwdata, x2, x);
+        gwadd (gwdata, x4, x);
+
+/* Test gwaddsub */
+
+        gwaddsub (gwdata, x, x2);       // compute x+x2 and x-x2
+        gwaddsub4 (gwdata, x, x2, x3, x4); // compute x+x2 and x-x2
+        gwadd (gwdata, x2, x);
+        gwadd (gwdata, x3, x);
+        gwadd (gwdata, x4, x);
+
+/* Test gwsmalladd and gwsmallmul */
+
+        gwsmalladd (gwdata, GWSMALLADD_MAX, x);
+        gwsmallmul (gwdata, GWSMALLMUL_MAX-1.0, x);
+
+/* Do some multiplies to make sure that the adds and subtracts above */
+/* normalized properly. */
+
+        gwfft (gwdata, x, x);
+        gwfftfftmul (gwdata, x, x, x);
+        diff = fabs (gwsuminp (gwdata, x) - gwsumout (gwdata, x));
+        if (diff > maxdiff) maxdiff = diff;
+
+        gwfft (gwdata, x, x2); gwcopy (gwdata, x2, x); gwfftadd3 (gwdata, x, x2, x4);
+        gwfftmul (gwdata, x4, x3);
+        diff = fabs (gwsuminp (gwdata, x3) - gwsumout (gwdata, x3));
+        if (diff > maxdiff) maxdiff = diff;
+        gwfft (gwdata, x3, x4);
+        gwfftfftmul (gwdata, x4, x2, x);
+        diff = fabs (gwsuminp (gwdata, x) - gwsumout (gwdata, x));
+        if (diff > maxdiff) maxdiff = diff;
+
+/* Print final stats */
+
+        failed = FALSE;
+        if (gwdata->GWERROR) {
+                OutputBoth (thread_num, "GWERROR set during calculations.\n");
+                failed = TRUE;
+        }
+        if (maxdiff > gwdata->MAXDIFF) {
+                OutputBoth (thread_num, "Sumout failed during test.\n");
+                failed = TRUE;
+        }
+        *maxerr = gw_get_maxerr (gwdata);
+        if (gwdata->MAXDIFF < 1e50)
+                sprintf (buf, "Test complete. MaxErr=%.8g, SumoutDiff=%.8g/%.8g(%d to 1)\n", *maxerr, maxdiff, gwdata->MAXDIFF, (int) (gwdata->MAXDIFF / maxdiff));
+        else
+                sprintf (buf, "Test complete. MaxErr=%.10g\n", *maxerr);
+        OutputBoth (thread_num, buf);
+
+/* Free some space (so that gwtogiant can use it for temporaries) */
+
+        gwfree (gwdata, x2);
+        gwfree (gwdata, x3);
+        gwfree (gwdata, x4);
+
+/* Return the final value */
+
+        gwtogiant (gwdata, x, result);
+        gwfree (gwdata, x);
+        return (failed);
+}
+
 /* Thoroughly test the current setup.  This is just like test_it except */
 /* that rather than using giants code to test the results, we compare */
 /* the final result to every possible FFT implementation for this FFT */
@@ -250,16 +428,15 @@ void test_it_all (
         int     threads)
 {
         gwhandle gwdata;
-        gwnum   x, x2, x3, x4;
+        gwnum   x;
         giant   g, g2, g3;
-        int     i, ii, res, nth_fft, num_squarings;
-        double  diff, maxdiff;
+        int     ii, res, nth_fft;
+        double  maxerr;
         char    buf[256], fft_desc[200];
 
 /* Init */
 
         g = g2 = g3 = NULL;
-        num_squarings = IniSectionGetInt (INI_FILE, "QA", "NUM_SQUARINGS", 50);
 
 /* Loop over both x87 and SSE2 implementations.  Pass 1 does x87 FFTs */
 /* on SSE2 machines.  Pass 2 does the SSE2 FFTs.  Pass 3 does AVX FFTs. */
@@ -303,159 +480,26 @@ void test_it_all (
                 sprintf (buf, "QA of %s using %s\n", gwmodulo_as_string (&gwdata), fft_desc);
                 OutputBoth (thread_num, buf);
 
-/* Alloc and init numbers */
-
-                x = gwalloc (&gwdata);
-                if (x == NULL) goto nomem;
-                x2 = gwalloc (&gwdata);
-                if (x2 == NULL) goto nomem;
-                x3 = gwalloc (&gwdata);
-                if (x3 == NULL) goto nomem;
-                x4 = gwalloc (&gwdata);
-                if (x4 == NULL) goto nomem;
+/* Generate the random starting value the first time through */
 
                 if (g == NULL) {
                         g = allocgiant (((unsigned long) gwdata.bit_length >> 5) + 10);
                         if (g == NULL) goto nomem;
+                        x = gwalloc (&gwdata);
+                        if (x == NULL) goto nomem;
                         gen_data (&gwdata, x, g);
-                } else
-                        gianttogw (&gwdata, g, x);
-
-/* Test 50 squarings */
-
-                gwcopy (&gwdata, x, x2);
-                maxdiff = 0.0;
-                gwsetnormroutine (&gwdata, 0, 1, 0); /* Enable error checking */
-                for (i = 0; i < num_squarings; i++) {
-
-                        /* Test POSTFFT sometimes */
-                        gwstartnextfft (&gwdata, (i & 3) == 2);
-
-                        /* Test gwsetaddin without and with POSTFFT set */
-                        if ((i == 45 || i == 46) && labs (c) == 1)
-                                gwsetaddin (&gwdata, -31);
-
-                        /* Test several different ways to square a number */
-                        if (i >= 4 && i <= 7) {
-                                gwfft (&gwdata, x, x);
-                                gwfftfftmul (&gwdata, x, x, x);
-                        } else if (i >= 12 && i <= 15) {
-                                gwfft (&gwdata, x, x3);
-                                gwfftmul (&gwdata, x3, x);
-                        } else if (i >= 20 && i <= 23) {
-                                gwfft (&gwdata, x, x3);
-                                gwcopy (&gwdata, x3, x4);
-                                gwfftfftmul (&gwdata, x3, x4, x);
-                        } else
-                                gwsquare (&gwdata, x);
-
-                        /* Remember maximum difference */
-                        diff = fabs (gwsuminp (&gwdata, x) - gwsumout (&gwdata, x));
-                        if (diff > maxdiff) maxdiff = diff;
-                        if ((i == 45 || i == 46) && labs (c) == 1)
-                                gwsetaddin (&gwdata, 0);
+                        gwfree (&gwdata, x);
                 }
-                if (gwdata.MAXDIFF < 1e50)
-                        sprintf (buf, "Squares complete. MaxErr=%.8g, SumoutDiff=%.8g/%.8g(%d to 1)\n", gw_get_maxerr (&gwdata), maxdiff, gwdata.MAXDIFF, (int) (gwdata.MAXDIFF / maxdiff));
-                else
-                        sprintf (buf, "Squares complete. MaxErr=%.10g\n", gw_get_maxerr (&gwdata));
-                OutputBoth (thread_num, buf);
 
-/* Test mul by const */
-
-                gwsetmulbyconst (&gwdata, 3);
-                gwsetnormroutine (&gwdata, 0, 1, 1);
-                gwsquare (&gwdata, x);
-                gwsetnormroutine (&gwdata, 0, 1, 0);
-                diff = fabs (gwsuminp (&gwdata, x) - gwsumout (&gwdata, x));
-                if (diff > maxdiff) maxdiff = diff;
-
-/* Test square and mul carefully */
-
-                gwfree (&gwdata, x3); gwfree (&gwdata, x4);
-                if (labs (c) == 1) gwsetaddin (&gwdata, -42);
-                gwsquare_carefully (&gwdata, x);
-                diff = fabs (gwsuminp (&gwdata, x) - gwsumout (&gwdata, x));
-                if (diff > maxdiff) maxdiff = diff;
-                gwmul_carefully (&gwdata, x, x);
-                gwfree (&gwdata, gwdata.GW_RANDOM); gwdata.GW_RANDOM = NULL;
-                diff = fabs (gwsuminp (&gwdata, x) - gwsumout (&gwdata, x));
-                if (diff > maxdiff) maxdiff = diff;
-                if (labs (c) == 1) gwsetaddin (&gwdata, 0);
-
-/* Test gwaddquick, gwsubquick */
-
-                x3 = gwalloc (&gwdata); if (x3 == NULL) goto nomem;
-                x4 = gwalloc (&gwdata); if (x4 == NULL) goto nomem;
-                gwadd3quick (&gwdata, x, x2, x3);
-                gwsub3quick (&gwdata, x, x2, x4);
-
-/* Test gwadd and gwsub */
-
-                gwadd (&gwdata, x, x); gwadd (&gwdata, x, x); gwadd (&gwdata, x, x);
-                gwsub (&gwdata, x3, x);
-                gwadd (&gwdata, x4, x);
-                gwadd3 (&gwdata, x3, x4, x2);
-                gwsub3 (&gwdata, x3, x, x4);
-                gwadd (&gwdata, x2, x);
-                gwadd (&gwdata, x4, x);
-
-/* Test gwaddsub */
-
-                gwaddsub (&gwdata, x, x2);      // compute x+x2 and x-x2
-                gwaddsub4 (&gwdata, x, x2, x3, x4); // compute x+x2 and x-x2
-                gwadd (&gwdata, x2, x);
-                gwadd (&gwdata, x3, x);
-                gwadd (&gwdata, x4, x);
-
-/* Test gwsmalladd and gwsmallmul */
-
-                gwsmalladd (&gwdata, GWSMALLADD_MAX, x);
-                gwsmallmul (&gwdata, GWSMALLMUL_MAX-1.0, x);
-
-/* Do some multiplies to make sure that the adds and subtracts above */
-/* normalized properly. */
-
-                gwfft (&gwdata, x, x);
-                gwfftfftmul (&gwdata, x, x, x);
-                diff = fabs (gwsuminp (&gwdata, x) - gwsumout (&gwdata, x));
-                if (diff > maxdiff) maxdiff = diff;
-
-                gwfft (&gwdata, x, x2); gwcopy (&gwdata, x2, x); gwfftadd3 (&gwdata, x, x2, x4);
-                gwfftmul (&gwdata, x4, x3);
-                diff = fabs (gwsuminp (&gwdata, x3) - gwsumout (&gwdata, x3));
-                if (diff > maxdiff) maxdiff = diff;
-                gwfft (&gwdata, x3, x4);
-                gwfftfftmul (&gwdata, x4, x2, x);
-                diff = fabs (gwsuminp (&gwdata, x) - gwsumout (&gwdata, x));
-                if (diff > maxdiff) maxdiff = diff;
-
-/* Print final stats */
-
-                if (gwdata.GWERROR) OutputBoth (thread_num, "GWERROR set during calculations.\n");
-                if (maxdiff > gwdata.MAXDIFF) OutputBoth (thread_num, "Sumout failed during test.\n");
-                if (gwdata.MAXDIFF < 1e50)
-                        sprintf (buf, "Test complete. MaxErr=%.8g, SumoutDiff=%.8g/%.8g(%d to 1)\n", gw_get_maxerr (&gwdata), maxdiff, gwdata.MAXDIFF, (int) (gwdata.MAXDIFF / maxdiff));
-                else
-                        sprintf (buf, "Test complete. MaxErr=%.10g\n", gw_get_maxerr (&gwdata));
-                OutputBoth (thread_num, buf);
-
-/* Free some space (so that gwtogiant can use it for temporaries) */
-
-                gwfree (&gwdata, x2);
-                gwfree (&gwdata, x3);
-                gwfree (&gwdata, x4);
-
-/* Do the final compare */
+/* Run the tests and do the final compare */
 
+                g3 = allocgiant (((unsigned long) gwdata.bit_length >> 5) + 10);
+                if (g3 == NULL) goto nomem;
+                res = test_one_impl (thread_num, &gwdata, g, g3, &maxerr);
+                if (res == GWERROR_MALLOC) goto nomem;
                 if (g2 == NULL) {
-                        g2 = allocgiant (((unsigned long) gwdata.bit_length >> 5) + 10);
-                        if (g2 == NULL) goto nomem;
-                        gwtogiant (&gwdata, x, g2);
+                        g2 = g3;
                 } else {
-                        g3 = allocgiant (((unsigned long) gwdata.bit_length >> 5) + 10);
-                        if (g3 == NULL) goto nomem;
-                        gwtogiant (&gwdata, x, g3);
                         if (gcompg (g2, g3)) {
                                 strcpy (buf, "Mismatched result.\n");
                                 OutputBoth (thread_num, buf);
@@ -465,6 +509,7 @@ void test_it_all (
                         }
                         free (g3);
                 }
+                g3 = NULL;
                 OutputBoth (thread_num, "\n");
 
 /* Do next FFT implementation */
@@ -477,11 +522,11 @@ bye:    free (g);
         return;
 
 nomem:  OutputBoth (thread_num, "Out of memory\n");
+        free (g3);
         gwdone (&gwdata);
         goto bye;
 }
 
-
 /* Thoroughly test the current setup */
 
 void test_it (
@@ -1051,3 +1096,812 @@ int test_all_impl (
 
         return (stop_reason);
 }
+
+/* Exhaustively QA every FFT implementation of every FFT length using all */
+/* the worker threads.  Each x87, SSE2, AVX, and AVX-512 FFT length gets one */
+/* Mersenne number near the FFT length's limit.  Every implementation of */
+/* that FFT length is a separate job, as is a cross-check using the default */
+/* implementation of the other passes.  Workers grab jobs from a */
+/* shared list, each using its own single-threaded gwhandle.  The random */
+/* starting value and the first result for each number are shared by all */
+/* the implementations of that number.  The FFT tables are not shared. */
+/* gwsetup lays out its sin/cos, premultiplier, and normalization tables */
+/* for one specific implementation, so no two jobs build identical tables, */
+/* and gwnum has no way for a gwhandle to borrow another handle's tables. */
+/* Completed jobs are written to a progress file so that the sweep can be */
+/* stopped and resumed.  When the last job finishes a pass/fail and roundoff */
+/* matrix is written to the results file.  Use Advanced/Time 9940 to run */
+/* with one worker per core or 9941 through 9959 to run with 1 through 19 */
+/* workers. */
+
+#define QA_SWEEP_FILE   "qasweep.txt"
+
+#define QA_PASS_X87     0
+#define QA_PASS_SSE2    1
+#define QA_PASS_AVX     2
+#define QA_PASS_AVX512  3
+#define QA_NUM_PASSES   4
+
+static const char *QA_PASS_NAMES[QA_NUM_PASSES] = {"x87", "SSE2", "AVX", "AVX-512"};
+
+struct qa_sweep_number {
+        int     pass;                   /* Pass whose FFT lengths the number was chosen from */
+        unsigned long n;                /* Exponent of the Mersenne number to test */
+        unsigned long fftlen;           /* FFT length the number was chosen for */
+        giant   input;                  /* Shared starting value, generated on first use */
+        giant   reference;              /* Shared result of the first implementation to finish */
+        uint64_t ref_res64;             /* Low 64 bits of the reference result */
+        int     have_ref_res64;         /* TRUE if ref_res64 is valid (may come from the progress file) */
+        int     jobs_left;              /* Shared giants are freed when this reaches zero */
+};
+
+struct qa_sweep_job {
+        int     number;                 /* Index into the numbers array */
+        int     pass;                   /* QA_PASS_X87, etc. */
+        int     cpu_flags;              /* CPU flags to use in gwsetup */
+        int     nth_fft;                /* Value for qa_pick_nth_fft */
+        int     state;                  /* 0 = not started, 1 = running, 2 = done */
+        int     failed;                 /* TRUE if the job failed */
+        double  maxerr;                 /* Maximum roundoff error */
+        char    *desc;                  /* FFT description */
+};
+
+static struct {
+        int     initialized;
+        int     lock_initialized;
+        gwmutex lock;                   /* Lock protecting everything below */
+        int     active_workers;         /* Workers currently in the sweep */
+        int     seed;                   /* Seed used to generate all starting values */
+        int     num_numbers;
+        struct qa_sweep_number *numbers;
+        int     num_jobs;
+        struct qa_sweep_job *jobs;
+        int     next_job;               /* Jobs before this one have been started */
+        int     jobs_done;
+} QA_SWEEP = {0};
+
+/* Return the CPU flags to use for a sweep pass, zero if this CPU cannot */
+/* run the pass. */
+
+int qa_sweep_cpu_flags (
+        int     pass)
+{
+        switch (pass) {
+        case QA_PASS_X87:
+#ifdef X86_64
+                return (0);
+#else
+                return (CPU_FLAGS & ~(CPU_AVX512F | CPU_AVX | CPU_SSE2));
+#endif
+        case QA_PASS_SSE2:
+                if (! (CPU_FLAGS & CPU_SSE2)) return (0);
+                return (CPU_FLAGS & ~(CPU_AVX512F | CPU_AVX));
+        case QA_PASS_AVX:
+                if (! (CPU_FLAGS & CPU_AVX)) return (0);
+                return (CPU_FLAGS & ~CPU_AVX512F);
+        case QA_PASS_AVX512:
+                if (! (CPU_FLAGS & CPU_AVX512F)) return (0);
+                return (CPU_FLAGS);
+        }
+        return (0);
+}
+
+/* Generate the shared random starting value for a sweep number.  We use our */
+/* own generator seeded from the number's index rather than rand() so */
+/* that every worker (and a resumed sweep) generates the same value. */
+
+giant qa_sweep_gen_input (
+        int     index)
+{
+        struct qa_sweep_number *num = &QA_SWEEP.numbers[index];
+        giant   g;
+        uint32_t state;
+        int     i, len;
+
+        len = (int) ((num->n + 31) >> 5);
+        g = allocgiant (len + 10);
+        if (g == NULL) return (NULL);
+        state = (uint32_t) QA_SWEEP.seed + (uint32_t) index * 0x9E3779B9 + 1;
+        for (i = 0; i < len; i++) {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                g->n[i] = state;
+        }
+        if (num->n & 31) g->n[len-1] &= (1 << (num->n & 31)) - 1;
+        g->sign = len;
+        while (g->sign && g->n[g->sign-1] == 0) g->sign--;
+        return (g);
+}
+
+/* Return the low 64 bits of a giant */
+
+uint64_t qa_sweep_res64 (
+        giant   g)
+{
+        if (g->sign <= 0) return (0);
+        if (g->sign == 1) return ((uint64_t) g->n[0]);
+        return (((uint64_t) g->n[1] << 32) + g->n[0]);
+}
+
+/* Build the list of numbers and jobs.  Called with the lock held. */
+
+int qa_sweep_build_jobs (
+        int     thread_num,
+        unsigned long min_n,
+        unsigned long max_n,
+        int     pct)
+{
+        gwhandle gwdata;
+        struct qa_sweep_number *num;
+        unsigned long n, fftlen, max_exp;
+        int     i, pass, cpu_flags, nth_fft, res;
+
+        QA_SWEEP.num_numbers = 0;
+        QA_SWEEP.numbers = NULL;
+        QA_SWEEP.num_jobs = 0;
+        QA_SWEEP.jobs = NULL;
+
+/* Pick one number near the limit of each FFT length of each pass */
+
+        for (pass = 0; pass < QA_NUM_PASSES; pass++) {
+            cpu_flags = qa_sweep_cpu_flags (pass);
+            if (cpu_flags == 0) continue;
+            for (n = min_n; n <= max_n; n = max_exp + 1) {
+                fftlen = gwmap_with_cpu_flags_to_fftlen (cpu_flags, 1.0, 2, n, -1);
+                if (fftlen == 0) break;
+                max_exp = gwmap_with_cpu_flags_fftlen_to_max_exponent (cpu_flags, fftlen);
+                if (max_exp < n) max_exp = n;
+                if (max_exp > max_n) max_exp = max_n;
+                QA_SWEEP.numbers = (struct qa_sweep_number *)
+                        realloc (QA_SWEEP.numbers, (QA_SWEEP.num_numbers + 1) * sizeof (struct qa_sweep_number));
+                if (QA_SWEEP.numbers == NULL) return (OutOfMemory (thread_num));
+                num = &QA_SWEEP.numbers[QA_SWEEP.num_numbers++];
+                memset (num, 0, sizeof (struct qa_sweep_number));
+                num->pass = pass;
+                num->n = (unsigned long) ((double) max_exp * (double) pct / 100.0);
+                if (num->n < n) num->n = n;
+                num->fftlen = gwmap_with_cpu_flags_to_fftlen (cpu_flags, 1.0, 2, num->n, -1);
+            }
+        }
+
+/* Use gwinfo to enumerate every implementation in the number's pass.  This */
+/* is much cheaper than a gwsetup.  As a cross-check, also test the first */
+/* implementation of every other pass. */
+
+        for (i = 0; i < QA_SWEEP.num_numbers; i++) {
+            for (pass = 0; pass < QA_NUM_PASSES; pass++) {
+                cpu_flags = qa_sweep_cpu_flags (pass);
+                if (cpu_flags == 0) continue;
+                for (nth_fft = 1; ; nth_fft = gwdata.qa_picked_nth_fft) {
+                        if (nth_fft != 1 && pass != QA_SWEEP.numbers[i].pass) break;
+                        gwinit (&gwdata);
+                        gwdata.cpu_flags = cpu_flags;
+                        gwdata.qa_pick_nth_fft = nth_fft;
+                        res = gwinfo (&gwdata, 1.0, 2, QA_SWEEP.numbers[i].n, -1);
+                        if (res) break;
+                        QA_SWEEP.jobs = (struct qa_sweep_job *)
+                                realloc (QA_SWEEP.jobs, (QA_SWEEP.num_jobs + 1) * sizeof (struct qa_sweep_job));
+                        if (QA_SWEEP.jobs == NULL) return (OutOfMemory (thread_num));
+                        memset (&QA_SWEEP.jobs[QA_SWEEP.num_jobs], 0, sizeof (struct qa_sweep_job));
+                        QA_SWEEP.jobs[QA_SWEEP.num_jobs].number = i;
+                        QA_SWEEP.jobs[QA_SWEEP.num_jobs].pass = pass;
+                        QA_SWEEP.jobs[QA_SWEEP.num_jobs].cpu_flags = cpu_flags;
+                        QA_SWEEP.jobs[QA_SWEEP.num_jobs].nth_fft = nth_fft;
+                        QA_SWEEP.num_jobs++;
+                        QA_SWEEP.numbers[i].jobs_left++;
+                }
+            }
+        }
+        return (0);
+}
+
+/* Read the progress file of an interrupted sweep.  Returns TRUE if the */
+/* file exists and matches the current sweep settings. */
+
+int qa_sweep_read_progress (
+        unsigned long min_n,
+        unsigned long max_n,
+        int     pct,
+        int     *seed)
+{
+        FILE    *fd;
+        char    line[512];
+        unsigned long file_min_n, file_max_n;
+        int     file_pct;
+
+        fd = fopen (QA_SWEEP_FILE, "r");
+        if (fd == NULL) return (FALSE);
+        if (fgets (line, sizeof (line), fd) == NULL ||
+            sscanf (line, "QA sweep: seed=%d, min_n=%lu, max_n=%lu, pct=%d", seed, &file_min_n, &file_max_n, &file_pct) != 4 ||
+            file_min_n != min_n || file_max_n != max_n || file_pct != pct) {
+                fclose (fd);
+                return (FALSE);
+        }
+        fclose (fd);
+        return (TRUE);
+}
+
+/* Mark the jobs recorded in the progress file as done.  Called after the */
+/* job list is built from the seed found in the progress file. */
+
+void qa_sweep_apply_progress (void)
+{
+        FILE    *fd;
+        char    line[512], status[20], res64_str[20], *impl;
+        int     job_num;
+        double  maxerr;
+        struct qa_sweep_job *job;
+        struct qa_sweep_number *num;
+
+        fd = fopen (QA_SWEEP_FILE, "r");
+        if (fd == NULL) return;
+        while (fgets (line, sizeof (line), fd) != NULL) {
+                if (sscanf (line, "job=%d, status=%19[^,], maxerr=%lf, res64=%19[^,],", &job_num, status, &maxerr, res64_str) != 4) continue;
+                if (job_num < 0 || job_num >= QA_SWEEP.num_jobs) continue;
+                job = &QA_SWEEP.jobs[job_num];
+                if (job->state == 2) continue;
+                num = &QA_SWEEP.numbers[job->number];
+                job->state = 2;
+                job->failed = (strcmp (status, "PASS") != 0);
+                job->maxerr = maxerr;
+                impl = strstr (line, "impl=");
+                if (impl != NULL) {
+                        impl += 5;
+                        impl[strcspn (impl, "\r\n")] = 0;
+                        job->desc = (char *) malloc (strlen (impl) + 1);
+                        if (job->desc != NULL) strcpy (job->desc, impl);
+                }
+                if (!job->failed && !num->have_ref_res64) {
+                        num->ref_res64 = strtoull (res64_str, NULL, 16);
+                        num->have_ref_res64 = TRUE;
+                }
+                num->jobs_left--;
+                QA_SWEEP.jobs_done++;
+        }
+        fclose (fd);
+}
+
+/* Write the pass/fail and roundoff matrix to the results file.  Called */
+/* with the lock held. */
+
+void qa_sweep_report (void)
+{
+        int     i, j, pass, tested[QA_NUM_PASSES], failures[QA_NUM_PASSES], total_failures;
+        double  worst[QA_NUM_PASSES];
+        char    buf[512];
+
+        for (pass = 0; pass < QA_NUM_PASSES; pass++) {
+                tested[pass] = failures[pass] = 0;
+                worst[pass] = 0.0;
+        }
+        total_failures = 0;
+
+/* Output one row per implementation, grouped by number */
+
+        writeResults ("QA sweep pass/fail and roundoff matrix:\n");
+        for (i = 0; i < QA_SWEEP.num_numbers; i++) {
+                sprintf (buf, "2^%lu-1 (chosen for %s FFT length %lu):\n", QA_SWEEP.numbers[i].n,
+                         QA_PASS_NAMES[QA_SWEEP.numbers[i].pass], QA_SWEEP.numbers[i].fftlen);
+                writeResults (buf);
+                for (j = 0; j < QA_SWEEP.num_jobs; j++) {
+                        struct qa_sweep_job *job = &QA_SWEEP.jobs[j];
+                        if (job->number != i) continue;
+                        sprintf (buf, "  %-7s #%-5d %-4s MaxErr=%.6f  %s\n",
+                                 QA_PASS_NAMES[job->pass], job->nth_fft, job->failed ? "FAIL" : "pass",
+                                 job->maxerr, job->desc != NULL ? job->desc : "");
+                        writeResults (buf);
+                        tested[job->pass]++;
+                        if (job->failed) failures[job->pass]++, total_failures++;
+                        if (job->maxerr > worst[job->pass]) worst[job->pass] = job->maxerr;
+                }
+        }
+
+/* Output a summary for each pass */
+
+        for (pass = 0; pass < QA_NUM_PASSES; pass++) {
+                if (tested[pass] == 0) continue;
+                sprintf (buf, "%s: %d implementations tested, %d failed, worst MaxErr=%.6f\n",
+                         QA_PASS_NAMES[pass], tested[pass], failures[pass], worst[pass]);
+                writeResults (buf);
+        }
+        sprintf (buf, "QA sweep complete.  %d implementations tested, %d failed.\n", QA_SWEEP.num_jobs, total_failures);
+        OutputBoth (MAIN_THREAD_NUM, buf);
+}
+
+/* Initialize the shared sweep state.  Called with the lock held by the */
+/* first worker to enter the sweep. */
+
+int qa_sweep_init (
+        int     thread_num)
+{
+        unsigned long min_n, max_n;
+        int     pct, resuming, stop_reason;
+        char    buf[200];
+
+        min_n = IniSectionGetInt (INI_FILE, "QA", "MIN_N", 250);
+        max_n = IniSectionGetInt (INI_FILE, "QA", "MAX_N", 70000000);
+        pct = IniSectionGetInt (INI_FILE, "QA", "SWEEP_FFT_LIMIT_PCT", 99);
+        if (pct < 1 || pct > 100) pct = 99;
+
+/* Resume from the progress file if it matches our settings.  Otherwise, */
+/* start a new sweep with a new seed. */
+
+        resuming = qa_sweep_read_progress (min_n, max_n, pct, &QA_SWEEP.seed);
+        if (!resuming) QA_SWEEP.seed = IniSectionGetInt (INI_FILE, "QA", "SPECIFIC_SEED", (int) time (NULL));
+
+        QA_SWEEP.next_job = 0;
+        QA_SWEEP.jobs_done = 0;
+        stop_reason = qa_sweep_build_jobs (thread_num, min_n, max_n, pct);
+        if (stop_reason) return (stop_reason);
+
+        if (resuming) {
+                qa_sweep_apply_progress ();
+                sprintf (buf, "Resuming QA sweep, %d of %d implementations already tested.\n", QA_SWEEP.jobs_done, QA_SWEEP.num_jobs);
+        } else {
+                FILE    *fd;
+                fd = fopen (QA_SWEEP_FILE, "w");
+                if (fd != NULL) {
+                        fprintf (fd, "QA sweep: seed=%d, min_n=%lu, max_n=%lu, pct=%d\n", QA_SWEEP.seed, min_n, max_n, pct);
+                        fclose (fd);
+                }
+                sprintf (buf, "Starting QA sweep of %d implementations on %d FFT lengths.  Random seed is %d.\n",
+                         QA_SWEEP.num_jobs, QA_SWEEP.num_numbers, QA_SWEEP.seed);
+        }
+        OutputBoth (thread_num, buf);
+        QA_SWEEP.initialized = TRUE;
+        return (0);
+}
+
+/* Free the shared sweep state.  Called with the lock held by the last worker */
+/* to leave the sweep. */
+
+void qa_sweep_term (void)
+{
+        int     i;
+
+        for (i = 0; i < QA_SWEEP.num_numbers; i++) {
+                free (QA_SWEEP.numbers[i].input);
+                free (QA_SWEEP.numbers[i].reference);
+        }
+        for (i = 0; i < QA_SWEEP.num_jobs; i++) free (QA_SWEEP.jobs[i].desc);
+        free (QA_SWEEP.numbers);
+        free (QA_SWEEP.jobs);
+        QA_SWEEP.numbers = NULL;
+        QA_SWEEP.jobs = NULL;
+        QA_SWEEP.num_numbers = 0;
+        QA_SWEEP.num_jobs = 0;
+        QA_SWEEP.initialized = FALSE;
+}
+
+/* Record the outcome of a job.  Called with the lock held. */
+
+void qa_sweep_job_done (
+        int     thread_num,
+        int     job_num,
+        giant   result,                 /* Job's final value or NULL if the job could not run */
+        int     failed)
+{
+        struct qa_sweep_job *job = &QA_SWEEP.jobs[job_num];
+        struct qa_sweep_number *num = &QA_SWEEP.numbers[job->number];
+        uint64_t res64;
+        FILE    *fd;
+        char    buf[300];
+
+/* Compare the result against the reference result.  The first */
+/* successful result becomes the reference for the other implementations. */
+
+        res64 = 0;
+        if (result != NULL) {
+                res64 = qa_sweep_res64 (result);
+                if (failed) ;
+                else if (num->reference != NULL) failed = (gcompg (num->reference, result) != 0);
+                else if (num->have_ref_res64) failed = (num->ref_res64 != res64);
+                if (!failed && num->reference == NULL) {
+                        num->reference = allocgiant (result->sign + 10);
+                        if (num->reference != NULL) gtog (result, num->reference);
+                        num->ref_res64 = res64;
+                        num->have_ref_res64 = TRUE;
+                }
+                OutputBoth (thread_num, failed ? "Mismatched result.\n\n" : "Results match!\n\n");
+        }
+        job->state = 2;
+        job->failed = failed;
+
+/* Append the job to the progress file */
+
+        fd = fopen (QA_SWEEP_FILE, "a");
+        if (fd != NULL) {
+                fprintf (fd, "job=%d, status=%s, maxerr=%.6f, res64=%08lX%08lX, impl=%s\n",
+                         job_num, failed ? "FAIL" : "PASS", job->maxerr,
+                         (unsigned long) (res64 >> 32), (unsigned long) (res64 & 0xFFFFFFFF),
+                         job->desc != NULL ? job->desc : "");
+                fclose (fd);
+        }
+
+/* Free the shared giants when the last implementation of a number finishes */
+
+        if (--num->jobs_left == 0) {
+                free (num->input); num->input = NULL;
+                free (num->reference); num->reference = NULL;
+        }
+
+/* Output the matrix when the last job finishes */
+
+        QA_SWEEP.jobs_done++;
+        if (QA_SWEEP.jobs_done == QA_SWEEP.num_jobs) qa_sweep_report ();
+        else if (QA_SWEEP.jobs_done % 100 == 0) {
+                sprintf (buf, "QA sweep: %d of %d implementations tested.\n", QA_SWEEP.jobs_done, QA_SWEEP.num_jobs);
+                OutputStr (thread_num, buf);
+        }
+}
+
+/* Worker thread's entry point for the parallel QA sweep */
+
+int test_all_impl_sweep (
+        int     thread_num,             /* Worker thread number */
+        struct PriorityInfo *sp_info)   /* SetPriority information */
+{
+        gwhandle gwdata;
+        giant   input, result;
+        int     job_num, res, stop_reason;
+        double  maxerr;
+        char    buf[300], fft_desc[200];
+
+/* Initialize the lock and shared state */
+
+        if (!QA_SWEEP.lock_initialized) {
+                QA_SWEEP.lock_initialized = TRUE;
+                gwmutex_init (&QA_SWEEP.lock);
+        }
+        gwmutex_lock (&QA_SWEEP.lock);
+        QA_SWEEP.active_workers++;
+        stop_reason = QA_SWEEP.initialized ? 0 : qa_sweep_init (thread_num);
+        if (stop_reason == 0 && QA_SWEEP.jobs_done == QA_SWEEP.num_jobs)
+                OutputBoth (thread_num, "QA sweep already complete.  Delete " QA_SWEEP_FILE " to start a new sweep.\n");
+        gwmutex_unlock (&QA_SWEEP.lock);
+
+/* Loop grabbing jobs until there are none left */
+
+        while (stop_reason == 0) {
+                stop_reason = stopCheck (thread_num);
+                if (stop_reason) break;
+
+/* Find the next job that has not been started, generating the shared */
+/* starting value if this is the number's first job */
+
+                gwmutex_lock (&QA_SWEEP.lock);
+                while (QA_SWEEP.next_job < QA_SWEEP.num_jobs && QA_SWEEP.jobs[QA_SWEEP.next_job].state != 0)
+                        QA_SWEEP.next_job++;
+                if (QA_SWEEP.next_job == QA_SWEEP.num_jobs) {
+                        gwmutex_unlock (&QA_SWEEP.lock);
+                        break;
+                }
+                job_num = QA_SWEEP.next_job++;
+                QA_SWEEP.jobs[job_num].state = 1;
+                if (QA_SWEEP.numbers[QA_SWEEP.jobs[job_num].number].input == NULL)
+                        QA_SWEEP.numbers[QA_SWEEP.jobs[job_num].number].input = qa_sweep_gen_input (QA_SWEEP.jobs[job_num].number);
+                input = QA_SWEEP.numbers[QA_SWEEP.jobs[job_num].number].input;
+                gwmutex_unlock (&QA_SWEEP.lock);
+
+/* Setup this implementation.  We use one thread per gwhandle -- the */
+/* parallelism comes from running many implementations at once. */
+
+                gwinit (&gwdata);
+                gwset_num_threads (&gwdata, 1);
+                gwset_thread_callback (&gwdata, SetAuxThreadPriority);
+                gwset_thread_callback_data (&gwdata, sp_info);
+                gwdata.cpu_flags = QA_SWEEP.jobs[job_num].cpu_flags;
+                gwdata.qa_pick_nth_fft = QA_SWEEP.jobs[job_num].nth_fft;
+                res = (input == NULL) ? GWERROR_MALLOC :
+                        gwsetup (&gwdata, 1.0, 2, QA_SWEEP.numbers[QA_SWEEP.jobs[job_num].number].n, -1);
+                if (res) {
+                        sprintf (buf, "QA sweep job %d: gwsetup failed with error code %d.\n", job_num, res);
+                        OutputBoth (thread_num, buf);
+                        gwmutex_lock (&QA_SWEEP.lock);
+                        qa_sweep_job_done (thread_num, job_num, NULL, TRUE);
+                        gwmutex_unlock (&QA_SWEEP.lock);
+                        continue;
+                }
+                gwfft_description (&gwdata, fft_desc);
+                sprintf (buf, "QA sweep job %d of %d: %s using %s\n", job_num + 1, QA_SWEEP.num_jobs, gwmodulo_as_string (&gwdata), fft_desc);
+                OutputBoth (thread_num, buf);
+
+/* Run the tests */
+
+                result = allocgiant (((unsigned long) gwdata.bit_length >> 5) + 10);
+                res = (result == NULL) ? GWERROR_MALLOC : test_one_impl (thread_num, &gwdata, input, result, &maxerr);
+                if (res == GWERROR_MALLOC) {
+                        OutputBoth (thread_num, "Out of memory\n");
+                        maxerr = 0.0;
+                }
+
+/* Record the results */
+
+                gwmutex_lock (&QA_SWEEP.lock);
+                QA_SWEEP.jobs[job_num].maxerr = maxerr;
+                QA_SWEEP.jobs[job_num].desc = (char *) malloc (strlen (fft_desc) + 1);
+                if (QA_SWEEP.jobs[job_num].desc != NULL) strcpy (QA_SWEEP.jobs[job_num].desc, fft_desc);
+                qa_sweep_job_done (thread_num, job_num, res == GWERROR_MALLOC ? NULL : result, res != 0);
+                gwmutex_unlock (&QA_SWEEP.lock);
+                free (result);
+                gwdone (&gwdata);
+        }
+
+/* The last worker out frees the shared state */
+
+        gwmutex_lock (&QA_SWEEP.lock);
+        if (--QA_SWEEP.active_workers == 0) qa_sweep_term ();
+        gwmutex_unlock (&QA_SWEEP.lock);
+        return (stop_reason);
+}
+
+/* Compare the tables gwsetup builds using the gwdbldbl _run routines (which */
+/* rotate one column's sin/cos to get the next column's) with tables built */
+/* computing every column from scratch.  We check every FFT length of every */
+/* pass from QA/MIN_N to QA/MAX_N.  Besides Mersenne numbers, each FFT length */
+/* is tried with a k > 1, c = +1 number, a base other than 2, and numbers */
+/* where abs(c) > 1 so that the weights include the c term.  Values that are */
+/* not bit-for-bit identical are reported, and are a failure if they differ by */
+/* more than a few ulps.  Switching the table building method affects every */
+/* gwsetup in the process, so only run this QA with one worker. */
+
+static const struct {
+        double  k;
+        unsigned long b;
+        long    c;
+} SINCOS_QA_FORMS[] = {
+        {1.0, 2, -1}, {1003.0, 2, 1}, {1.0, 3, -1}, {1.0, 2, 3}, {5.0, 6, -7}};
+
+int test_sincos_tables (
+        int     thread_num)             /* Worker thread number */
+{
+        gwhandle gwdata;
+        unsigned long min_n, max_n, n, fftlen, max_exp, form_n, i, num_words, num_diffs, num_bad;
+        unsigned long total_ffts, total_diffs, total_bad;
+        double  *copy, x, y;
+        int     pass, form, cpu_flags, res, stop_reason;
+        char    buf[500], fft_desc[200];
+
+        min_n = IniSectionGetInt (INI_FILE, "QA", "MIN_N", 250);
+        max_n = IniSectionGetInt (INI_FILE, "QA", "MAX_N", 70000000);
+        total_ffts = total_diffs = total_bad = 0;
+        stop_reason = 0;
+
+        for (pass = 0; pass < QA_NUM_PASSES && !stop_reason; pass++) {
+            cpu_flags = qa_sweep_cpu_flags (pass);
+            if (cpu_flags == 0) continue;
+            for (n = min_n; n <= max_n && !stop_reason; n = max_exp + 1) {
+                fftlen = gwmap_with_cpu_flags_to_fftlen (cpu_flags, 1.0, 2, n, -1);
+                if (fftlen == 0) break;
+                max_exp = gwmap_with_cpu_flags_fftlen_to_max_exponent (cpu_flags, fftlen);
+                if (max_exp < n) max_exp = n;
+                for (form = 0; form < (int) (sizeof (SINCOS_QA_FORMS) / sizeof (SINCOS_QA_FORMS[0])); form++) {
+                    stop_reason = stopCheck (thread_num);
+                    if (stop_reason) break;
+
+/* Use the largest Mersenne number this FFT length handles.  For the other */
+/* forms, whose k and c cost a few bits per FFT word, pick a number of the */
+/* form a little smaller than that. */
+
+                    if (form == 0) form_n = max_exp;
+                    else form_n = (unsigned long) ((0.97 * (double) max_exp - log2 (SINCOS_QA_FORMS[form].k)) /
+                                                   log2 ((double) SINCOS_QA_FORMS[form].b));
+
+/* Build the tables using the _run routines and save a copy */
+
+                    gwdbldbl_set_scalar_tables (FALSE);
+                    gwinit (&gwdata);
+                    gwset_num_threads (&gwdata, 1);
+                    gwdata.cpu_flags = cpu_flags;
+                    res = gwsetup (&gwdata, SINCOS_QA_FORMS[form].k, SINCOS_QA_FORMS[form].b, form_n, SINCOS_QA_FORMS[form].c);
+                    if (res == GWERROR_TOO_LARGE && form) continue;    /* Does not fit this pass' largest FFT */
+                    if (res) {
+                        sprintf (buf, "Table QA: gwsetup of %.0f*%lu^%lu%+ld failed with error code %d.\n",
+                                 SINCOS_QA_FORMS[form].k, SINCOS_QA_FORMS[form].b, form_n, SINCOS_QA_FORMS[form].c, res);
+                        OutputBoth (thread_num, buf);
+                        continue;
+                    }
+                    gwfft_description (&gwdata, fft_desc);
+                    num_words = gwdata.mem_needed / sizeof (double);
+                    copy = (double *) malloc (num_words * sizeof (double));
+                    if (copy == NULL) {
+                        gwdone (&gwdata);
+                        stop_reason = OutOfMemory (thread_num);
+                        break;
+                    }
+                    memcpy (copy, gwdata.gwnum_memory, num_words * sizeof (double));
+                    gwdone (&gwdata);
+
+/* Build the tables a column at a time and compare */
+
+                    gwdbldbl_set_scalar_tables (TRUE);
+                    gwinit (&gwdata);
+                    gwset_num_threads (&gwdata, 1);
+                    gwdata.cpu_flags = cpu_flags;
+                    res = gwsetup (&gwdata, SINCOS_QA_FORMS[form].k, SINCOS_QA_FORMS[form].b, form_n, SINCOS_QA_FORMS[form].c);
+                    gwdbldbl_set_scalar_tables (FALSE);
+                    if (res) {
+                        free (copy);
+                        continue;
+                    }
+                    num_diffs = num_bad = 0;
+                    if (gwdata.mem_needed / sizeof (double) != num_words) num_bad++;
+                    else for (i = 0; i < num_words; i++) {
+                        x = copy[i];
+                        y = gwdata.gwnum_memory[i];
+                        if (memcmp (&x, &y, sizeof (double)) == 0) continue;
+                        num_diffs++;
+                        if (x != x || y != y || fabs (x - y) > fabs (y) * 1.0e-15) num_bad++;
+                    }
+                    total_ffts++;
+                    total_diffs += num_diffs;
+                    total_bad += num_bad;
+                    if (num_diffs) {
+                        sprintf (buf, "Table QA: %s %s: %lu of %lu values differ, %lu by more than roundoff.\n",
+                                 gwmodulo_as_string (&gwdata), fft_desc, num_diffs, num_words, num_bad);
+                        OutputBoth (thread_num, buf);
+                    }
+                    free (copy);
+                    gwdone (&gwdata);
+                }
+            }
+        }
+
+        sprintf (buf, "Table QA %s: %lu FFTs, %lu values differ, %lu by more than roundoff.\n",
+                 total_bad ? "FAILED" : "passed", total_ffts, total_diffs, total_bad);
+        OutputBoth (thread_num, buf);
+        return (stop_reason);
+}
+
+/* Run the GMP QA steps on one handle.  Returns the final value and the */
+/* milliseconds per squaring. */
+
+int gmp_qa_steps (
+        gwhandle *gwdata,
+        giant   x,                      /* Starting value */
+        int     addin,                  /* Small value added to the starting value */
+        unsigned long iters,            /* Number of squarings to time */
+        giant   result,                 /* Returned final value */
+        double  *ms)                    /* Returned time per squaring */
+{
+        gwnum   g, t;
+        unsigned long i;
+        double  timers[2];
+
+        g = gwalloc (gwdata);
+        t = gwalloc (gwdata);
+        if (g == NULL || t == NULL) return (GWERROR_MALLOC);
+        gianttogw (gwdata, x, g);
+        if (addin) gwsmalladd (gwdata, (double) addin, g);
+
+/* Time the squarings */
+
+        clear_timers (timers, 2);
+        start_timer (timers, 0);
+        for (i = 0; i < iters; i++) gwsquare (gwdata, g);
+        end_timer (timers, 0);
+        *ms = timer_value (timers, 0) / iters * 1000.0;
+
+/* Use mul-by-const, the small constant routines, add/sub, and a multiply */
+
+        gwsetmulbyconst (gwdata, 3);
+        gwsetnormroutine (gwdata, 0, 0, 1);
+        gwsquare (gwdata, g);
+        gwsetnormroutine (gwdata, 0, 0, 0);
+        gwsmalladd (gwdata, -2.0, g);
+        gwsmallmul (gwdata, 5.0, g);
+        gwadd3 (gwdata, g, g, t);
+        gwsub3 (gwdata, g, t, g);
+        gwsafemul (gwdata, t, g);
+        return (gwtogiant (gwdata, g, result));
+}
+
+/* Check the GMP fallback (see gwset_gmp_fallback in gwnum.h) against our FFTs */
+/* and time both.  For n from QA/GMP_MIN_N to QA/GMP_MAX_N (doubling n each time) */
+/* we do the same operations on 2^n-1 and 3*2^n+1 with an FFT and with GMP. */
+/* Besides a random starting value we start from N-1 and from 0-1 so that the */
+/* reductions of values at the top of the range and of negative values get tested. */
+
+#define GMP_QA_RANDOM   0               /* Start from a random value */
+#define GMP_QA_N_MINUS_1 1              /* Start from the giant N-1 */
+#define GMP_QA_MINUS_1  2               /* Start from zero and add -1 */
+
+int test_gmp_mul (
+        int     thread_num)             /* Worker thread number */
+{
+        gwhandle fftdata, gmpdata;
+        giant   x, fftres, gmpres;
+        unsigned long min_n, max_n, iters, n, i, num_words;
+        int     form, start, res, num_bad, stop_reason;
+        double  fft_ms, gmp_ms;
+        char    buf[600], fft_desc[200], gmp_desc[200];
+        static const char * const start_desc[3] = {"random", "N-1", "-1"};
+
+        min_n = IniSectionGetInt (INI_FILE, "QA", "GMP_MIN_N", 1000000);
+        max_n = IniSectionGetInt (INI_FILE, "QA", "GMP_MAX_N", 32000000);
+        iters = IniSectionGetInt (INI_FILE, "QA", "GMP_ITERS", 10);
+        num_bad = 0;
+        stop_reason = 0;
+        srand ((unsigned) time (NULL));
+
+        for (n = min_n; n <= max_n && !stop_reason; n += n) {
+          for (form = 0; form < 2 && !stop_reason; form++) {
+            for (start = GMP_QA_RANDOM; start <= GMP_QA_MINUS_1 && !stop_reason; start++) {
+                double  k = form ? 3.0 : 1.0;
+                signed long c = form ? 1 : -1;
+
+                num_words = (n >> 5) + 2;
+                x = allocgiant (num_words);
+                fftres = allocgiant (num_words + 4);
+                gmpres = allocgiant (num_words + 4);
+                if (x == NULL || fftres == NULL || gmpres == NULL) {
+                        free (x); free (fftres); free (gmpres);
+                        return (OutOfMemory (thread_num));
+                }
+                if (start == GMP_QA_RANDOM) {
+                        for (i = 0; i < (n >> 5); i++) x->n[i] = ((uint32_t) rand () << 16) ^ (uint32_t) rand ();
+                        x->sign = (int) (n >> 5);
+                        while (x->sign && x->n[x->sign-1] == 0) x->sign--;
+                } else if (start == GMP_QA_N_MINUS_1) {
+                        ultog ((uint32_t) k, x);
+                        gshiftleft ((int) n, x);
+                        iaddg (c - 1, x);
+                } else
+                        setzero (x);
+
+/* Do the operations with an FFT and then with GMP */
+
+                gwinit (&fftdata);
+                gwset_num_threads (&fftdata, 1);
+                res = gwsetup (&fftdata, k, 2, n, c);
+                if (!res) {
+                        gwfft_description (&fftdata, fft_desc);
+                        res = gmp_qa_steps (&fftdata, x, (start == GMP_QA_MINUS_1) ? -1 : 0, iters, fftres, &fft_ms);
+                }
+                gwdone (&fftdata);
+                if (!res) {
+                        gwinit (&gmpdata);
+                        gwset_gmp_fallback (&gmpdata, 2);
+                        res = gwsetup (&gmpdata, k, 2, n, c);
+                        if (!res && !gw_using_gmp (&gmpdata)) {
+                                OutputStr (thread_num, "GMP QA: gwnum was built without GW_GMP_FALLBACK.\n");
+                                gwdone (&gmpdata);
+                                free (x); free (fftres); free (gmpres);
+                                return (0);
+                        }
+                        if (!res) {
+                                gwfft_description (&gmpdata, gmp_desc);
+                                res = gmp_qa_steps (&gmpdata, x, (start == GMP_QA_MINUS_1) ? -1 : 0, iters, gmpres, &gmp_ms);
+                        }
+                        gwdone (&gmpdata);
+                }
+
+/* Compare results and output timings.  Only the random starting value gives meaningful timings. */
+
+                if (res) {
+                        sprintf (buf, "GMP QA: %.0f*2^%lu%+ld starting from %s failed with error code %d.\n",
+                                 k, n, c, start_desc[start], res);
+                        num_bad++;
+                } else if (gcompg (fftres, gmpres)) {
+                        sprintf (buf, "GMP QA: %.0f*2^%lu%+ld starting from %s results differ.\n",
+                                 k, n, c, start_desc[start]);
+                        num_bad++;
+                } else if (start == GMP_QA_RANDOM)
+                        sprintf (buf, "%.0f*2^%lu%+ld: %s %.3f ms, %s %.3f ms (%.1fx).\n",
+                                 k, n, c, fft_desc, fft_ms, gmp_desc, gmp_ms, gmp_ms / fft_ms);
+                else
+                        sprintf (buf, "%.0f*2^%lu%+ld: starting from %s matches.\n", k, n, c, start_desc[start]);
+                OutputBoth (thread_num, buf);
+                free (x);
+                free (fftres);
+                free (gmpres);
+                stop_reason = stopCheck (thread_num);
+            }
+          }
+        }
+
+        sprintf (buf, "GMP QA %s: %d mismatches or errors.\n", num_bad ? "FAILED" : "PASSED", num_bad);
+        OutputBoth (thread_num, buf);
+        return (stop_reason);
+}
@@ -305,7 +305,10 @@ int main (
 /* or running a torture test */
 
         nameAndReadIniFiles (named_ini_files);
-        if (MENUING != 2 && !torture_test) initCommCode ();
+        if (MENUING != 2 && !torture_test) {
+                initCommCode ();
+                startControlSocket ();
+        }
 
 /* If not running a torture test, set the program to nice priority. */
 /* Technically, this is not necessary since worker threads are set to */
@@ -380,6 +383,10 @@ int main (
 
         writeWorkToDoFile (TRUE);
 
+/* Leave the group of processes sharing this host */
+
+        host_detach ();
+
 /* Delete the pidfile */
 
         _unlink (pidfile);
@@ -515,14 +515,14 @@ again:  if (max_num_workers () > 1)
                 }
 
 /* If user changed the priority of worker threads, then change */
-/* the INI file.  Restart worker threads so that they are running at */
-/* the new priority. */
+/* the INI file.  Running worker threads pick up the new priority */
+/* the next time they check the config generation. */
 
                 if (PRIORITY != m_priority) {
                         PRIORITY = m_priority;
                         IniWriteInt (INI_FILE, "Priority", PRIORITY);
                         new_options = TRUE;
-                        restart = TRUE;
+                        CONFIG_GENERATION++;
                 }
 
 /* If the user changed any of the work preferences record it in the INI file */
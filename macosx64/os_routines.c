@@ -467,3 +467,333 @@ void checkPauseListCallback (void)
 #endif
 }
 
+
+/* Optional control socket.  Setting ControlSocket=path in prime.txt creates a Unix */
+/* domain socket at that path.  Orchestration software connects and sends a batch */
+/* of worktodo lines, ending the batch with a line containing only a period or by */
+/* closing its end of the connection.  The work units are added immediately (see */
+/* addWorkToDoBatch) and a status line for each input line is sent back. */
+
+#if defined (__linux__) || defined (__APPLE__) || defined (__FreeBSD__)
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Send a reply to the client.  A client that has already disconnected must */
+/* not raise SIGPIPE, which would kill mprime. */
+
+void controlSocketReply (
+        int     fd,
+        const char *p)
+{
+        size_t  len;
+        ssize_t bytes;
+
+        for (len = strlen (p); len; p += bytes, len -= bytes) {
+#ifdef MSG_NOSIGNAL
+                bytes = send (fd, p, len, MSG_NOSIGNAL);
+#else
+                bytes = write (fd, p, len);             /* SO_NOSIGPIPE is set on the socket */
+#endif
+                if (bytes <= 0) break;
+        }
+}
+
+void controlSocketConnection (
+        int     fd)
+{
+        char    *batch, *reply, *end;
+        size_t  len, alloc_len;
+        ssize_t bytes;
+        struct timeval timeout;
+
+/* Read the batch until EOF or a line with only a period.  A client that stops */
+/* sending must not tie up the only thread accepting connections, so give up */
+/* on a connection that has been idle for 30 seconds. */
+
+        timeout.tv_sec = 30;
+        timeout.tv_usec = 0;
+        setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+        setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+#ifdef SO_NOSIGPIPE
+        {
+                int     on = 1;
+                setsockopt (fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof (on));
+        }
+#endif
+        alloc_len = 65536;
+        batch = (char *) malloc (alloc_len);
+        if (batch == NULL) return;
+        len = 0;
+        for ( ; ; ) {
+                if (len + 4096 > alloc_len) {
+                        char    *bigger;
+                        alloc_len *= 2;
+                        bigger = (char *) realloc (batch, alloc_len);
+                        if (bigger == NULL) goto done;
+                        batch = bigger;
+                }
+                bytes = read (fd, batch + len, alloc_len - len - 1);
+                if (bytes <= 0) break;
+                len += bytes;
+                batch[len] = 0;
+                if (strcmp (batch, ".\n") == 0 || strcmp (batch, ".\r\n") == 0) { len = 0; break; }
+                end = strstr (batch, "\n.\n");
+                if (end == NULL) end = strstr (batch, "\n.\r\n");
+                if (end != NULL) { len = end - batch + 1; break; }
+        }
+        batch[len] = 0;
+
+/* A failed read (such as the idle timeout expiring) may have left a partial */
+/* last line.  Do not add any of the batch. */
+
+        if (bytes < 0) {
+                controlSocketReply (fd, "ERROR read failed, batch discarded\n");
+                goto done;
+        }
+
+/* Add the work and send back the status of each line */
+
+        reply = NULL;
+        addWorkToDoBatch (batch, &reply);
+        if (reply != NULL) {
+                controlSocketReply (fd, reply);
+                free (reply);
+        }
+done:   free (batch);
+}
+
+void controlSocketThread (
+        void    *arg)
+{
+        int     listen_fd, fd;
+
+        listen_fd = (int) (intptr_t) arg;
+        for ( ; ; ) {
+                fd = accept (listen_fd, NULL, NULL);
+                if (fd < 0) continue;
+                controlSocketConnection (fd);
+                close (fd);
+        }
+}
+
+void startControlSocket (void)
+{
+        struct sockaddr_un addr;
+        struct stat st;
+        char    path[sizeof (addr.sun_path)];
+        char    buf[sizeof (addr.sun_path) + 80];
+        int     listen_fd, rc;
+        mode_t  old_umask;
+        gwthread thread_id;
+
+        IniGetString (INI_FILE, "ControlSocket", path, sizeof (path), NULL);
+        if (path[0] == 0) return;
+
+/* Create the socket, replacing a stale one from an earlier run.  Never delete */
+/* anything but a socket, a typo in prime.txt should not cost the user a file. */
+/* The umask is set before bind so that only our user can ever connect. */
+
+        listen_fd = socket (AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) goto err;
+        memset (&addr, 0, sizeof (addr));
+        addr.sun_family = AF_UNIX;
+        strcpy (addr.sun_path, path);
+        if (lstat (path, &st) == 0) {
+                if (!S_ISSOCK (st.st_mode)) goto err;
+                _unlink (path);
+        }
+        old_umask = umask (0077);
+        rc = bind (listen_fd, (struct sockaddr *) &addr, sizeof (addr));
+        umask (old_umask);
+        if (rc < 0) goto err;
+        if (listen (listen_fd, 5) < 0) goto err;
+
+/* Accept connections in a separate thread */
+
+        gwthread_create (&thread_id, &controlSocketThread, (void *) (intptr_t) listen_fd);
+        return;
+
+err:    sprintf (buf, "Unable to create control socket %s\n", path);
+        OutputBoth (MAIN_THREAD_NUM, buf);
+        if (listen_fd >= 0) close (listen_fd);
+}
+#else
+void startControlSocket (void)
+{
+}
+#endif
+
+/* Shared memory and interprocess lock used to coordinate several mprime processes */
+/* on one host (see HostSharedMemory in commonb.c). */
+
+#if defined (__linux__) || defined (__APPLE__) || defined (__FreeBSD__)
+#include <pthread.h>
+#include <sys/mman.h>
+
+/* The lock lives in space the shared segment reserves for it */
+
+typedef char host_lock_size_check[sizeof (pthread_mutex_t) <= HOST_LOCK_SIZE ? 1 : -1];
+
+/* POSIX shared memory names must begin with a slash */
+
+void host_shm_name (
+        const char *name,
+        char    *shm_name)
+{
+        sprintf (shm_name, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+void *host_shm_attach (
+        const char *name,
+        unsigned long size,
+        int     *created)
+{
+        char    shm_name[100];
+        struct stat st;
+        void    *p;
+        int     fd, i, retried = FALSE;
+
+        host_shm_name (name, shm_name);
+
+/* Create the segment, or open it if another process created it first */
+
+retry:  *created = TRUE;
+        fd = shm_open (shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno == EEXIST) {
+                *created = FALSE;
+                fd = shm_open (shm_name, O_RDWR, 0600);
+        }
+        if (fd < 0) return (NULL);
+
+/* The creator sets the size.  Others wait for it to do so, touching the */
+/* memory before that would fault.  A creator that died before setting the */
+/* size leaves a segment no one can use, remove it and create a new one. */
+
+        if (*created) {
+                if (ftruncate (fd, size) < 0) {
+                        close (fd);
+                        shm_unlink (shm_name);
+                        return (NULL);
+                }
+        } else {
+                for (i = 0; i < 50; i++) {
+                        if (fstat (fd, &st) == 0 && (unsigned long) st.st_size >= size) break;
+                        Sleep (100);
+                }
+                if (i == 50) {
+                        close (fd);
+                        if (retried) return (NULL);
+                        shm_unlink (shm_name);
+                        retried = TRUE;
+                        goto retry;
+                }
+        }
+
+        p = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close (fd);
+        if (p == MAP_FAILED) return (NULL);
+        return (p);
+}
+
+void host_shm_detach (
+        void    *p,
+        unsigned long size)
+{
+        munmap (p, size);
+}
+
+/* Remove the segment's name.  Processes that have it mapped keep using it, */
+/* the next host_shm_attach creates a new segment. */
+
+void host_shm_remove (
+        const char *name)
+{
+        char    shm_name[100];
+
+        host_shm_name (name, shm_name);
+        shm_unlink (shm_name);
+}
+
+/* The lock is a process-shared mutex.  On Linux it is robust, so that a process */
+/* that dies holding the lock does not hang the others. */
+
+void host_shm_lock_init (
+        void    *lock)
+{
+        pthread_mutexattr_t attr;
+
+        pthread_mutexattr_init (&attr);
+        pthread_mutexattr_setpshared (&attr, PTHREAD_PROCESS_SHARED);
+#ifdef __linux__
+        pthread_mutexattr_setrobust (&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+        pthread_mutex_init ((pthread_mutex_t *) lock, &attr);
+        pthread_mutexattr_destroy (&attr);
+}
+
+void host_shm_lock (
+        void    *lock)
+{
+#ifdef __linux__
+        if (pthread_mutex_lock ((pthread_mutex_t *) lock) == EOWNERDEAD)
+                pthread_mutex_consistent ((pthread_mutex_t *) lock);
+#else
+        pthread_mutex_lock ((pthread_mutex_t *) lock);
+#endif
+}
+
+void host_shm_unlock (
+        void    *lock)
+{
+        pthread_mutex_unlock ((pthread_mutex_t *) lock);
+}
+
+unsigned long host_getpid (void)
+{
+        return ((unsigned long) getpid ());
+}
+
+int host_process_alive (
+        unsigned long pid)
+{
+        return (kill ((pid_t) pid, 0) == 0 || errno == EPERM);
+}
+#else
+void *host_shm_attach (
+        const char *name,
+        unsigned long size,
+        int     *created)
+{
+        return (NULL);
+}
+void host_shm_detach (
+        void    *p,
+        unsigned long size)
+{
+}
+void host_shm_remove (
+        const char *name)
+{
+}
+void host_shm_lock_init (
+        void    *lock)
+{
+}
+void host_shm_lock (
+        void    *lock)
+{
+}
+void host_shm_unlock (
+        void    *lock)
+{
+}
+unsigned long host_getpid (void)
+{
+        return (0);
+}
+int host_process_alive (
+        unsigned long pid)
+{
+        return (FALSE);
+}
+#endif
@@ -54,6 +54,7 @@
 #define _unlink         unlink
 #define _creat          creat
 #define _chdir          chdir
+#define _getcwd         getcwd
 #define closesocket     close
 #define IsCharAlphaNumeric(c) isalnum(c)
 #define _stricmp        strcasecmp
@@ -115,6 +116,7 @@ extern int MENUING;                     /* TRUE when main menu active */
 void sigterm_handler(int);
 void main_menu (void);
 void linuxContinue (char *, int, int);
+void startControlSocket (void);
 void Sleep (long);
 void test_user(void);
 void test_welcome(void);
@@ -192,6 +192,10 @@ void CPrime95Doc::OnCloseDocument()
 
 	writeWorkToDoFile (TRUE);
 
+// Leave the group of processes sharing this host
+
+	host_detach ();
+
 // Finish closing
 
 	CDocument::OnCloseDocument();